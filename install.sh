@@ -89,13 +89,17 @@ Options:
   -a, --auto-all          Non-interactive install with builtins (automation mode)
 
 Installation Locations (with default prefix):
-  Standalone binaries: /usr/local/bin/mailheader, mailmessage, mailheaderclean
-  Scripts:             /usr/local/bin/mailgetaddresses, mailgetheaders, mailheaderclean-batch
+  Standalone binaries: /usr/local/bin/mailheader, mailmessage, mailheaderclean,
+                       mailheaderclean-client, mailgetaddresses, mail-tools,
+                       mailgrep, mailthread
+  Scripts:             /usr/local/bin/mailgetheaders, mailheaderclean-batch
                        (includes clean-email-headers symlink for backwards compatibility)
-  Manpages:            /usr/local/share/man/man1/mailheader.1, mailmessage.1, mailheaderclean.1, mailgetaddresses.1
+  Manpages:            /usr/local/share/man/man1/mailheader.1, mailmessage.1, mailheaderclean.1, mailgetaddresses.1,
+                       mail-tools.1, mailgrep.1, mailthread.1
   Documentation:       /usr/local/share/doc/mail-tools/
   Bash completions:    /usr/local/share/bash-completion/completions/mail-tools
-  Builtins (optional): /usr/local/lib/bash/loadables/mailheader.so, mailmessage.so, mailheaderclean.so
+  Builtins (optional): /usr/local/lib/bash/loadables/mailheader.so, mailmessage.so, mailheaderclean.so,
+                       mailgetaddresses.so, mailgetheaders.so
   Profile script:      /etc/profile.d/mail-tools.sh (always, regardless of --prefix)
 
 Examples:
@@ -197,7 +201,7 @@ build_standalone() {
 
   cd "$SCRIPT_DIR"
   make standalone || die 1 'Failed to build standalone binaries'
-  success 'Standalone binaries built (mailheader, mailmessage, mailheaderclean)'
+  success 'Standalone binaries built (mailheader, mailmessage, mailheaderclean, mailgetaddresses)'
 }
 
 build_builtin() {
@@ -233,7 +237,7 @@ build_builtin() {
     error 'Failed to build bash builtins'
     return 1
   }
-  success 'Bash builtins built (mailheader.so, mailmessage.so, mailheaderclean.so)'
+  success 'Bash builtins built (mailheader.so, mailmessage.so, mailheaderclean.so, mailgetaddresses.so, mailgetheaders.so)'
   return 0
 }
 
@@ -245,7 +249,11 @@ install_standalone() {
          "  $BIN_DIR/mailheader" \
          "  $BIN_DIR/mailmessage" \
          "  $BIN_DIR/mailheaderclean" \
+         "  $BIN_DIR/mailheaderclean-client" \
          "  $BIN_DIR/mailgetaddresses" \
+         "  $BIN_DIR/mail-tools" \
+         "  $BIN_DIR/mailgrep" \
+         "  $BIN_DIR/mailthread" \
          "  $BIN_DIR/mailgetheaders" \
          "  $BIN_DIR/mailheaderclean-batch (script)" \
          "  $BIN_DIR/clean-email-headers -> mailheaderclean-batch (symlink)" \
@@ -253,9 +261,10 @@ install_standalone() {
          "  $MAN_DIR/mailmessage.1" \
          "  $MAN_DIR/mailheaderclean.1" \
          "  $MAN_DIR/mailgetaddresses.1" \
-         "  $DOC_DIR/README.md" \
-         "  $DOC_DIR/benchmark.sh" \
-         "  $DOC_DIR/benchmark_detailed.sh"
+         "  $MAN_DIR/mail-tools.1" \
+         "  $MAN_DIR/mailgrep.1" \
+         "  $MAN_DIR/mailthread.1" \
+         "  $DOC_DIR/README.md"
     return 0
   fi
 
@@ -264,11 +273,13 @@ install_standalone() {
   install -m 755 "$SCRIPT_DIR"/build/bin/mailheader "$BIN_DIR"/ || die 1 "Failed to install mailheader binary"
   install -m 755 "$SCRIPT_DIR"/build/bin/mailmessage "$BIN_DIR"/ || die 1 "Failed to install mailmessage binary"
   install -m 755 "$SCRIPT_DIR"/build/bin/mailheaderclean "$BIN_DIR"/ || die 1 "Failed to install mailheaderclean binary"
+  install -m 755 "$SCRIPT_DIR"/build/bin/mailheaderclean-client "$BIN_DIR"/ || die 1 "Failed to install mailheaderclean-client binary"
+  install -m 755 "$SCRIPT_DIR"/build/bin/mailgetaddresses "$BIN_DIR"/ || die 1 "Failed to install mailgetaddresses binary"
+  install -m 755 "$SCRIPT_DIR"/build/bin/mail-tools "$BIN_DIR"/ || die 1 "Failed to install mail-tools binary"
+  install -m 755 "$SCRIPT_DIR"/build/bin/mailgrep "$BIN_DIR"/ || die 1 "Failed to install mailgrep binary"
+  install -m 755 "$SCRIPT_DIR"/build/bin/mailthread "$BIN_DIR"/ || die 1 "Failed to install mailthread binary"
 
   # Install scripts
-  if [[ -f "$SCRIPT_DIR"/scripts/mailgetaddresses ]]; then
-    install -m 755 "$SCRIPT_DIR"/scripts/mailgetaddresses "$BIN_DIR"/ || warn "Failed to install mailgetaddresses script"
-  fi
   if [[ -f "$SCRIPT_DIR"/scripts/mailgetheaders ]]; then
     install -m 755 "$SCRIPT_DIR"/scripts/mailgetheaders "$BIN_DIR"/ || warn "Failed to install mailgetheaders script"
   fi
@@ -292,6 +303,15 @@ install_standalone() {
   if [[ -f "$SCRIPT_DIR"/man/mailgetaddresses.1 ]]; then
     install -m 644 "$SCRIPT_DIR"/man/mailgetaddresses.1 "$MAN_DIR"/ || warn "Failed to install mailgetaddresses manpage"
   fi
+  if [[ -f "$SCRIPT_DIR"/man/mail-tools.1 ]]; then
+    install -m 644 "$SCRIPT_DIR"/man/mail-tools.1 "$MAN_DIR"/ || warn "Failed to install mail-tools manpage"
+  fi
+  if [[ -f "$SCRIPT_DIR"/man/mailgrep.1 ]]; then
+    install -m 644 "$SCRIPT_DIR"/man/mailgrep.1 "$MAN_DIR"/ || warn "Failed to install mailgrep manpage"
+  fi
+  if [[ -f "$SCRIPT_DIR"/man/mailthread.1 ]]; then
+    install -m 644 "$SCRIPT_DIR"/man/mailthread.1 "$MAN_DIR"/ || warn "Failed to install mailthread manpage"
+  fi
 
   # Install documentation
   if [[ -f "$SCRIPT_DIR"/README.md ]]; then
@@ -299,14 +319,6 @@ install_standalone() {
     install -m 644 "$SCRIPT_DIR"/README.md "$DOC_DIR"/ || warn "Failed to install README"
   fi
 
-  # Install benchmark scripts
-  if [[ -f "$SCRIPT_DIR"/tools/benchmark.sh ]]; then
-    install -m 755 "$SCRIPT_DIR"/tools/benchmark.sh "$DOC_DIR"/ || warn "Failed to install benchmark.sh"
-  fi
-  if [[ -f "$SCRIPT_DIR"/tools/benchmark_detailed.sh ]]; then
-    install -m 755 "$SCRIPT_DIR"/tools/benchmark_detailed.sh "$DOC_DIR"/ || warn "Failed to install benchmark_detailed.sh"
-  fi
-
   success 'Standalone installation complete'
 }
 
@@ -337,6 +349,8 @@ install_builtin() {
          "  $LOADABLE_DIR/mailheader.so" \
          "  $LOADABLE_DIR/mailmessage.so" \
          "  $LOADABLE_DIR/mailheaderclean.so" \
+         "  $LOADABLE_DIR/mailgetaddresses.so" \
+         "  $LOADABLE_DIR/mailgetheaders.so" \
          "  $PROFILE_DIR/mail-tools.sh"
     return 0
   fi
@@ -346,6 +360,8 @@ install_builtin() {
   install -m 755 "$SCRIPT_DIR"/build/lib/mailheader.so "$LOADABLE_DIR"/ || die 1 "Failed to install mailheader builtin"
   install -m 755 "$SCRIPT_DIR"/build/lib/mailmessage.so "$LOADABLE_DIR"/ || die 1 "Failed to install mailmessage builtin"
   install -m 755 "$SCRIPT_DIR"/build/lib/mailheaderclean.so "$LOADABLE_DIR"/ || die 1 "Failed to install mailheaderclean builtin"
+  install -m 755 "$SCRIPT_DIR"/build/lib/mailgetaddresses.so "$LOADABLE_DIR"/ || die 1 "Failed to install mailgetaddresses builtin"
+  install -m 755 "$SCRIPT_DIR"/build/lib/mailgetheaders.so "$LOADABLE_DIR"/ || die 1 "Failed to install mailgetheaders builtin"
 
   # Install profile script
   install -d "$PROFILE_DIR"
@@ -378,15 +394,16 @@ show_completion_message() {
   success 'Installation complete!'
   echo
   echo 'Installed files:'
-  echo "  • Standalone binaries: $BIN_DIR/mailheader, $BIN_DIR/mailmessage, $BIN_DIR/mailheaderclean"
-  echo "  • Scripts:             $BIN_DIR/mailgetaddresses, $BIN_DIR/mailgetheaders, $BIN_DIR/mailheaderclean-batch"
+  echo "  • Standalone binaries: $BIN_DIR/mailheader, $BIN_DIR/mailmessage, $BIN_DIR/mailheaderclean, $BIN_DIR/mailheaderclean-client, $BIN_DIR/mailgetaddresses, $BIN_DIR/mail-tools, $BIN_DIR/mailgrep, $BIN_DIR/mailthread"
+  echo "  • Scripts:             $BIN_DIR/mailgetheaders, $BIN_DIR/mailheaderclean-batch"
   echo "                         (includes $BIN_DIR/clean-email-headers symlink)"
-  echo "  • Manpages:            $MAN_DIR/mailheader.1, $MAN_DIR/mailmessage.1, $MAN_DIR/mailheaderclean.1, $MAN_DIR/mailgetaddresses.1"
+  echo "  • Manpages:            $MAN_DIR/mailheader.1, $MAN_DIR/mailmessage.1, $MAN_DIR/mailheaderclean.1, $MAN_DIR/mailgetaddresses.1, $MAN_DIR/mail-tools.1, $MAN_DIR/mailgrep.1, $MAN_DIR/mailthread.1"
   echo "  • Documentation:       $DOC_DIR/"
   echo "  • Bash completions:    $COMPLETION_DIR/mail-tools"
 
   if ((INSTALL_BUILTIN)); then
-    echo "  • Bash builtins:       $LOADABLE_DIR/mailheader.so, $LOADABLE_DIR/mailmessage.so, $LOADABLE_DIR/mailheaderclean.so"
+    echo "  • Bash builtins:       $LOADABLE_DIR/mailheader.so, $LOADABLE_DIR/mailmessage.so, $LOADABLE_DIR/mailheaderclean.so,"
+    echo "                         $LOADABLE_DIR/mailgetaddresses.so, $LOADABLE_DIR/mailgetheaders.so"
     echo "  • Profile script:      $PROFILE_DIR/mail-tools.sh"
     echo
     echo 'The bash builtins will be available in new bash sessions.'
@@ -404,8 +421,8 @@ show_completion_message() {
   echo '  which mailheader       # Check binaries'
   echo '  which mailmessage'
   echo '  which mailheaderclean'
-  echo '  which mailgetaddresses # Check scripts'
-  echo '  which mailgetheaders'
+  echo '  which mailgetaddresses'
+  echo '  which mailgetheaders   # Check scripts'
   echo '  which mailheaderclean-batch  # Check batch script'
   echo '  which clean-email-headers  # Check symlink (should point to mailheaderclean-batch)'
   echo '  man mailheader         # View manpages'
@@ -417,6 +434,8 @@ show_completion_message() {
     echo '  help mailheader        # View builtin help (after sourcing profile)'
     echo '  help mailmessage'
     echo '  help mailheaderclean'
+    echo '  help mailgetaddresses'
+    echo '  help mailgetheaders'
   fi
 
   echo
@@ -433,7 +452,11 @@ uninstall_files() {
       "$BIN_DIR"/mailheader \
       "$BIN_DIR"/mailmessage \
       "$BIN_DIR"/mailheaderclean \
+      "$BIN_DIR"/mailheaderclean-client \
       "$BIN_DIR"/mailgetaddresses \
+      "$BIN_DIR"/mail-tools \
+      "$BIN_DIR"/mailgrep \
+      "$BIN_DIR"/mailthread \
       "$BIN_DIR"/mailgetheaders \
       "$BIN_DIR"/mailheaderclean-batch \
       "$BIN_DIR"/clean-email-headers \
@@ -441,10 +464,15 @@ uninstall_files() {
       "$MAN_DIR"/mailmessage.1 \
       "$MAN_DIR"/mailheaderclean.1 \
       "$MAN_DIR"/mailgetaddresses.1 \
+      "$MAN_DIR"/mail-tools.1 \
+      "$MAN_DIR"/mailgrep.1 \
+      "$MAN_DIR"/mailthread.1 \
       "$COMPLETION_DIR"/mail-tools \
       "$LOADABLE_DIR"/mailheader.so \
       "$LOADABLE_DIR"/mailmessage.so \
       "$LOADABLE_DIR"/mailheaderclean.so \
+      "$LOADABLE_DIR"/mailgetaddresses.so \
+      "$LOADABLE_DIR"/mailgetheaders.so \
       "$PROFILE_DIR"/mail-tools.sh \
       "$PROFILE_DIR"/mailheader.sh \
       "$DOC_DIR"; do
@@ -470,9 +498,21 @@ uninstall_files() {
   if [[ -f "$BIN_DIR"/mailheaderclean ]]; then
     rm -f "$BIN_DIR"/mailheaderclean && files_removed+=1
   fi
+  if [[ -f "$BIN_DIR"/mailheaderclean-client ]]; then
+    rm -f "$BIN_DIR"/mailheaderclean-client && files_removed+=1
+  fi
   if [[ -f "$BIN_DIR"/mailgetaddresses ]]; then
     rm -f "$BIN_DIR"/mailgetaddresses && files_removed+=1
   fi
+  if [[ -f "$BIN_DIR"/mail-tools ]]; then
+    rm -f "$BIN_DIR"/mail-tools && files_removed+=1
+  fi
+  if [[ -f "$BIN_DIR"/mailgrep ]]; then
+    rm -f "$BIN_DIR"/mailgrep && files_removed+=1
+  fi
+  if [[ -f "$BIN_DIR"/mailthread ]]; then
+    rm -f "$BIN_DIR"/mailthread && files_removed+=1
+  fi
   if [[ -f "$BIN_DIR"/mailgetheaders ]]; then
     rm -f "$BIN_DIR"/mailgetheaders && files_removed+=1
   fi
@@ -498,6 +538,15 @@ uninstall_files() {
   if [[ -f "$MAN_DIR"/mailgetaddresses.1 ]]; then
     rm -f "$MAN_DIR"/mailgetaddresses.1 && files_removed+=1
   fi
+  if [[ -f "$MAN_DIR"/mail-tools.1 ]]; then
+    rm -f "$MAN_DIR"/mail-tools.1 && files_removed+=1
+  fi
+  if [[ -f "$MAN_DIR"/mailgrep.1 ]]; then
+    rm -f "$MAN_DIR"/mailgrep.1 && files_removed+=1
+  fi
+  if [[ -f "$MAN_DIR"/mailthread.1 ]]; then
+    rm -f "$MAN_DIR"/mailthread.1 && files_removed+=1
+  fi
 
   # Remove bash completions
   if [[ -f "$COMPLETION_DIR"/mail-tools ]]; then
@@ -514,6 +563,12 @@ uninstall_files() {
   if [[ -f "$LOADABLE_DIR"/mailheaderclean.so ]]; then
     rm -f "$LOADABLE_DIR"/mailheaderclean.so && files_removed+=1
   fi
+  if [[ -f "$LOADABLE_DIR"/mailgetaddresses.so ]]; then
+    rm -f "$LOADABLE_DIR"/mailgetaddresses.so && files_removed+=1
+  fi
+  if [[ -f "$LOADABLE_DIR"/mailgetheaders.so ]]; then
+    rm -f "$LOADABLE_DIR"/mailgetheaders.so && files_removed+=1
+  fi
 
   # Remove profile scripts (both new and legacy)
   if [[ -f "$PROFILE_DIR"/mail-tools.sh ]]; then
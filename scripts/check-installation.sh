@@ -15,7 +15,7 @@ done
 echo
 
 echo "2. Checking bash loadable builtins (.so files):"
-for builtin in mailheader mailmessage mailheaderclean; do
+for builtin in mailheader mailmessage mailheaderclean mailgetaddresses mailgetheaders; do
     if [ -f "/usr/local/lib/bash/loadables/$builtin.so" ]; then
         echo "  ✓ /usr/local/lib/bash/loadables/$builtin.so exists"
     else
@@ -48,7 +48,7 @@ echo "  BASH_LOADABLES_PATH=$BASH_LOADABLES_PATH"
 echo
 
 echo "6. Testing builtin loading (non-interactive):"
-for builtin in mailheader mailmessage mailheaderclean; do
+for builtin in mailheader mailmessage mailheaderclean mailgetaddresses mailgetheaders; do
     if enable -f "$builtin.so" "$builtin" 2>/dev/null; then
         echo "  ✓ $builtin loaded successfully"
         type "$builtin"
@@ -24,6 +24,8 @@ if [ -n "$PS1" ]; then
     enable -f mailheader.so mailheader 2>/dev/null || true
     enable -f mailmessage.so mailmessage 2>/dev/null || true
     enable -f mailheaderclean.so mailheaderclean 2>/dev/null || true
+    enable -f mailgetaddresses.so mailgetaddresses 2>/dev/null || true
+    enable -f mailgetheaders.so mailgetheaders 2>/dev/null || true
 fi
 
 # Usage notes for scripts and cron jobs:
@@ -34,6 +36,8 @@ fi
 #   enable -f mailheader.so mailheader 2>/dev/null || true
 #   enable -f mailmessage.so mailmessage 2>/dev/null || true
 #   enable -f mailheaderclean.so mailheaderclean 2>/dev/null || true
+#   enable -f mailgetaddresses.so mailgetaddresses 2>/dev/null || true
+#   enable -f mailgetheaders.so mailgetheaders 2>/dev/null || true
 #
 # Or use the one-liner for cron:
 #
@@ -43,3 +47,10 @@ fi
 #
 # The BASH_LOADABLES_PATH is already set globally, so you only need to
 # explicitly enable the builtins.
+#
+# Where the builtins are not installed, one mail-tools coprocess answers
+# header, body, clean and fields requests without a fork per message:
+#
+#   coproc MAILTOOLS { mail-tools --coproc; }
+#
+# See mail-tools(1) for the protocol and a helper function.
@@ -0,0 +1,566 @@
+/*
+mail_addr.h - Address extraction for mailgetaddresses
+
+Finds the selected address fields (From, To, Cc, ...) in a message's
+header block, unfolds them and parses each value as an RFC 5322
+address-list in one pass:
+
+  John Doe <john@example.com>        angle-addr with display name
+  "Doe, John" <john@example.com>     quoted-string (commas, escapes)
+  john@example.com (John Doe)        addr-spec with a comment as name
+  Team: a@example.com, b@example.com;  group (members only)
+  undisclosed-recipients:;           empty group (nothing)
+
+Display names are decoded from RFC 2047 encoded-words (=?charset?Q?...?=
+and =?charset?B?...?=) into UTF-8; charsets other than UTF-8 and ASCII
+are converted with iconv(). Words that cannot be decoded are left as
+they are.
+
+Shared between the standalone binary (mailgetaddresses.c) and the bash
+loadable builtin (mailgetaddresses_loadable.c).
+*/
+
+#ifndef MAIL_ADDR_H
+#define MAIL_ADDR_H
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <iconv.h>
+
+#include "mail_io.h"
+
+/* Growable byte buffer. Allocation failure is sticky in error, so callers
+ * check once after a whole message. */
+typedef struct {
+    char *p;
+    size_t len, cap;
+    int error;
+} mail_addr_buf;
+
+static inline int mail_addr_buf_reserve(mail_addr_buf *b, size_t n) {
+    size_t cap;
+    char *p;
+
+    if (b->error) return -1;
+    if (b->len + n <= b->cap) return 0;
+    cap = b->cap ? b->cap : 256;
+    while (cap < b->len + n) cap *= 2;
+    p = realloc(b->p, cap);
+    if (!p) {
+        b->error = ENOMEM;
+        return -1;
+    }
+    b->p = p;
+    b->cap = cap;
+    return 0;
+}
+
+static inline void mail_addr_buf_put(mail_addr_buf *b, const char *s, size_t n) {
+    if (n == 0 || mail_addr_buf_reserve(b, n) == -1) return;
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+}
+
+static inline void mail_addr_buf_putc(mail_addr_buf *b, char c) {
+    mail_addr_buf_put(b, &c, 1);
+}
+
+static inline void mail_addr_buf_free(mail_addr_buf *b) {
+    free(b->p);
+    memset(b, 0, sizeof(*b));
+}
+
+/* RFC 2047 encoded-words ------------------------------------------------- */
+
+/* Parse the encoded-word at p. Returns one past its "?=" with the charset
+ * (language suffix dropped), encoding and text set, or NULL. */
+static inline const char *mail_addr_encoded_word(const char *p, const char *end,
+                                                 const char **cs, size_t *cs_len,
+                                                 char *enc, const char **text, size_t *text_len) {
+    const char *q, *t, *s, *star;
+
+    if (end - p < 8 || p[0] != '=' || p[1] != '?') return NULL;
+    q = memchr(p + 2, '?', end - (p + 2));
+    if (!q || q == p + 2 || end - q < 5 || q[2] != '?') return NULL;
+    *enc = (char)toupper((unsigned char)q[1]);
+    if (*enc != 'Q' && *enc != 'B') return NULL;
+
+    t = q + 3;
+    for (s = t; s + 1 < end && !(s[0] == '?' && s[1] == '='); s++) {
+        if (isspace((unsigned char)*s) || *s == '?') return NULL;
+    }
+    if (s + 1 >= end) return NULL;
+
+    star = memchr(p + 2, '*', q - (p + 2));
+    *cs = p + 2;
+    *cs_len = (star ? star : q) - (p + 2);
+    *text = t;
+    *text_len = s - t;
+    return s + 2;
+}
+
+static inline int mail_addr_hex(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static inline int mail_addr_b64(int c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/* Append the decoded bytes of an encoded-word's text. Returns 0, or -1 if
+ * the text is not valid for its encoding. */
+static inline int mail_addr_decode_text(mail_addr_buf *out, char enc, const char *s, size_t n) {
+    const char *end = s + n;
+
+    if (enc == 'Q') {
+        while (s < end) {
+            if (*s == '_') {
+                mail_addr_buf_putc(out, ' ');
+                s++;
+            } else if (*s == '=' && end - s >= 3 && mail_addr_hex(s[1]) >= 0 && mail_addr_hex(s[2]) >= 0) {
+                mail_addr_buf_putc(out, (char)(mail_addr_hex(s[1]) << 4 | mail_addr_hex(s[2])));
+                s += 3;
+            } else {
+                mail_addr_buf_putc(out, *s++);
+            }
+        }
+        return 0;
+    }
+
+    unsigned bits = 0;
+    int nbits = 0;
+    for (; s < end && *s != '='; s++) {
+        int v = mail_addr_b64((unsigned char)*s);
+        if (v < 0) return -1;
+        bits = (bits << 6) | (unsigned)v;
+        nbits += 6;
+        if (nbits >= 8) {
+            nbits -= 8;
+            mail_addr_buf_putc(out, (char)(bits >> nbits));
+        }
+    }
+    return 0;
+}
+
+/* Append s (n bytes in charset cs) as UTF-8. Returns -1 if the charset is
+ * unknown; invalid sequences become U+FFFD. */
+static inline int mail_addr_to_utf8(mail_addr_buf *out, const char *cs, size_t cs_len,
+                                    const char *s, size_t n) {
+    char name[64];
+    iconv_t cd;
+    char *in = (char *)s;
+    size_t in_left = n;
+
+    if (cs_len == 0 || cs_len >= sizeof(name)) return -1;
+    memcpy(name, cs, cs_len);
+    name[cs_len] = '\0';
+
+    if (strcasecmp(name, "utf-8") == 0 || strcasecmp(name, "utf8") == 0 ||
+        strcasecmp(name, "us-ascii") == 0) {
+        mail_addr_buf_put(out, s, n);
+        return 0;
+    }
+
+    cd = iconv_open("UTF-8", name);
+    if (cd == (iconv_t)-1) return -1;
+    while (in_left > 0) {
+        if (mail_addr_buf_reserve(out, in_left * 4 + 16) == -1) break;
+        char *o = out->p + out->len;
+        size_t o_left = out->cap - out->len;
+        size_t r = iconv(cd, &in, &in_left, &o, &o_left);
+        out->len = o - out->p;
+        if (r == (size_t)-1 && errno != E2BIG) {
+            mail_addr_buf_put(out, "\xEF\xBF\xBD", 3);
+            in++;
+            in_left--;
+        }
+    }
+    iconv_close(cd);
+    return 0;
+}
+
+/* Append s with its encoded-words decoded. Whitespace between adjacent
+ * encoded-words is dropped, and a run of words in one charset is converted
+ * as a whole so that characters split across words come out intact. */
+static inline void mail_addr_decode(mail_addr_buf *out, mail_addr_buf *raw, const char *s, size_t n) {
+    const char *p = s, *end = s + n;
+    const char *run_cs = NULL, *run_start = NULL, *run_end = NULL;
+    size_t run_cs_len = 0;
+    int run_bad = 0;
+
+    raw->len = 0;
+    while (p <= end) {
+        const char *cs = NULL, *text = NULL, *we = NULL;
+        size_t cs_len = 0, text_len = 0;
+        char enc = 0;
+
+        if (p < end && *p == '=') we = mail_addr_encoded_word(p, end, &cs, &cs_len, &enc, &text, &text_len);
+
+        /* The current run ends here: convert it, or copy it back verbatim */
+        if (run_cs && (!we || cs_len != run_cs_len || strncasecmp(cs, run_cs, cs_len) != 0)) {
+            if (run_bad || mail_addr_to_utf8(out, run_cs, run_cs_len, raw->p, raw->len) == -1) {
+                mail_addr_buf_put(out, run_start, run_end - run_start);
+            }
+            run_cs = NULL;
+            run_bad = 0;
+            raw->len = 0;
+        }
+        if (p == end) break;
+
+        if (!we) {
+            mail_addr_buf_putc(out, *p++);
+            continue;
+        }
+
+        if (!run_cs) {
+            run_cs = cs;
+            run_cs_len = cs_len;
+            run_start = p;
+        }
+        if (mail_addr_decode_text(raw, enc, text, text_len) == -1) run_bad = 1;
+        run_end = p = we;
+
+        /* Linear whitespace before another encoded-word is not displayed */
+        const char *w = p;
+        while (w < end && isspace((unsigned char)*w)) w++;
+        if (w > p && w < end && mail_addr_encoded_word(w, end, &cs, &cs_len, &enc, &text, &text_len)) p = w;
+    }
+}
+
+/* Field selection -------------------------------------------------------- */
+
+/* Field names from -H, lower-cased. "all" stands for every address field. */
+typedef struct {
+    char **names;
+    int count;
+} mail_addr_fields;
+
+static inline void mail_addr_fields_free(mail_addr_fields *f) {
+    for (int i = 0; i < f->count; i++) free(f->names[i]);
+    free(f->names);
+    f->names = NULL;
+    f->count = 0;
+}
+
+static inline int mail_addr_fields_add(mail_addr_fields *f, const char *s, size_t n) {
+    char **names = realloc(f->names, (f->count + 1) * sizeof(char *));
+    char *name;
+
+    if (!names) return -1;
+    f->names = names;
+    name = malloc(n + 1);
+    if (!name) return -1;
+    for (size_t i = 0; i < n; i++) name[i] = (char)tolower((unsigned char)s[i]);
+    name[n] = '\0';
+    f->names[f->count++] = name;
+    return 0;
+}
+
+/* Parse a comma-separated list such as "from,to,cc". Returns 0, or -1
+ * on allocation failure. */
+static inline int mail_addr_fields_parse(mail_addr_fields *f, const char *csv) {
+    static const char *all[] = { "from", "sender", "reply-to", "to", "cc", "bcc" };
+    const char *p = csv;
+
+    f->names = NULL;
+    f->count = 0;
+    while (*p) {
+        const char *start, *end;
+
+        while (*p == ',' || isspace((unsigned char)*p)) p++;
+        start = p;
+        while (*p && *p != ',') p++;
+        end = p;
+        while (end > start && isspace((unsigned char)end[-1])) end--;
+        if (end == start) continue;
+
+        if (end - start == 3 && strncasecmp(start, "all", 3) == 0) {
+            for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+                if (mail_addr_fields_add(f, all[i], strlen(all[i])) == -1) return -1;
+            }
+        } else if (mail_addr_fields_add(f, start, end - start) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline int mail_addr_fields_match(const mail_addr_fields *f, const char *name, size_t len) {
+    for (int i = 0; i < f->count; i++) {
+        if (strlen(f->names[i]) == len && strncasecmp(f->names[i], name, len) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Address-list parsing --------------------------------------------------- */
+
+typedef struct {
+    int names;          /* -n: "Name <addr>" when there is a name */
+    int separate;       /* -s: "FIELD: " prefix */
+    mail_addr_fields fields;
+} mail_addr_opts;
+
+/* Scratch buffers, reused from message to message */
+typedef struct {
+    mail_addr_buf value;    /* unfolded field body */
+    mail_addr_buf phrase;   /* display name, quotes and escapes removed */
+    mail_addr_buf comment;  /* first comment, the name of a bare addr-spec */
+    mail_addr_buf spec;     /* addr-spec outside angle brackets */
+    mail_addr_buf angle;    /* addr-spec inside angle brackets */
+    mail_addr_buf name;     /* decoded display name */
+    mail_addr_buf raw;      /* decoder scratch */
+} mail_addr_scratch;
+
+static inline void mail_addr_scratch_free(mail_addr_scratch *s) {
+    mail_addr_buf_free(&s->value);
+    mail_addr_buf_free(&s->phrase);
+    mail_addr_buf_free(&s->comment);
+    mail_addr_buf_free(&s->spec);
+    mail_addr_buf_free(&s->angle);
+    mail_addr_buf_free(&s->name);
+    mail_addr_buf_free(&s->raw);
+}
+
+static inline int mail_addr_scratch_error(const mail_addr_scratch *s) {
+    return s->value.error || s->phrase.error || s->comment.error || s->spec.error ||
+           s->angle.error || s->name.error || s->raw.error;
+}
+
+/* Skip a comment starting at p ('('), appending its text to out if out is
+ * not NULL. Nested comments are kept as text. Returns one past the ')'. */
+static inline const char *mail_addr_comment(const char *p, const char *end, mail_addr_buf *out) {
+    int depth = 0;
+
+    for (; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            if (out) mail_addr_buf_putc(out, p[1]);
+            p++;
+            continue;
+        }
+        if (*p == '(' && depth++ == 0) continue;
+        if (*p == ')' && --depth == 0) return p + 1;
+        if (out) mail_addr_buf_putc(out, *p);
+    }
+    return end;
+}
+
+/* Trim whitespace in place; returns the new start */
+static inline const char *mail_addr_trim(const char *p, size_t *n) {
+    while (*n > 0 && isspace((unsigned char)*p)) {
+        p++;
+        (*n)--;
+    }
+    while (*n > 0 && isspace((unsigned char)p[*n - 1])) (*n)--;
+    return p;
+}
+
+/* Clean a display name into s->name: decode encoded-words, drop quotes
+ * around the whole name and a trailing "(...)" note, and turn control
+ * characters into spaces. Empty if the name is just the address. */
+static inline void mail_addr_clean_name(mail_addr_scratch *s, const mail_addr_buf *src,
+                                        const char *addr, size_t addr_len) {
+    const char *p = src->p;
+    size_t n = src->len;
+
+    s->name.len = 0;
+    p = mail_addr_trim(p, &n);
+    if (n >= 2 && ((p[0] == '"' && p[n - 1] == '"') || (p[0] == '\'' && p[n - 1] == '\''))) {
+        p++;
+        n -= 2;
+        p = mail_addr_trim(p, &n);
+    }
+    if (n > 0 && p[n - 1] == ')') {
+        const char *open = NULL;
+        for (const char *q = p; q < p + n; q++) {
+            if (*q == '(') open = q;
+        }
+        if (open && open > p) {
+            n = open - p;
+            p = mail_addr_trim(p, &n);
+        }
+    }
+    if (n == 0) return;
+
+    mail_addr_decode(&s->name, &s->raw, p, n);
+    if (s->name.len == 0) return;
+    for (size_t i = 0; i < s->name.len; i++) {
+        if ((unsigned char)s->name.p[i] < 0x20 || s->name.p[i] == 0x7f) s->name.p[i] = ' ';
+    }
+    p = mail_addr_trim(s->name.p, &s->name.len);
+    memmove(s->name.p, p, s->name.len);
+    if (s->name.len == addr_len && memcmp(s->name.p, addr, addr_len) == 0) s->name.len = 0;
+}
+
+/* Write one address line for field label[0, label_len) */
+static inline void mail_addr_emit(const mail_addr_opts *o, mail_addr_scratch *s, mail_addr_buf *out,
+                                  const char *label, size_t label_len,
+                                  const char *addr, size_t addr_len, const mail_addr_buf *name) {
+    if (o->separate) {
+        for (size_t i = 0; i < label_len; i++) mail_addr_buf_putc(out, (char)toupper((unsigned char)label[i]));
+        mail_addr_buf_put(out, ": ", 2);
+    }
+    if (o->names && name->len > 0) {
+        mail_addr_clean_name(s, name, addr, addr_len);
+    } else {
+        s->name.len = 0;
+    }
+    if (s->name.len > 0) {
+        mail_addr_buf_put(out, s->name.p, s->name.len);
+        mail_addr_buf_put(out, " <", 2);
+        mail_addr_buf_put(out, addr, addr_len);
+        mail_addr_buf_put(out, ">\n", 2);
+    } else {
+        mail_addr_buf_put(out, addr, addr_len);
+        mail_addr_buf_putc(out, '\n');
+    }
+}
+
+/* A bare addr-spec needs a local part and a domain around its one '@'
+ * (a quoted local part may contain more); anything else is not taken
+ * for an address */
+static inline int mail_addr_is_spec(const char *p, size_t n) {
+    const char *at;
+
+    if (n < 3) return 0;
+    for (at = p + n - 1; at > p && *at != '@'; at--) {}
+    if (at == p || at == p + n - 1) return 0;
+    return p[0] == '"' || !memchr(p, '@', at - p);
+}
+
+/* The mailbox collected so far ends: emit it if it has an address */
+static inline void mail_addr_mailbox_end(const mail_addr_opts *o, mail_addr_scratch *s, mail_addr_buf *out,
+                                         const char *label, size_t label_len, int has_angle) {
+    if (has_angle) {
+        const char *a = s->angle.p;
+        size_t n = s->angle.len;
+
+        /* Obsolete source route: <@relay1,@relay2:user@example.com> */
+        if (n > 0 && a[0] == '@') {
+            const char *colon = memchr(a, ':', n);
+            if (colon) {
+                n -= colon + 1 - a;
+                a = colon + 1;
+            }
+        }
+        if (n > 0) mail_addr_emit(o, s, out, label, label_len, a, n, &s->phrase);
+    } else if (mail_addr_is_spec(s->spec.p, s->spec.len)) {
+        mail_addr_emit(o, s, out, label, label_len, s->spec.p, s->spec.len, &s->comment);
+    }
+    s->phrase.len = s->comment.len = s->spec.len = s->angle.len = 0;
+}
+
+/* Parse an address-list and append one line per address to out */
+static inline void mail_addr_parse_list(const mail_addr_opts *o, mail_addr_scratch *s, mail_addr_buf *out,
+                                        const char *label, size_t label_len, const char *p, size_t n) {
+    const char *end = p + n;
+    int has_angle = 0, space = 0;
+
+    s->phrase.len = s->comment.len = s->spec.len = s->angle.len = 0;
+    while (p < end) {
+        char c = *p;
+
+        if (isspace((unsigned char)c)) {
+            space = 1;
+            p++;
+        } else if (c == '(') {
+            p = mail_addr_comment(p, end, s->comment.len ? NULL : &s->comment);
+            space = 1;
+        } else if (c == '"') {
+            /* quoted-string: unescaped into the name, verbatim into the spec */
+            if (space && s->phrase.len) mail_addr_buf_putc(&s->phrase, ' ');
+            const char *q = p + 1;
+            while (q < end && *q != '"') {
+                if (*q == '\\' && q + 1 < end) q++;
+                mail_addr_buf_putc(&s->phrase, *q++);
+            }
+            if (q < end) q++;
+            mail_addr_buf_put(&s->spec, p, q - p);
+            p = q;
+            space = 0;
+        } else if (c == '<') {
+            /* angle-addr: whitespace and comments are not part of it */
+            has_angle = 1;
+            s->angle.len = 0;
+            for (p++; p < end && *p != '>'; ) {
+                if (*p == '(') {
+                    p = mail_addr_comment(p, end, NULL);
+                } else if (*p == '"') {
+                    const char *q = p + 1;
+                    while (q < end && *q != '"') q += (*q == '\\' && q + 1 < end) ? 2 : 1;
+                    if (q < end) q++;
+                    mail_addr_buf_put(&s->angle, p, q - p);
+                    p = q;
+                } else {
+                    if (!isspace((unsigned char)*p)) mail_addr_buf_putc(&s->angle, *p);
+                    p++;
+                }
+            }
+            if (p < end) p++;
+            space = 1;
+        } else if (c == ',' || c == ';') {
+            mail_addr_mailbox_end(o, s, out, label, label_len, has_angle);
+            has_angle = space = 0;
+            p++;
+        } else if (c == ':' && !has_angle) {
+            /* group: the display name before ':' is not an address */
+            s->phrase.len = s->comment.len = s->spec.len = 0;
+            space = 0;
+            p++;
+        } else {
+            if (c == '\\' && p + 1 < end) c = *++p;
+            if (space && s->phrase.len) mail_addr_buf_putc(&s->phrase, ' ');
+            mail_addr_buf_putc(&s->phrase, c);
+            mail_addr_buf_putc(&s->spec, c);
+            space = 0;
+            p++;
+        }
+    }
+    mail_addr_mailbox_end(o, s, out, label, label_len, has_angle);
+}
+
+/* Append the addresses of the selected fields in the header block at
+ * [p, end) to out, one per line. Parsing stops at the first blank line. */
+static inline void mail_addr_extract(const mail_addr_opts *o, mail_addr_scratch *s, mail_addr_buf *out,
+                                     const char *p, const char *end) {
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+
+        if (mail_line_is_blank(p, eol)) break;
+        if (mail_line_is_continuation(p, eol)) {
+            p = eol;
+            continue;
+        }
+
+        const char *colon = memchr(p, ':', eol - p);
+        if (!colon || !mail_addr_fields_match(&o->fields, p, colon - p)) {
+            p = eol;
+            continue;
+        }
+
+        /* Unfold the field body: continuation lines keep their whitespace */
+        s->value.len = 0;
+        mail_addr_buf_put(&s->value, colon + 1, eol - (colon + 1));
+        const char *q = eol;
+        while (q < end) {
+            const char *qe = mail_line_end(q, end);
+            if (mail_line_is_blank(q, qe) || !mail_line_is_continuation(q, qe)) break;
+            mail_addr_buf_put(&s->value, q, qe - q);
+            q = qe;
+        }
+        mail_addr_parse_list(o, s, out, p, colon - p, s->value.p, s->value.len);
+        p = q;
+    }
+}
+
+#endif /* MAIL_ADDR_H */
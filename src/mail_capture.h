@@ -0,0 +1,116 @@
+/*
+mail_capture.h - -v VAR and -a ARRAY for the mailheader and mailmessage builtins
+
+By default the builtins print to stdout, so a script that wants the result
+in a variable pays for the fork of $(...) or < <(...). With -v VAR the
+output is assigned to the shell variable VAR instead; with -a ARRAY each
+line of it becomes one element of the indexed array ARRAY (no newlines
+kept, an empty line is an empty element). Output is collected by a
+MAIL_WRITER_MEMORY writer (mail_io.h) and bound through the bash variable
+API once every FILE has been read. A variable the calling function has
+declared local is the one assigned.
+
+Bash strings cannot hold NUL bytes: they are dropped, as $(...) drops them.
+
+For the loadable builtins only: include after builtins.h and shell.h, with
+builtin_error() and sh_invalidid() declared.
+*/
+
+#ifndef MAIL_CAPTURE_H
+#define MAIL_CAPTURE_H
+
+#include <string.h>
+#include <stdio.h>
+
+#include "mail_io.h"
+
+typedef struct {
+    const char *name;   /* VAR or ARRAY, or NULL to print */
+    int array;          /* -a ARRAY */
+} mail_capture;
+
+/* Record -v NAME (array 0) or -a NAME (array 1). Returns 0, or -1 with an
+ * error reported if NAME is not a valid identifier or one was given. */
+static int mail_capture_option(mail_capture *cap, int array, const char *name) {
+    if (cap->name) {
+        builtin_error("-v and -a take one variable");
+        return -1;
+    }
+    if (legal_identifier((char *)name) == 0) {
+        sh_invalidid((char *)name);
+        return -1;
+    }
+    cap->name = name;
+    cap->array = array;
+    return 0;
+}
+
+/* Point out at stdout, or at memory when capturing */
+static void mail_capture_start(const mail_capture *cap, mail_writer *out) {
+    if (cap->name) {
+        mail_writer_init(out, MAIL_WRITER_MEMORY);
+    } else {
+        /* Output goes straight to the descriptor behind the stream */
+        fflush(stdout);
+        mail_writer_init(out, fileno(stdout));
+    }
+}
+
+/* Remove NUL bytes from p[0, len) in place; returns the new length */
+static size_t mail_capture_drop_nul(char *p, size_t len) {
+    char *src = memchr(p, '\0', len), *end = p + len, *dst;
+
+    if (!src) return len;
+    for (dst = src; src < end; src++) {
+        if (*src) *dst++ = *src;
+    }
+    *dst = '\0';
+    return dst - p;
+}
+
+/* Assign what out collected to the variable or array. Returns
+ * EXECUTION_SUCCESS, or EXECUTION_FAILURE with the error reported. */
+static int mail_capture_bind(const mail_capture *cap, mail_writer *out) {
+    char empty[1] = "";
+    char *text = empty, *p, *end;
+    size_t len = 0;
+    SHELL_VAR *var;
+    arrayind_t i;
+
+    if (mail_writer_flush(out) == -1) {
+        builtin_error("%s: %s", cap->name, strerror(errno));
+        return EXECUTION_FAILURE;
+    }
+    if (out->mem) {
+        text = out->mem;
+        len = mail_capture_drop_nul(text, out->mem_len);
+    }
+
+    if (!cap->array) {
+        var = bind_variable(cap->name, text, 0);
+        return var == 0 || readonly_p(var) || noassign_p(var) ? EXECUTION_FAILURE : EXECUTION_SUCCESS;
+    }
+
+    /* 1: fail on readonly (reports its own error) */
+    var = find_or_make_array_variable((char *)cap->name, 1);
+    if (var == 0) {
+        return EXECUTION_FAILURE;
+    }
+    if (!array_p(var)) {
+        builtin_error("%s: not an indexed array", cap->name);
+        return EXECUTION_FAILURE;
+    }
+    array_flush(array_cell(var));
+
+    for (p = text, end = text + len, i = 0; p < end; i++) {
+        char *nl = memchr(p, '\n', end - p);
+        if (nl) *nl = '\0';
+        if (bind_array_element(var, i, p, 0) == 0) {
+            return EXECUTION_FAILURE;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return EXECUTION_SUCCESS;
+}
+
+#endif /* MAIL_CAPTURE_H */
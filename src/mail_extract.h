@@ -0,0 +1,70 @@
+/*
+mail_extract.h - Header block and body of a mapped message
+
+The mapped-input halves of mailheader and mailmessage: the header block
+with continuation lines joined, optionally limited to the fields of a
+mail_select, and everything after the first blank line. CRs are removed
+and tabs folded; ranges without either are written straight from the
+input, so the writer must be flushed before the input is closed.
+
+Shared by the mailheader and mailmessage standalone binaries, their bash
+loadable builtins and mail-tools --coproc.
+*/
+
+#ifndef MAIL_EXTRACT_H
+#define MAIL_EXTRACT_H
+
+#include "mail_io.h"
+#include "mail_select.h"
+
+/* Emit the header block: every line up to the first blank line, CRs removed
+ * and tabs folded. A line followed by a continuation line loses its newline,
+ * so each header comes out on one line. Only the header pages are touched.
+ * With sel, only the selected fields, stopping once all have been seen. */
+static inline void mail_extract_headers(const mail_input *in, mail_select *sel, mail_writer *out) {
+    const char *p = in->data;
+    const char *end = in->data + in->len;
+    int keep = 1;
+
+    if (sel) mail_select_reset(sel);
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+        size_t n = eol - p;
+
+        if (mail_line_is_blank(p, eol)) {
+            break;
+        }
+
+        if (sel && !mail_line_is_continuation(p, eol)) {
+            if (mail_select_done(sel)) break;
+            keep = mail_select_line(sel, p, n);
+        }
+        if (keep) {
+            if (eol < end && mail_line_is_continuation(eol, end)) {
+                n--;  /* join with the next line: drop this line's newline */
+            }
+            mail_write_folded(out, p, n);
+        }
+
+        p = eol;
+    }
+}
+
+/* Emit the message body: everything after the first blank line, CRs removed
+ * and tabs folded. Nothing is output if there is no blank line. */
+static inline void mail_extract_body(const mail_input *in, mail_writer *out) {
+    const char *p = in->data;
+    const char *end = in->data + in->len;
+
+    /* Skip header section - find the blank line */
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+        if (mail_line_is_blank(p, eol)) {
+            mail_write_folded(out, eol, end - eol);
+            return;
+        }
+        p = eol;
+    }
+}
+
+#endif /* MAIL_EXTRACT_H */
@@ -0,0 +1,758 @@
+/*
+mail_index.h - Per-directory sidecar header index
+
+A directory of one-message files (a maildir cur/ or new/) can carry an
+index, DIR/.mailheader.idx, that records for every message its header
+block range, its body offset, and the location and unfolded value of a
+set of fields (From, To, Cc, Date, Subject and Message-ID unless more are
+asked for). Field queries are answered from the index alone, and
+mailmessage can start at the recorded body offset instead of scanning the
+header block.
+
+The index is refreshed on every use: the directory is listed and each file
+is stat()ed, and only files whose inode, size or mtime changed are opened
+and parsed again. A message renamed within the directory (maildir flag
+changes) is found again by inode. The new index is written to a temporary
+file and renamed over the old one, so readers never see a partial index.
+
+Layout (native byte order, all offsets from the start of the file):
+
+  mail_index_head
+  field names       nfields lower-case NUL-terminated names, padded to 8
+  entries           count * (mail_index_entry + nfields * mail_index_field),
+                    sorted by file name
+  pool              file names and field values, not NUL-terminated
+
+Used by mailheader --index and mailmessage --index, standalone binaries and
+bash loadable builtins alike.
+*/
+
+#ifndef MAIL_INDEX_H
+#define MAIL_INDEX_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mail_io.h"
+
+#define MAIL_INDEX_NAME ".mailheader.idx"
+#define MAIL_INDEX_MAGIC "MHIDX\0\0\1"
+#define MAIL_INDEX_DEFAULT_FIELDS "from,to,cc,date,subject,message-id"
+#define MAIL_INDEX_MAX_FIELDS 64
+#define MAIL_INDEX_NONE UINT64_MAX      /* field not present in the message */
+
+typedef struct {
+    char magic[8];
+    uint32_t nfields;
+    uint32_t entry_size;    /* mail_index_entry + nfields * mail_index_field */
+    uint64_t count;
+    uint64_t names_len;     /* field names, before padding */
+    uint64_t pool_len;
+} mail_index_head;
+
+typedef struct {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t name_off;      /* file name in the pool */
+    uint64_t name_len;
+    uint64_t header_end;    /* offset of the blank line ending the header block */
+    uint64_t body_off;      /* first body byte (size if there is no body) */
+} mail_index_entry;
+
+typedef struct {
+    uint64_t off;           /* start of the field's first line, or MAIL_INDEX_NONE */
+    uint64_t len;           /* raw length, continuation lines included */
+    uint64_t value_off;     /* unfolded value in the pool */
+    uint64_t value_len;
+} mail_index_field;
+
+/* An index image, mapped from the file or assembled in memory */
+typedef struct {
+    char *base;
+    size_t len;
+    int mapped;
+    const mail_index_head *head;
+    const char *fields[MAIL_INDEX_MAX_FIELDS];
+    const unsigned char *entries;
+    const char *pool;
+    int save_error;         /* errno if mail_index_update() could not write */
+} mail_index;
+
+static inline size_t mail_index_pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static inline size_t mail_index_count(const mail_index *ix) {
+    return ix->head ? (size_t)ix->head->count : 0;
+}
+
+static inline const mail_index_entry *mail_index_at(const mail_index *ix, size_t i) {
+    return (const mail_index_entry *)(ix->entries + i * ix->head->entry_size);
+}
+
+static inline const mail_index_field *mail_index_slots(const mail_index_entry *e) {
+    return (const mail_index_field *)(e + 1);
+}
+
+/* Pool bytes [off, off + len), or NULL if the range is outside the pool */
+static inline const char *mail_index_str(const mail_index *ix, uint64_t off, uint64_t len) {
+    if (off > ix->head->pool_len || len > ix->head->pool_len - off) return NULL;
+    return ix->pool + off;
+}
+
+/* Position of a field name (any case) in the index, or -1 */
+static inline int mail_index_field_pos(const mail_index *ix, const char *name, size_t len) {
+    for (uint32_t i = 0; ix->head && i < ix->head->nfields; i++) {
+        if (strncasecmp(ix->fields[i], name, len) == 0 && ix->fields[i][len] == '\0') return (int)i;
+    }
+    return -1;
+}
+
+/* Next name of the comma-separated field list at *p, blanks around it
+ * trimmed and empty names skipped. Returns 1 with the name in
+ * [*name, *name + *len), 0 at the end of the list, or -1 (errno EINVAL)
+ * for a pattern such as X-*: only literal names can be indexed. */
+static inline int mail_index_next_field(const char **p, const char **name, size_t *len) {
+    while (**p) {
+        const char *start = *p;
+        size_t n;
+        while (**p && **p != ',') (*p)++;
+        n = *p - start;
+        if (**p == ',') (*p)++;
+        while (n > 0 && isspace((unsigned char)*start)) start++, n--;
+        while (n > 0 && isspace((unsigned char)start[n - 1])) n--;
+        if (n == 0) continue;
+        if (memchr(start, '*', n) || memchr(start, '?', n) || memchr(start, '[', n)) {
+            errno = EINVAL;
+            return -1;
+        }
+        *name = start;
+        *len = n;
+        return 1;
+    }
+    return 0;
+}
+
+static inline void mail_index_close(mail_index *ix) {
+    if (ix->mapped) {
+        munmap(ix->base, ix->len);
+    } else {
+        free(ix->base);
+    }
+    memset(ix, 0, sizeof(*ix));
+}
+
+/* Check the head and the section sizes of the image in ix->base and set
+ * up the section pointers. Entry contents are range-checked on use. */
+static inline int mail_index_attach(mail_index *ix) {
+    const mail_index_head *h = (const mail_index_head *)ix->base;
+    const char *names;
+    size_t off;
+
+    if (ix->len < sizeof(*h) || memcmp(h->magic, MAIL_INDEX_MAGIC, 8) != 0) return -1;
+    if (h->nfields > MAIL_INDEX_MAX_FIELDS ||
+        h->entry_size != sizeof(mail_index_entry) + h->nfields * sizeof(mail_index_field)) return -1;
+
+    off = sizeof(*h);
+    if (h->names_len > ix->len - off) return -1;
+    names = ix->base + off;
+    for (uint32_t i = 0; i < h->nfields; i++) {
+        const char *nul = memchr(names, '\0', ix->base + off + h->names_len - names);
+        if (!nul) return -1;
+        ix->fields[i] = names;
+        names = nul + 1;
+    }
+    off += mail_index_pad8(h->names_len);
+    if (off > ix->len || h->count > (ix->len - off) / h->entry_size) return -1;
+    ix->entries = (const unsigned char *)ix->base + off;
+    off += h->count * h->entry_size;
+    if (h->pool_len != ix->len - off) return -1;
+    ix->pool = ix->base + off;
+    ix->head = h;
+    return 0;
+}
+
+/* Map the index of dir. Returns 0, or -1 if there is none or it is not a
+ * valid index. */
+static inline int mail_index_open(mail_index *ix, const char *dir) {
+    struct stat st;
+    int dfd, fd;
+    void *map;
+
+    memset(ix, 0, sizeof(*ix));
+    dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd == -1) return -1;
+    fd = openat(dfd, MAIL_INDEX_NAME, O_RDONLY);
+    close(dfd);
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(mail_index_head)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    ix->base = map;
+    ix->len = (size_t)st.st_size;
+    ix->mapped = 1;
+    if (mail_index_attach(ix) == -1) {
+        mail_index_close(ix);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Entry of the file called name, or NULL */
+static inline const mail_index_entry *mail_index_find(const mail_index *ix, const char *name) {
+    size_t lo = 0, hi = mail_index_count(ix), len = strlen(name);
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const mail_index_entry *e = mail_index_at(ix, mid);
+        const char *s = mail_index_str(ix, e->name_off, e->name_len);
+        if (!s) return NULL;
+
+        int c = memcmp(s, name, e->name_len < len ? e->name_len : len);
+        if (c == 0) c = e->name_len < len ? -1 : e->name_len > len;
+        if (c == 0) return e;
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/* An entry describes the file as it is now */
+static inline int mail_index_current(const mail_index_entry *e, const struct stat *st) {
+    return e->ino == (uint64_t)st->st_ino && e->size == (uint64_t)st->st_size &&
+           e->mtime_sec == (int64_t)st->st_mtim.tv_sec && e->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+/* Building ---------------------------------------------------------------- */
+
+typedef struct {
+    char *names[MAIL_INDEX_MAX_FIELDS];
+    uint32_t nfields;
+    size_t entry_size;
+    unsigned char *entries;
+    size_t count, cap;
+    char *pool;
+    size_t pool_len, pool_cap;
+    int error;              /* sticky ENOMEM */
+} mail_index_build;
+
+typedef struct {
+    char *name;
+    struct stat st;
+} mail_index_file;
+
+static inline uint64_t mail_index_pool_add(mail_index_build *b, const char *p, size_t n) {
+    uint64_t off = b->pool_len;
+
+    if (b->pool_len + n > b->pool_cap) {
+        size_t cap = b->pool_cap ? b->pool_cap : 65536;
+        while (cap < b->pool_len + n) cap *= 2;
+        char *pool = realloc(b->pool, cap);
+        if (!pool) {
+            b->error = ENOMEM;
+            return 0;
+        }
+        b->pool = pool;
+        b->pool_cap = cap;
+    }
+    memcpy(b->pool + b->pool_len, p, n);
+    b->pool_len += n;
+    return off;
+}
+
+/* Append an entry with every field absent; NULL if memory runs out */
+static inline mail_index_entry *mail_index_build_entry(mail_index_build *b) {
+    mail_index_entry *e;
+    mail_index_field *f;
+
+    if (b->count == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 1024;
+        unsigned char *entries = realloc(b->entries, cap * b->entry_size);
+        if (!entries) {
+            b->error = ENOMEM;
+            return NULL;
+        }
+        b->entries = entries;
+        b->cap = cap;
+    }
+    e = (mail_index_entry *)(b->entries + b->count * b->entry_size);
+    memset(e, 0, b->entry_size);
+    f = (mail_index_field *)(e + 1);
+    for (uint32_t i = 0; i < b->nfields; i++) f[i].off = MAIL_INDEX_NONE;
+    b->count++;
+    return e;
+}
+
+/* Record the header block of one message: its end, the body offset and
+ * the first occurrence of every indexed field. Values are unfolded the
+ * way mailheader prints them (newlines dropped, CR removed, TAB as space)
+ * with the space after the colon and trailing whitespace trimmed. */
+static inline void mail_index_scan(mail_index_build *b, mail_index_entry *e, const char *data, size_t len) {
+    mail_index_field *slots = (mail_index_field *)(e + 1);
+    const char *p = data, *end = data + len;
+    char *value = NULL;
+    size_t value_cap = 0;
+
+    e->header_end = e->body_off = len;
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+        const char *field_end = eol;
+        const char *colon;
+        int pos;
+
+        if (mail_line_is_blank(p, eol)) {
+            e->header_end = p - data;
+            e->body_off = eol - data;
+            break;
+        }
+        while (field_end < end && mail_line_is_continuation(field_end, end)) {
+            field_end = mail_line_end(field_end, end);
+        }
+
+        colon = memchr(p, ':', eol - p);
+        pos = -1;
+        if (colon && colon > p) {
+            for (uint32_t i = 0; i < b->nfields; i++) {
+                if ((size_t)(colon - p) == strlen(b->names[i]) &&
+                    strncasecmp(b->names[i], p, colon - p) == 0) {
+                    pos = (int)i;
+                    break;
+                }
+            }
+        }
+
+        if (pos >= 0 && slots[pos].off == MAIL_INDEX_NONE) {
+            size_t raw = field_end - colon, n = 0, skip = 0;
+            if (raw > value_cap) {
+                char *grown = realloc(value, raw);
+                if (!grown) {
+                    b->error = ENOMEM;
+                    break;
+                }
+                value = grown;
+                value_cap = raw;
+            }
+            for (const char *s = colon + 1; s < field_end; ) {
+                const char *next = mail_line_end(s, field_end);
+                size_t m = next - s;
+                if (m > 0 && s[m - 1] == '\n') m--;
+                n += mail_fold_copy(value + n, s, m);
+                s = next;
+            }
+            while (skip < n && value[skip] == ' ') skip++;
+            while (n > skip && isspace((unsigned char)value[n - 1])) n--;
+
+            slots[pos].off = p - data;
+            slots[pos].len = field_end - p;
+            slots[pos].value_len = n - skip;
+            slots[pos].value_off = mail_index_pool_add(b, value + skip, n - skip);
+        }
+        p = field_end;
+    }
+    free(value);
+}
+
+/* Copy an entry of the old index, re-pointing its strings into the new pool */
+static inline void mail_index_reuse(mail_index_build *b, mail_index_entry *e,
+                                    const mail_index *old, const mail_index_entry *o) {
+    const mail_index_field *from = mail_index_slots(o);
+    mail_index_field *to = (mail_index_field *)(e + 1);
+
+    e->header_end = o->header_end;
+    e->body_off = o->body_off;
+    for (uint32_t i = 0; i < b->nfields; i++) {
+        const char *s = from[i].off == MAIL_INDEX_NONE ? NULL :
+                        mail_index_str(old, from[i].value_off, from[i].value_len);
+        to[i] = from[i];
+        if (s) {
+            to[i].value_off = mail_index_pool_add(b, s, from[i].value_len);
+        } else {
+            to[i].off = MAIL_INDEX_NONE;
+        }
+    }
+}
+
+static inline int mail_index_file_cmp(const void *a, const void *b) {
+    return strcmp(((const mail_index_file *)a)->name, ((const mail_index_file *)b)->name);
+}
+
+/* Old entries by inode, for files renamed since the last update */
+typedef struct {
+    uint64_t ino;
+    size_t entry;
+} mail_index_ino;
+
+static inline int mail_index_ino_cmp(const void *a, const void *b) {
+    uint64_t x = ((const mail_index_ino *)a)->ino, y = ((const mail_index_ino *)b)->ino;
+    return x < y ? -1 : x > y;
+}
+
+static inline const mail_index_entry *mail_index_find_ino(const mail_index *old, const mail_index_ino *by_ino,
+                                                          uint64_t ino) {
+    size_t lo = 0, hi = by_ino ? mail_index_count(old) : 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (by_ino[mid].ino == ino) return mail_index_at(old, by_ino[mid].entry);
+        if (by_ino[mid].ino < ino) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/* Field set for the new index: the old one if it has every requested
+ * field, otherwise the old (or default) fields plus the missing ones.
+ * Returns 1 if it equals the old set, 0 if not, -1 on ENOMEM, too many
+ * fields (E2BIG) or a field pattern (EINVAL). */
+static inline int mail_index_choose_fields(mail_index_build *b, const mail_index *old, const char *csv) {
+    const char *lists[2] = { NULL, csv };
+    int same = old->head != NULL;
+
+    if (old->head) {
+        for (uint32_t i = 0; i < old->head->nfields; i++) {
+            if ((b->names[b->nfields++] = strdup(old->fields[i])) == NULL) return -1;
+        }
+    } else {
+        lists[0] = MAIL_INDEX_DEFAULT_FIELDS;
+    }
+
+    for (int l = 0; l < 2; l++) {
+        const char *p = lists[l] ? lists[l] : "";
+        const char *start;
+        size_t n;
+        int more;
+        while ((more = mail_index_next_field(&p, &start, &n)) != 0) {
+            int known = 0;
+            if (more == -1) return -1;
+            for (uint32_t i = 0; i < b->nfields; i++) {
+                if (strlen(b->names[i]) == n && strncasecmp(b->names[i], start, n) == 0) known = 1;
+            }
+            if (known) continue;
+            if (b->nfields == MAIL_INDEX_MAX_FIELDS) {
+                errno = E2BIG;
+                return -1;
+            }
+            char *name = strndup(start, n);
+            if (!name) return -1;
+            for (char *c = name; *c; c++) *c = tolower((unsigned char)*c);
+            b->names[b->nfields++] = name;
+            same = 0;
+        }
+    }
+    b->entry_size = sizeof(mail_index_entry) + b->nfields * sizeof(mail_index_field);
+    return same;
+}
+
+/* Regular files of dir except dot files, sorted by name */
+static inline mail_index_file *mail_index_list(int dfd, size_t *count) {
+    mail_index_file *files = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *d;
+    int fd = dup(dfd);
+    DIR *dir = fd == -1 ? NULL : fdopendir(fd);
+
+    if (!dir) {
+        if (fd != -1) close(fd);
+        return NULL;
+    }
+    while ((d = readdir(dir)) != NULL) {
+        struct stat st;
+        if (d->d_name[0] == '.') continue;
+        if (fstatat(dfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISREG(st.st_mode)) continue;
+        if (n == cap) {
+            mail_index_file *grown = realloc(files, (cap ? cap * 2 : 1024) * sizeof(*files));
+            if (!grown) goto fail;
+            files = grown;
+            cap = cap ? cap * 2 : 1024;
+        }
+        if ((files[n].name = strdup(d->d_name)) == NULL) goto fail;
+        files[n++].st = st;
+    }
+    closedir(dir);
+    if (!files) files = malloc(sizeof(*files));     /* empty directory: not an error */
+    if (n > 0) qsort(files, n, sizeof(*files), mail_index_file_cmp);
+    *count = n;
+    return files;
+
+fail:
+    closedir(dir);
+    while (n > 0) free(files[--n].name);
+    free(files);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Assemble the image of b into ix (memory owned by ix) */
+static inline int mail_index_assemble(mail_index *ix, const mail_index_build *b) {
+    mail_index_head h;
+    size_t names_len = 0, off, total;
+    char *img;
+
+    for (uint32_t i = 0; i < b->nfields; i++) names_len += strlen(b->names[i]) + 1;
+    total = sizeof(h) + mail_index_pad8(names_len) + b->count * b->entry_size + b->pool_len;
+    img = calloc(1, total);
+    if (!img) return -1;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAIL_INDEX_MAGIC, 8);
+    h.nfields = b->nfields;
+    h.entry_size = (uint32_t)b->entry_size;
+    h.count = b->count;
+    h.names_len = names_len;
+    h.pool_len = b->pool_len;
+    memcpy(img, &h, sizeof(h));
+    off = sizeof(h);
+    for (uint32_t i = 0; i < b->nfields; i++) {
+        size_t n = strlen(b->names[i]) + 1;
+        memcpy(img + off, b->names[i], n);
+        off += n;
+    }
+    off = sizeof(h) + mail_index_pad8(names_len);
+    if (b->count) memcpy(img + off, b->entries, b->count * b->entry_size);
+    off += b->count * b->entry_size;
+    if (b->pool_len) memcpy(img + off, b->pool, b->pool_len);
+
+    memset(ix, 0, sizeof(*ix));
+    ix->base = img;
+    ix->len = total;
+    return mail_index_attach(ix);
+}
+
+/* Write the image to a temporary file in dir and rename it over the
+ * index. Returns 0, or -1 with errno set. */
+static inline int mail_index_save(const mail_index *ix, const char *dir) {
+    size_t dir_len = strlen(dir), done = 0;
+    char *tmp = malloc(dir_len + sizeof("/" MAIL_INDEX_NAME ".XXXXXX"));
+    char *path = malloc(dir_len + sizeof("/" MAIL_INDEX_NAME));
+    int fd = -1, saved;
+
+    if (!tmp || !path) {
+        free(tmp);
+        free(path);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(tmp, dir, dir_len);
+    memcpy(tmp + dir_len, "/" MAIL_INDEX_NAME ".XXXXXX", sizeof("/" MAIL_INDEX_NAME ".XXXXXX"));
+    memcpy(path, dir, dir_len);
+    memcpy(path + dir_len, "/" MAIL_INDEX_NAME, sizeof("/" MAIL_INDEX_NAME));
+
+    fd = mkstemp(tmp);
+    if (fd == -1) goto fail;
+    fchmod(fd, 0644);
+    while (done < ix->len) {
+        ssize_t w = write(fd, ix->base + done, ix->len - done);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            goto fail;
+        }
+        done += (size_t)w;
+    }
+    if (close(fd) == -1) {
+        fd = -1;
+        goto fail;
+    }
+    fd = -1;
+    if (rename(tmp, path) == -1) goto fail;
+    free(tmp);
+    free(path);
+    return 0;
+
+fail:
+    saved = errno;
+    if (fd != -1) close(fd);
+    unlink(tmp);
+    free(tmp);
+    free(path);
+    errno = saved;
+    return -1;
+}
+
+/* Bring the index of dir up to date and load it into ix. Files whose
+ * inode, size and mtime match their old entry are not opened. fields
+ * (comma-separated, may be NULL) must be indexed; they are added to the
+ * field set if missing, which reparses every message. If the index
+ * cannot be written ix is still filled in and ix->save_error is set.
+ * Returns 0, or -1 with errno set. */
+static inline int mail_index_update(mail_index *ix, const char *dir, const char *fields) {
+    mail_index old;
+    mail_index_build b;
+    mail_index_file *files;
+    mail_index_ino *by_ino = NULL;
+    size_t nfiles = 0, changed = 0;
+    int dfd, same, r = -1;
+
+    memset(&b, 0, sizeof(b));
+    memset(ix, 0, sizeof(*ix));
+    dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd == -1) return -1;
+    if (mail_index_open(&old, dir) == -1) memset(&old, 0, sizeof(old));
+
+    same = mail_index_choose_fields(&b, &old, fields);
+    files = same == -1 ? NULL : mail_index_list(dfd, &nfiles);
+    if (!files) goto out;
+
+    if (same && mail_index_count(&old) > 0 &&
+        (by_ino = malloc(mail_index_count(&old) * sizeof(*by_ino))) != NULL) {
+        for (size_t i = 0; i < mail_index_count(&old); i++) {
+            by_ino[i].ino = mail_index_at(&old, i)->ino;
+            by_ino[i].entry = i;
+        }
+        qsort(by_ino, mail_index_count(&old), sizeof(*by_ino), mail_index_ino_cmp);
+    }
+
+    for (size_t i = 0; i < nfiles && !b.error; i++) {
+        const mail_index_entry *o = NULL;
+        mail_index_entry *e;
+
+        if (same) {
+            o = mail_index_find(&old, files[i].name);
+            if (!o || !mail_index_current(o, &files[i].st)) {
+                changed++;
+                o = mail_index_find_ino(&old, by_ino, (uint64_t)files[i].st.st_ino);
+                if (o && !mail_index_current(o, &files[i].st)) o = NULL;
+            }
+        }
+
+        if (!o) {
+            /* Unreadable files are left out until they can be read */
+            int fd = openat(dfd, files[i].name, O_RDONLY);
+            mail_input in;
+            if (fd == -1) continue;
+            if (mail_input_fd(&in, fd) == -1) {
+                close(fd);
+                continue;
+            }
+            close(fd);
+            if ((e = mail_index_build_entry(&b)) != NULL) mail_index_scan(&b, e, in.data, in.len);
+            mail_input_close(&in);
+        } else if ((e = mail_index_build_entry(&b)) != NULL) {
+            mail_index_reuse(&b, e, &old, o);
+        }
+        if (!e) break;
+
+        e->ino = (uint64_t)files[i].st.st_ino;
+        e->size = (uint64_t)files[i].st.st_size;
+        e->mtime_sec = (int64_t)files[i].st.st_mtim.tv_sec;
+        e->mtime_nsec = (int64_t)files[i].st.st_mtim.tv_nsec;
+        e->name_len = strlen(files[i].name);
+        e->name_off = mail_index_pool_add(&b, files[i].name, e->name_len);
+    }
+    if (b.error) {
+        errno = b.error;
+        goto out;
+    }
+    if (mail_index_assemble(ix, &b) == -1) {
+        errno = ENOMEM;
+        goto out;
+    }
+    r = 0;
+
+    /* Skip the write when nothing changed */
+    if ((changed || !same || b.count != mail_index_count(&old)) && mail_index_save(ix, dir) == -1) {
+        ix->save_error = errno;
+    }
+
+out:
+    if (r == -1) {
+        int saved = errno;
+        mail_index_close(ix);
+        errno = saved;
+    }
+    for (size_t i = 0; files && i < nfiles; i++) free(files[i].name);
+    free(files);
+    free(by_ino);
+    for (uint32_t i = 0; i < b.nfields; i++) free(b.names[i]);
+    free(b.entries);
+    free(b.pool);
+    if (old.head) mail_index_close(&old);
+    close(dfd);
+    return r;
+}
+
+/* Queries --------------------------------------------------------------- */
+
+/* One line per message: the file name, then the value of each field in
+ * csv (indexed fields only), tab-separated; a missing field is empty.
+ * Returns 0, or -1 if a field in csv is not indexed (errno ENOENT) or is
+ * a pattern (EINVAL). */
+static inline int mail_index_write_fields(const mail_index *ix, const char *csv, mail_writer *out) {
+    int pos[MAIL_INDEX_MAX_FIELDS];
+    int n = 0, more;
+    const char *p = csv, *start;
+    size_t len;
+
+    while ((more = mail_index_next_field(&p, &start, &len)) != 0) {
+        if (more == -1) return -1;
+        if (n == MAIL_INDEX_MAX_FIELDS || (pos[n] = mail_index_field_pos(ix, start, len)) < 0) {
+            errno = n == MAIL_INDEX_MAX_FIELDS ? E2BIG : ENOENT;
+            return -1;
+        }
+        n++;
+    }
+
+    for (size_t i = 0; i < mail_index_count(ix); i++) {
+        const mail_index_entry *e = mail_index_at(ix, i);
+        const mail_index_field *f = mail_index_slots(e);
+        const char *name = mail_index_str(ix, e->name_off, e->name_len);
+
+        if (!name) continue;
+        mail_write_range(out, name, e->name_len);
+        for (int j = 0; j < n; j++) {
+            const char *v = f[pos[j]].off == MAIL_INDEX_NONE ? NULL :
+                            mail_index_str(ix, f[pos[j]].value_off, f[pos[j]].value_len);
+            mail_write_copy(out, "\t", 1);
+            if (v) mail_write_range(out, v, f[pos[j]].value_len);
+        }
+        mail_write_copy(out, "\n", 1);
+    }
+    return 0;
+}
+
+/* Body offset of the message at path, open on fd, if the index of its
+ * directory has a current entry for it; -1 otherwise. The index is only
+ * read, never updated. */
+static inline long long mail_index_body_offset(const char *path, int fd) {
+    const char *slash = strrchr(path, '/');
+    const mail_index_entry *e;
+    mail_index ix;
+    struct stat st;
+    long long off = -1;
+    char *dir;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) return -1;
+    dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if (!dir) return -1;
+    if (mail_index_open(&ix, dir) == 0) {
+        e = mail_index_find(&ix, slash ? slash + 1 : path);
+        if (e && mail_index_current(e, &st) && e->body_off <= e->size) off = (long long)e->body_off;
+        mail_index_close(&ix);
+    }
+    free(dir);
+    return off;
+}
+
+#endif /* MAIL_INDEX_H */
@@ -0,0 +1,444 @@
+/*
+mail_io.h - Shared zero-copy input and buffered output for the mail tools
+
+Messages are mapped into memory with mmap() when the input is a regular
+file, or read() into a buffer otherwise (pipes, /dev/stdin). Pipes and
+files larger than the memory ceiling (MAIL_TOOLS_MEMORY) are better
+streamed with mail_mbox.h; mail_input_streamed() tells them apart. Lines are
+found with memchr() and handed to the output as (pointer, length) ranges.
+Output is buffered with explicit lengths and written with writev(): short
+ranges and text that needs CR stripping or tab folding are copied into the
+buffer, long untouched ranges are written straight from the mapping.
+CR and TAB are found and folded by the kernels in mail_scan.h. It is
+shared by the standalone binaries and the bash loadable builtins of
+mailheader, mailmessage and mailheaderclean.
+*/
+
+#ifndef MAIL_IO_H
+#define MAIL_IO_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "mail_scan.h"
+
+/* Input ----------------------------------------------------------------- */
+
+typedef struct {
+    const char *data;   /* message bytes */
+    size_t len;
+    void *map;          /* mmap()ed region, or NULL */
+    char *buf;          /* read() fallback buffer, or NULL */
+} mail_input;
+
+#define MAIL_MEMORY_DEFAULT (64UL * 1024 * 1024)
+#define MAIL_MEMORY_MIN (4 * 1024)
+
+/* Memory ceiling: the most bytes of one input held in memory at a time.
+ * MAIL_TOOLS_MEMORY is a byte count with an optional K, M or G suffix;
+ * unset or invalid means 64M, and less than 4K is taken as 4K. */
+static inline size_t mail_memory_max(void) {
+    const char *env = getenv("MAIL_TOOLS_MEMORY");
+    unsigned long long v;
+    char *end;
+    int shift = 0;
+
+    if (!env || *env < '0' || *env > '9') return MAIL_MEMORY_DEFAULT;
+    errno = 0;
+    v = strtoull(env, &end, 10);
+    if (errno) return MAIL_MEMORY_DEFAULT;
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    }
+    if (*end || v > (SIZE_MAX >> shift)) return MAIL_MEMORY_DEFAULT;
+    v <<= shift;
+    return v < MAIL_MEMORY_MIN ? MAIL_MEMORY_MIN : (size_t)v;
+}
+
+/* Whether fd should be streamed rather than loaded whole: it is not a
+ * regular file (a pipe, a socket, a terminal), or it is larger than the
+ * memory ceiling. Mapping such a file would bring every page of a huge
+ * line into the process as it is scanned. */
+static inline int mail_input_streamed(int fd) {
+    struct stat st;
+
+    if (fstat(fd, &st) == -1) return 0;     /* mail_input_fd() reports it */
+    if (!S_ISREG(st.st_mode)) return 1;
+    return (unsigned long long)st.st_size > mail_memory_max();
+}
+
+/* Load everything readable from fd. Regular files are mapped, anything
+ * else is read into a growing buffer. Returns 0, or -1 with errno set. */
+static inline int mail_input_fd(mail_input *in, int fd) {
+    struct stat st;
+    size_t cap = 0;
+
+    memset(in, 0, sizeof(*in));
+    if (fstat(fd, &st) == -1) return -1;
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            in->map = map;
+            in->data = map;
+            in->len = (size_t)st.st_size;
+            return 0;
+        }
+    }
+
+    /* read() fallback: pipes, character devices, files that cannot be mapped */
+    for (;;) {
+        if (in->len == cap) {
+            size_t new_cap = cap ? cap * 2 : 65536;
+            char *n = realloc(in->buf, new_cap);
+            if (!n) {
+                free(in->buf);
+                in->buf = NULL;
+                errno = ENOMEM;
+                return -1;
+            }
+            in->buf = n;
+            cap = new_cap;
+        }
+        ssize_t r = read(fd, in->buf + in->len, cap - in->len);
+        if (r == 0) break;
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            int saved = errno;
+            free(in->buf);
+            in->buf = NULL;
+            errno = saved;
+            return -1;
+        }
+        in->len += (size_t)r;
+    }
+    in->data = in->buf;
+    return 0;
+}
+
+/* Open and load path. Returns 0, or -1 with errno set. */
+static inline int mail_input_open(mail_input *in, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+    int r = mail_input_fd(in, fd);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return r;
+}
+
+static inline void mail_input_close(mail_input *in) {
+    if (in->map) munmap(in->map, in->len);
+    free(in->buf);
+    memset(in, 0, sizeof(*in));
+}
+
+/* Line helpers ---------------------------------------------------------- */
+
+/* End of the line starting at p: one past its '\n', or end */
+static inline const char *mail_line_end(const char *p, const char *end) {
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+/* A line is blank if everything before its newline is whitespace */
+static inline int mail_line_is_blank(const char *p, const char *end) {
+    while (p < end) {
+        if (*p == '\n') return 1;
+        if (!isspace((unsigned char)*p)) return 0;
+        p++;
+    }
+    return 1;
+}
+
+/* Continuation lines start with whitespace */
+static inline int mail_line_is_continuation(const char *p, const char *end) {
+    return p < end && (*p == ' ' || *p == '\t');
+}
+
+#define MAIL_HEADER_READ_SIZE (16 * 1024)
+
+/* Read fd into *buf (*cap bytes, grown with realloc()) up to its first
+ * blank line, the end of input or the memory ceiling, for tools that need
+ * only the header block: a message is neither mapped nor read whole.
+ * Returns the header block length (more may have been read), or -1 with
+ * errno set. */
+static inline ssize_t mail_read_header(int fd, char **buf, size_t *cap) {
+    size_t max = mail_memory_max(), len = 0, scan = 0;
+
+    for (;;) {
+        if (len >= max) return (ssize_t)len;
+        if (len + MAIL_HEADER_READ_SIZE > *cap) {
+            size_t grown = *cap ? *cap : 4096;
+            while (grown < len + MAIL_HEADER_READ_SIZE) grown *= 2;
+            char *b = realloc(*buf, grown);
+            if (!b) {
+                errno = ENOMEM;
+                return -1;
+            }
+            *buf = b;
+            *cap = grown;
+        }
+        ssize_t r = read(fd, *buf + len, MAIL_HEADER_READ_SIZE);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return (ssize_t)len;
+        len += (size_t)r;
+
+        /* Complete lines read so far: stop at the blank one */
+        const char *end = *buf + len, *p = *buf + scan, *nl;
+        while ((nl = memchr(p, '\n', end - p)) != NULL) {
+            if (mail_line_is_blank(p, nl + 1)) return (ssize_t)(p - *buf);
+            p = nl + 1;
+        }
+        scan = (size_t)(p - *buf);
+    }
+}
+
+/* Output ---------------------------------------------------------------- */
+
+#define MAIL_IOV_MAX 1024           /* Linux IOV_MAX */
+#define MAIL_OUTBUF_SIZE (256 * 1024)
+#define MAIL_COPY_MAX 4096          /* ranges up to this size are copied */
+#define MAIL_WRITER_MEMORY (-3)     /* fd of a writer that collects into memory */
+#define MAIL_WRITER_HOLD (-4)       /* fd of a writer that must not flush */
+
+/* Buffered output with explicit lengths. Short ranges and folded text are
+ * copied into one large buffer, so a run of small header lines (or many
+ * small messages) costs a memcpy each rather than a write; long ranges,
+ * typically message bodies, are queued by reference and go out from the
+ * input mapping in the same writev() as the buffered bytes around them.
+ * The buffer is only reused after everything queued has been written. */
+typedef struct {
+    int fd;
+    int error;              /* errno of the first failed write, or 0 */
+    int iovcnt;
+    int refs;               /* queued ranges that point into caller memory */
+    unsigned long long written;     /* bytes written so far */
+    struct iovec iov[MAIL_IOV_MAX];
+    char *buf;
+    size_t buf_len, buf_cap;
+    char *mem;              /* MAIL_WRITER_MEMORY: everything written */
+    size_t mem_len, mem_cap;
+} mail_writer;
+
+static inline void mail_writer_init(mail_writer *w, int fd) {
+    w->fd = fd;
+    w->error = 0;
+    w->iovcnt = 0;
+    w->refs = 0;
+    w->written = 0;
+    w->buf = NULL;
+    w->buf_len = w->buf_cap = 0;
+    w->mem = NULL;
+    w->mem_len = w->mem_cap = 0;
+}
+
+/* Append n bytes to the memory of a MAIL_WRITER_MEMORY writer, keeping
+ * room for a terminating NUL. Returns 0, or -1 if memory runs out. */
+static inline int mail_writer_collect(mail_writer *w, const void *p, size_t n) {
+    if (w->mem_len + n >= w->mem_cap) {
+        size_t cap = w->mem_cap ? w->mem_cap : 4096;
+        while (w->mem_len + n >= cap) cap *= 2;
+        char *mem = realloc(w->mem, cap);
+        if (!mem) return -1;
+        w->mem = mem;
+        w->mem_cap = cap;
+    }
+    memcpy(w->mem + w->mem_len, p, n);
+    w->mem_len += n;
+    w->mem[w->mem_len] = '\0';
+    return 0;
+}
+
+/* Write everything queued. Returns 0, or -1 once a write has failed. A
+ * MAIL_WRITER_MEMORY writer appends the queued bytes to mem
+ * (NUL-terminated), for builtins that assign their output to a shell
+ * variable and for output whose length must go first. A MAIL_WRITER_HOLD
+ * writer keeps its output queued until it is redirected; a flush with
+ * anything queued, including the one made when the buffer or the iovec
+ * array is full, drops it and fails with ENOBUFS. */
+static inline int mail_writer_flush(mail_writer *w) {
+    struct iovec *iov = w->iov;
+    int cnt = w->iovcnt;
+
+    if (w->fd == MAIL_WRITER_HOLD && cnt > 0 && !w->error) w->error = ENOBUFS;
+
+    if (w->fd == MAIL_WRITER_MEMORY) {
+        for (; cnt > 0 && !w->error; iov++, cnt--) {
+            if (mail_writer_collect(w, iov->iov_base, iov->iov_len) == -1) w->error = ENOMEM;
+            w->written += iov->iov_len;
+        }
+    }
+    while (cnt > 0 && !w->error) {
+        ssize_t n = writev(w->fd, iov, cnt);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            w->error = errno;
+            break;
+        }
+        w->written += (size_t)n;
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    w->iovcnt = 0;
+    w->refs = 0;
+    w->buf_len = 0;
+    if (w->error) {
+        errno = w->error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Call before memory passed to mail_write_range() goes away (e.g. the
+ * input is unmapped). Flushes only if a range still refers to it, so
+ * small messages keep accumulating in the buffer. */
+static inline int mail_writer_detach(mail_writer *w) {
+    if (w->refs) return mail_writer_flush(w);
+    if (w->error) {
+        errno = w->error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Point a flushed writer at another fd, keeping its buffer and clearing
+ * any earlier error. Returns the previous fd. */
+static inline int mail_writer_redirect(mail_writer *w, int fd) {
+    int old = w->fd;
+
+    w->fd = fd;
+    w->error = 0;
+    w->iovcnt = 0;
+    w->refs = 0;
+    w->buf_len = 0;
+    return old;
+}
+
+static inline void mail_writer_free(mail_writer *w) {
+    free(w->buf);
+    w->buf = NULL;
+    w->buf_len = w->buf_cap = 0;
+    free(w->mem);
+    w->mem = NULL;
+    w->mem_len = w->mem_cap = 0;
+}
+
+/* Room for at least one byte in the buffer and one iovec. Returns 0, or -1
+ * if the buffer cannot be allocated. */
+static inline int mail_writer_reserve(mail_writer *w) {
+    if (!w->buf) {
+        w->buf = malloc(MAIL_OUTBUF_SIZE);
+        if (!w->buf) {
+            w->error = ENOMEM;
+            return -1;
+        }
+        w->buf_cap = MAIL_OUTBUF_SIZE;
+    }
+    if (w->buf_len == w->buf_cap || w->iovcnt == MAIL_IOV_MAX) mail_writer_flush(w);
+    return 0;
+}
+
+/* Account for n bytes just placed at the end of the buffer */
+static inline void mail_writer_commit(mail_writer *w, size_t n) {
+    char *p = w->buf + w->buf_len;
+
+    if (n == 0) return;
+    w->buf_len += n;
+    if (w->iovcnt > 0) {
+        struct iovec *last = &w->iov[w->iovcnt - 1];
+        if ((char *)last->iov_base + last->iov_len == p) {
+            last->iov_len += n;
+            return;
+        }
+    }
+    w->iov[w->iovcnt].iov_base = p;
+    w->iov[w->iovcnt].iov_len = n;
+    w->iovcnt++;
+}
+
+/* Copy n bytes at p into the buffer */
+static inline void mail_write_copy(mail_writer *w, const char *p, size_t n) {
+    while (n > 0) {
+        if (mail_writer_reserve(w) == -1) return;
+        size_t chunk = w->buf_cap - w->buf_len;
+        if (chunk > n) chunk = n;
+        memcpy(w->buf + w->buf_len, p, chunk);
+        mail_writer_commit(w, chunk);
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+/* Queue n bytes at p. A range that continues the previous one is merged
+ * with it; otherwise short ranges are copied and long ones referenced. */
+static inline void mail_write_range(mail_writer *w, const char *p, size_t n) {
+    if (n == 0) return;
+    if (w->iovcnt > 0) {
+        struct iovec *last = &w->iov[w->iovcnt - 1];
+        if ((const char *)last->iov_base + last->iov_len == p) {
+            last->iov_len += n;
+            return;
+        }
+    }
+    if (n <= MAIL_COPY_MAX) {
+        mail_write_copy(w, p, n);
+        return;
+    }
+    if (w->iovcnt == MAIL_IOV_MAX) mail_writer_flush(w);
+    w->iov[w->iovcnt].iov_base = (void *)p;
+    w->iov[w->iovcnt].iov_len = n;
+    w->iovcnt++;
+    w->refs++;
+}
+
+/* Queue a NUL-terminated string followed by a newline */
+static inline void mail_write_line(mail_writer *w, const char *s) {
+    mail_write_copy(w, s, strlen(s));
+    mail_write_copy(w, "\n", 1);
+}
+
+/* Queue n bytes at p with CR removed and TAB turned into space. Ranges
+ * without either are queued as-is; the rest is transformed into the buffer. */
+static inline void mail_write_folded(mail_writer *w, const char *p, size_t n) {
+    const char *end = p + n;
+    const char *q = mail_find_fold(p, end);
+
+    if (!q) {
+        mail_write_range(w, p, n);
+        return;
+    }
+    mail_write_range(w, p, q - p);
+
+    while (q < end) {
+        if (mail_writer_reserve(w) == -1) return;
+        size_t chunk = end - q;
+        if (chunk > w->buf_cap - w->buf_len) chunk = w->buf_cap - w->buf_len;
+        mail_writer_commit(w, mail_fold_copy(w->buf + w->buf_len, q, chunk));
+        q += chunk;
+    }
+}
+
+#endif /* MAIL_IO_H */
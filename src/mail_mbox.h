@@ -0,0 +1,211 @@
+/*
+mail_mbox.h - Streaming message splitter for mbox files and stdin
+
+Reads a descriptor through a fixed-size buffer and hands out the input
+one line at a time, tagged with the part of the message it belongs to
+(From_ line, header, blank separator, body). Memory use is bounded by
+the buffer: a line longer than the buffer is handed out in pieces. The
+one exception is a header line whose field name (up to the colon) does
+not fit: the buffer then doubles until the name is complete, so callers
+always see a header line's whole name in its first piece, but never
+beyond the memory ceiling of mail_io.h (MAIL_TOOLS_MEMORY). A name
+longer than the ceiling is handed out in pieces like any long line.
+
+A new message starts at the beginning of the input and at every line
+beginning with "From " that follows a blank line (or that appears where
+a header line is expected). A stream that does not start with a From_
+line is taken as one message, so a single message piped from an MDA
+works the same way as an mbox. Body lines are passed on unchanged; no
+">From " unquoting is done.
+
+mail_mbox_init_message() reads the stream as one message instead: no
+From_ lines and no splitting, as the tools treat a single FILE. The
+tools use it for stdin and for files larger than the memory ceiling.
+
+Used by the --mbox mode of mailheader, mailmessage and mailheaderclean,
+standalone binaries and bash loadable builtins alike.
+*/
+
+#ifndef MAIL_MBOX_H
+#define MAIL_MBOX_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mail_io.h"
+
+#define MAIL_MBOX_BUF_SIZE (256 * 1024)     /* initial buffer */
+
+typedef enum {
+    MBOX_FROM,          /* "From " envelope line */
+    MBOX_HEADER,        /* header or header continuation line */
+    MBOX_SEPARATOR,     /* blank line ending the header block */
+    MBOX_BODY           /* body line */
+} mail_mbox_part;
+
+/* One line, or one piece of a line longer than the buffer. The bytes stay
+ * valid until the next call to mail_mbox_next(). */
+typedef struct {
+    const char *p;
+    size_t len;
+    mail_mbox_part part;
+    int line_start;     /* first piece of its line */
+    int new_message;    /* first piece of a message */
+} mail_mbox_chunk;
+
+typedef struct {
+    int fd;
+    int error;          /* errno of a failed read, or 0 */
+    int eof;
+    char *buf;
+    size_t start, end;  /* unread bytes are buf[start, end) */
+    size_t cap;         /* buffer size */
+    size_t max;         /* largest buffer allowed: the memory ceiling */
+    int single;         /* one message: no From_ lines, no splitting */
+    mail_mbox_part state;       /* part expected for the next line */
+    mail_mbox_part cont_part;   /* part of a line handed out in pieces */
+    int at_line_start;
+    int prev_blank;     /* last complete line was blank */
+    size_t messages;    /* messages started so far */
+} mail_mbox;
+
+/* Returns 0, or -1 with errno set if the buffer cannot be allocated */
+static inline int mail_mbox_init(mail_mbox *mb, int fd) {
+    memset(mb, 0, sizeof(*mb));
+    mb->fd = fd;
+    mb->at_line_start = 1;
+    mb->state = MBOX_HEADER;
+    mb->max = mail_memory_max();
+    mb->cap = mb->max < MAIL_MBOX_BUF_SIZE ? mb->max : MAIL_MBOX_BUF_SIZE;
+    mb->buf = malloc(mb->cap);
+    if (!mb->buf) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* Same, for a stream holding a single message */
+static inline int mail_mbox_init_message(mail_mbox *mb, int fd) {
+    if (mail_mbox_init(mb, fd) == -1) return -1;
+    mb->single = 1;
+    return 0;
+}
+
+static inline void mail_mbox_free(mail_mbox *mb) {
+    free(mb->buf);
+    mb->buf = NULL;
+}
+
+/* Move unread bytes to the front and read more. Returns bytes read, 0 at
+ * end of input, -1 on error. */
+static inline ssize_t mail_mbox_fill(mail_mbox *mb) {
+    ssize_t r;
+
+    if (mb->start > 0) {
+        memmove(mb->buf, mb->buf + mb->start, mb->end - mb->start);
+        mb->end -= mb->start;
+        mb->start = 0;
+    }
+    do {
+        r = read(mb->fd, mb->buf + mb->end, mb->cap - mb->end);
+    } while (r == -1 && errno == EINTR);
+    if (r > 0) mb->end += (size_t)r;
+    return r;
+}
+
+/* The buffer is full with one unfinished line. Double it (up to the
+ * ceiling) when that line is a header line still without its colon.
+ * Returns 1 if it grew, 0 if the line is to be handed out in pieces. */
+static inline int mail_mbox_grow(mail_mbox *mb) {
+    size_t cap;
+    char *buf;
+
+    if (!mb->at_line_start || mb->state == MBOX_BODY || mb->cap >= mb->max ||
+        mail_line_is_continuation(mb->buf, mb->buf + mb->end) ||
+        memchr(mb->buf, ':', mb->end)) {
+        return 0;
+    }
+    cap = mb->cap > mb->max / 2 ? mb->max : mb->cap * 2;
+    buf = realloc(mb->buf, cap);
+    if (!buf) return 0;
+    mb->buf = buf;
+    mb->cap = cap;
+    return 1;
+}
+
+/* Next line or line piece. Returns 1 with c filled in, 0 at end of input,
+ * -1 on a read error (errno set). */
+static inline int mail_mbox_next(mail_mbox *mb, mail_mbox_chunk *c) {
+    const char *p, *nl;
+    size_t len;
+    int complete;
+
+    for (;;) {
+        p = mb->buf + mb->start;
+        nl = memchr(p, '\n', mb->end - mb->start);
+        if (nl) {
+            len = nl + 1 - p;
+            complete = 1;
+            break;
+        }
+        if (mb->eof) {
+            if (mb->end == mb->start) return 0;
+            len = mb->end - mb->start;      /* last line, no newline */
+            complete = 1;
+            break;
+        }
+        if (mb->start == 0 && mb->end == mb->cap && !mail_mbox_grow(mb)) {
+            len = mb->cap;                  /* longer than the buffer */
+            complete = 0;
+            break;
+        }
+        ssize_t r = mail_mbox_fill(mb);
+        if (r == -1) {
+            mb->error = errno;
+            return -1;
+        }
+        if (r == 0) mb->eof = 1;
+    }
+    mb->start += len;
+
+    c->p = p;
+    c->len = len;
+    c->line_start = mb->at_line_start;
+    c->new_message = 0;
+
+    if (!mb->at_line_start) {
+        c->part = mb->cont_part;
+    } else {
+        int is_from = !mb->single && len >= 5 && memcmp(p, "From ", 5) == 0;
+        int is_blank = mail_line_is_blank(p, p + len);
+
+        if (mb->messages == 0 || (is_from && (mb->state != MBOX_BODY || mb->prev_blank))) {
+            c->new_message = 1;
+            mb->messages++;
+            mb->state = MBOX_HEADER;
+        }
+        if (c->new_message && is_from) {
+            c->part = MBOX_FROM;
+        } else if (mb->state == MBOX_BODY) {
+            c->part = MBOX_BODY;
+        } else if (is_blank) {
+            c->part = MBOX_SEPARATOR;
+            mb->state = MBOX_BODY;
+        } else {
+            c->part = MBOX_HEADER;
+        }
+        mb->prev_blank = is_blank;
+    }
+
+    mb->at_line_start = complete;
+    if (!complete) {
+        mb->cont_part = c->part;
+        mb->prev_blank = 0;
+    }
+    return 1;
+}
+
+#endif /* MAIL_MBOX_H */
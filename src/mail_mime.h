@@ -0,0 +1,749 @@
+/*
+mail_mime.h - MIME part walker for mailmessage --text, --part, --list-parts
+and --extract-attachments
+
+mailmessage prints everything after the header block, base64 attachments
+included. The MIME modes follow the part tree instead:
+
+  --text         the decoded text parts that are not attachments, CRs
+                 removed and tabs folded; of a multipart/alternative only
+                 the first branch with text
+  --part N       the decoded body of leaf part N, byte for byte
+  --list-parts   one line per leaf part: number, type, transfer encoding,
+                 encoded size in bytes and file name, tab-separated
+  --extract-attachments
+                 the decoded body of every attachment (a leaf part with an
+                 attachment disposition or a file name), each to the fd the
+                 caller's open_part() returns for it
+
+Leaf parts are numbered from 1 in message order, nested multiparts
+flattened; a message that is not multipart is part 1.
+
+The delimiters of the innermost open multipart are found with memmem() on
+"\n--BOUNDARY" rather than line by line, so a part that is not wanted (a
+PDF, an image) is passed over without being copied or decoded: only the
+header lines of each part and the wanted bodies are looked at. Header
+lines are consumed one at a time, keeping just the Content-Type,
+Content-Transfer-Encoding and Content-Disposition values, and base64 and
+quoted-printable are decoded straight into the output buffer with their
+state carried across calls; runs of whole base64 groups go through the
+vectorized decoder of mail_scan.h. The walker is therefore fed either a whole
+mapped message or successive read() chunks of a pipe or of a file over
+the memory ceiling (mail_io.h), with the same result, and holds no more
+than a delimiter's length of input back between chunks.
+
+Decoded text keeps its charset; nothing is converted. RFC 2231 file names
+(filename*=, filename*0*=...) are percent-decoded and their charset is
+kept in filename_charset for the caller to convert.
+
+Shared by the standalone binary and the bash loadable builtin; memmem()
+needs _GNU_SOURCE defined before the first include.
+*/
+
+#ifndef MAIL_MIME_H
+#define MAIL_MIME_H
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "mail_io.h"
+
+#define MAIL_MIME_DEPTH 16          /* nested multiparts followed */
+#define MAIL_MIME_BOUNDARY_MAX 200  /* RFC 2046 allows 70; be lenient */
+#define MAIL_MIME_FIELD_MAX 1024    /* Content-* value kept, unfolded */
+#define MAIL_MIME_NAME_MIN 64       /* header line bytes needed to classify it */
+
+typedef enum { MIME_LIST, MIME_TEXT, MIME_PART, MIME_EXTRACT } mail_mime_mode;
+typedef enum { MIME_ENC_NONE, MIME_ENC_QP, MIME_ENC_BASE64 } mail_mime_enc;
+typedef enum { MIME_HEADERS, MIME_BODY, MIME_SKIP } mail_mime_state;
+
+/* The Content-* fields kept from a header block */
+enum { MIME_CONTENT_TYPE, MIME_CONTENT_ENCODING, MIME_CONTENT_DISPOSITION, MIME_FIELDS };
+
+static const char *const mail_mime_field_names[MIME_FIELDS] = {
+    "Content-Type", "Content-Transfer-Encoding", "Content-Disposition"
+};
+
+typedef struct {
+    char delim[MAIL_MIME_BOUNDARY_MAX + 4];  /* "\n--BOUNDARY" */
+    size_t len;
+    int alternative;    /* multipart/alternative */
+    unsigned branch;    /* child part being read, from 1 */
+    unsigned chosen;    /* --text: branch whose text was output, or 0 */
+} mail_mime_level;
+
+typedef struct mail_mime mail_mime;
+
+struct mail_mime {
+    mail_mime_mode mode;
+    unsigned want;              /* --part N */
+    mail_writer *out;
+
+    /* --extract-attachments: open_part() returns the fd for the attachment
+     * just begun, or -1 to skip it; close_part() gets it back once its
+     * body is written, with the errno of a failed write or 0 */
+    int (*open_part)(void *ctx, const mail_mime *m);
+    void (*close_part)(void *ctx, const mail_mime *m, int fd, int error);
+    void *ctx;
+
+    mail_mime_state state;
+    int bol;                    /* input position is at a line start */
+    mail_mime_level level[MAIL_MIME_DEPTH];
+    int depth;                  /* open multiparts */
+    unsigned parts;             /* leaf parts begun */
+    int found;                  /* --part N was seen */
+
+    /* Header block being read */
+    char field[MIME_FIELDS][MAIL_MIME_FIELD_MAX + 1];
+    size_t field_len[MIME_FIELDS];
+    unsigned field_seen;        /* bit per field */
+    int capture;                /* field of the current line, or -1 */
+    int in_line;                /* a header line was consumed in part */
+
+    /* Current leaf part */
+    int emit;                   /* its body is output */
+    mail_mime_enc enc;
+    unsigned long long size;    /* encoded body bytes */
+    char type[64];
+    char encoding[32];
+    char filename[256];
+    char filename_charset[32];  /* RFC 2231 name: its charset, or "" */
+
+    /* Decoder state carried between calls */
+    uint32_t b64_bits;
+    int b64_n;                  /* bits held in b64_bits */
+    int qp_state;               /* 0, after '=', after "=X", after "=\r" */
+    char qp_hex;
+    char last;                  /* last byte output by --text */
+};
+
+static inline void mail_mime_init(mail_mime *m, mail_mime_mode mode, unsigned want, mail_writer *out) {
+    memset(m, 0, sizeof(*m));
+    m->mode = mode;
+    m->want = want;
+    m->out = out;
+    m->state = MIME_HEADERS;
+    m->bol = 1;
+    m->capture = -1;
+    m->last = '\n';
+}
+
+/* Header fields ----------------------------------------------------------- */
+
+/* Hex digit value of c, or -1 */
+static inline int mail_mime_hex(unsigned char c) {
+    if ((unsigned)(c - '0') < 10u) return c - '0';
+    if ((unsigned)((c | 0x20) - 'a') < 6u) return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+/* Lowercased first token of a Content-* value (up to ';' or a space) */
+static inline void mail_mime_token(const char *v, char *buf, size_t cap) {
+    size_t k = 0;
+
+    while (*v == ' ') v++;
+    for (; *v && *v != ';' && *v != ' '; v++) {
+        if (k + 1 < cap) buf[k++] = (char)tolower((unsigned char)*v);
+    }
+    buf[k] = '\0';
+}
+
+/* Parameter name of a Content-* value, quoted or not, into buf (truncated
+ * to cap). Returns its full length, or -1 if it is absent. */
+static inline int mail_mime_param(const char *v, const char *name, char *buf, size_t cap) {
+    size_t nlen = strlen(name);
+    const char *p = v;
+
+    for (;;) {
+        /* Next ';' outside a quoted string */
+        int quoted = 0;
+        for (; *p && (quoted || *p != ';'); p++) {
+            if (*p == '"') quoted = !quoted;
+            else if (*p == '\\' && quoted && p[1]) p++;
+        }
+        if (!*p) return -1;
+        for (p++; *p == ' '; p++) {}
+
+        if (strncasecmp(p, name, nlen) == 0) {
+            const char *q = p + nlen;
+            size_t k = 0;
+            int len = 0;
+
+            while (*q == ' ') q++;
+            if (*q != '=') continue;
+            for (q++; *q == ' '; q++) {}
+            if (*q == '"') {
+                for (q++; *q && *q != '"'; q++, len++) {
+                    if (*q == '\\' && q[1]) q++;
+                    if (k + 1 < cap) buf[k++] = *q;
+                }
+            } else {
+                for (; *q && *q != ';' && *q != ' '; q++, len++) {
+                    if (k + 1 < cap) buf[k++] = *q;
+                }
+            }
+            buf[k] = '\0';
+            return len;
+        }
+    }
+}
+
+/* Append the RFC 2231 value piece v to buf[*k, cap), decoding %XX when
+ * extended; the first extended piece starts with charset'language' */
+static inline void mail_mime_ext_piece(const char *v, int extended, int first, char *buf, size_t cap,
+                                       size_t *k, char *charset, size_t cs_cap) {
+    if (extended && first) {
+        const char *q1 = strchr(v, '\''), *q2 = q1 ? strchr(q1 + 1, '\'') : NULL;
+        if (q2) {
+            size_t n = (size_t)(q1 - v) < cs_cap ? (size_t)(q1 - v) : cs_cap - 1;
+            memcpy(charset, v, n);
+            charset[n] = '\0';
+            v = q2 + 1;
+        }
+    }
+    for (; *v && *k + 1 < cap; v++) {
+        int hi, lo;
+        if (extended && v[0] == '%' && (hi = mail_mime_hex((unsigned char)v[1])) >= 0
+            && (lo = mail_mime_hex((unsigned char)v[2])) >= 0) {
+            buf[(*k)++] = (char)(hi << 4 | lo);
+            v += 2;
+        } else {
+            buf[(*k)++] = *v;
+        }
+    }
+    buf[*k] = '\0';
+}
+
+/* File name parameter name of a Content-* value into buf: RFC 2231
+ * name*= or name*0*=, name*1*=... continuations first, then plain name=.
+ * charset is set to the extended value's charset, or "". Returns 1 if
+ * there is one, 0 if not. */
+static inline int mail_mime_filename(const char *v, const char *name, char *buf, size_t cap,
+                                     char *charset, size_t cs_cap) {
+    char key[32], piece[256];
+    size_t k = 0;
+
+    buf[0] = '\0';
+    charset[0] = '\0';
+    snprintf(key, sizeof(key), "%s*", name);
+    if (mail_mime_param(v, key, piece, sizeof(piece)) >= 0) {
+        mail_mime_ext_piece(piece, 1, 1, buf, cap, &k, charset, cs_cap);
+        return 1;
+    }
+    for (int i = 0; i < 100; i++) {
+        int extended = 1;
+        snprintf(key, sizeof(key), "%s*%d*", name, i);
+        if (mail_mime_param(v, key, piece, sizeof(piece)) < 0) {
+            extended = 0;
+            snprintf(key, sizeof(key), "%s*%d", name, i);
+            if (mail_mime_param(v, key, piece, sizeof(piece)) < 0) break;
+        }
+        mail_mime_ext_piece(piece, extended, i == 0, buf, cap, &k, charset, cs_cap);
+    }
+    if (k) return 1;
+    return mail_mime_param(v, name, buf, cap) >= 0;
+}
+
+/* One header line, or the piece [p, q) of one: a line that starts with a
+ * kept field name starts capturing its value, continuation lines add to
+ * the value being captured, any other line ends it. CR and LF are dropped,
+ * TAB becomes a space, values are cut at MAIL_MIME_FIELD_MAX. */
+static inline void mail_mime_header_piece(mail_mime *m, const char *p, const char *q, int line_start) {
+    if (line_start && !mail_line_is_continuation(p, q)) {
+        m->capture = -1;
+        for (int i = 0; i < MIME_FIELDS; i++) {
+            size_t nlen = strlen(mail_mime_field_names[i]);
+            if ((size_t)(q - p) > nlen && p[nlen] == ':'
+                && strncasecmp(p, mail_mime_field_names[i], nlen) == 0) {
+                /* The first occurrence counts */
+                if (!(m->field_seen & (1u << i))) {
+                    m->field_seen |= 1u << i;
+                    m->field_len[i] = 0;
+                    m->capture = i;
+                }
+                p += nlen + 1;
+                break;
+            }
+        }
+    }
+    if (m->capture < 0) return;
+
+    char *f = m->field[m->capture];
+    size_t k = m->field_len[m->capture];
+    for (; p < q; p++) {
+        if (*p == '\r' || *p == '\n') continue;
+        if (k < MAIL_MIME_FIELD_MAX) f[k++] = (*p == '\t') ? ' ' : *p;
+    }
+    f[k] = '\0';
+    m->field_len[m->capture] = k;
+}
+
+/* --text: whether an alternative above the current part already had its
+ * text output from another branch */
+static inline int mail_mime_muted(const mail_mime *m) {
+    for (int i = 0; i < m->depth; i++) {
+        const mail_mime_level *l = &m->level[i];
+        if (l->alternative && l->chosen && l->chosen != l->branch) return 1;
+    }
+    return 0;
+}
+
+/* Value of a kept field of the header block just read, or NULL */
+static inline const char *mail_mime_value(const mail_mime *m, int i) {
+    return (m->field_seen & (1u << i)) ? m->field[i] : NULL;
+}
+
+/* The header block of the message or of a part is complete: open a
+ * multipart, or start a leaf part */
+static inline void mail_mime_begin(mail_mime *m) {
+    const char *ct = mail_mime_value(m, MIME_CONTENT_TYPE);
+    const char *cte = mail_mime_value(m, MIME_CONTENT_ENCODING);
+    const char *cd = mail_mime_value(m, MIME_CONTENT_DISPOSITION);
+    char boundary[MAIL_MIME_BOUNDARY_MAX + 1];
+    int blen, attachment = 0;
+
+    m->field_seen = 0;
+    m->capture = -1;
+    m->in_line = 0;
+
+    /* RFC 2045: no (or no usable) Content-Type is text/plain */
+    mail_mime_token(ct ? ct : "", m->type, sizeof(m->type));
+    if (!strchr(m->type, '/')) strcpy(m->type, "text/plain");
+
+    if (ct && strncmp(m->type, "multipart/", 10) == 0 && m->depth < MAIL_MIME_DEPTH
+        && (blen = mail_mime_param(ct, "boundary", boundary, sizeof(boundary))) > 0
+        && blen <= MAIL_MIME_BOUNDARY_MAX) {
+        mail_mime_level *l = &m->level[m->depth++];
+        l->len = (size_t)snprintf(l->delim, sizeof(l->delim), "\n--%s", boundary);
+        l->alternative = strcmp(m->type, "multipart/alternative") == 0;
+        l->branch = 0;
+        l->chosen = 0;
+        m->state = MIME_SKIP;   /* the preamble */
+        return;
+    }
+
+    m->parts++;
+    m->size = 0;
+    m->enc = MIME_ENC_NONE;
+    strcpy(m->encoding, "7bit");
+    if (cte) {
+        mail_mime_token(cte, m->encoding, sizeof(m->encoding));
+        if (strcmp(m->encoding, "base64") == 0) m->enc = MIME_ENC_BASE64;
+        else if (strcmp(m->encoding, "quoted-printable") == 0) m->enc = MIME_ENC_QP;
+    }
+    m->filename[0] = '\0';
+    m->filename_charset[0] = '\0';
+    if (cd) {
+        char disposition[16];
+        mail_mime_token(cd, disposition, sizeof(disposition));
+        attachment = strcmp(disposition, "attachment") == 0;
+        mail_mime_filename(cd, "filename", m->filename, sizeof(m->filename),
+                           m->filename_charset, sizeof(m->filename_charset));
+    }
+    if (!m->filename[0] && ct) {
+        mail_mime_filename(ct, "name", m->filename, sizeof(m->filename),
+                           m->filename_charset, sizeof(m->filename_charset));
+    }
+
+    switch (m->mode) {
+    case MIME_TEXT:
+        m->emit = strncmp(m->type, "text/", 5) == 0 && !attachment && !mail_mime_muted(m);
+        if (m->emit) {
+            /* Every alternative above now has its branch */
+            for (int i = 0; i < m->depth; i++) {
+                mail_mime_level *l = &m->level[i];
+                if (l->alternative && !l->chosen) l->chosen = l->branch;
+            }
+        }
+        break;
+    case MIME_PART:
+        m->emit = m->parts == m->want;
+        if (m->emit) m->found = 1;
+        break;
+    case MIME_EXTRACT: {
+        /* The writer is flushed between attachments */
+        int fd = attachment || m->filename[0] ? m->open_part(m->ctx, m) : -1;
+        m->emit = fd >= 0;
+        if (m->emit) mail_writer_redirect(m->out, fd);
+        break;
+    }
+    default:
+        m->emit = 0;
+    }
+    m->b64_bits = 0;
+    m->b64_n = 0;
+    m->qp_state = 0;
+    m->state = MIME_BODY;
+}
+
+/* Decoders ---------------------------------------------------------------- */
+
+/* Base64 alphabet value of c, or -1 */
+static inline int mail_mime_b64_value(unsigned char c) {
+    return mail_b64_table[c] == 0xff ? -1 : mail_b64_table[c];
+}
+
+/* Decode base64 from *pp (up to end) into dst, at most cap bytes; *pp is
+ * advanced past what was used. Returns the bytes written. Between groups
+ * the lines go to the kernel whole; line breaks, padding and groups cut
+ * by a line or a chunk end are taken a byte at a time. */
+static inline size_t mail_mime_b64(mail_mime *m, char *dst, size_t cap, const char **pp, const char *end) {
+    const char *p = *pp;
+    uint32_t bits = m->b64_bits;
+    int nb = m->b64_n;
+    size_t k = 0;
+
+    while (p < end && k < cap) {
+        if (nb == 0 && end - p >= 4) {
+            size_t used;
+            k += mail_b64_decode(dst + k, cap - k, p, (size_t)(end - p), &used);
+            p += used;
+            if (p == end || k == cap) break;
+        }
+
+        unsigned char c = (unsigned char)*p++;
+        int v = mail_mime_b64_value(c);
+
+        if (v < 0) {
+            /* Padding ends a group; line breaks and stray bytes are skipped */
+            if (c == '=') {
+                bits = 0;
+                nb = 0;
+            }
+            continue;
+        }
+        bits = bits << 6 | (uint32_t)v;
+        nb += 6;
+        if (nb >= 8) {
+            nb -= 8;
+            dst[k++] = (char)(bits >> nb);
+            bits &= (1u << nb) - 1;
+        }
+    }
+    m->b64_bits = bits;
+    m->b64_n = nb;
+    *pp = p;
+    return k;
+}
+
+/* Decode quoted-printable as mail_mime_b64() does; cap is at least 2. An
+ * '=' that starts no escape or soft line break is kept as it is. */
+static inline size_t mail_mime_qp(mail_mime *m, char *dst, size_t cap, const char **pp, const char *end) {
+    const char *p = *pp;
+    size_t k = 0;
+
+    while (p < end && k + 2 <= cap) {
+        unsigned char c = (unsigned char)*p;
+        int h;
+
+        switch (m->qp_state) {
+        case 0:
+            p++;
+            if (c == '=') m->qp_state = 1;
+            else dst[k++] = (char)c;
+            break;
+        case 1:     /* after '=' */
+            if (c == '\n') {
+                p++;                    /* soft line break */
+                m->qp_state = 0;
+            } else if (c == '\r') {
+                p++;
+                m->qp_state = 3;
+            } else if (mail_mime_hex(c) >= 0) {
+                p++;
+                m->qp_hex = (char)c;
+                m->qp_state = 2;
+            } else {
+                dst[k++] = '=';         /* c is read again */
+                m->qp_state = 0;
+            }
+            break;
+        case 2:     /* after "=X" */
+            if ((h = mail_mime_hex(c)) >= 0) {
+                p++;
+                dst[k++] = (char)(mail_mime_hex((unsigned char)m->qp_hex) << 4 | h);
+            } else {
+                dst[k++] = '=';
+                dst[k++] = m->qp_hex;
+            }
+            m->qp_state = 0;
+            break;
+        default:    /* after "=\r": a soft line break */
+            if (c == '\n') p++;
+            m->qp_state = 0;
+        }
+    }
+    *pp = p;
+    return k;
+}
+
+/* Decode [p, p + n) of the current part into the output buffer; --text
+ * folds it there in place (the fold never writes ahead of its reads) */
+static inline void mail_mime_decode(mail_mime *m, const char *p, size_t n) {
+    mail_writer *w = m->out;
+    const char *end = p + n;
+
+    while (p < end) {
+        if (mail_writer_reserve(w) == -1) return;
+        if (w->buf_cap - w->buf_len < 2) mail_writer_flush(w);
+
+        char *dst = w->buf + w->buf_len;
+        size_t cap = w->buf_cap - w->buf_len;
+        size_t k = m->enc == MIME_ENC_BASE64 ? mail_mime_b64(m, dst, cap, &p, end)
+                                             : mail_mime_qp(m, dst, cap, &p, end);
+
+        if (m->mode == MIME_TEXT) k = mail_fold_copy(dst, dst, k);
+        if (k) {
+            m->last = dst[k - 1];
+            mail_writer_commit(w, k);
+        }
+    }
+}
+
+/* Walking ----------------------------------------------------------------- */
+
+/* Body bytes of the current part, or preamble and epilogue text */
+static inline void mail_mime_content(mail_mime *m, const char *p, size_t n) {
+    if (m->state != MIME_BODY || n == 0) return;
+    m->size += n;
+    if (!m->emit) return;
+
+    if (m->enc != MIME_ENC_NONE) {
+        mail_mime_decode(m, p, n);
+    } else if (m->mode == MIME_TEXT) {
+        const char *q = p + n;
+        mail_write_folded(m->out, p, n);
+        while (q > p && q[-1] == '\r') q--;
+        if (q > p) m->last = q[-1];
+    } else {
+        mail_write_range(m->out, p, n);
+    }
+}
+
+/* The current part ends: flush a pending escape, end --text output with a
+ * newline, print the --list-parts line */
+static inline void mail_mime_end_part(mail_mime *m) {
+    if (m->state != MIME_BODY) return;
+    m->state = MIME_SKIP;
+
+    if (m->emit) {
+        if (m->enc == MIME_ENC_QP && m->qp_state == 2) {
+            char esc[2] = { '=', m->qp_hex };
+            mail_write_copy(m->out, esc, 2);
+            m->last = esc[1];
+        }
+        if (m->mode == MIME_TEXT && m->last != '\n') {
+            mail_write_copy(m->out, "\n", 1);
+            m->last = '\n';
+        }
+    }
+    if (m->mode == MIME_EXTRACT && m->emit) {
+        int error = mail_writer_flush(m->out) == -1 ? errno : 0;
+        m->close_part(m->ctx, m, mail_writer_redirect(m->out, -1), error);
+    }
+    if (m->mode == MIME_LIST) {
+        char line[sizeof(m->type) + sizeof(m->encoding) + sizeof(m->filename) + 48];
+        int n = snprintf(line, sizeof(line), "%u\t%s\t%s\t%llu\t%s\n",
+                         m->parts, m->type, m->encoding, m->size, m->filename);
+        mail_write_copy(m->out, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+}
+
+/* The rest of a delimiter line, from q just past "--BOUNDARY": "--" on the
+ * closing one, then white space (anything, on the closing one) up to the
+ * newline. Returns 1 with *next past the line, 0 if the boundary only
+ * starts a longer line, -1 if the line is not complete yet. */
+static inline int mail_mime_delimiter(const char *q, const char *end, int at_eof, int *close, const char **next) {
+    *close = 0;
+    if (end - q < 2 && !at_eof) return -1;
+    if (end - q >= 2 && q[0] == '-' && q[1] == '-') {
+        *close = 1;
+        q += 2;
+    }
+    for (; q < end; q++) {
+        if (*q == '\n') {
+            *next = q + 1;
+            return 1;
+        }
+        if (!*close && *q != ' ' && *q != '\t' && *q != '\r') return 0;
+    }
+    if (!at_eof) return -1;
+    *next = end;
+    return 1;
+}
+
+/* Next delimiter of the innermost multipart in [p, end): *cend is where
+ * the content before it ends, as the newline (CRLF or LF) in front of a
+ * delimiter belongs to it. Returns 1 if found, 0 if not, -1 if one starts
+ * but its line is not complete yet. */
+static inline int mail_mime_find(const mail_mime *m, const char *p, const char *end, int at_eof,
+                                 const char **cend, int *close, const char **next) {
+    const mail_mime_level *l = &m->level[m->depth - 1];
+    const char *from = p;
+    int r;
+
+    /* At a line start no newline is needed in front */
+    if (m->bol && (size_t)(end - p) >= l->len - 1 && memcmp(p, l->delim + 1, l->len - 1) == 0) {
+        if ((r = mail_mime_delimiter(p + l->len - 1, end, at_eof, close, next)) != 0) {
+            *cend = p;
+            return r;
+        }
+        from = p + 1;
+    }
+    for (;;) {
+        const char *q = memmem(from, end - from, l->delim, l->len);
+        if (!q) return 0;
+        if ((r = mail_mime_delimiter(q + l->len, end, at_eof, close, next)) != 0) {
+            *cend = (q > p && q[-1] == '\r') ? q - 1 : q;
+            return r;
+        }
+        from = q + 1;
+    }
+}
+
+/* Walk the n bytes at p; at_eof when nothing follows them. Returns the
+ * bytes consumed: the rest must be passed again at the start of the next
+ * call, with more input after it. */
+static inline size_t mail_mime_feed(mail_mime *m, const char *p, size_t n, int at_eof) {
+    const char *start = p, *end = p + n;
+
+    while (p < end) {
+        if (m->state == MIME_HEADERS) {
+            const char *nl = memchr(p, '\n', end - p);
+            const char *q = nl ? nl + 1 : end;
+
+            if (!m->in_line && mail_line_is_blank(p, q)) {
+                if (!nl && !at_eof) break;
+                mail_mime_begin(m);
+                p = q;
+                m->bol = 1;
+                continue;
+            }
+            /* A line is taken in pieces once its field name is in */
+            if (!nl && !at_eof && !m->in_line && (size_t)(end - p) < MAIL_MIME_NAME_MIN) break;
+            mail_mime_header_piece(m, p, q, !m->in_line);
+            m->in_line = !nl;
+            p = q;
+            continue;
+        }
+
+        if (m->depth == 0) {
+            /* Not multipart, or past the outermost closing delimiter */
+            mail_mime_content(m, p, end - p);
+            p = end;
+            break;
+        }
+
+        const char *cend, *next;
+        int close;
+        int r = mail_mime_find(m, p, end, at_eof, &cend, &close, &next);
+
+        if (r == 0) {
+            /* Keep back what may be a delimiter (and its CR) cut by the end */
+            size_t hold = at_eof ? 0 : m->level[m->depth - 1].len + 1;
+            if ((size_t)(end - p) <= hold) break;
+            mail_mime_content(m, p, (size_t)(end - p) - hold);
+            p = end - hold;
+            m->bol = p[-1] == '\n';
+            continue;
+        }
+        if (r < 0) {
+            if (cend > p) {
+                mail_mime_content(m, p, cend - p);
+                p = cend;
+                m->bol = 0;
+            }
+            break;
+        }
+
+        mail_mime_content(m, p, cend - p);
+        mail_mime_end_part(m);
+        if (close) {
+            m->depth--;
+            m->state = MIME_SKIP;   /* the epilogue */
+        } else {
+            m->level[m->depth - 1].branch++;
+            m->state = MIME_HEADERS;
+        }
+        p = next;
+        m->bol = 1;
+    }
+    return (size_t)(p - start);
+}
+
+/* The input has ended */
+static inline void mail_mime_finish(mail_mime *m) {
+    if (m->state == MIME_HEADERS) mail_mime_begin(m);   /* headers, no body */
+    mail_mime_end_part(m);
+}
+
+#define MAIL_MIME_CHUNK (64 * 1024)
+
+/* Walk the message read from fd. A regular file within the memory
+ * ceiling is mapped and walked in one call; anything else is read in
+ * chunks of up to 64K (less under a smaller ceiling). Returns 0, or -1
+ * with errno set if fd cannot be read or a line that must be held whole
+ * outgrows the ceiling. Output pointing into the input is written out
+ * before the input goes away. */
+static inline int mail_mime_run(mail_mime *m, int fd) {
+    size_t max = mail_memory_max(), cap, len = 0;
+    mail_input in;
+    char *buf;
+
+    if (!mail_input_streamed(fd)) {
+        if (mail_input_fd(&in, fd) == -1) return -1;
+        mail_mime_feed(m, in.data, in.len, 1);
+        mail_mime_finish(m);
+        mail_writer_detach(m->out);
+        mail_input_close(&in);
+        return 0;
+    }
+
+    cap = max < MAIL_MIME_CHUNK ? max : MAIL_MIME_CHUNK;
+    if (!(buf = malloc(cap))) return -1;
+    for (;;) {
+        ssize_t r = read(fd, buf + len, cap - len);
+        size_t used;
+
+        if (r == -1) {
+            int saved = errno;
+            if (saved == EINTR) continue;
+            mail_mime_finish(m);    /* close an attachment being written */
+            mail_writer_detach(m->out);
+            free(buf);
+            errno = saved;
+            return -1;
+        }
+        len += (size_t)r;
+        used = mail_mime_feed(m, buf, len, r == 0);
+        if (r == 0) break;
+
+        /* Output may point into buf: write it before the input moves */
+        mail_writer_detach(m->out);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+        if (len == cap) {
+            size_t new_cap = cap * 2 < max ? cap * 2 : max;
+            char *nb = new_cap > cap ? realloc(buf, new_cap) : NULL;
+            if (!nb) {
+                mail_mime_finish(m);
+                free(buf);
+                errno = new_cap > cap ? ENOMEM : EFBIG;
+                return -1;
+            }
+            buf = nb;
+            cap = new_cap;
+        }
+    }
+    mail_mime_finish(m);
+    mail_writer_detach(m->out);
+    free(buf);
+    return 0;
+}
+
+#endif /* MAIL_MIME_H */
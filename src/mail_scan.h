@@ -0,0 +1,385 @@
+/*
+mail_scan.h - Scanning kernels for CR stripping and tab folding
+
+The utilities drop CR and turn TAB into a space in the text they print.
+Finding those bytes and copying text around them runs over every header
+line, and over the whole body in mailmessage. The MIME modes of
+mailmessage also decode base64, which dominates the time spent on
+attachments. This header provides those kernels in four variants, chosen
+once per process:
+
+  avx2    32 bytes per step (x86, when the CPU has AVX2)
+  sse2    16 bytes per step (x86; always present on x86-64)
+  swar    8 bytes per step in a 64-bit word (portable fallback)
+  scalar  byte at a time (reference implementation)
+
+Base64 is decoded 32 input bytes per step by the avx2 variant (the
+pshufb range lookup of Mula and Lemire); the others decode a group of four
+bytes at a time through a table.
+
+Set MAIL_TOOLS_SCAN to one of those names to force a variant; unknown or
+unsupported names fall back to automatic selection. Newlines are found
+with memchr(), which the C library already vectorises, and the blank and
+continuation line checks only ever look at a line's first bytes.
+*/
+
+#ifndef MAIL_SCAN_H
+#define MAIL_SCAN_H
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAIL_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    const char *name;
+    /* First CR or TAB in [p, end), or NULL */
+    const char *(*find_fold)(const char *p, const char *end);
+    /* Copy n bytes from src to dst removing CR and turning TAB into space;
+     * returns the number of bytes written (at most n) */
+    size_t (*fold_copy)(char *dst, const char *src, size_t n);
+    /* Decode the whole groups of four base64 bytes at the start of
+     * src[0, n) into dst (room for cap bytes), stopping at a group with a
+     * byte outside the alphabet (a line break, padding) or when dst is
+     * full; returns the bytes written and sets *used to the bytes read */
+    size_t (*b64_decode)(char *dst, size_t cap, const char *src, size_t n, size_t *used);
+} mail_scan_kernel;
+
+/* Scalar ---------------------------------------------------------------- */
+
+static inline const char *mail_find_fold_scalar(const char *p, const char *end) {
+    for (; p < end; p++) {
+        if (*p == '\r' || *p == '\t') return p;
+    }
+    return NULL;
+}
+
+static inline size_t mail_fold_copy_scalar(char *dst, const char *src, size_t n) {
+    char *d = dst;
+    const char *end = src + n;
+
+    while (src < end) {
+        char c = *src++;
+        if (c == '\r') continue;
+        *d++ = (c == '\t') ? ' ' : c;
+    }
+    return d - dst;
+}
+
+/* Value of each byte in the base64 alphabet, 0xff outside it */
+static const unsigned char mail_b64_table[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+static inline size_t mail_b64_decode_scalar(char *dst, size_t cap, const char *src, size_t n, size_t *used) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t i = 0, k = 0;
+
+    while (n - i >= 4 && cap - k >= 3) {
+        unsigned a = mail_b64_table[s[i]], b = mail_b64_table[s[i + 1]];
+        unsigned c = mail_b64_table[s[i + 2]], d = mail_b64_table[s[i + 3]];
+        if ((a | b | c | d) & 0x80) break;
+
+        uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        dst[k] = (char)(v >> 16);
+        dst[k + 1] = (char)(v >> 8);
+        dst[k + 2] = (char)v;
+        i += 4;
+        k += 3;
+    }
+    *used = i;
+    return k;
+}
+
+/* SWAR: eight bytes per 64-bit word --------------------------------------- */
+
+#define MAIL_SWAR_ONES  0x0101010101010101ULL
+#define MAIL_SWAR_HIGHS 0x8080808080808080ULL
+
+/* Nonzero if any byte of w is CR or TAB (exact: no false positives when
+ * the result is zero, which is all the callers rely on) */
+static inline uint64_t mail_swar_fold_bytes(uint64_t w) {
+    uint64_t cr = w ^ (MAIL_SWAR_ONES * '\r');
+    uint64_t tab = w ^ (MAIL_SWAR_ONES * '\t');
+    return (((cr - MAIL_SWAR_ONES) & ~cr) | ((tab - MAIL_SWAR_ONES) & ~tab)) & MAIL_SWAR_HIGHS;
+}
+
+static inline const char *mail_find_fold_swar(const char *p, const char *end) {
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        if (mail_swar_fold_bytes(w)) return mail_find_fold_scalar(p, p + 8);
+        p += 8;
+    }
+    return mail_find_fold_scalar(p, end);
+}
+
+static inline size_t mail_fold_copy_swar(char *dst, const char *src, size_t n) {
+    char *d = dst;
+
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, src, 8);
+        if (mail_swar_fold_bytes(w)) {
+            d += mail_fold_copy_scalar(d, src, 8);
+        } else {
+            memcpy(d, &w, 8);
+            d += 8;
+        }
+        src += 8;
+        n -= 8;
+    }
+    return (d - dst) + mail_fold_copy_scalar(d, src, n);
+}
+
+#ifdef MAIL_SCAN_X86
+
+/* Copy the bytes of a folded block around the CRs marked in crmask */
+static inline char *mail_scan_drop_cr(char *d, const char *block, unsigned len, uint32_t crmask) {
+    unsigned start = 0;
+
+    while (crmask) {
+        unsigned i = (unsigned)__builtin_ctz(crmask);
+        memcpy(d, block + start, i - start);
+        d += i - start;
+        start = i + 1;
+        crmask &= crmask - 1;
+    }
+    memcpy(d, block + start, len - start);
+    return d + (len - start);
+}
+
+/* SSE2: sixteen bytes per step -------------------------------------------- */
+
+__attribute__((target("sse2")))
+static const char *mail_find_fold_sse2(const char *p, const char *end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, tab)));
+        if (mask) return p + __builtin_ctz((unsigned)mask);
+        p += 16;
+    }
+    return mail_find_fold_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static size_t mail_fold_copy_sse2(char *dst, const char *src, size_t n) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i space = _mm_set1_epi8(' ');
+    char *d = dst;
+
+    while (n >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)src);
+        __m128i is_tab = _mm_cmpeq_epi8(v, tab);
+        uint32_t crmask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+
+        v = _mm_or_si128(_mm_andnot_si128(is_tab, v), _mm_and_si128(is_tab, space));
+        if (!crmask) {
+            /* d never runs ahead of src, so the 16 bytes fit */
+            _mm_storeu_si128((__m128i *)d, v);
+            d += 16;
+        } else {
+            char block[16];
+            _mm_storeu_si128((__m128i *)block, v);
+            d = mail_scan_drop_cr(d, block, 16, crmask);
+        }
+        src += 16;
+        n -= 16;
+    }
+    return (d - dst) + mail_fold_copy_scalar(d, src, n);
+}
+
+/* AVX2: thirty-two bytes per step ----------------------------------------- */
+
+__attribute__((target("avx2")))
+static const char *mail_find_fold_avx2(const char *p, const char *end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i tab = _mm256_set1_epi8('\t');
+
+    /* Two vectors per iteration for long clean runs (bodies) */
+    while (end - p >= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+        __m256i fa = _mm256_or_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(a, tab));
+        __m256i fb = _mm256_or_si256(_mm256_cmpeq_epi8(b, cr), _mm256_cmpeq_epi8(b, tab));
+        if (!_mm256_testz_si256(_mm256_or_si256(fa, fb), _mm256_or_si256(fa, fb))) {
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(fa);
+            if (mask) return p + __builtin_ctz(mask);
+            return p + 32 + __builtin_ctz((uint32_t)_mm256_movemask_epi8(fb));
+        }
+        p += 64;
+    }
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, tab)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return mail_find_fold_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static size_t mail_fold_copy_avx2(char *dst, const char *src, size_t n) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i space = _mm256_set1_epi8(' ');
+    char *d = dst;
+
+    while (n >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)src);
+        __m256i is_tab = _mm256_cmpeq_epi8(v, tab);
+        uint32_t crmask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr));
+
+        v = _mm256_blendv_epi8(v, space, is_tab);
+        if (!crmask) {
+            _mm256_storeu_si256((__m256i *)d, v);
+            d += 32;
+        } else {
+            char block[32];
+            _mm256_storeu_si256((__m256i *)block, v);
+            d = mail_scan_drop_cr(d, block, 32, crmask);
+        }
+        src += 32;
+        n -= 32;
+    }
+    return (d - dst) + mail_fold_copy_sse2(d, src, n);
+}
+
+__attribute__((target("avx2")))
+static size_t mail_b64_decode_avx2(char *dst, size_t cap, const char *src, size_t n, size_t *used) {
+    /* Low and high nibble classes: a byte is in the alphabet when its two
+     * classes share no bit; roll is what to add to get its 6-bit value */
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    /* Four 6-bit values to three bytes per 32-bit lane, then the lanes'
+     * twelve bytes side by side */
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+    size_t i = 0, k = 0, rest;
+
+    /* 32 bytes in, 24 out, but the store writes 32 */
+    while (n - i >= 32 && cap - k >= 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, mask_2f));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+
+        if (!_mm256_testz_si256(lo, hi)) break;
+        in = _mm256_add_epi8(in, roll);
+        in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+        in = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(in, pack), lanes);
+        _mm256_storeu_si256((__m256i *)(dst + k), in);
+        i += 32;
+        k += 24;
+    }
+    k += mail_b64_decode_scalar(dst + k, cap - k, src + i, n - i, &rest);
+    *used = i + rest;
+    return k;
+}
+
+#endif /* MAIL_SCAN_X86 */
+
+/* Dispatch -------------------------------------------------------------- */
+
+static const mail_scan_kernel mail_scan_kernels[] = {
+#ifdef MAIL_SCAN_X86
+    { "avx2",   mail_find_fold_avx2,   mail_fold_copy_avx2,   mail_b64_decode_avx2 },
+    { "sse2",   mail_find_fold_sse2,   mail_fold_copy_sse2,   mail_b64_decode_scalar },
+#endif
+    { "swar",   mail_find_fold_swar,   mail_fold_copy_swar,   mail_b64_decode_scalar },
+    { "scalar", mail_find_fold_scalar, mail_fold_copy_scalar, mail_b64_decode_scalar },
+};
+
+#define MAIL_SCAN_KERNEL_COUNT ((int)(sizeof(mail_scan_kernels) / sizeof(mail_scan_kernels[0])))
+
+/* Whether the CPU can run kernel k */
+static inline int mail_scan_supported(const mail_scan_kernel *k) {
+#ifdef MAIL_SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(k->name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(k->name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    (void)k;
+    return 1;
+}
+
+/* Kernel by name if supported, otherwise the best one for this CPU */
+static inline const mail_scan_kernel *mail_scan_select(const char *name) {
+    int i;
+
+    if (name && *name) {
+        for (i = 0; i < MAIL_SCAN_KERNEL_COUNT; i++) {
+            if (strcmp(mail_scan_kernels[i].name, name) == 0 && mail_scan_supported(&mail_scan_kernels[i])) {
+                return &mail_scan_kernels[i];
+            }
+        }
+    }
+    for (i = 0; i < MAIL_SCAN_KERNEL_COUNT; i++) {
+        if (mail_scan_supported(&mail_scan_kernels[i])) return &mail_scan_kernels[i];
+    }
+    return &mail_scan_kernels[MAIL_SCAN_KERNEL_COUNT - 1];
+}
+
+static const mail_scan_kernel *mail_scan_active;
+
+/* The kernel for this process, chosen on first use */
+static inline const mail_scan_kernel *mail_scan(void) {
+    if (!mail_scan_active) mail_scan_active = mail_scan_select(getenv("MAIL_TOOLS_SCAN"));
+    return mail_scan_active;
+}
+
+/* Short ranges (most header lines) are cheaper without the indirect call */
+#define MAIL_SCAN_SHORT 16
+
+static inline const char *mail_find_fold(const char *p, const char *end) {
+    if (end - p < MAIL_SCAN_SHORT) return mail_find_fold_scalar(p, end);
+    return mail_scan()->find_fold(p, end);
+}
+
+static inline size_t mail_fold_copy(char *dst, const char *src, size_t n) {
+    if (n < MAIL_SCAN_SHORT) return mail_fold_copy_scalar(dst, src, n);
+    return mail_scan()->fold_copy(dst, src, n);
+}
+
+static inline size_t mail_b64_decode(char *dst, size_t cap, const char *src, size_t n, size_t *used) {
+    return mail_scan()->b64_decode(dst, cap, src, n, used);
+}
+
+#endif /* MAIL_SCAN_H */
@@ -0,0 +1,141 @@
+/*
+mail_select.h - Header field selection for mailheader -H
+
+The comma-separated field list is compiled into the case-folded trie of
+mailheaderclean_matcher.h, so each header name is classified in a single
+pass over its bytes; glob patterns (X-*, *-Status) work as they do in
+the mailheaderclean removal list.
+
+Fields that RFC 5322 allows at most once (From, To, Subject, Date, ...)
+end the search: when every requested field is one of them, given by its
+exact name, the header scan stops as soon as each has been seen, and the
+rest of the header block is neither unfolded nor printed. Any other
+field, or a pattern, can match again later, so then the whole header
+block is scanned.
+
+Shared by the standalone binary and the bash loadable builtin.
+*/
+
+#ifndef MAIL_SELECT_H
+#define MAIL_SELECT_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <ctype.h>
+#include <strings.h>
+
+#include "mailheaderclean_matcher.h"
+
+#define MAIL_SELECT_MAX_FIELDS 64
+
+typedef struct {
+    header_matcher matcher;
+    char *names[MAIL_SELECT_MAX_FIELDS];   /* requested fields, duplicates dropped */
+    int count;
+    int stop_early;                 /* every field is a single-instance name */
+    unsigned long long seen;        /* fields matched in the current message */
+} mail_select;
+
+/* RFC 5322 section 3.6: fields that appear at most once in a message */
+static inline int mail_select_single(const char *name) {
+    static const char *const single[] = {
+        "date", "from", "sender", "reply-to", "to", "cc", "bcc",
+        "message-id", "in-reply-to", "references", "subject",
+    };
+
+    for (size_t i = 0; i < sizeof(single) / sizeof(single[0]); i++) {
+        if (strcasecmp(name, single[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static inline void mail_select_free(mail_select *s) {
+    header_matcher_free(&s->matcher);
+    for (int i = 0; i < s->count; i++) free(s->names[i]);
+    s->count = 0;
+}
+
+/* Compile the comma-separated csv; blanks around a name are ignored.
+ * Returns 0, or -1 with errno set:
+ * EINVAL for an empty list, E2BIG for more than MAIL_SELECT_MAX_FIELDS
+ * names, ENOMEM. */
+static inline int mail_select_compile(mail_select *s, const char *csv) {
+    const char *p = csv;
+
+    memset(s, 0, sizeof(*s));
+    s->stop_early = 1;
+    while (*p) {
+        const char *start = p;
+        int dup = 0;
+
+        while (*p && *p != ',') p++;
+        size_t len = p - start;
+        if (*p == ',') p++;
+
+        /* Trim blanks around each name, as parse_csv_headers() does */
+        while (len > 0 && isspace((unsigned char)*start)) start++, len--;
+        while (len > 0 && isspace((unsigned char)start[len - 1])) len--;
+        if (len == 0) continue;
+
+        for (int i = 0; i < s->count; i++) {
+            if (strncasecmp(s->names[i], start, len) == 0 && s->names[i][len] == '\0') dup = 1;
+        }
+        if (dup) continue;
+        if (s->count == MAIL_SELECT_MAX_FIELDS) {
+            mail_select_free(s);
+            errno = E2BIG;
+            return -1;
+        }
+        if ((s->names[s->count] = strndup(start, len)) == NULL) {
+            mail_select_free(s);
+            errno = ENOMEM;
+            return -1;
+        }
+        if (!mail_select_single(s->names[s->count])) s->stop_early = 0;
+        s->count++;
+    }
+    if (s->count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (header_matcher_compile(&s->matcher, s->names, s->count) == -1) {
+        mail_select_free(s);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* Start a new message */
+static inline void mail_select_reset(mail_select *s) {
+    s->seen = 0;
+}
+
+/* Every requested field has been seen and none can appear again */
+static inline int mail_select_done(const mail_select *s) {
+    return s->stop_early &&
+           s->seen == (s->count == MAIL_SELECT_MAX_FIELDS ? ~0ULL : (1ULL << s->count) - 1);
+}
+
+/* Which requested field the header line starting at p (len bytes, at
+ * least up to the colon) is, as its position in the list, or -1; records
+ * it as seen */
+static inline int mail_select_field(mail_select *s, const char *p, size_t len) {
+    const char *colon = memchr(p, ':', len);
+    int i;
+
+    if (!colon) return -1;
+    i = header_matcher_match(&s->matcher, p, colon - p);
+    if (i == -1) return -1;
+    s->seen |= 1ULL << i;
+    return i;
+}
+
+/* Whether the header line starting at p is a requested field; records it
+ * as seen */
+static inline int mail_select_line(mail_select *s, const char *p, size_t len) {
+    return mail_select_field(s, p, len) != -1;
+}
+
+#endif /* MAIL_SELECT_H */
@@ -0,0 +1,960 @@
+/*
+mail_thread.h - Conversation thread index
+
+mailthread reads the Message-ID, In-Reply-To, References, Date and Subject
+of every message under a set of directories and links the messages into
+threads, following jwz's algorithm without subject grouping:
+
+  - every message ID is interned once, in an open-addressing hash table;
+  - the IDs of a message's References field (then its In-Reply-To, if that
+    is not the last reference already) are linked parent to child, where
+    the child has no parent yet and no loop would form;
+  - a message's own parent is the last of those IDs, whatever an earlier
+    message's References suggested;
+  - an ID that is referenced but not found is a missing message. Missing
+    messages are spliced out of the tree, their children moved up to
+    their parent, except at the top of a thread holding several replies
+    together. A thread is never rooted at a missing message with only one
+    reply.
+
+Replies are ordered by date, then by path, and threads by the date of
+their first message.
+
+The index is one file, meant to be mapped and read in place (native byte
+order, all offsets from the start of the file):
+
+  mail_thread_head
+  messages  count * mail_thread_msg, sorted by path
+  nodes     nodes * mail_thread_node: node i is message i for i < count,
+            then the missing messages that are kept
+  roots     uint32 thread roots in order, padded to 8
+  buckets   uint32 node of each hash slot, MAIL_THREAD_NONE if empty
+            (a power of two, linear probing on mail_thread_hash())
+  pool      paths, IDs, references and subjects, not NUL-terminated
+
+Updating it reads only the files whose inode, size or mtime changed (found
+by path, or by inode after a maildir flag change renamed them), then links
+the threads again from the stored IDs. The new index is written to a
+temporary file and renamed over the old one.
+
+Used by the mailthread standalone binary.
+*/
+
+#ifndef MAIL_THREAD_H
+#define MAIL_THREAD_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "mail_io.h"
+#include "mail_select.h"
+
+#define MAIL_THREAD_NAME ".mailthread.idx"
+#define MAIL_THREAD_MAGIC "MTIDX\0\0\1"
+#define MAIL_THREAD_FIELDS "message-id,in-reply-to,references,date,subject"
+#define MAIL_THREAD_NONE UINT32_MAX
+#define MAIL_THREAD_MAX (UINT32_MAX / 4)    /* messages, nodes, slots */
+
+/* Positions in MAIL_THREAD_FIELDS */
+enum { MAIL_THREAD_ID, MAIL_THREAD_REPLY, MAIL_THREAD_REFS, MAIL_THREAD_DATE, MAIL_THREAD_SUBJECT, MAIL_THREAD_NFIELDS };
+
+typedef struct {
+    char magic[8];
+    uint32_t count;         /* messages */
+    uint32_t nodes;         /* messages, then missing ones */
+    uint32_t roots;
+    uint32_t buckets;       /* hash slots, a power of two */
+    uint64_t pool_len;
+} mail_thread_head;
+
+typedef struct {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t date;           /* Date in seconds since the epoch, 0 if missing or unreadable */
+    uint64_t path_off;
+    uint64_t id_off;        /* Message-ID, <...> */
+    uint64_t refs_off;      /* parent IDs, oldest first: <a><b><c> */
+    uint64_t subject_off;   /* unfolded Subject */
+    uint32_t path_len;
+    uint32_t id_len;
+    uint32_t refs_len;
+    uint32_t subject_len;
+} mail_thread_msg;
+
+typedef struct {
+    uint32_t msg;           /* message, or MAIL_THREAD_NONE for a missing one */
+    uint32_t parent;        /* MAIL_THREAD_NONE at the top of a thread */
+    uint32_t child;         /* first reply */
+    uint32_t next;          /* next reply to the same parent */
+    uint64_t id_off;
+    uint32_t id_len;
+    uint32_t reserved;
+} mail_thread_node;
+
+/* An index, mapped from its file */
+typedef struct {
+    char *base;
+    size_t len;
+    const mail_thread_head *head;
+    const mail_thread_msg *msgs;
+    const mail_thread_node *nodes;
+    const uint32_t *roots;
+    const uint32_t *buckets;
+    const char *pool;
+} mail_thread;
+
+static inline size_t mail_thread_pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static inline uint64_t mail_thread_hash(const char *p, size_t n) {
+    uint64_t h = 1469598103934665603ULL;    /* FNV-1a */
+
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static inline size_t mail_thread_count(const mail_thread *ix) {
+    return ix->head ? ix->head->count : 0;
+}
+
+/* Pool bytes [off, off + len), or NULL if the range is outside the pool */
+static inline const char *mail_thread_str(const mail_thread *ix, uint64_t off, uint64_t len) {
+    if (off > ix->head->pool_len || len > ix->head->pool_len - off) return NULL;
+    return ix->pool + off;
+}
+
+static inline void mail_thread_close(mail_thread *ix) {
+    if (ix->base) munmap(ix->base, ix->len);
+    memset(ix, 0, sizeof(*ix));
+}
+
+static inline int mail_thread_link_ok(uint32_t n, uint32_t nodes) {
+    return n == MAIL_THREAD_NONE || n < nodes;
+}
+
+/* Check the head, the section sizes and every node link of the image in
+ * ix->base and set up the section pointers. Strings are range-checked on
+ * use. */
+static inline int mail_thread_attach(mail_thread *ix) {
+    const mail_thread_head *h = (const mail_thread_head *)ix->base;
+    size_t off = sizeof(*h);
+
+    if (ix->len < sizeof(*h) || memcmp(h->magic, MAIL_THREAD_MAGIC, 8) != 0) return -1;
+    if (h->count > h->nodes || h->nodes > MAIL_THREAD_MAX || h->roots > h->nodes ||
+        h->buckets > MAIL_THREAD_MAX || (h->buckets & (h->buckets - 1)) != 0) return -1;
+    if ((ix->len - off) / sizeof(mail_thread_msg) < h->count) return -1;
+    ix->msgs = (const mail_thread_msg *)(ix->base + off);
+    off += (size_t)h->count * sizeof(mail_thread_msg);
+    if ((ix->len - off) / sizeof(mail_thread_node) < h->nodes) return -1;
+    ix->nodes = (const mail_thread_node *)(ix->base + off);
+    off += (size_t)h->nodes * sizeof(mail_thread_node);
+    if (ix->len - off < mail_thread_pad8((size_t)h->roots * 4)) return -1;
+    ix->roots = (const uint32_t *)(ix->base + off);
+    off += mail_thread_pad8((size_t)h->roots * 4);
+    if (ix->len - off < mail_thread_pad8((size_t)h->buckets * 4)) return -1;
+    ix->buckets = (const uint32_t *)(ix->base + off);
+    off += mail_thread_pad8((size_t)h->buckets * 4);
+    if (h->pool_len != ix->len - off) return -1;
+    ix->pool = ix->base + off;
+
+    for (uint32_t i = 0; i < h->nodes; i++) {
+        const mail_thread_node *n = &ix->nodes[i];
+        if (n->msg != (i < h->count ? i : MAIL_THREAD_NONE) || !mail_thread_link_ok(n->parent, h->nodes) ||
+            !mail_thread_link_ok(n->child, h->nodes) || !mail_thread_link_ok(n->next, h->nodes)) return -1;
+    }
+    for (uint32_t i = 0; i < h->roots; i++) {
+        if (ix->roots[i] >= h->nodes) return -1;
+    }
+    for (uint32_t i = 0; i < h->buckets; i++) {
+        if (!mail_thread_link_ok(ix->buckets[i], h->nodes)) return -1;
+    }
+    ix->head = h;
+    return 0;
+}
+
+/* Map the index file at path. Returns 0, or -1 with errno set (EINVAL if
+ * it is not a valid index). */
+static inline int mail_thread_open(mail_thread *ix, const char *path) {
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(ix, 0, sizeof(*ix));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(mail_thread_head)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    ix->base = map;
+    ix->len = (size_t)st.st_size;
+    if (mail_thread_attach(ix) == -1) {
+        mail_thread_close(ix);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Message at path, or NULL */
+static inline const mail_thread_msg *mail_thread_find_path(const mail_thread *ix, const char *path) {
+    size_t lo = 0, hi = mail_thread_count(ix), len = strlen(path);
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const mail_thread_msg *m = &ix->msgs[mid];
+        const char *s = mail_thread_str(ix, m->path_off, m->path_len);
+        if (!s) return NULL;
+
+        int c = memcmp(s, path, m->path_len < len ? m->path_len : len);
+        if (c == 0) c = m->path_len < len ? -1 : m->path_len > len;
+        if (c == 0) return m;
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/* Node of the message ID id (with its angle brackets), or MAIL_THREAD_NONE */
+static inline uint32_t mail_thread_find(const mail_thread *ix, const char *id, size_t len) {
+    uint32_t mask;
+
+    if (!ix->head || ix->head->buckets == 0) return MAIL_THREAD_NONE;
+    mask = ix->head->buckets - 1;
+    for (uint32_t i = (uint32_t)mail_thread_hash(id, len) & mask, probes = 0;
+         probes <= mask; i = (i + 1) & mask, probes++) {
+        uint32_t n = ix->buckets[i];
+        if (n == MAIL_THREAD_NONE) break;
+        const mail_thread_node *node = &ix->nodes[n];
+        const char *s = mail_thread_str(ix, node->id_off, node->id_len);
+        if (s && node->id_len == len && memcmp(s, id, len) == 0) return n;
+    }
+    return MAIL_THREAD_NONE;
+}
+
+/* Top of the thread of node n */
+static inline uint32_t mail_thread_root(const mail_thread *ix, uint32_t n) {
+    for (uint32_t steps = 0; ix->nodes[n].parent != MAIL_THREAD_NONE && steps < ix->head->nodes; steps++) {
+        n = ix->nodes[n].parent;
+    }
+    return n;
+}
+
+/* Node after n in the depth-first order of a thread walked from its top,
+ * or MAIL_THREAD_NONE after the last; *depth is n's and becomes the
+ * returned node's */
+static inline uint32_t mail_thread_next(const mail_thread *ix, uint32_t n, int *depth) {
+    if (ix->nodes[n].child != MAIL_THREAD_NONE) {
+        ++*depth;
+        return ix->nodes[n].child;
+    }
+    while (*depth > 0) {
+        if (ix->nodes[n].next != MAIL_THREAD_NONE) return ix->nodes[n].next;
+        n = ix->nodes[n].parent;
+        --*depth;
+    }
+    return MAIL_THREAD_NONE;
+}
+
+/* Header fields ------------------------------------------------------------ */
+
+/* Days from 1970-01-01 to y-m-d (proleptic Gregorian) */
+static inline int64_t mail_thread_days(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static inline const char *mail_thread_number(const char *p, const char *end, int *v, int *digits) {
+    *v = 0;
+    *digits = 0;
+    while (p < end && isdigit((unsigned char)*p) && *digits < 9) {
+        *v = *v * 10 + (*p++ - '0');
+        ++*digits;
+    }
+    return p;
+}
+
+/* An RFC 5322 date ("Mon, 2 Jan 2006 15:04:05 -0700", the day name,
+ * seconds and zone optional; obsolete two-digit years and zone names
+ * accepted) as seconds since the epoch, or 0 if it cannot be read */
+static inline int64_t mail_thread_date(const char *p, size_t len) {
+    static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+    static const struct { const char *name; int minutes; } zones[] = {
+        { "ut", 0 }, { "utc", 0 }, { "gmt", 0 }, { "z", 0 },
+        { "edt", -240 }, { "est", -300 }, { "cdt", -300 }, { "cst", -360 },
+        { "mdt", -360 }, { "mst", -420 }, { "pdt", -420 }, { "pst", -480 },
+    };
+    const char *end = p + len;
+    int day, year, hour, minute, second = 0, month = -1, digits, zone = 0;
+
+#define SKIP_SPACE() while (p < end && (isspace((unsigned char)*p) || *p == ',' || *p == '-')) p++
+
+    SKIP_SPACE();
+    if (p < end && isalpha((unsigned char)*p)) {
+        while (p < end && isalpha((unsigned char)*p)) p++;
+        SKIP_SPACE();
+    }
+    p = mail_thread_number(p, end, &day, &digits);
+    if (digits == 0 || day < 1 || day > 31) return 0;
+    SKIP_SPACE();
+    if (end - p < 3) return 0;
+    for (int i = 0; i < 12; i++) {
+        if (strncasecmp(p, months + 3 * i, 3) == 0) month = i + 1;
+    }
+    if (month < 0) return 0;
+    while (p < end && isalpha((unsigned char)*p)) p++;
+    SKIP_SPACE();
+    p = mail_thread_number(p, end, &year, &digits);
+    if (digits < 2) return 0;
+    if (digits == 2) year += year < 50 ? 2000 : 1900;
+    if (digits == 3) year += 1900;
+    SKIP_SPACE();
+    p = mail_thread_number(p, end, &hour, &digits);
+    if (digits == 0 || hour > 23 || p == end || *p++ != ':') return 0;
+    p = mail_thread_number(p, end, &minute, &digits);
+    if (digits == 0 || minute > 59) return 0;
+    if (p < end && *p == ':') {
+        p = mail_thread_number(p + 1, end, &second, &digits);
+        if (digits == 0 || second > 60) return 0;
+    }
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if (p < end && (*p == '+' || *p == '-')) {
+        int sign = *p == '-' ? -1 : 1, hhmm;
+        p = mail_thread_number(p + 1, end, &hhmm, &digits);
+        if (digits == 4) zone = sign * (hhmm / 100 * 60 + hhmm % 100);
+    } else if (p < end && isalpha((unsigned char)*p)) {
+        const char *name = p;
+        while (p < end && isalpha((unsigned char)*p)) p++;
+        for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++) {
+            if ((size_t)(p - name) == strlen(zones[i].name) && strncasecmp(name, zones[i].name, p - name) == 0) {
+                zone = zones[i].minutes;
+            }
+        }
+    }
+#undef SKIP_SPACE
+
+    return mail_thread_days(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - zone * 60;
+}
+
+/* Next <id> of the value [*p, end): its range, or NULL when there is none.
+ * Angle brackets around white space or another '<' are not an ID. */
+static inline const char *mail_thread_next_id(const char **p, const char *end, size_t *len) {
+    const char *s = *p;
+
+    while ((s = memchr(s, '<', end - s)) != NULL) {
+        const char *e = s + 1;
+        while (e < end && *e != '>' && *e != '<' && !isspace((unsigned char)*e)) e++;
+        if (e < end && *e == '>' && e - s > 1) {
+            *p = e + 1;
+            *len = (size_t)(e + 1 - s);
+            return s;
+        }
+        s = e;
+    }
+    *p = end;
+    return NULL;
+}
+
+/* One message's threading fields, in a scratch buffer reused from message
+ * to message */
+typedef struct {
+    const char *id, *refs, *subject;
+    size_t id_len, refs_len, subject_len;
+    int64_t date;
+    char *scratch;
+    size_t scratch_cap;
+} mail_thread_fields;
+
+/* Read the fields of the header block [data, data + len) with sel, which
+ * was compiled from MAIL_THREAD_FIELDS; the scan stops when all five have
+ * been seen. Values are unfolded as mailheader prints them. Returns 0, or
+ * -1 if memory runs out. */
+static inline int mail_thread_parse(mail_thread_fields *f, mail_select *sel, const char *data, size_t len) {
+    const char *raw[MAIL_THREAD_NFIELDS] = { NULL }, *raw_end[MAIL_THREAD_NFIELDS] = { NULL };
+    const char *value[MAIL_THREAD_NFIELDS] = { NULL };
+    size_t value_len[MAIL_THREAD_NFIELDS] = { 0 }, need = 0;
+    const char *p = data, *end = data + len;
+    char *out;
+
+    mail_select_reset(sel);
+    while (p < end && !mail_select_done(sel)) {
+        const char *eol = mail_line_end(p, end);
+        const char *field_end = eol;
+        int i;
+
+        while (field_end < end && mail_line_is_continuation(field_end, end)) {
+            field_end = mail_line_end(field_end, end);
+        }
+        if (!mail_line_is_continuation(p, eol) && (i = mail_select_field(sel, p, eol - p)) >= 0 && !raw[i]) {
+            raw[i] = memchr(p, ':', eol - p) + 1;
+            raw_end[i] = field_end;
+            need += (size_t)(field_end - raw[i]);
+        }
+        p = field_end;
+    }
+
+    /* Unfolded values, then the parent IDs: at most the raw sizes again */
+    need = 2 * need + 1;
+    if (need > f->scratch_cap) {
+        char *grown = realloc(f->scratch, need);
+        if (!grown) return -1;
+        f->scratch = grown;
+        f->scratch_cap = need;
+    }
+    out = f->scratch;
+    for (int i = 0; i < MAIL_THREAD_NFIELDS; i++) {
+        size_t n = 0;
+        if (!raw[i]) continue;
+        for (const char *s = raw[i]; s < raw_end[i]; ) {
+            const char *next = mail_line_end(s, raw_end[i]);
+            size_t m = (size_t)(next - s);
+            if (m > 0 && s[m - 1] == '\n') m--;
+            n += mail_fold_copy(out + n, s, m);
+            s = next;
+        }
+        value[i] = out;
+        while (n > 0 && isspace((unsigned char)value[i][n - 1])) n--;
+        while (n > 0 && isspace((unsigned char)*value[i])) {
+            value[i]++;
+            n--;
+        }
+        value_len[i] = n;
+        out += (size_t)(value[i] - out) + n;
+    }
+
+    /* Message-ID: the <id>, or the bare value if it has none */
+    f->id = NULL;
+    f->id_len = 0;
+    if (value[MAIL_THREAD_ID]) {
+        const char *s = value[MAIL_THREAD_ID];
+        f->id = mail_thread_next_id(&s, s + value_len[MAIL_THREAD_ID], &f->id_len);
+        if (!f->id && value_len[MAIL_THREAD_ID] > 0 && !memchr(value[MAIL_THREAD_ID], ' ', value_len[MAIL_THREAD_ID])) {
+            f->id = value[MAIL_THREAD_ID];
+            f->id_len = value_len[MAIL_THREAD_ID];
+        }
+    }
+
+    /* Parents: every References ID, then the first In-Reply-To ID unless it
+     * is the last reference */
+    f->refs = out;
+    f->refs_len = 0;
+    const char *last = NULL, *id;
+    size_t last_len = 0, n;
+    if (value[MAIL_THREAD_REFS]) {
+        const char *s = value[MAIL_THREAD_REFS], *e = s + value_len[MAIL_THREAD_REFS];
+        while ((id = mail_thread_next_id(&s, e, &n)) != NULL) {
+            memmove(out + f->refs_len, id, n);
+            last = out + f->refs_len;
+            last_len = n;
+            f->refs_len += n;
+        }
+    }
+    if (value[MAIL_THREAD_REPLY]) {
+        const char *s = value[MAIL_THREAD_REPLY];
+        id = mail_thread_next_id(&s, s + value_len[MAIL_THREAD_REPLY], &n);
+        if (id && !(last && last_len == n && memcmp(last, id, n) == 0)) {
+            memmove(out + f->refs_len, id, n);
+            f->refs_len += n;
+        }
+    }
+
+    f->subject = value[MAIL_THREAD_SUBJECT];
+    f->subject_len = value_len[MAIL_THREAD_SUBJECT];
+    f->date = value[MAIL_THREAD_DATE] ? mail_thread_date(value[MAIL_THREAD_DATE], value_len[MAIL_THREAD_DATE]) : 0;
+    return 0;
+}
+
+/* Building ----------------------------------------------------------------- */
+
+typedef struct {
+    mail_thread_msg *msgs;
+    size_t count, cap;
+    char *pool;
+    size_t pool_len, pool_cap;
+    int error;              /* sticky ENOMEM or E2BIG */
+} mail_thread_build;
+
+static inline uint64_t mail_thread_pool_add(mail_thread_build *b, const char *p, size_t n) {
+    uint64_t off = b->pool_len;
+
+    if (n > UINT32_MAX) {
+        b->error = E2BIG;
+        return 0;
+    }
+    if (b->pool_len + n > b->pool_cap) {
+        size_t cap = b->pool_cap ? b->pool_cap : 1 << 20;
+        while (cap < b->pool_len + n) cap *= 2;
+        char *pool = realloc(b->pool, cap);
+        if (!pool) {
+            b->error = ENOMEM;
+            return 0;
+        }
+        b->pool = pool;
+        b->pool_cap = cap;
+    }
+    if (n) memcpy(b->pool + b->pool_len, p, n);
+    b->pool_len += n;
+    return off;
+}
+
+/* Append a message for path as it is described by st; NULL if memory runs
+ * out or there are too many messages */
+static inline mail_thread_msg *mail_thread_build_msg(mail_thread_build *b, const char *path, const struct stat *st) {
+    mail_thread_msg *m;
+
+    if (b->count == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        mail_thread_msg *msgs = b->count >= MAIL_THREAD_MAX ? NULL : realloc(b->msgs, cap * sizeof(*msgs));
+        if (!msgs) {
+            b->error = b->count >= MAIL_THREAD_MAX ? E2BIG : ENOMEM;
+            return NULL;
+        }
+        b->msgs = msgs;
+        b->cap = cap;
+    }
+    m = &b->msgs[b->count++];
+    memset(m, 0, sizeof(*m));
+    m->ino = (uint64_t)st->st_ino;
+    m->size = (uint64_t)st->st_size;
+    m->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    m->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    m->path_len = (uint32_t)strlen(path);
+    m->path_off = mail_thread_pool_add(b, path, m->path_len);
+    return m;
+}
+
+/* Record a message read from its file */
+static inline void mail_thread_add(mail_thread_build *b, const char *path, const struct stat *st,
+                                   const mail_thread_fields *f) {
+    mail_thread_msg *m = mail_thread_build_msg(b, path, st);
+
+    if (!m) return;
+    m->date = f->date;
+    m->id_len = (uint32_t)f->id_len;
+    m->id_off = mail_thread_pool_add(b, f->id, f->id_len);
+    m->refs_len = (uint32_t)f->refs_len;
+    m->refs_off = mail_thread_pool_add(b, f->refs, f->refs_len);
+    m->subject_len = (uint32_t)f->subject_len;
+    m->subject_off = mail_thread_pool_add(b, f->subject, f->subject_len);
+}
+
+/* Record a message from its entry o in the old index */
+static inline void mail_thread_reuse(mail_thread_build *b, const char *path, const struct stat *st,
+                                     const mail_thread *old, const mail_thread_msg *o) {
+    const char *id = mail_thread_str(old, o->id_off, o->id_len);
+    const char *refs = mail_thread_str(old, o->refs_off, o->refs_len);
+    const char *subject = mail_thread_str(old, o->subject_off, o->subject_len);
+    mail_thread_msg *m = mail_thread_build_msg(b, path, st);
+
+    if (!m) return;
+    m->date = o->date;
+    if (id) {
+        m->id_len = o->id_len;
+        m->id_off = mail_thread_pool_add(b, id, o->id_len);
+    }
+    if (refs) {
+        m->refs_len = o->refs_len;
+        m->refs_off = mail_thread_pool_add(b, refs, o->refs_len);
+    }
+    if (subject) {
+        m->subject_len = o->subject_len;
+        m->subject_off = mail_thread_pool_add(b, subject, o->subject_len);
+    }
+}
+
+/* An entry describes the file as it is now */
+static inline int mail_thread_current(const mail_thread_msg *m, const struct stat *st) {
+    return m->ino == (uint64_t)st->st_ino && m->size == (uint64_t)st->st_size &&
+           m->mtime_sec == (int64_t)st->st_mtim.tv_sec && m->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+static inline int mail_thread_path_cmp(const void *a, const void *b, void *pool) {
+    const mail_thread_msg *x = a, *y = b;
+    int c = memcmp((const char *)pool + x->path_off, (const char *)pool + y->path_off,
+                   x->path_len < y->path_len ? x->path_len : y->path_len);
+    return c ? c : (x->path_len > y->path_len) - (x->path_len < y->path_len);
+}
+
+/* Sort the messages by path and drop repeated paths (a directory named
+ * twice) */
+static inline void mail_thread_sort(mail_thread_build *b) {
+    size_t n = 0;
+
+    qsort_r(b->msgs, b->count, sizeof(*b->msgs), mail_thread_path_cmp, b->pool);
+    for (size_t i = 0; i < b->count; i++) {
+        if (n > 0 && mail_thread_path_cmp(&b->msgs[n - 1], &b->msgs[i], b->pool) == 0) continue;
+        b->msgs[n++] = b->msgs[i];
+    }
+    b->count = n;
+}
+
+/* Linking ------------------------------------------------------------------ */
+
+/* The threads of the sorted messages of a build */
+typedef struct {
+    mail_thread_node *nodes;
+    uint32_t count;
+    uint32_t *roots;
+    uint32_t nroots;
+    uint32_t *buckets;
+    uint32_t nbuckets;
+} mail_thread_tree;
+
+typedef struct {
+    const mail_thread_build *b;
+    mail_thread_node *nodes;
+    size_t count, cap;
+    uint32_t *slots;
+    uint32_t mask;
+} mail_thread_interner;
+
+static inline void mail_thread_tree_free(mail_thread_tree *t) {
+    free(t->nodes);
+    free(t->roots);
+    free(t->buckets);
+    memset(t, 0, sizeof(*t));
+}
+
+/* Hash slots for nodes: a power of two at least twice as many */
+static inline uint32_t *mail_thread_slots(size_t nodes, uint32_t *count) {
+    size_t n = 16;
+    uint32_t *slots;
+
+    while (n < 2 * nodes) n *= 2;
+    if (n > MAIL_THREAD_MAX) return NULL;
+    slots = malloc(n * sizeof(*slots));
+    if (slots) memset(slots, 0xff, n * sizeof(*slots));
+    *count = (uint32_t)n;
+    return slots;
+}
+
+/* Slot of id, empty if it is not interned */
+static inline uint32_t *mail_thread_slot(mail_thread_interner *in, const char *id, size_t len) {
+    const char *pool = in->b->pool;
+
+    for (uint32_t i = (uint32_t)mail_thread_hash(id, len) & in->mask; ; i = (i + 1) & in->mask) {
+        uint32_t n = in->slots[i];
+        if (n == MAIL_THREAD_NONE ||
+            (in->nodes[n].id_len == len && memcmp(pool + in->nodes[n].id_off, id, len) == 0)) return &in->slots[i];
+    }
+}
+
+static inline int mail_thread_rehash(mail_thread_interner *in) {
+    uint32_t count;
+    uint32_t *slots = mail_thread_slots(in->count * 2, &count);
+
+    if (!slots) return -1;
+    for (uint32_t i = 0; i <= in->mask; i++) {
+        uint32_t n = in->slots[i];
+        if (n == MAIL_THREAD_NONE) continue;
+        uint32_t j = (uint32_t)mail_thread_hash(in->b->pool + in->nodes[n].id_off, in->nodes[n].id_len) & (count - 1);
+        while (slots[j] != MAIL_THREAD_NONE) j = (j + 1) & (count - 1);
+        slots[j] = n;
+    }
+    free(in->slots);
+    in->slots = slots;
+    in->mask = count - 1;
+    return 0;
+}
+
+/* Node of the ID at pool offset off, added as a missing message if it is
+ * new; MAIL_THREAD_NONE if memory runs out */
+static inline uint32_t mail_thread_intern(mail_thread_interner *in, uint64_t off, uint32_t len) {
+    uint32_t *slot = mail_thread_slot(in, in->b->pool + off, len);
+    mail_thread_node *n;
+
+    if (*slot != MAIL_THREAD_NONE) return *slot;
+    if (in->count == in->cap) {
+        size_t cap = in->cap * 2;
+        mail_thread_node *nodes = cap > MAIL_THREAD_MAX ? NULL : realloc(in->nodes, cap * sizeof(*nodes));
+        if (!nodes) return MAIL_THREAD_NONE;
+        in->nodes = nodes;
+        in->cap = cap;
+    }
+    n = &in->nodes[in->count];
+    memset(n, 0, sizeof(*n));
+    n->msg = n->parent = n->child = n->next = MAIL_THREAD_NONE;
+    n->id_off = off;
+    n->id_len = len;
+    *slot = (uint32_t)in->count++;
+    if (2 * in->count > in->mask && mail_thread_rehash(in) == -1) return MAIL_THREAD_NONE;
+    return (uint32_t)in->count - 1;
+}
+
+/* Whether making parent the parent of child would close a loop. While
+ * linking, reserved is set on nodes that have been given a reply: only
+ * those can be an ancestor of anything. */
+static inline int mail_thread_loops(const mail_thread_node *nodes, uint32_t child, uint32_t parent) {
+    if (!nodes[child].reserved) return 0;
+    for (uint32_t n = parent; n != MAIL_THREAD_NONE; n = nodes[n].parent) {
+        if (n == child) return 1;
+    }
+    return 0;
+}
+
+/* Sort key of a reply or a thread */
+typedef struct {
+    uint32_t parent;
+    uint32_t node;
+    int64_t date;
+} mail_thread_key;
+
+static inline int mail_thread_key_cmp(const void *a, const void *b) {
+    const mail_thread_key *x = a, *y = b;
+
+    if (x->parent != y->parent) return x->parent < y->parent ? -1 : 1;
+    if (x->date != y->date) return x->date < y->date ? -1 : 1;
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+/* Link the messages of b (sorted by path) into threads. Returns 0, or -1
+ * with errno set. */
+static inline int mail_thread_link(mail_thread_tree *t, const mail_thread_build *b) {
+    mail_thread_interner in = { b, NULL, b->count, b->count + b->count / 2 + 16, NULL, 0 };
+    uint32_t *renum = NULL, *kids = NULL, slots_count;
+    int64_t *date = NULL;
+    mail_thread_key *keys = NULL;
+    size_t nkeys = 0, kept;
+    int r = -1;
+
+    memset(t, 0, sizeof(*t));
+    in.nodes = malloc(in.cap * sizeof(*in.nodes));
+    in.slots = mail_thread_slots(in.cap, &slots_count);
+    if (!in.nodes || !in.slots) goto out;
+    in.mask = slots_count - 1;
+
+    /* Messages: the first with an ID owns it */
+    for (size_t i = 0; i < b->count; i++) {
+        const mail_thread_msg *m = &b->msgs[i];
+        mail_thread_node *n = &in.nodes[i];
+
+        n->msg = (uint32_t)i;
+        n->parent = n->child = n->next = MAIL_THREAD_NONE;
+        n->id_off = m->id_off;
+        n->id_len = m->id_len;
+        n->reserved = 0;
+        if (m->id_len) {
+            uint32_t *slot = mail_thread_slot(&in, b->pool + m->id_off, m->id_len);
+            if (*slot == MAIL_THREAD_NONE) *slot = (uint32_t)i;
+        }
+    }
+
+    /* Parents */
+    for (size_t i = 0; i < b->count; i++) {
+        const mail_thread_msg *m = &b->msgs[i];
+        const char *s = b->pool + m->refs_off, *end = s + m->refs_len, *id;
+        uint32_t prev = MAIL_THREAD_NONE;
+        size_t len;
+
+        while ((id = mail_thread_next_id(&s, end, &len)) != NULL) {
+            uint32_t n = mail_thread_intern(&in, (uint64_t)(id - b->pool), (uint32_t)len);
+            if (n == MAIL_THREAD_NONE) goto out;
+            if (n == i) break;      /* a message listing itself among its parents */
+            if (prev != MAIL_THREAD_NONE && in.nodes[n].parent == MAIL_THREAD_NONE && n != prev &&
+                !mail_thread_loops(in.nodes, n, prev)) {
+                in.nodes[n].parent = prev;
+                in.nodes[prev].reserved = 1;
+            }
+            prev = n;
+        }
+        if (prev == MAIL_THREAD_NONE || !mail_thread_loops(in.nodes, (uint32_t)i, prev)) {
+            in.nodes[i].parent = prev;
+            if (prev != MAIL_THREAD_NONE) in.nodes[prev].reserved = 1;
+        }
+    }
+    for (size_t i = 0; i < in.count; i++) in.nodes[i].reserved = 0;
+
+    /* Splice out missing messages: replies move up past missing parents
+     * to the nearest message, or to a missing message at the top */
+    renum = malloc(in.count * sizeof(*renum));
+    kids = calloc(in.count, sizeof(*kids));
+    if (!renum || !kids) goto out;
+    for (size_t i = 0; i < in.count; i++) {
+        uint32_t p = in.nodes[i].parent;
+        while (p != MAIL_THREAD_NONE && in.nodes[p].msg == MAIL_THREAD_NONE && in.nodes[p].parent != MAIL_THREAD_NONE) {
+            p = in.nodes[p].parent;
+        }
+        in.nodes[i].parent = p;
+    }
+    for (size_t i = 0; i < b->count; i++) {
+        if (in.nodes[i].parent != MAIL_THREAD_NONE) kids[in.nodes[i].parent]++;
+    }
+    /* A missing top with one reply gives way to it, one with none goes */
+    for (size_t i = 0; i < b->count; i++) {
+        uint32_t p = in.nodes[i].parent;
+        if (p != MAIL_THREAD_NONE && in.nodes[p].msg == MAIL_THREAD_NONE && kids[p] < 2) in.nodes[i].parent = MAIL_THREAD_NONE;
+    }
+    kept = b->count;
+    for (size_t i = 0; i < in.count; i++) {
+        if (i < b->count) {
+            renum[i] = (uint32_t)i;
+        } else if (in.nodes[i].parent == MAIL_THREAD_NONE && kids[i] >= 2) {
+            renum[i] = (uint32_t)kept;
+            in.nodes[kept++] = in.nodes[i];
+        } else {
+            renum[i] = MAIL_THREAD_NONE;
+        }
+    }
+    for (size_t i = 0; i < kept; i++) {
+        if (in.nodes[i].parent != MAIL_THREAD_NONE) in.nodes[i].parent = renum[in.nodes[i].parent];
+    }
+
+    /* Dates: a missing top takes its earliest reply's */
+    date = malloc((kept ? kept : 1) * sizeof(*date));
+    keys = malloc((kept ? kept : 1) * sizeof(*keys));
+    if (!date || !keys) goto out;
+    for (size_t i = 0; i < kept; i++) date[i] = i < b->count ? b->msgs[i].date : INT64_MAX;
+    for (size_t i = 0; i < b->count; i++) {
+        uint32_t p = in.nodes[i].parent;
+        if (p >= b->count && p != MAIL_THREAD_NONE && date[i] < date[p]) date[p] = date[i];
+    }
+
+    /* Replies and threads in date order */
+    for (size_t i = 0; i < kept; i++) {
+        keys[nkeys].parent = in.nodes[i].parent;
+        keys[nkeys].node = (uint32_t)i;
+        keys[nkeys].date = date[i];
+        nkeys++;
+    }
+    qsort(keys, nkeys, sizeof(*keys), mail_thread_key_cmp);
+    for (size_t i = nkeys; i-- > 0; ) {
+        mail_thread_node *n = &in.nodes[keys[i].node];
+        if (keys[i].parent == MAIL_THREAD_NONE) {
+            t->nroots++;
+        } else {
+            n->next = in.nodes[keys[i].parent].child;
+            in.nodes[keys[i].parent].child = keys[i].node;
+        }
+    }
+    t->roots = malloc((t->nroots ? t->nroots : 1) * sizeof(*t->roots));
+    if (!t->roots) goto out;
+    for (size_t i = nkeys - t->nroots; i < nkeys; i++) t->roots[i - (nkeys - t->nroots)] = keys[i].node;
+
+    /* Lookup table over the IDs of the nodes kept */
+    t->buckets = mail_thread_slots(kept, &t->nbuckets);
+    if (!t->buckets) goto out;
+    for (uint32_t i = 0; i <= in.mask; i++) {
+        uint32_t n = in.slots[i] == MAIL_THREAD_NONE ? MAIL_THREAD_NONE : renum[in.slots[i]];
+        if (n == MAIL_THREAD_NONE) continue;
+        uint32_t j = (uint32_t)mail_thread_hash(b->pool + in.nodes[n].id_off, in.nodes[n].id_len) & (t->nbuckets - 1);
+        while (t->buckets[j] != MAIL_THREAD_NONE) j = (j + 1) & (t->nbuckets - 1);
+        t->buckets[j] = n;
+    }
+
+    t->nodes = in.nodes;
+    t->count = (uint32_t)kept;
+    in.nodes = NULL;
+    r = 0;
+
+out:
+    if (r == -1) {
+        mail_thread_tree_free(t);
+        errno = ENOMEM;
+    }
+    free(in.nodes);
+    free(in.slots);
+    free(renum);
+    free(kids);
+    free(date);
+    free(keys);
+    return r;
+}
+
+/* Write the index of b and t to a temporary file next to path and rename
+ * it over path. Returns 0, or -1 with errno set. */
+static inline int mail_thread_save(const mail_thread_build *b, const mail_thread_tree *t, const char *path) {
+    static const char zeros[8];
+    size_t path_len = strlen(path);
+    char *tmp = malloc(path_len + sizeof(".XXXXXX"));
+    mail_thread_head h;
+    struct iovec iov[8];
+    int fd = -1, saved;
+
+    if (!tmp) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(tmp, path, path_len);
+    memcpy(tmp + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAIL_THREAD_MAGIC, 8);
+    h.count = (uint32_t)b->count;
+    h.nodes = t->count;
+    h.roots = t->nroots;
+    h.buckets = t->nbuckets;
+    h.pool_len = b->pool_len;
+    iov[0] = (struct iovec){ &h, sizeof(h) };
+    iov[1] = (struct iovec){ b->msgs, b->count * sizeof(*b->msgs) };
+    iov[2] = (struct iovec){ t->nodes, (size_t)t->count * sizeof(*t->nodes) };
+    iov[3] = (struct iovec){ t->roots, (size_t)t->nroots * 4 };
+    iov[4] = (struct iovec){ (void *)zeros, mail_thread_pad8((size_t)t->nroots * 4) - (size_t)t->nroots * 4 };
+    iov[5] = (struct iovec){ t->buckets, (size_t)t->nbuckets * 4 };
+    iov[6] = (struct iovec){ (void *)zeros, mail_thread_pad8((size_t)t->nbuckets * 4) - (size_t)t->nbuckets * 4 };
+    iov[7] = (struct iovec){ b->pool, b->pool_len };
+
+    fd = mkstemp(tmp);
+    if (fd == -1) goto fail;
+    fchmod(fd, 0644);
+    for (int i = 0; i < 8; ) {
+        ssize_t w = writev(fd, iov + i, 8 - i);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            goto fail;
+        }
+        while (i < 8 && (size_t)w >= iov[i].iov_len) w -= (ssize_t)iov[i++].iov_len;
+        if (i < 8) {
+            iov[i].iov_base = (char *)iov[i].iov_base + w;
+            iov[i].iov_len -= (size_t)w;
+        }
+    }
+    if (close(fd) == -1) {
+        fd = -1;
+        goto fail;
+    }
+    fd = -1;
+    if (rename(tmp, path) == -1) goto fail;
+    free(tmp);
+    return 0;
+
+fail:
+    saved = errno;
+    if (fd != -1) close(fd);
+    unlink(tmp);
+    free(tmp);
+    errno = saved;
+    return -1;
+}
+
+#endif /* MAIL_THREAD_H */
@@ -0,0 +1,303 @@
+/*
+mail-tools - one long-lived process for scripts that cannot load the builtins
+With --coproc, reads one command per line on stdin and answers each on
+stdout with a length-prefixed result, for use with bash coproc:
+
+  header FILE           headers of FILE, as mailheader FILE
+  body FILE             body of FILE, as mailmessage FILE
+  clean FILE            FILE with headers removed, as mailheaderclean FILE
+  fields FILE LIST      the comma-separated LIST of fields, as mailheader -H
+
+Every answer is a line "STATUS LENGTH" followed by exactly LENGTH bytes:
+the result for status 0, an error message otherwise. Commands are answered
+in order, so a script can send many before reading any answer; answers are
+written out in batches whenever no further command is waiting.
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <poll.h>
+
+/* Include the shared removal list and message filter, -H field selection,
+ * header and body extraction and zero-copy I/O */
+#include "mailheaderclean_filter.h"
+#include "mail_select.h"
+#include "mail_extract.h"
+#include "mail_io.h"
+
+#define COPROC_LINE_MAX (64 * 1024)    /* longest command line */
+
+#define COPROC_OK 0
+#define COPROC_UNREADABLE 1            /* FILE could not be opened or read */
+#define COPROC_INVALID 22              /* unknown command, bad arguments */
+
+typedef struct coproc coproc;
+typedef void (*coproc_fn)(coproc *cp, const mail_input *in, mail_writer *out);
+
+struct coproc {
+    header_matcher removal;     /* compiled once, from the environment at start */
+    mail_select select;         /* fields of the last "fields" command */
+    char *select_csv;           /* its LIST, or NULL */
+    mail_writer out;            /* stdout */
+    mail_writer result;         /* MAIL_WRITER_MEMORY: each result, before its head */
+};
+
+/* Each command gives the same result as the tool it stands in for */
+static void run_header(coproc *cp, const mail_input *in, mail_writer *out) {
+    (void)cp;
+    mail_extract_headers(in, NULL, out);
+}
+
+static void run_fields(coproc *cp, const mail_input *in, mail_writer *out) {
+    mail_extract_headers(in, &cp->select, out);
+}
+
+static void run_body(coproc *cp, const mail_input *in, mail_writer *out) {
+    (void)cp;
+    mail_extract_body(in, out);
+}
+
+static void run_clean(coproc *cp, const mail_input *in, mail_writer *out) {
+    filter_message(&cp->removal, in, out, NULL);
+}
+
+/* Queue the "STATUS LENGTH" line of an answer */
+static void answer_head(coproc *cp, int status, unsigned long long len) {
+    char head[48];
+    int n = snprintf(head, sizeof(head), "%d %llu\n", status, len);
+
+    mail_write_copy(&cp->out, head, n);
+}
+
+/* Queue an error answer with a printf-style message */
+static void answer_error(coproc *cp, int status, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+static void answer_error(coproc *cp, int status, const char *fmt, ...) {
+    char msg[1024];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (n < 0) n = 0;
+    if ((size_t)n >= sizeof(msg)) n = sizeof(msg) - 1;
+    answer_head(cp, status, n);
+    mail_write_copy(&cp->out, msg, n);
+}
+
+/* Compile LIST for "fields", reusing the last one when it is the same */
+static int select_fields(coproc *cp, const char *csv) {
+    if (cp->select_csv && strcmp(cp->select_csv, csv) == 0) return 0;
+    if (cp->select_csv) {
+        mail_select_free(&cp->select);
+        free(cp->select_csv);
+        cp->select_csv = NULL;
+    }
+    if (mail_select_compile(&cp->select, csv) == -1) return -1;
+    cp->select_csv = strdup(csv);
+    if (!cp->select_csv) {
+        mail_select_free(&cp->select);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* Answer one command line (without its newline, NUL-terminated). The
+ * result is produced once into memory, which gives its length, and
+ * queued after the head. */
+static void answer(coproc *cp, char *line) {
+    static const struct {
+        const char *name;
+        coproc_fn fn;
+    } commands[] = {
+        { "header", run_header },
+        { "body",   run_body },
+        { "clean",  run_clean },
+        { "fields", run_fields },
+    };
+    coproc_fn fn = NULL;
+    char *file = strchr(line, ' ');
+    mail_input in;
+    int r;
+
+    if (file) *file++ = '\0';
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(line, commands[i].name) == 0) fn = commands[i].fn;
+    }
+    if (!fn) {
+        answer_error(cp, COPROC_INVALID, "unknown command '%s'", line);
+        return;
+    }
+    if (fn == run_fields && file) {
+        /* Field names have no spaces: LIST follows the last one */
+        char *csv = strrchr(file, ' ');
+        if (!csv || csv == file) {
+            answer_error(cp, COPROC_INVALID, "usage: fields FILE LIST");
+            return;
+        }
+        *csv++ = '\0';
+        if (select_fields(cp, csv) == -1) {
+            answer_error(cp, COPROC_INVALID, "%s: %s", csv,
+                         errno == EINVAL ? "no field names" : strerror(errno));
+            return;
+        }
+    }
+    if (!file || !*file) {
+        answer_error(cp, COPROC_INVALID, "usage: %s FILE%s", line, fn == run_fields ? " LIST" : "");
+        return;
+    }
+
+    if (mail_input_open(&in, file) == -1) {
+        answer_error(cp, COPROC_UNREADABLE, "%s: %s", file, strerror(errno));
+        return;
+    }
+    mail_writer_redirect(&cp->result, MAIL_WRITER_MEMORY);
+    cp->result.mem_len = 0;
+    fn(cp, &in, &cp->result);
+    r = mail_writer_flush(&cp->result);
+    mail_input_close(&in);
+    if (r == -1) {
+        answer_error(cp, COPROC_UNREADABLE, "%s: %s", file, strerror(errno));
+        return;
+    }
+
+    answer_head(cp, COPROC_OK, cp->result.mem_len);
+    mail_write_range(&cp->out, cp->result.mem, cp->result.mem_len);
+    /* The next result reuses the memory */
+    mail_writer_detach(&cp->out);
+}
+
+/* Read commands until end of input. Every complete line already read is
+ * answered before the next read, and the answers are written out only
+ * when no more input is waiting (read() may block) or the output buffer
+ * is full, so pipelined commands get batched answers.
+ * Returns 0, or -1 on a read or write error. */
+static int coproc_run(coproc *cp, const char *progname) {
+    char *buf = malloc(COPROC_LINE_MAX + 1);
+    size_t len = 0;
+    int skipping = 0, r = 0;
+
+    if (!buf) {
+        fprintf(stderr, "%s: %s\n", progname, strerror(ENOMEM));
+        return -1;
+    }
+    for (;;) {
+        char *p = buf, *nl;
+        ssize_t n;
+
+        while ((nl = memchr(p, '\n', len - (p - buf))) != NULL) {
+            *nl = '\0';
+            if (!skipping) answer(cp, p);
+            skipping = 0;
+            p = nl + 1;
+        }
+        len -= p - buf;
+        memmove(buf, p, len);
+        if (len == COPROC_LINE_MAX) {
+            if (!skipping) answer_error(cp, COPROC_INVALID, "command longer than %d bytes", COPROC_LINE_MAX);
+            skipping = 1;
+            len = 0;
+        }
+
+        /* More commands waiting: keep batching (the writer flushes by
+         * itself when its buffer fills) */
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if (poll(&pfd, 1, 0) != 1 && mail_writer_flush(&cp->out) == -1) {
+            fprintf(stderr, "%s: write error: %s\n", progname, strerror(errno));
+            r = -1;
+            break;
+        }
+        n = read(STDIN_FILENO, buf + len, COPROC_LINE_MAX - len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) {
+            fprintf(stderr, "%s: read error: %s\n", progname, strerror(errno));
+            r = -1;
+            break;
+        }
+        if (n == 0) {
+            /* A last command without its newline */
+            if (len > 0 && !skipping) {
+                buf[len] = '\0';
+                answer(cp, buf);
+                if (mail_writer_flush(&cp->out) == -1) r = -1;
+            }
+            break;
+        }
+        len += (size_t)n;
+    }
+    free(buf);
+    return r;
+}
+
+static void usage(const char *progname) {
+    printf("Usage: %s --coproc\n", progname);
+    printf("Answer mail tool commands read from stdin, one per line, for scripts\n");
+    printf("that cannot load the builtins (bash: coproc %s --coproc)\n", progname);
+    printf("\nCommands:\n");
+    printf("  header FILE       Headers of FILE (mailheader FILE)\n");
+    printf("  body FILE         Body of FILE (mailmessage FILE)\n");
+    printf("  clean FILE        FILE with headers removed (mailheaderclean FILE)\n");
+    printf("  fields FILE LIST  Comma-separated LIST of fields (mailheader -H LIST FILE)\n");
+    printf("\nEach answer is a line \"STATUS LENGTH\" and LENGTH bytes: the result if\n");
+    printf("STATUS is 0, else an error message (1: FILE unreadable, 22: bad command).\n");
+    printf("The removal list for clean is read from the environment at start.\n");
+    printf("\nOptions:\n");
+    printf("  -c, --coproc  Run the command loop\n");
+    printf("  -h, --help    Show this help message\n");    printf("\nExit status: 0 at the end of input, 1 on a read or write error,\n");
+    printf("2 on a usage error.\n");
+}
+
+int main(int argc, char *argv[]) {
+    coproc cp;
+    char **removal_list = NULL;
+    int removal_count, run = 0, opt, r;
+
+    static const struct option long_options[] = {
+        { "coproc", no_argument, NULL, 'c' },
+        { "help",   no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "ch", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            run = 1;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            return 2;
+        }
+    }
+    if (!run || optind != argc) {
+        fprintf(stderr, "%s: usage: %s --coproc\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    memset(&cp, 0, sizeof(cp));
+    removal_count = build_removal_list(&removal_list);
+    header_matcher_compile(&cp.removal, removal_list, removal_count);
+    mail_writer_init(&cp.out, STDOUT_FILENO);
+    mail_writer_init(&cp.result, MAIL_WRITER_MEMORY);
+
+    r = coproc_run(&cp, argv[0]);
+
+    mail_writer_free(&cp.out);
+    mail_writer_free(&cp.result);
+    if (cp.select_csv) {
+        mail_select_free(&cp.select);
+        free(cp.select_csv);
+    }
+    header_matcher_free(&cp.removal);
+    for (int i = 0; i < removal_count; i++) free(removal_list[i]);
+    free(removal_list);
+    return r == -1 ? 1 : 0;
+}
@@ -0,0 +1,354 @@
+/*
+mail_walk.h - Parallel walk over FILE and DIR arguments
+
+The walk is a stack of pending paths shared by all workers: a worker that
+pops a directory lists it and pushes its entries (in reverse, so a single
+worker visits them in directory order, as find does); a worker that pops
+a file hands it to the tool's file() callback with that worker's state.
+Symbolic links found in directories are not followed (find -type f), and
+directories whose name is in the exclusion list are pruned, DIR arguments
+included.
+
+Each tool collects a file's output in its worker state and writes it with
+mail_walk_write(), so the lines of different files never interleave.
+
+Shared by the mailgetaddresses and mailgrep standalone binaries (the
+builtins do not start threads); link with -pthread.
+*/
+
+#ifndef MAIL_WALK_H
+#define MAIL_WALK_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+/* A path waiting to be processed */
+typedef struct {
+    char *path;
+    int is_dir;
+    int is_arg;         /* named on the command line: report problems */
+} mail_walk_item;
+
+typedef struct mail_walk mail_walk;
+
+struct mail_walk {
+    const char *progname;
+    char **exclude;
+    int exclude_count;
+    int quiet;          /* do not report skipped files */
+
+    /* Process one file with the calling worker's state */
+    void (*file)(mail_walk *walk, void *worker, const mail_walk_item *item);
+    /* The worker has nothing left to do (write out what it holds) */
+    void (*done)(mail_walk *walk, void *worker);
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    mail_walk_item *stack;
+    size_t len, cap;
+    size_t busy;        /* items being processed */
+    size_t files;       /* files read, counted by the tool */
+    int errors;
+    int stop;           /* no more items are handed out */
+
+    pthread_mutex_t out_lock;
+};
+
+static inline void mail_walk_init(mail_walk *walk, const char *progname) {
+    memset(walk, 0, sizeof(*walk));
+    walk->progname = progname;
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_mutex_init(&walk->out_lock, NULL);
+    pthread_cond_init(&walk->wake, NULL);
+}
+
+static inline void mail_walk_free(mail_walk *walk) {
+    for (int i = 0; i < walk->exclude_count; i++) free(walk->exclude[i]);
+    free(walk->exclude);
+    for (size_t i = 0; i < walk->len; i++) free(walk->stack[i].path);
+    free(walk->stack);
+    pthread_mutex_destroy(&walk->lock);
+    pthread_mutex_destroy(&walk->out_lock);
+    pthread_cond_destroy(&walk->wake);
+}
+
+/* Report a skipped path, unless quiet */
+static inline void mail_walk_warn(mail_walk *walk, const char *fmt, const char *path) {
+    if (walk->quiet) return;
+    pthread_mutex_lock(&walk->out_lock);
+    fprintf(stderr, "%s: ", walk->progname);
+    fprintf(stderr, fmt, path);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&walk->out_lock);
+}
+
+static inline void mail_walk_error(mail_walk *walk) {
+    pthread_mutex_lock(&walk->lock);
+    walk->errors++;
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/* Count a file that could be read */
+static inline void mail_walk_counted(mail_walk *walk) {
+    pthread_mutex_lock(&walk->lock);
+    walk->files++;
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/* Hand out no more items; the workers return once their current one is
+ * done */
+static inline void mail_walk_stop(mail_walk *walk) {
+    pthread_mutex_lock(&walk->lock);
+    walk->stop = 1;
+    pthread_cond_broadcast(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/* Write p[0, n) to stdout in one piece with respect to the other workers */
+static inline void mail_walk_write(mail_walk *walk, const char *p, size_t n) {
+    pthread_mutex_lock(&walk->out_lock);
+    while (n > 0) {
+        ssize_t r = write(STDOUT_FILENO, p, n);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: write error: %s\n", walk->progname, strerror(errno));
+            mail_walk_error(walk);
+            break;
+        }
+        p += r;
+        n -= (size_t)r;
+    }
+    pthread_mutex_unlock(&walk->out_lock);
+}
+
+/* Add the comma-separated directory names of csv to the exclusion list.
+ * Returns 0, or -1 if memory runs out. */
+static inline int mail_walk_exclude(mail_walk *walk, const char *csv) {
+    const char *p = csv;
+
+    while (*p) {
+        const char *start = p;
+        while (*p && *p != ',') p++;
+        if (p > start) {
+            char **list = realloc(walk->exclude, (walk->exclude_count + 1) * sizeof(char *));
+            if (!list) return -1;
+            walk->exclude = list;
+            walk->exclude[walk->exclude_count] = strndup(start, p - start);
+            if (!walk->exclude[walk->exclude_count]) return -1;
+            walk->exclude_count++;
+        }
+        if (*p == ',') p++;
+    }
+    return 0;
+}
+
+static inline int mail_walk_excluded(const mail_walk *walk, const char *name) {
+    for (int i = 0; i < walk->exclude_count; i++) {
+        if (fnmatch(walk->exclude[i], name, 0) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Push items (already in pop order, last popped first) */
+static inline void mail_walk_push(mail_walk *walk, mail_walk_item *items, size_t n) {
+    if (n == 0) return;
+    pthread_mutex_lock(&walk->lock);
+    if (walk->len + n > walk->cap) {
+        size_t cap = walk->cap ? walk->cap : 256;
+        while (cap < walk->len + n) cap *= 2;
+        mail_walk_item *stack = realloc(walk->stack, cap * sizeof(mail_walk_item));
+        if (!stack) {
+            walk->errors++;
+            pthread_mutex_unlock(&walk->lock);
+            fprintf(stderr, "%s: %s\n", walk->progname, strerror(ENOMEM));
+            for (size_t i = 0; i < n; i++) free(items[i].path);
+            return;
+        }
+        walk->stack = stack;
+        walk->cap = cap;
+    }
+    memcpy(walk->stack + walk->len, items, n * sizeof(mail_walk_item));
+    walk->len += n;
+    pthread_cond_broadcast(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/* Push items given in visiting order */
+static inline void mail_walk_push_reversed(mail_walk *walk, mail_walk_item *items, size_t n) {
+    for (size_t i = 0; i < n / 2; i++) {
+        mail_walk_item t = items[i];
+        items[i] = items[n - 1 - i];
+        items[n - 1 - i] = t;
+    }
+    mail_walk_push(walk, items, n);
+}
+
+/* Next item, waiting while other workers may still push more. Returns 0
+ * when the walk is complete or stopped. */
+static inline int mail_walk_take(mail_walk *walk, mail_walk_item *item) {
+    pthread_mutex_lock(&walk->lock);
+    while (walk->len == 0 && walk->busy > 0 && !walk->stop) pthread_cond_wait(&walk->wake, &walk->lock);
+    if (walk->len == 0 || walk->stop) {
+        pthread_cond_broadcast(&walk->wake);
+        pthread_mutex_unlock(&walk->lock);
+        return 0;
+    }
+    *item = walk->stack[--walk->len];
+    walk->busy++;
+    pthread_mutex_unlock(&walk->lock);
+    return 1;
+}
+
+static inline void mail_walk_item_done(mail_walk *walk) {
+    pthread_mutex_lock(&walk->lock);
+    if (--walk->busy == 0 && walk->len == 0) pthread_cond_broadcast(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/* List a directory and push its regular files and subdirectories */
+static inline void mail_walk_dir(mail_walk *walk, const char *path) {
+    mail_walk_item *items = NULL;
+    size_t n = 0, cap = 0, path_len = strlen(path);
+    struct dirent *e;
+    DIR *dir = opendir(path);
+
+    if (!dir) {
+        mail_walk_warn(walk, "cannot open directory %s", path);
+        return;
+    }
+    while ((e = readdir(dir)) != NULL) {
+        const char *name = e->d_name;
+        int is_dir;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        if (mail_walk_excluded(walk, name)) continue;
+
+        size_t name_len = strlen(name);
+        char *child = malloc(path_len + name_len + 2);
+        if (!child) break;
+        memcpy(child, path, path_len);
+        child[path_len] = '/';
+        memcpy(child + path_len + 1, name, name_len + 1);
+
+        if (e->d_type == DT_DIR || e->d_type == DT_REG) {
+            is_dir = e->d_type == DT_DIR;
+        } else {
+            struct stat st;
+            if (e->d_type != DT_UNKNOWN || lstat(child, &st) == -1 ||
+                !(S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+                free(child);
+                continue;
+            }
+            is_dir = S_ISDIR(st.st_mode);
+        }
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            mail_walk_item *grown = realloc(items, cap * sizeof(mail_walk_item));
+            if (!grown) {
+                free(child);
+                break;
+            }
+            items = grown;
+        }
+        items[n].path = child;
+        items[n].is_dir = is_dir;
+        items[n].is_arg = 0;
+        n++;
+    }
+    closedir(dir);
+
+    mail_walk_push_reversed(walk, items, n);
+    free(items);
+}
+
+/* Queue the command-line paths, in order. A path that is neither a
+ * regular file nor a directory is reported and skipped. Returns the number
+ * of paths skipped that way. */
+static inline int mail_walk_args(mail_walk *walk, char *const *paths, int count) {
+    mail_walk_item *items = calloc((size_t)count, sizeof(mail_walk_item));
+    size_t n = 0;
+    int skipped = 0;
+
+    for (int i = 0; items && i < count; i++) {
+        const char *path = paths[i];
+        const char *base = strrchr(path, '/');
+        struct stat st;
+
+        if (stat(path, &st) == -1 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+            mail_walk_warn(walk, "Not a file or directory, skipping: %s", path);
+            skipped++;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode) && mail_walk_excluded(walk, base && base[1] ? base + 1 : path)) continue;
+        items[n].path = strdup(path);
+        items[n].is_dir = S_ISDIR(st.st_mode);
+        items[n].is_arg = 1;
+        if (items[n].path) n++;
+    }
+    if (items) {
+        mail_walk_push_reversed(walk, items, n);
+        free(items);
+    }
+    return skipped;
+}
+
+typedef struct {
+    mail_walk *walk;
+    void *worker;
+    pthread_t thread;
+} mail_walk_thread;
+
+static inline void *mail_walk_worker(void *arg) {
+    mail_walk_thread *t = arg;
+    mail_walk *walk = t->walk;
+    mail_walk_item item;
+
+    while (mail_walk_take(walk, &item)) {
+        if (item.is_dir) {
+            mail_walk_dir(walk, item.path);
+        } else {
+            walk->file(walk, t->worker, &item);
+        }
+        free(item.path);
+        mail_walk_item_done(walk);
+    }
+    if (walk->done) walk->done(walk, t->worker);
+    return NULL;
+}
+
+/* Process the whole stack with jobs workers (the calling thread is one);
+ * workers is an array of jobs states of size bytes each */
+static inline void mail_walk_run(mail_walk *walk, int jobs, void *workers, size_t size) {
+    mail_walk_thread *threads = calloc((size_t)jobs, sizeof(mail_walk_thread));
+    int started = 1;
+
+    if (!threads) {
+        fprintf(stderr, "%s: %s\n", walk->progname, strerror(ENOMEM));
+        walk->errors++;
+        return;
+    }
+    for (int i = 0; i < jobs; i++) {
+        threads[i].walk = walk;
+        threads[i].worker = (char *)workers + (size_t)i * size;
+    }
+    for (; started < jobs; started++) {
+        int err = pthread_create(&threads[started].thread, NULL, mail_walk_worker, &threads[started]);
+        if (err != 0) {
+            fprintf(stderr, "%s: cannot start workers: %s\n", walk->progname, strerror(err));
+            break;
+        }
+    }
+    mail_walk_worker(&threads[0]);
+    for (int i = 1; i < started; i++) pthread_join(threads[i].thread, NULL);
+    free(threads);
+}
+
+#endif /* MAIL_WALK_H */
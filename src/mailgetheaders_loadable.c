@@ -0,0 +1,382 @@
+/*
+ * mailgetheaders - Bash loadable builtin
+ * Loads the headers of an email message into an associative array
+ */
+
+/*
+   This file is part of the mailgetheaders bash loadable builtin.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "builtins.h"
+#include "shell.h"
+
+/* External function declarations */
+extern char **make_builtin_argv();
+extern void builtin_usage();
+extern void builtin_error();
+extern void sh_invalidid();
+
+/* Include shared zero-copy input and range output */
+#include "mail_io.h"
+
+/* What to keep when a header name appears more than once */
+typedef enum {
+    DUP_FIRST,
+    DUP_LAST,
+    DUP_CONCAT      /* values joined with a newline, in message order */
+} dup_policy;
+
+typedef struct {
+    char *name;
+    char *value;
+    size_t value_len;
+} header_entry;
+
+/* Headers in order of first appearance */
+typedef struct {
+    header_entry *items;
+    size_t count, cap;
+} header_table;
+
+static void table_free(header_table *t) {
+    for (size_t i = 0; i < t->count; i++) {
+        free(t->items[i].name);
+        free(t->items[i].value);
+    }
+    free(t->items);
+    memset(t, 0, sizeof(*t));
+}
+
+static header_entry *table_find(header_table *t, const char *name, size_t len) {
+    for (size_t i = 0; i < t->count; i++) {
+        if (strncmp(t->items[i].name, name, len) == 0 && t->items[i].name[len] == '\0') {
+            return &t->items[i];
+        }
+    }
+    return NULL;
+}
+
+/* Add one field; value is malloc'd and owned by the table from here on.
+ * Returns 0, or -1 if memory runs out. */
+static int table_add(header_table *t, dup_policy policy, const char *name, size_t name_len,
+                     char *value, size_t value_len) {
+    header_entry *e = table_find(t, name, name_len);
+
+    if (e) {
+        if (policy == DUP_FIRST) {
+            free(value);
+        } else if (policy == DUP_LAST) {
+            free(e->value);
+            e->value = value;
+            e->value_len = value_len;
+        } else {
+            char *joined = realloc(e->value, e->value_len + 1 + value_len + 1);
+            if (!joined) {
+                free(value);
+                return -1;
+            }
+            joined[e->value_len] = '\n';
+            memcpy(joined + e->value_len + 1, value, value_len + 1);
+            e->value = joined;
+            e->value_len += 1 + value_len;
+            free(value);
+        }
+        return 0;
+    }
+
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 64;
+        header_entry *items = realloc(t->items, cap * sizeof(*items));
+        if (!items) {
+            free(value);
+            return -1;
+        }
+        t->items = items;
+        t->cap = cap;
+    }
+    e = &t->items[t->count];
+    e->name = strndup(name, name_len);
+    if (!e->name) {
+        free(value);
+        return -1;
+    }
+    e->value = value;
+    e->value_len = value_len;
+    t->count++;
+    return 0;
+}
+
+/* Parse the header block at [p, end): continuation lines joined, CRs
+ * removed and tabs folded to spaces, as mailheader prints them; the
+ * value starts after the colon and surrounding whitespace is trimmed.
+ * A leading mbox "From " line and lines without a field name are skipped. */
+static int load_headers(header_table *t, dup_policy policy, const char *p, const char *end) {
+    if (end - p >= 5 && memcmp(p, "From ", 5) == 0) {
+        p = mail_line_end(p, end);
+    }
+
+    while (p < end && !mail_line_is_blank(p, end)) {
+        const char *field_end = mail_line_end(p, end);
+        const char *colon;
+        char *value, *d;
+        size_t len;
+
+        QUIT;  /* Check for signals */
+
+        while (field_end < end && mail_line_is_continuation(field_end, end)) {
+            field_end = mail_line_end(field_end, end);
+        }
+
+        colon = memchr(p, ':', field_end - p);
+        for (const char *q = p; colon && q < colon; q++) {
+            if (isspace((unsigned char)*q)) colon = NULL;
+        }
+        if (!colon || colon == p) {
+            p = field_end;
+            continue;
+        }
+
+        /* Copy the value line by line, dropping the newlines */
+        value = malloc(field_end - colon);
+        if (!value) return -1;
+        d = value;
+        for (const char *s = colon + 1; s < field_end; ) {
+            const char *eol = mail_line_end(s, field_end);
+            size_t n = eol - s;
+            if (n > 0 && s[n - 1] == '\n') n--;
+            d += mail_fold_copy(d, s, n);
+            s = eol;
+        }
+
+        /* Trim the space after the colon and trailing whitespace */
+        len = d - value;
+        size_t skip = 0;
+        while (skip < len && value[skip] == ' ') skip++;
+        while (len > skip && isspace((unsigned char)value[len - 1])) len--;
+        memmove(value, value + skip, len - skip);
+        len -= skip;
+        value[len] = '\0';
+
+        if (table_add(t, policy, p, colon - p, value, len) == -1) return -1;
+        p = field_end;
+    }
+    return 0;
+}
+
+/* Bind every entry, then file, into the associative array called name.
+ * The array is emptied first; a local declared by the caller is used. */
+static int bind_headers(char *name, const header_table *t, char *file) {
+    SHELL_VAR *var;
+
+    if (legal_identifier(name) == 0) {
+        sh_invalidid(name);
+        return EXECUTION_FAILURE;
+    }
+    /* 1: fail on readonly, 2: associative (reports its own errors) */
+    var = find_or_make_array_variable(name, 1 | 2);
+    if (var == 0) {
+        return EXECUTION_FAILURE;
+    }
+    assoc_flush(assoc_cell(var));
+
+    for (size_t i = 0; i < t->count; i++) {
+        if (strcmp(t->items[i].name, "file") == 0) continue;   /* bound below */
+        if (bind_assoc_variable(var, name, savestring(t->items[i].name), t->items[i].value, 0) == 0) {
+            return EXECUTION_FAILURE;
+        }
+    }
+    if (bind_assoc_variable(var, name, savestring("file"), file, 0) == 0) {
+        return EXECUTION_FAILURE;
+    }
+    return EXECUTION_SUCCESS;
+}
+
+/* Write s inside double quotes, escaping what the shell expands there */
+static void write_quoted(mail_writer *out, const char *s) {
+    const char *run = s;
+
+    mail_write_copy(out, "\"", 1);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\' || *s == '$' || *s == '`') {
+            mail_write_copy(out, run, s - run);
+            mail_write_copy(out, "\\", 1);
+            run = s;
+        }
+    }
+    mail_write_copy(out, run, s - run);
+    mail_write_copy(out, "\"", 1);
+}
+
+static void write_key(mail_writer *out, const char *key) {
+    const char *s;
+
+    for (s = key; *s; s++) {
+        if (!isalnum((unsigned char)*s) && *s != '-' && *s != '_' && *s != '.') break;
+    }
+    mail_write_copy(out, "[", 1);
+    if (*s) {
+        write_quoted(out, key);
+    } else {
+        mail_write_copy(out, key, s - key);
+    }
+    mail_write_copy(out, "]=", 2);
+}
+
+/* Without -A: print a declaration for eval, as the mailgetheaders script does */
+static int print_headers(const header_table *t, const char *file) {
+    mail_writer out;
+    int r;
+
+    /* Output goes straight to the descriptor behind the stream */
+    fflush(stdout);
+    mail_writer_init(&out, fileno(stdout));
+
+    mail_write_copy(&out, "declare -A Headers=(", 20);
+    for (size_t i = 0; i < t->count; i++) {
+        if (strcmp(t->items[i].name, "file") == 0) continue;   /* replaced below */
+        write_key(&out, t->items[i].name);
+        write_quoted(&out, t->items[i].value);
+        mail_write_copy(&out, " ", 1);
+    }
+    write_key(&out, "file");
+    write_quoted(&out, file);
+    mail_write_line(&out, " )");
+
+    r = mail_writer_flush(&out);
+    mail_writer_free(&out);
+    if (r == -1) {
+        builtin_error("write error: %s", strerror(errno));
+        return EXECUTION_FAILURE;
+    }
+    return EXECUTION_SUCCESS;
+}
+
+/* Bash builtin entry point */
+int
+mailgetheaders_builtin(WORD_LIST *list)
+{
+    char **v;
+    int c, i, r;
+    char *array = NULL;
+    char *file;
+    dup_policy policy = DUP_LAST;
+    header_table table;
+    mail_input in;
+
+    /* Convert WORD_LIST to argc/argv */
+    v = make_builtin_argv(list, &c);
+
+    /* Options: -A ARRAY, -d first|last|concat */
+    for (i = 1; i < c && v[i][0] == '-' && v[i][1] != '\0'; i++) {
+        if (strcmp(v[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if ((strcmp(v[i], "-A") != 0 && strcmp(v[i], "-d") != 0) || i + 1 >= c) {
+            builtin_usage();
+            free(v);
+            return EX_USAGE;
+        }
+        if (v[i][1] == 'A') {
+            array = v[++i];
+        } else if (strcmp(v[++i], "first") == 0) {
+            policy = DUP_FIRST;
+        } else if (strcmp(v[i], "last") == 0) {
+            policy = DUP_LAST;
+        } else if (strcmp(v[i], "concat") == 0) {
+            policy = DUP_CONCAT;
+        } else {
+            builtin_error("%s: invalid duplicate policy (first, last or concat)", v[i]);
+            free(v);
+            return EX_USAGE;
+        }
+    }
+
+    if (c - i != 1) {
+        builtin_usage();
+        free(v);
+        return EX_USAGE;
+    }
+
+    QUIT;  /* Check for signals */
+
+    if (mail_input_open(&in, v[i]) == -1) {
+        builtin_error("%s: cannot open: %s", v[i], strerror(errno));
+        free(v);
+        return EXECUTION_FAILURE;
+    }
+
+    memset(&table, 0, sizeof(table));
+    r = load_headers(&table, policy, in.data, in.data + in.len);
+    mail_input_close(&in);
+
+    /* Same as the script: Headers[file] is the resolved path */
+    file = realpath(v[i], NULL);
+    if (r == -1 || !file) {
+        builtin_error("%s: %s", v[i], strerror(r == -1 ? ENOMEM : errno));
+        r = EXECUTION_FAILURE;
+    } else if (array) {
+        r = bind_headers(array, &table, file);
+    } else {
+        r = print_headers(&table, file);
+    }
+
+    free(file);
+    table_free(&table);
+    free(v);
+    return r;
+}
+
+/* Documentation strings */
+char *mailgetheaders_doc[] = {
+    "Load email headers into an associative array.",
+    " ",
+    "Parse the header block of FILE and store each header in the",
+    "associative array ARRAY, keyed by header name, with continuation",
+    "lines joined. ARRAY is emptied first; a local array declared by the",
+    "calling function is used. The key 'file' holds the resolved path of",
+    "FILE.",
+    " ",
+    "Without -A, print a 'declare -A Headers=(...)' statement for eval,",
+    "like the mailgetheaders script.",
+    " ",
+    "Options:",
+    "  -A ARRAY   Store the headers in ARRAY",
+    "  -d POLICY  Header appearing more than once: first, last (default),",
+    "             or concat (values joined with a newline)",
+    " ",
+    "Exit Status:",
+    "Returns success unless FILE cannot be read or ARRAY cannot be assigned.",
+    (char *)NULL
+};
+
+/* Builtin metadata structure */
+struct builtin mailgetheaders_struct = {
+    "mailgetheaders",           /* builtin name */
+    mailgetheaders_builtin,     /* function implementing builtin */
+    BUILTIN_ENABLED,            /* initial flags for builtin */
+    mailgetheaders_doc,         /* array of long documentation strings */
+    "mailgetheaders [-A ARRAY] [-d first|last|concat] FILE", /* usage synopsis */
+    0                           /* reserved for internal use */
+};
@@ -0,0 +1,525 @@
+/*
+mailgrep - search email headers
+Matches regular expressions or literal strings against the unfolded header
+lines (or selected field values) of each message, reading no further than
+the blank line, walking directories with optional worker threads
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <regex.h>
+
+/* Include shared line helpers and CR/TAB folding, the -H field selection
+ * and the parallel directory walk */
+#include "mail_io.h"
+#include "mail_select.h"
+#include "mail_walk.h"
+
+#define GREP_FLUSH_SIZE (64 * 1024)
+#define GREP_LITERAL_MIN 3          /* shorter required literals filter nothing */
+#define GREP_LITERAL_MAX 256
+
+/* Growable byte buffer */
+typedef struct {
+    char *p;
+    size_t len, cap;
+} grep_buf;
+
+static int grep_buf_reserve(grep_buf *b, size_t n) {
+    if (b->len + n <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + n) cap *= 2;
+    char *p = realloc(b->p, cap);
+    if (!p) return -1;
+    b->p = p;
+    b->cap = cap;
+    return 0;
+}
+
+/* One -e PATTERN: compiled, and the literal every match must contain */
+typedef struct {
+    const char *text;
+    regex_t re;
+    char literal[GREP_LITERAL_MAX + 1];
+    size_t literal_len;
+} grep_pattern;
+
+/* Run-wide, read-only once the workers start */
+typedef struct {
+    grep_pattern *patterns;
+    int count;
+    int fixed;                  /* -F */
+    int icase;                  /* -i */
+    int list;                   /* -l */
+    int quiet;                  /* -q */
+    int prefilter;              /* every pattern has a literal */
+    const char *fields;         /* -H LIST, or NULL for whole lines */
+} grep_opts;
+
+/* Per-worker state. Each file's lines are collected in out and written
+ * with its neighbours in one write (mail_walk.h). */
+typedef struct {
+    const grep_opts *opts;
+    mail_select sel;            /* its own copy: seen flags are per message */
+    grep_buf head;              /* header block being searched */
+    grep_buf line;              /* unfolded header line */
+    grep_buf out;
+    int matched;
+} grep_worker;
+
+/* Literals ---------------------------------------------------------------- */
+
+/* The longest run of literal characters that every match of the extended
+ * regular expression re must contain, into buf. Runs stop at anything
+ * that is not a plain character, at white space (folding may turn it into
+ * a line break and indentation in the file) and at a quantified
+ * character, which is dropped; groups are skipped. An alternation at any
+ * level means there is no such run. Returns its length, or 0. */
+static size_t grep_required_literal(const char *re, char *buf) {
+    char run[GREP_LITERAL_MAX];
+    size_t len = 0, best = 0;
+    int depth = 0;
+
+#define END_RUN() do { if (len > best) { best = len; memcpy(buf, run, len); } len = 0; } while (0)
+
+    for (const char *p = re; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+
+        switch (c) {
+        case '|':
+            return 0;
+        case '[':
+            /* A bracket expression; ']' first in it is literal */
+            END_RUN();
+            p++;
+            if (*p == '^') p++;
+            if (*p == ']') p++;
+            while (*p && *p != ']') {
+                if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+                    char close = p[1];
+                    for (p += 2; *p && !(*p == close && p[1] == ']'); p++) {}
+                    if (*p) p++;
+                }
+                if (*p) p++;
+            }
+            if (!*p) p--;
+            continue;
+        case '(':
+            depth++;
+            END_RUN();
+            continue;
+        case ')':
+            if (depth > 0) depth--;
+            END_RUN();
+            continue;
+        case '*': case '?': case '{':
+            /* The character before is optional */
+            if (len > 0) len--;
+            END_RUN();
+            if (c == '{') {
+                while (p[1] && p[1] != '}') p++;
+            }
+            continue;
+        case '+':
+            END_RUN();
+            continue;
+        case '.': case '^': case '$':
+            END_RUN();
+            continue;
+        case '\\':
+            /* An escaped special character is literal; other escapes
+             * (\w, \b, back-references) are not */
+            if (!p[1]) {
+                END_RUN();
+                continue;
+            }
+            p++;
+            c = (unsigned char)*p;
+            if (!strchr(".[]()*+?{}|^$\\/-", c)) {
+                END_RUN();
+                continue;
+            }
+            break;
+        }
+        if (depth > 0 || isspace(c) || c < 0x20) {
+            END_RUN();
+            continue;
+        }
+        /* A quantifier after this character is handled when it is read */
+        if (len == sizeof(run)) END_RUN();
+        run[len++] = (char)c;
+    }
+    END_RUN();
+#undef END_RUN
+    return best;
+}
+
+/* The longest run without white space of a fixed string, into buf */
+static size_t grep_fixed_literal(const char *s, char *buf) {
+    size_t best = 0;
+
+    while (*s) {
+        size_t n = 0;
+        while (s[n] && !isspace((unsigned char)s[n]) && (unsigned char)s[n] >= 0x20) n++;
+        if (n > best) {
+            best = n < GREP_LITERAL_MAX ? n : GREP_LITERAL_MAX;
+            memcpy(buf, s, best);
+        }
+        s += n;
+        if (*s) s++;
+    }
+    return best;
+}
+
+/* First occurrence of needle[0, m) in hay[0, n), ignoring ASCII case:
+ * memchr() for either case of the first byte, then a comparison */
+static const char *grep_find_icase(const char *hay, size_t n, const char *needle, size_t m) {
+    const char *end = hay + n, *p = hay;
+    int lo = tolower((unsigned char)needle[0]), up = toupper((unsigned char)needle[0]);
+
+    if (m == 0) return hay;
+    while ((size_t)(end - p) >= m) {
+        size_t span = (size_t)(end - p) - m + 1;
+        const char *a = memchr(p, lo, span);
+        const char *b = lo != up ? memchr(p, up, a ? (size_t)(a - p) : span) : NULL;
+        const char *q = b ? b : a;
+
+        if (!q) return NULL;
+        if (strncasecmp(q + 1, needle + 1, m - 1) == 0) {
+            /* strncasecmp() stops at a NUL in both; make sure none cut it short */
+            if (!memchr(q, '\0', m)) return q;
+        }
+        p = q + 1;
+    }
+    return NULL;
+}
+
+static const char *grep_find(const grep_opts *o, const char *hay, size_t n, const char *needle, size_t m) {
+    return o->icase ? grep_find_icase(hay, n, needle, m) : memmem(hay, n, needle, m);
+}
+
+/* Whether the header block can contain a match at all */
+static int grep_prefilter(const grep_opts *o, const char *p, size_t n) {
+    if (!o->prefilter) return 1;
+    for (int i = 0; i < o->count; i++) {
+        const grep_pattern *pat = &o->patterns[i];
+        if (grep_find(o, p, n, pat->literal, pat->literal_len)) return 1;
+    }
+    return 0;
+}
+
+/* Matching ---------------------------------------------------------------- */
+
+/* Whether text (NUL-terminated, n bytes) matches one of the patterns */
+static int grep_match(const grep_opts *o, const char *text, size_t n) {
+    for (int i = 0; i < o->count; i++) {
+        const grep_pattern *pat = &o->patterns[i];
+        if (o->fixed ? grep_find(o, text, n, pat->text, strlen(pat->text)) != NULL
+                     : regexec(&pat->re, text, 0, NULL, 0) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Search the header block [p, end) of path. Returns the matching lines. */
+static int grep_block(grep_worker *w, const char *path, const char *p, const char *end) {
+    const grep_opts *o = w->opts;
+    int matches = 0;
+
+    if (o->fields) mail_select_reset(&w->sel);
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+        const char *q = eol;
+
+        while (q < end && mail_line_is_continuation(q, end)) q = mail_line_end(q, end);
+        if (o->fields && !mail_line_is_continuation(p, eol)) {
+            if (mail_select_done(&w->sel)) break;
+            if (!mail_select_line(&w->sel, p, eol - p)) {
+                p = q;
+                continue;
+            }
+        } else if (o->fields) {
+            /* Continuation lines before any field */
+            p = q;
+            continue;
+        }
+
+        /* Unfold [p, q) as mailheader prints it: newlines before
+         * continuations dropped, CRs removed, tabs folded */
+        grep_buf *l = &w->line;
+        l->len = 0;
+        if (grep_buf_reserve(l, (size_t)(q - p) + 1) == -1) return -1;
+        for (const char *s = p; s < q; ) {
+            const char *e = mail_line_end(s, q);
+            size_t n = (size_t)(e - s);
+            if (n && s[n - 1] == '\n') n--;
+            l->len += mail_fold_copy(l->p + l->len, s, n);
+            s = e;
+        }
+        l->p[l->len] = '\0';
+
+        const char *text = l->p;
+        if (o->fields) {
+            /* The value: after the colon and the white space that follows */
+            text = memchr(l->p, ':', l->len);
+            for (text++; *text == ' '; text++) {}
+        }
+        if (grep_match(o, text, l->len - (size_t)(text - l->p))) {
+            matches++;
+            if (o->list || o->quiet) break;
+            size_t plen = strlen(path);
+            if (grep_buf_reserve(&w->out, plen + l->len + 2) == -1) return -1;
+            memcpy(w->out.p + w->out.len, path, plen);
+            w->out.p[w->out.len + plen] = ':';
+            memcpy(w->out.p + w->out.len + plen + 1, l->p, l->len);
+            w->out.p[w->out.len + plen + 1 + l->len] = '\n';
+            w->out.len += plen + l->len + 2;
+        }
+        p = q;
+    }
+    return matches;
+}
+
+/* Write the worker's collected output to stdout */
+static void worker_flush(mail_walk *walk, void *arg) {
+    grep_worker *w = arg;
+
+    mail_walk_write(walk, w->out.p, w->out.len);
+    w->out.len = 0;
+}
+
+/* Search one message */
+static void grep_file(mail_walk *walk, void *arg, const mail_walk_item *item) {
+    grep_worker *w = arg;
+    const grep_opts *o = w->opts;
+    int stdin_fd = strcmp(item->path, "-") == 0;
+    const char *name = stdin_fd ? "(standard input)" : item->path;
+    int fd = stdin_fd ? STDIN_FILENO : open(item->path, O_RDONLY | O_CLOEXEC);
+    ssize_t len;
+    int r = 0;
+
+    if (fd == -1) {
+        mail_walk_warn(walk, "%s: cannot open", name);
+        mail_walk_error(walk);
+        return;
+    }
+    len = mail_read_header(fd, &w->head.p, &w->head.cap);
+    if (len == -1) {
+        int saved = errno;
+        pthread_mutex_lock(&walk->out_lock);
+        if (!walk->quiet) fprintf(stderr, "%s: %s: %s\n", walk->progname, name, strerror(saved));
+        pthread_mutex_unlock(&walk->out_lock);
+        mail_walk_error(walk);
+    }
+    if (!stdin_fd) close(fd);
+    if (len == -1) return;
+    mail_walk_counted(walk);
+
+    if (grep_prefilter(o, w->head.p, (size_t)len)) {
+        r = grep_block(w, name, w->head.p, w->head.p + len);
+    }
+    if (r == -1) {
+        fprintf(stderr, "%s: %s: %s\n", walk->progname, name, strerror(ENOMEM));
+        mail_walk_error(walk);
+        return;
+    }
+    if (r > 0) {
+        w->matched = 1;
+        if (o->quiet) {
+            mail_walk_stop(walk);
+            return;
+        }
+        if (o->list) {
+            size_t n = strlen(name);
+            if (grep_buf_reserve(&w->out, n + 1) == -1) return;
+            memcpy(w->out.p + w->out.len, name, n);
+            w->out.p[w->out.len + n] = '\n';
+            w->out.len += n + 1;
+        }
+    }
+    if (w->out.len >= GREP_FLUSH_SIZE) worker_flush(walk, w);
+}
+
+static void usage(const char *progname) {
+    printf("Usage: %s [OPTIONS] PATTERN FILE|DIR [FILE|DIR ...]\n", progname);
+    printf("       %s [OPTIONS] -e PATTERN [-e PATTERN ...] FILE|DIR [FILE|DIR ...]\n", progname);
+    printf("Search the header block of each message (never the body) for PATTERN, a\n");
+    printf("POSIX extended regular expression, and print PATH:LINE for every matching\n");
+    printf("header line, unfolded; - reads a message from stdin\n");
+    printf("\nOptions:\n");
+    printf("  -e, --regexp PATTERN  Search for PATTERN; several -e match any of them\n");
+    printf("  -F, --fixed-strings   PATTERNs are literal strings\n");
+    printf("  -i, --ignore-case     Ignore ASCII case\n");
+    printf("  -H, --fields LIST     Match only the values of these comma-separated fields\n");
+    printf("                        (glob patterns allowed, as in mailheader -H)\n");
+    printf("  -l, --files-with-matches  Print only the paths of matching messages\n");
+    printf("  -q, --quiet           Print nothing; stop at the first match\n");
+    printf("  -s, --no-messages     Do not report unreadable files\n");
+    printf("  -x, --exclude L       Comma-separated directory names to skip (default: none)\n");
+    printf("  -j, --jobs N          Search with N worker threads (0: one per CPU);\n");
+    printf("                        files are then output in no particular order\n");
+    printf("  -h, --help            Show this help message\n");
+    printf("\nExit status: 0 if a line matched, 1 if none did, 2 on an error.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *exclude = "";
+    const char **texts = NULL;
+    int ntexts = 0, jobs = 1, opt, cflags = REG_EXTENDED | REG_NOSUB;
+    grep_opts opts = { 0 };
+    grep_worker *workers;
+    mail_walk walk;
+
+    static const struct option long_options[] = {
+        { "regexp",             required_argument, NULL, 'e' },
+        { "fixed-strings",      no_argument,       NULL, 'F' },
+        { "ignore-case",        no_argument,       NULL, 'i' },
+        { "fields",             required_argument, NULL, 'H' },
+        { "files-with-matches", no_argument,       NULL, 'l' },
+        { "quiet",              no_argument,       NULL, 'q' },
+        { "no-messages",        no_argument,       NULL, 's' },
+        { "exclude",            required_argument, NULL, 'x' },
+        { "jobs",               required_argument, NULL, 'j' },
+        { "help",               no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    mail_walk_init(&walk, argv[0]);
+    texts = calloc((size_t)argc, sizeof(char *));
+    if (!texts) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(ENOMEM));
+        return 2;
+    }
+    while ((opt = getopt_long(argc, argv, "e:FiH:lqsx:j:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'e':
+            texts[ntexts++] = optarg;
+            break;
+        case 'F':
+            opts.fixed = 1;
+            break;
+        case 'i':
+            opts.icase = 1;
+            cflags |= REG_ICASE;
+            break;
+        case 'H':
+            opts.fields = optarg;
+            break;
+        case 'l':
+            opts.list = 1;
+            break;
+        case 'q':
+            opts.quiet = 1;
+            break;
+        case 's':
+            walk.quiet = 1;
+            break;
+        case 'x':
+            exclude = optarg;
+            break;
+        case 'j': {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n < 0 || n > 1024) {
+                fprintf(stderr, "%s: invalid jobs '%s'\n", argv[0], optarg);
+                return 2;
+            }
+            if (n == 0) {
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+                if (n < 1) n = 1;
+                if (n > 1024) n = 1024;
+            }
+            jobs = (int)n;
+            break;
+        }
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            return 2;
+        }
+    }
+
+    if (ntexts == 0 && optind < argc) texts[ntexts++] = argv[optind++];
+    if (ntexts == 0 || optind == argc) {
+        fprintf(stderr, "%s: no args\n", argv[0]);
+        return 2;
+    }
+
+    opts.patterns = calloc((size_t)ntexts, sizeof(grep_pattern));
+    workers = calloc((size_t)jobs, sizeof(grep_worker));
+    if (!opts.patterns || !workers || mail_walk_exclude(&walk, exclude) == -1) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(ENOMEM));
+        return 2;
+    }
+    opts.count = ntexts;
+    opts.prefilter = 1;
+    for (int i = 0; i < ntexts; i++) {
+        grep_pattern *pat = &opts.patterns[i];
+        int err;
+
+        pat->text = texts[i];
+        if (opts.fixed) {
+            pat->literal_len = grep_fixed_literal(pat->text, pat->literal);
+        } else {
+            if ((err = regcomp(&pat->re, pat->text, cflags)) != 0) {
+                char msg[256];
+                regerror(err, &pat->re, msg, sizeof(msg));
+                fprintf(stderr, "%s: %s: %s\n", argv[0], pat->text, msg);
+                return 2;
+            }
+            pat->literal_len = grep_required_literal(pat->text, pat->literal);
+        }
+        if (pat->literal_len < GREP_LITERAL_MIN) opts.prefilter = 0;
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        workers[i].opts = &opts;
+        if (opts.fields && mail_select_compile(&workers[i].sel, opts.fields) == -1) {
+            fprintf(stderr, "%s: invalid field list '%s': %s\n", argv[0], opts.fields, strerror(errno));
+            return 2;
+        }
+    }
+    walk.file = grep_file;
+    walk.done = worker_flush;
+
+    /* Resolve the scan kernel before the workers share it */
+    mail_scan();
+
+    /* - is searched as a file (stat() would see the terminal or pipe);
+     * the last argument is pushed first so the first is searched first */
+    for (int i = argc - 1; i >= optind; i--) {
+        if (strcmp(argv[i], "-") == 0) {
+            mail_walk_item item = { strdup("-"), 0, 1 };
+            if (item.path) mail_walk_push(&walk, &item, 1);
+        } else {
+            walk.errors += mail_walk_args(&walk, argv + i, 1);
+        }
+    }
+    mail_walk_run(&walk, jobs, workers, sizeof(grep_worker));
+
+    int matched = 0;
+    for (int i = 0; i < jobs; i++) {
+        matched |= workers[i].matched;
+        if (opts.fields) mail_select_free(&workers[i].sel);
+        free(workers[i].head.p);
+        free(workers[i].line.p);
+        free(workers[i].out.p);
+    }
+    for (int i = 0; !opts.fixed && i < ntexts; i++) regfree(&opts.patterns[i].re);
+    free(opts.patterns);
+    free(workers);
+    free(texts);
+    int errors = walk.errors;
+    mail_walk_free(&walk);
+
+    if (matched && opts.quiet) return 0;
+    return errors ? 2 : matched ? 0 : 1;
+}
@@ -8,98 +8,260 @@ Extracts email headers (everything up to first blank line) with improved perform
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
 
-static void process_line(char *line) {
-    char *src = line, *dst = line;
+/* Include shared zero-copy input and range output, the mbox splitter,
+ * the directory index, the -H field selection and header extraction */
+#include "mail_io.h"
+#include "mail_mbox.h"
+#include "mail_index.h"
+#include "mail_select.h"
+#include "mail_extract.h"
 
-    while (*src) {
-        if (*src == '\r') {
-            src++;
-            continue;
+/* Streaming version for mbox files, stdin and files too large to map:
+ * the header block of every message, same rules as mail_extract_headers(),
+ * blocks separated by a blank line. A line's newline is held back until
+ * the next line shows whether it is a continuation. With sel, only the
+ * selected fields of each message (an empty block if none). A single
+ * message stops at its body. Returns 0, or -1 on a read error. */
+static int stream_headers(mail_mbox *mb, mail_select *sel, mail_writer *out) {
+    mail_mbox_chunk c;
+    int pending_nl = 0;
+    int keep = 1;
+    int r;
+
+    while (mail_writer_detach(out), (r = mail_mbox_next(mb, &c)) > 0) {
+        if (c.new_message && mb->messages > 1) {
+            if (pending_nl) mail_write_copy(out, "\n", 1);
+            pending_nl = 0;
+            mail_write_copy(out, "\n", 1);
         }
-        if (*src == '\t') {
-            *dst++ = ' ';
-            src++;
+        if (c.new_message && sel) mail_select_reset(sel);
+        if (c.part == MBOX_SEPARATOR) {
+            /* A whitespace-only separator still joins like a continuation */
+            if (pending_nl && !mail_line_is_continuation(c.p, c.p + c.len)) {
+                mail_write_copy(out, "\n", 1);
+            }
+            pending_nl = 0;
+            if (mb->single) break;
             continue;
         }
-        *dst++ = *src++;
-    }
-    *dst = '\0';
-}
+        if (c.part != MBOX_HEADER) continue;
 
-static int is_blank_line(const char *line) {
-    while (*line) {
-        if (*line == '\n') return 1;
-        if (!isspace((unsigned char)*line)) return 0;
-        line++;
-    }
-    return 1;
-}
+        if (sel && c.line_start && !mail_line_is_continuation(c.p, c.p + c.len)) {
+            if (mb->single && mail_select_done(sel)) break;
+            keep = !mail_select_done(sel) && mail_select_line(sel, c.p, c.len);
+        }
+        if (!keep) continue;
+
+        if (c.line_start && pending_nl && !mail_line_is_continuation(c.p, c.p + c.len)) {
+            mail_write_copy(out, "\n", 1);
+        }
+        pending_nl = 0;
 
-static int is_continuation_line(const char *line) {
-    return (line[0] == ' ' || line[0] == '\t');
+        size_t n = c.len;
+        if (n > 0 && c.p[n - 1] == '\n') {
+            n--;
+            pending_nl = 1;
+        }
+        mail_write_folded(out, c.p, n);
+    }
+    if (pending_nl) mail_write_copy(out, "\n", 1);
+    return r;
 }
 
 static void usage(const char *progname) {
-    printf("Usage: %s FILE\n", progname);
+    printf("Usage: %s [--mbox] [-H FIELDS] FILE\n", progname);
+    printf("       %s --index DIR [-n] [-H FIELDS]\n", progname);
     printf("Extract email headers from FILE (up to first blank line)\n");
+    printf("\nOptions:\n");
+    printf("  -M, --mbox  Stream FILE as an mbox (or stdin if FILE is - or absent):\n");
+    printf("              headers of every message, separated by blank lines\n");
+    printf("  -H, --fields FIELDS\n");
+    printf("              Only the comma-separated FIELDS (any case, X-* patterns\n");
+    printf("              allowed); reading stops once From, To, Subject and other\n");
+    printf("              single-instance fields have all been seen\n");
+    printf("  --index DIR Create or update the header index of DIR (%s);\n", MAIL_INDEX_NAME);
+    printf("              only messages changed since the last update are read.\n");
+    printf("              With -H: print each message's name and the values of\n");
+    printf("              FIELDS, tab-separated, from the index\n");
+    printf("  -n, --no-update\n");
+    printf("              With --index: answer from the index as it is, without\n");
+    printf("              listing DIR; the FIELDS must already be indexed\n");
+    printf("  -h, --help  Show this help message\n");
+    printf("\nExit status: 0 on success, 1 if FILE, DIR or the index cannot be read,\n");
+    printf("2 on a usage error (unknown option, missing FILE, invalid FIELDS).\n");
 }
 
-int main(int argc, const char* argv[]) {
-    FILE *file;
-    char *line = NULL;
-    char *next_line = NULL;
-    size_t line_cap = 0, next_line_cap = 0;
-    ssize_t line_len, next_line_len;
-    int in_headers = 1;
-
-    if (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
-        usage(argv[0]);
-        return 0;
-    }
+/* --index: update the index of dir (unless update is 0, which only maps
+ * it), then answer the field query if any */
+static int run_index(const char *progname, const char *dir, const char *fields, int update,
+                     mail_writer *out) {
+    mail_index ix;
+    int r = 0;
 
-    if (argc != 2) {
-        fprintf(stderr, "%s: no args\n", argv[0]);
-        return 2;
+    if (!update) {
+        if (mail_index_open(&ix, dir) == -1) {
+            fprintf(stderr, "%s: %s: cannot read index: %s\n", progname, dir, strerror(errno));
+            return 1;
+        }
+    } else if (mail_index_update(&ix, dir, fields) == -1) {
+        if (errno == EINVAL) {
+            fprintf(stderr, "%s: %s: field patterns cannot be indexed\n", progname, fields);
+            return 2;
+        }
+        fprintf(stderr, "%s: %s: %s\n", progname, dir, strerror(errno));
+        return 1;
+    }
+    if (ix.save_error) {
+        fprintf(stderr, "%s: %s: cannot write index: %s\n", progname, dir, strerror(ix.save_error));
     }
+    if (fields && mail_index_write_fields(&ix, fields, out) == -1) {
+        r = errno == EINVAL ? 2 : 1;
+        fprintf(stderr, "%s: %s: %s\n", progname, fields,
+                errno == ENOENT ? "field not indexed" :
+                errno == EINVAL ? "field patterns cannot be indexed" : strerror(errno));
+    }
+    /* Output points into the index; write it out before closing */
+    if (mail_writer_flush(out) == -1) r = 1;
+    mail_index_close(&ix);
+    return r;
+}
+
+/* Stream fd with bounded memory, as an mbox or as a single message */
+static int run_stream(const char *progname, const char *path, int fd, int single,
+                      mail_select *sel, mail_writer *out) {
+    mail_mbox mb;
+    int r;
 
-    file = fopen(argv[1], "r");
-    if (!file) {
-        fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], argv[1]);
+    if ((single ? mail_mbox_init_message(&mb, fd) : mail_mbox_init(&mb, fd)) == -1) {
+        fprintf(stderr, "%s: %s\n", progname, strerror(errno));
         return 1;
     }
+    r = stream_headers(&mb, sel, out);
+    if (r == -1) fprintf(stderr, "%s: %s: %s\n", progname, path ? path : "stdin", strerror(errno));
+    mail_mbox_free(&mb);
+    return r == -1 ? 1 : 0;
+}
 
-    line_len = getline(&line, &line_cap, file);
+/* --mbox: stream path (or stdin) with bounded memory */
+static int run_mbox(const char *progname, const char *path, mail_select *sel, mail_writer *out) {
+    int fd = STDIN_FILENO;
+    int r;
 
-    while (in_headers && line_len != -1) {
-        if (is_blank_line(line)) {
+    if (path && strcmp(path, "-") != 0) {
+        fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "\n%s: %s could not be opened!\n", progname, path);
+            return 1;
+        }
+    }
+    r = run_stream(progname, path, fd, 0, sel, out);
+    if (fd != STDIN_FILENO) close(fd);
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    mail_input in;
+    mail_writer out;
+    mail_select select, *sel = NULL;
+    const char *fields = NULL, *index_dir = NULL;
+    int mbox = 0, update = 1, fd, opt, r;
+
+    static const struct option long_options[] = {
+        { "mbox",   no_argument,       NULL, 'M' },
+        { "fields", required_argument, NULL, 'H' },
+        { "index",  required_argument, NULL, 'I' },
+        { "no-update", no_argument,    NULL, 'n' },
+        { "help",   no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "MH:nh", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'M':
+            mbox = 1;
+            break;
+        case 'H':
+            fields = optarg;
             break;
+        case 'I':
+            index_dir = optarg;
+            break;
+        case 'n':
+            update = 0;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            return 2;
+        }
+    }
+
+    if (index_dir) {
+        if (mbox || optind != argc) {
+            fprintf(stderr, "%s: --index takes no FILE and no --mbox\n", argv[0]);
+            return 2;
         }
+        mail_writer_init(&out, STDOUT_FILENO);
+        r = run_index(argv[0], index_dir, fields, update, &out);
+        mail_writer_free(&out);
+        return r;
+    }
 
-        process_line(line);
+    if (!update) {
+        fprintf(stderr, "%s: -n needs --index\n", argv[0]);
+        return 2;
+    }
 
-        next_line_len = getline(&next_line, &next_line_cap, file);
+    if (argc - optind != 1 && !(mbox && optind == argc)) {
+        fprintf(stderr, "%s: no args\n", argv[0]);
+        return 2;
+    }
 
-        if (next_line_len != -1 && is_continuation_line(next_line)) {
-            line[strlen(line) - 1] = '\0';
-            printf("%s", line);
-        } else {
-            printf("%s", line);
+    if (fields) {
+        if (mail_select_compile(&select, fields) == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], fields,
+                    errno == EINVAL ? "no field names" : strerror(errno));
+            return 2;
         }
+        sel = &select;
+    }
 
-        char *temp = line;
-        line = next_line;
-        next_line = temp;
+    if (mbox) {
+        mail_writer_init(&out, STDOUT_FILENO);
+        r = run_mbox(argv[0], optind < argc ? argv[optind] : NULL, sel, &out);
+        if (mail_writer_flush(&out) == -1) r = 1;
+        mail_writer_free(&out);
+        if (sel) mail_select_free(sel);
+        return r;
+    }
 
-        size_t temp_cap = line_cap;
-        line_cap = next_line_cap;
-        next_line_cap = temp_cap;
+    fd = strcmp(argv[optind], "-") == 0 ? STDIN_FILENO : open(argv[optind], O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], argv[optind]);
+        if (sel) mail_select_free(sel);
+        return 1;
+    }
 
-        line_len = next_line_len;
+    mail_writer_init(&out, STDOUT_FILENO);
+    if (mail_input_streamed(fd)) {
+        /* Pipes and files over the memory ceiling */
+        r = run_stream(argv[0], argv[optind], fd, 1, sel, &out);
+        if (mail_writer_flush(&out) == -1) r = 1;
+    } else if (mail_input_fd(&in, fd) == -1) {
+        fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], argv[optind]);
+        r = 1;
+    } else {
+        mail_extract_headers(&in, sel, &out);
+        r = mail_writer_flush(&out) == -1 ? 1 : 0;
+        mail_input_close(&in);
     }
 
-    free(line);
-    free(next_line);
-    fclose(file);
-    return 0;
-}
\ No newline at end of file
+    mail_writer_free(&out);
+    if (fd != STDIN_FILENO) close(fd);
+    if (sel) mail_select_free(sel);
+    return r;
+}
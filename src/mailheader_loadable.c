@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "builtins.h"
 #include "shell.h"
@@ -35,92 +36,152 @@ extern char **make_builtin_argv();
 extern void builtin_usage();
 extern void builtin_error();
 
-/* Helper function: process a line (remove \r, convert \t to space) */
-static void process_line(char *line) {
-    char *src = line, *dst = line;
+extern void sh_invalidid();
+
+/* Include shared zero-copy input and range output, the mbox splitter,
+ * the directory index, the -H field selection, header extraction and
+ * -v/-a capture */
+#include "mail_io.h"
+#include "mail_mbox.h"
+#include "mail_index.h"
+#include "mail_select.h"
+#include "mail_extract.h"
+#include "mail_capture.h"
+
+/* Header block of every message read from fd, as an mbox or as a single
+ * message (which stops at its body), blocks separated by a blank line,
+ * bounded memory; with sel, only the selected fields of each message */
+static int stream_headers(int fd, const char *filename, int single, mail_select *sel, mail_writer *out) {
+    mail_mbox mb;
+    mail_mbox_chunk c;
+    int pending_nl = 0;
+    int keep = 1;
+    int r, w;
+
+    if ((single ? mail_mbox_init_message(&mb, fd) : mail_mbox_init(&mb, fd)) == -1) {
+        builtin_error("%s", strerror(errno));
+        return EXECUTION_FAILURE;
+    }
 
-    while (*src) {
-        if (*src == '\r') {
-            src++;
-            continue;
+    while (mail_writer_detach(out), (r = mail_mbox_next(&mb, &c)) > 0) {
+        QUIT;  /* Check for signals */
+
+        if (c.new_message && mb.messages > 1) {
+            if (pending_nl) mail_write_copy(out, "\n", 1);
+            pending_nl = 0;
+            mail_write_copy(out, "\n", 1);
         }
-        if (*src == '\t') {
-            *dst++ = ' ';
-            src++;
+        if (c.new_message && sel) mail_select_reset(sel);
+        if (c.part == MBOX_SEPARATOR) {
+            /* A whitespace-only separator still joins like a continuation */
+            if (pending_nl && !mail_line_is_continuation(c.p, c.p + c.len)) {
+                mail_write_copy(out, "\n", 1);
+            }
+            pending_nl = 0;
+            if (single) break;
             continue;
         }
-        *dst++ = *src++;
+        if (c.part != MBOX_HEADER) continue;
+
+        if (sel && c.line_start && !mail_line_is_continuation(c.p, c.p + c.len)) {
+            if (single && mail_select_done(sel)) break;
+            keep = !mail_select_done(sel) && mail_select_line(sel, c.p, c.len);
+        }
+        if (!keep) continue;
+
+        if (c.line_start && pending_nl && !mail_line_is_continuation(c.p, c.p + c.len)) {
+            mail_write_copy(out, "\n", 1);
+        }
+        pending_nl = 0;
+
+        size_t n = c.len;
+        if (n > 0 && c.p[n - 1] == '\n') {
+            n--;
+            pending_nl = 1;
+        }
+        mail_write_folded(out, c.p, n);
     }
-    *dst = '\0';
-}
+    if (pending_nl) mail_write_copy(out, "\n", 1);
 
-/* Helper function: check if a line is blank */
-static int is_blank_line(const char *line) {
-    while (*line) {
-        if (*line == '\n') return 1;
-        if (!isspace((unsigned char)*line)) return 0;
-        line++;
+    w = mail_writer_flush(out);
+    mail_mbox_free(&mb);
+
+    if (r == -1) {
+        builtin_error("%s: read error: %s", filename, strerror(mb.error));
+        return EXECUTION_FAILURE;
+    }
+    if (w == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
     }
-    return 1;
+    return EXECUTION_SUCCESS;
 }
 
-/* Helper function: check if a line is a continuation line */
-static int is_continuation_line(const char *line) {
-    return (line[0] == ' ' || line[0] == '\t');
-}
+/* Core extraction function: emit every line of fd up to the first blank
+ * line, CRs removed and tabs folded, joining continuation lines. With sel,
+ * only the selected fields, stopping once all have been seen. */
+static int extract_headers(int fd, const char *filename, mail_select *sel, mail_writer *out) {
+    mail_input in;
+    int r;
 
-/* Core extraction function */
-static int extract_headers(const char *filename, FILE *output) {
-    FILE *file;
-    char *line = NULL;
-    char *next_line = NULL;
-    size_t line_cap = 0, next_line_cap = 0;
-    ssize_t line_len, next_line_len;
-    int in_headers = 1;
-
-    file = fopen(filename, "r");
-    if (!file) {
+    if (mail_input_streamed(fd)) {
+        /* Larger than the memory ceiling, or not a regular file */
+        return stream_headers(fd, filename, 1, sel, out);
+    }
+    if (mail_input_fd(&in, fd) == -1) {
         builtin_error("%s: cannot open: %s", filename, strerror(errno));
         return EXECUTION_FAILURE;
     }
 
-    line_len = getline(&line, &line_cap, file);
+    mail_extract_headers(&in, sel, out);
 
-    while (in_headers && line_len != -1) {
-        QUIT;  /* Check for signals */
-
-        if (is_blank_line(line)) {
-            break;
-        }
+    /* Output points into the input; write it out before closing */
+    r = mail_writer_flush(out);
+    mail_input_close(&in);
 
-        process_line(line);
+    if (r == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
+    }
+    return EXECUTION_SUCCESS;
+}
 
-        next_line_len = getline(&next_line, &next_line_cap, file);
+/* --index: update the index of dir (unless update is 0, which only maps
+ * it), then answer the field query if any */
+static int index_headers(const char *dir, const char *fields, int update, mail_writer *out) {
+    mail_index ix;
+    int r = EXECUTION_SUCCESS;
 
-        if (next_line_len != -1 && is_continuation_line(next_line)) {
-            line[strlen(line) - 1] = '\0';
-            fprintf(output, "%s", line);
-        } else {
-            fprintf(output, "%s", line);
+    if (!update) {
+        if (mail_index_open(&ix, dir) == -1) {
+            builtin_error("%s: cannot read index: %s", dir, strerror(errno));
+            return EXECUTION_FAILURE;
         }
-
-        /* Swap line buffers */
-        char *temp = line;
-        line = next_line;
-        next_line = temp;
-
-        size_t temp_cap = line_cap;
-        line_cap = next_line_cap;
-        next_line_cap = temp_cap;
-
-        line_len = next_line_len;
+    } else if (mail_index_update(&ix, dir, fields) == -1) {
+        if (errno == EINVAL) {
+            builtin_error("%s: field patterns cannot be indexed", fields);
+            return EX_USAGE;
+        }
+        builtin_error("%s: %s", dir, strerror(errno));
+        return EXECUTION_FAILURE;
+    }
+    if (ix.save_error) {
+        builtin_error("%s: cannot write index: %s", dir, strerror(ix.save_error));
     }
 
-    free(line);
-    free(next_line);
-    fclose(file);
-
-    return EXECUTION_SUCCESS;
+    if (fields && mail_index_write_fields(&ix, fields, out) == -1) {
+        builtin_error("%s: %s", fields,
+                      errno == ENOENT ? "field not indexed" :
+                      errno == EINVAL ? "field patterns cannot be indexed" : strerror(errno));
+        r = EXECUTION_FAILURE;
+    }
+    /* Output points into the index; write it out before closing */
+    if (mail_writer_flush(out) == -1) {
+        builtin_error("%s: write error: %s", dir, strerror(errno));
+        r = EXECUTION_FAILURE;
+    }
+    mail_index_close(&ix);
+    return r;
 }
 
 /* Bash builtin entry point */
@@ -128,35 +189,139 @@ int
 mailheader_builtin(WORD_LIST *list)
 {
     char **v;
-    int c, r;
+    int c, i, r;
+    int mbox = 0, update = 1;
+    const char *fields = NULL, *index_dir = NULL;
+    mail_select select, *sel = NULL;
+    mail_capture cap = { NULL, 0 };
+    mail_writer out;
 
     /* Convert WORD_LIST to argc/argv */
     v = make_builtin_argv(list, &c);
 
-    if (c != 2) {
+    /* Options: -M/--mbox, -H/--fields FIELDS, --index DIR, -n/--no-update,
+     * -v VAR, -a ARRAY */
+    for (i = 1; i < c && v[i][0] == '-' && v[i][1] != '\0'; i++) {
+        const char *a = v[i];
+
+        if (strcmp(a, "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(a, "-M") == 0 || strcmp(a, "--mbox") == 0) {
+            mbox = 1;
+        } else if ((strcmp(a, "-H") == 0 || strcmp(a, "--fields") == 0) && i + 1 < c) {
+            fields = v[++i];
+        } else if (strcmp(a, "--index") == 0 && i + 1 < c) {
+            index_dir = v[++i];
+        } else if (strcmp(a, "-n") == 0 || strcmp(a, "--no-update") == 0) {
+            update = 0;
+        } else if ((strcmp(a, "-v") == 0 || strcmp(a, "-a") == 0) && i + 1 < c) {
+            if (mail_capture_option(&cap, a[1] == 'a', v[++i]) == -1) {
+                free(v);
+                return EX_USAGE;
+            }
+        } else {
+            builtin_usage();
+            free(v);
+            return EX_USAGE;
+        }
+    }
+
+    QUIT;  /* Check for signals */
+
+    if (index_dir ? mbox || i != c : (i == c && !mbox) || !update) {
         builtin_usage();
         free(v);
         return EX_USAGE;
     }
 
-    QUIT;  /* Check for signals */
+    if (fields && !index_dir) {
+        if (mail_select_compile(&select, fields) == -1) {
+            builtin_error("%s: %s", fields, errno == EINVAL ? "no field names" : strerror(errno));
+            free(v);
+            return EX_USAGE;
+        }
+        sel = &select;
+    }
+
+    mail_capture_start(&cap, &out);
+
+    if (index_dir) {
+        r = index_headers(index_dir, fields, update, &out);
+    } else {
+        /* Every FILE even after a failure, --mbox without one reads stdin;
+         * blocks separated by a blank line, as the messages of an mbox are */
+        char *files[] = { "-", NULL };
+        char **f;
+        int any = 0;
+
+        for (f = i < c ? v + i : files, r = EXECUTION_SUCCESS; *f; f++) {
+            const char *name = *f;
+            int fd = STDIN_FILENO;
+
+            QUIT;  /* Check for signals */
+            if (mbox && strcmp(name, "-") == 0) {
+                name = "stdin";
+            } else if ((fd = open(name, O_RDONLY)) == -1) {
+                builtin_error("%s: cannot open: %s", name, strerror(errno));
+                r = EXECUTION_FAILURE;
+                continue;
+            }
+            if (any) mail_write_copy(&out, "\n", 1);
+            any = 1;
+            if ((mbox ? stream_headers(fd, name, 0, sel, &out)
+                      : extract_headers(fd, name, sel, &out)) != EXECUTION_SUCCESS) {
+                r = EXECUTION_FAILURE;
+            }
+            if (fd != STDIN_FILENO) close(fd);
+        }
+    }
 
-    r = extract_headers(v[1], stdout);
+    /* What was read is assigned even if a FILE failed */
+    if (cap.name && mail_capture_bind(&cap, &out) != EXECUTION_SUCCESS) {
+        r = EXECUTION_FAILURE;
+    }
+    mail_writer_free(&out);
 
+    if (sel) mail_select_free(sel);
     free(v);
     return r;
 }
 
 /* Documentation strings */
 char *mailheader_doc[] = {
-    "Extract email headers from a file.",
+    "Extract email headers from files.",
+    " ",
+    "Read each FILE and display its email headers (everything up to the",
+    "first blank line), the headers of one FILE separated from the next by",
+    "a blank line. Continuation lines (starting with whitespace) are joined",
+    "with the previous line.",
+    " ",
+    "With --mbox (-M), read each FILE as an mbox, or stdin if FILE is - or",
+    "omitted, and display the headers of every message, separated by a",
+    "blank line. Memory use stays bounded however large the input is.",
+    " ",
+    "With -H FIELDS, display only the comma-separated FIELDS, matched in",
+    "any case (X-* style patterns allowed). When every field is one that",
+    "appears at most once (From, To, Subject, Date, Message-ID, ...),",
+    "reading stops as soon as all of them have been seen.",
+    " ",
+    "With --index DIR, create or update the header index of the messages",
+    "in DIR (DIR/.mailheader.idx); only messages changed since the last",
+    "update are read. With -H FIELDS, then print one line per message:",
+    "its file name and the values of the comma-separated FIELDS, separated",
+    "by tabs, answered from the index without opening the messages.",
+    "With -n, answer from the index as it is, without listing DIR; the",
+    "FIELDS must already be indexed.",
     " ",
-    "Read the specified FILE and display email headers (everything up to",
-    "the first blank line). Continuation lines (starting with whitespace)",
-    "are joined with the previous line.",
+    "With -v VAR, assign the output to the shell variable VAR instead of",
+    "displaying it. With -a ARRAY, assign each line of it to an element of",
+    "the indexed array ARRAY, starting at index 0; ARRAY is emptied first.",
     " ",
     "Exit Status:",
-    "Returns success unless the file cannot be opened or read.",
+    "Returns success unless a FILE cannot be opened or read, or VAR or",
+    "ARRAY cannot be assigned. The remaining FILEs are still read.",
     (char *)NULL
 };
 
@@ -166,6 +331,6 @@ struct builtin mailheader_struct = {
     mailheader_builtin,     /* function implementing builtin */
     BUILTIN_ENABLED,        /* initial flags for builtin */
     mailheader_doc,         /* array of long documentation strings */
-    "mailheader FILE",      /* usage synopsis */
+    "mailheader [-v VAR | -a ARRAY] [--mbox] [-H FIELDS] FILE... | --index DIR [-n] [-H FIELDS]", /* usage synopsis */
     0                       /* reserved for internal use */
 };
@@ -8,261 +8,1377 @@ Removes bloat headers while preserving essential routing information
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
-#include <fnmatch.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-/* Include shared header removal list */
-#include "mailheaderclean_headers.h"
+/* Include the shared removal list and header block filter, compiled
+ * matcher, run statistics, the processed-state journal, the --serve
+ * protocol and zero-copy I/O */
+#include "mailheaderclean_filter.h"
+#include "mailheaderclean_matcher.h"
+#include "mailheaderclean_stats.h"
+#include "mailheaderclean_journal.h"
+#include "mailheaderclean_serve.h"
+#include "mail_io.h"
+#include "mail_mbox.h"
 
-static void process_line(char *line) {
-    char *src = line, *dst = line;
+struct clean_pool;
 
-    while (*src) {
-        if (*src == '\r') {
-            src++;
-            continue;
+/* Per-run state shared by every file processed in one invocation.
+ * The removal list is built and compiled once for the whole run; with
+ * --jobs each worker gets a copy that shares the (read-only) matcher. */
+typedef struct {
+    const char *progname;
+    header_matcher matcher;
+    mail_writer out;        /* stdout, when not rewriting in place */
+    int in_place;
+    int mbox;               /* arguments are mbox files, stdin if none */
+    int maxdepth;
+    int watch;              /* --watch: files may move away before they are cleaned */
+    int errors;
+    clean_stats *stats;         /* --stats counters, or NULL */
+    const clean_journal *journal;   /* --journal entries from earlier runs, or NULL */
+    clean_journal_log *log;     /* files found or made clean in this run, or NULL */
+    struct clean_pool *pool;    /* set when files go to worker threads */
+} clean_run;
+
+/* Whether cleaning would leave the message as it is: no field to remove
+ * and no CR or TAB to fold in the header block. Stops at the first line
+ * that would change. Returns the number of header fields, or -1. */
+static int header_block_unchanged(const header_matcher *matcher, const mail_input *in) {
+    const char *p = in->data;
+    const char *end = in->data + in->len;
+    int first_received_seen = 0;
+    int fields = 0;
+
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+
+        if (mail_line_is_blank(p, eol)) break;
+        if (mail_find_fold(p, eol)) return -1;
+
+        if (!mail_line_is_continuation(p, eol)) {
+            const char *colon = memchr(p, ':', eol - p);
+            size_t name_len = colon ? (size_t)(colon - p) : 0;
+            if (colon) {
+                if (name_len == 8 && strncasecmp(p, "Received", 8) == 0) {
+                    if (first_received_seen) return -1;
+                    first_received_seen = 1;
+                } else if (header_matcher_match(matcher, p, name_len) != -1) {
+                    return -1;
+                }
+                fields++;
+            }
         }
-        if (*src == '\t') {
-            *dst++ = ' ';
-            src++;
-            continue;
+        p = eol;
+    }
+    return fields;
+}
+
+/* Clean fd to stdout with bounded memory, as an mbox or as one message */
+static void clean_stream(clean_run *run, const char *path, int fd, int single) {
+    mail_mbox mb;
+
+    if ((single ? mail_mbox_init_message(&mb, fd) : mail_mbox_init(&mb, fd)) == -1 ||
+        stream_messages(&run->matcher, &mb, &run->out, run->stats) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+        run->errors++;
+    }
+    mail_mbox_free(&mb);
+}
+
+/* Clean an mbox file (or stdin for "-") to stdout with bounded memory */
+static void clean_mbox(clean_run *run, const char *path) {
+    int fd = STDIN_FILENO;
+
+    if (strcmp(path, "-") != 0) {
+        fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "\n%s: %s could not be opened!\n", run->progname, path);
+            run->errors++;
+            return;
         }
-        *dst++ = *src++;
     }
-    *dst = '\0';
+    clean_stream(run, path, fd, 0);
+    if (fd != STDIN_FILENO) close(fd);
 }
 
-static int is_blank_line(const char *line) {
-    while (*line) {
-        if (*line == '\n') return 1;
-        if (!isspace((unsigned char)*line)) return 0;
-        line++;
+/* Bodies at least this long are attached in the kernel when rewriting in
+ * place; shorter ones go out in the same writev() as the header block */
+#define CLEAN_ATTACH_MIN (64 * 1024)
+
+/* Append len bytes at in_off of in_fd to out_fd without passing them
+ * through user space: as a reflink (FICLONERANGE) when both offsets are
+ * block aligned, otherwise with copy_file_range(), which itself shares
+ * extents where the filesystem can (XFS, btrfs) and copies inside the
+ * kernel elsewhere. Returns the bytes appended; fewer than len if the
+ * kernel cannot copy between these files, and the caller writes the rest. */
+static size_t attach_range(int out_fd, int in_fd, off_t in_off, size_t len) {
+    off_t out_off = lseek(out_fd, 0, SEEK_CUR);
+    size_t done = 0;
+
+    if (out_off == -1) return 0;
+
+#ifdef FICLONERANGE
+    struct stat st;
+    if (fstat(out_fd, &st) == 0 && st.st_blksize > 0 &&
+        in_off % st.st_blksize == 0 && out_off % st.st_blksize == 0) {
+        /* The length may be unaligned: the range ends at the end of in_fd */
+        struct file_clone_range range = {
+            .src_fd = in_fd,
+            .src_offset = (unsigned long long)in_off,
+            .src_length = len,
+            .dest_offset = (unsigned long long)out_off,
+        };
+        if (ioctl(out_fd, FICLONERANGE, &range) == 0) {
+            done = len;
+            out_off += len;
+        }
     }
-    return 1;
+#endif
+
+    while (done < len) {
+        ssize_t n = copy_file_range(in_fd, &in_off, out_fd, &out_off, len - done, 0);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;  /* EXDEV, ENOSYS, EINVAL...: write the rest */
+        done += (size_t)n;
+    }
+
+    /* Later writes go after what was attached */
+    if (done && lseek(out_fd, out_off, SEEK_SET) == -1) return 0;
+    return done;
 }
 
-static int is_continuation_line(const char *line) {
-    return (line[0] == ' ' || line[0] == '\t');
+/* Put tmp_path in place of path. The two are exchanged and the old file
+ * unlinked, so a message renamed away meanwhile (a Maildir reader moving
+ * it from new/ to cur/) is not brought back under its old name: that fails
+ * with ENOENT. Filesystems without RENAME_EXCHANGE get a plain rename. */
+static int replace_file(const char *tmp_path, const char *path) {
+    if (renameat2(AT_FDCWD, tmp_path, AT_FDCWD, path, RENAME_EXCHANGE) == 0) {
+        unlink(tmp_path);
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) return -1;
+    return rename(tmp_path, path);
 }
 
-/* Case-insensitive string comparison */
-static int strcasecmp_custom(const char *s1, const char *s2) {
-    while (*s1 && *s2) {
-        int c1 = tolower((unsigned char)*s1);
-        int c2 = tolower((unsigned char)*s2);
-        if (c1 != c2) return c1 - c2;
-        s1++;
-        s2++;
+/* Rewrite path in place: filter the header block into a temp file in the
+ * same directory and attach the body unchanged, copy mode, ownership and
+ * timestamps from the original, then swap it in with replace_file(). The
+ * temp file is a dot file, which Maildir readers ignore. Long bodies are
+ * attached with attach_range(), so they are neither read nor written by
+ * this process. A message with nothing to clean is left untouched. Files
+ * left clean are added to the journal log. in was loaded from in_fd, which
+ * gives the attributes and the body, so a file put in place of path
+ * meanwhile cannot be spliced in. With --stats, the filtering is charged
+ * to classify from *since. */
+static int clean_in_place(clean_run *run, const char *path, int in_fd, const mail_input *in,
+                          uint64_t *since) {
+    struct stat st, new_st;
+    size_t path_len = strlen(path);
+    const char *base = strrchr(path, '/');
+    size_t dir_len = base ? (size_t)(base + 1 - path) : 0;
+    char *tmp_path;
+    int fd, saved_fd, fields;
+    const char *body;
+    size_t body_len;
+    int r;
+
+    if (fstat(in_fd, &st) == -1) return -1;
+
+    /* Already clean: no temp file, no rename, same inode */
+    fields = header_block_unchanged(&run->matcher, in);
+    clean_stats_time(run->stats, CLEAN_PHASE_CLASSIFY, since);
+    if (fields != -1) {
+        if (run->stats) clean_stats_unchanged(run->stats, in->len, fields);
+        if (run->log) clean_journal_add(run->log, &st);
+        return 0;
     }
-    return tolower((unsigned char)*s1) - tolower((unsigned char)*s2);
+
+    /* DIR/.NAME.XXXXXX */
+    tmp_path = malloc(path_len + 9);
+    if (!tmp_path) return -1;
+    memcpy(tmp_path, path, dir_len);
+    tmp_path[dir_len] = '.';
+    memcpy(tmp_path + dir_len + 1, path + dir_len, path_len - dir_len);
+    memcpy(tmp_path + path_len + 1, ".XXXXXX", 8);
+
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        free(tmp_path);
+        return -1;
+    }
+
+    /* Reuse the run's output buffer for the temp file */
+    saved_fd = mail_writer_redirect(&run->out, fd);
+    clean_stats_time(run->stats, CLEAN_PHASE_WRITE, since);
+    body = filter_header_block(&run->matcher, in, &run->out, run->stats);
+    body_len = in->data + in->len - body;
+    clean_stats_time(run->stats, CLEAN_PHASE_CLASSIFY, since);
+
+    if (body_len >= CLEAN_ATTACH_MIN && mail_writer_flush(&run->out) == 0) {
+        size_t done = attach_range(fd, in_fd, body - in->data, body_len);
+        if (run->stats) run->stats->bytes_out += done;
+        body += done;
+        body_len -= done;
+    }
+    mail_write_range(&run->out, body, body_len);
+    r = mail_writer_flush(&run->out);
+    mail_writer_redirect(&run->out, saved_fd);
+    if (r == -1) goto fail;
+
+    /* Preserve file attributes; ownership can only be kept when permitted */
+    if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+        /* not fatal: same behaviour as cp --preserve=all as non-root */
+    }
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    if (fchmod(fd, st.st_mode & 07777) == -1 || futimens(fd, times) == -1) goto fail;
+    if (run->log && fstat(fd, &new_st) == -1) goto fail;
+
+    if (close(fd) == -1) {
+        fd = -1;
+        goto fail;
+    }
+    if (replace_file(tmp_path, path) == -1) {
+        fd = -1;
+        goto fail;
+    }
+    if (run->log) clean_journal_add(run->log, &new_st);
+
+    free(tmp_path);
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        if (fd != -1) close(fd);
+        unlink(tmp_path);
+        errno = saved;
+    }
+    free(tmp_path);
+    return -1;
 }
 
-/* Check if header should be removed
- * Supports wildcard patterns using shell glob syntax:
- *   X-*         matches any header starting with X-
- *   *-Status    matches any header ending with -Status
- *   X-MS-*      matches any header starting with X-MS-
- *   X-*-Status  matches X- followed by anything, ending in -Status
- */
-static int should_remove_header(const char *header, char **removal_list, int removal_count) {
-    int i;
+/* Clean a single file ("-" is stdin), to stdout or in place. To stdout,
+ * pipes and files over the memory ceiling are streamed. */
+static void clean_file(clean_run *run, const char *path) {
+    mail_input in;
+    uint64_t t = 0;
+    int fd, r;
+
+    clean_stats_start(run->stats, &t);
 
-    /* Check removal list with wildcard support */
-    for (i = 0; i < removal_count; i++) {
-        /* Use fnmatch for glob pattern matching (case-insensitive) */
-#ifdef FNM_CASEFOLD
-        /* GNU extension for case-insensitive matching */
-        if (fnmatch(removal_list[i], header, FNM_CASEFOLD) == 0) {
-            return 1;
+    /* Clean when last seen and not changed since: not even opened */
+    if (run->journal) {
+        struct stat st;
+        if (stat(path, &st) == 0 && clean_journal_current(run->journal, &st)) {
+            if (run->stats) run->stats->journal_skipped++;
+            clean_stats_time(run->stats, CLEAN_PHASE_READ, &t);
+            return;
         }
-#else
-        /* Fallback: convert both to lowercase for comparison */
-        char pattern_lower[256], header_lower[256];
-        const char *p_src = removal_list[i];
-        const char *h_src = header;
-        char *p_dst = pattern_lower;
-        char *h_dst = header_lower;
+    }
 
-        while (*p_src && p_dst < pattern_lower + 255) {
-            *p_dst++ = tolower((unsigned char)*p_src++);
+    if (run->in_place) {
+        /* Kept open: the body is attached from the file that was mapped */
+        if ((fd = open(path, O_RDONLY)) == -1) {
+            r = -1;
+        } else if ((r = mail_input_fd(&in, fd)) == -1) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+        }
+    } else if ((fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY)) == -1) {
+        r = -1;
+    } else {
+        if (mail_input_streamed(fd)) {
+            clean_stream(run, path, fd, 1);
+            if (fd != STDIN_FILENO) close(fd);
+            return;
         }
-        *p_dst = '\0';
+        r = mail_input_fd(&in, fd);
+        if (fd != STDIN_FILENO) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+        }
+    }
+    if (r == -1) {
+        if (run->watch && errno == ENOENT) return;
+        fprintf(stderr, "\n%s: %s could not be opened!\n", run->progname, path);
+        run->errors++;
+        return;
+    }
+    clean_stats_time(run->stats, CLEAN_PHASE_READ, &t);
+
+    if (run->in_place) {
+        int saved;
+        r = clean_in_place(run, path, fd, &in, &t);
+        saved = errno;
+        close(fd);
+        errno = saved;
+    } else {
+        /* Long ranges point into the input; small messages stay buffered */
+        filter_message(&run->matcher, &in, &run->out, run->stats);
+        clean_stats_time(run->stats, CLEAN_PHASE_CLASSIFY, &t);
+        r = mail_writer_detach(&run->out);
+    }
+    clean_stats_time(run->stats, CLEAN_PHASE_WRITE, &t);
+    if (r == -1 && !(run->watch && errno == ENOENT)) {
+        fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+        run->errors++;
+    }
+    mail_input_close(&in);
+    clean_stats_time(run->stats, CLEAN_PHASE_READ, &t);
+}
+
+/* Parallel in-place cleaning (--jobs) --------------------------------------
+ *
+ * The main thread walks the arguments and hands paths to the workers in
+ * batches, round robin. Each worker owns a deque: it takes work from the
+ * tail of its own deque and, when that runs dry, steals half of another
+ * worker's deque from the head. Workers sleep only when every deque is
+ * empty and wake when a batch arrives or the walk is finished. */
+
+#define POOL_BATCH 64           /* paths handed to one worker at a time */
+#define POOL_STEAL_MAX 256      /* most paths taken in one steal */
+
+typedef struct {
+    pthread_mutex_t lock;
+    char **items;
+    size_t head, tail, cap;     /* owner pops at tail, thieves take from head */
+} clean_deque;
+
+typedef struct {
+    clean_run run;              /* private copy: writer, error count, stats */
+    clean_stats stats;          /* this worker's --stats counters */
+    clean_journal_log log;      /* this worker's --journal entries */
+    struct clean_pool *pool;
+    clean_deque deque;
+    pthread_t thread;
+    int index;
+} clean_worker;
+
+typedef struct clean_pool {
+    clean_worker *workers;
+    int nworkers;
+    atomic_size_t queued;       /* paths in all deques */
+    pthread_mutex_t lock;       /* guards sleeping/done for the condvar */
+    pthread_cond_t wake;
+    int sleeping;
+    int done;
+    char *batch[POOL_BATCH];    /* walker side: paths not yet handed out */
+    int batch_len;
+    int next;                   /* worker to receive the next batch */
+} clean_pool;
 
-        while (*h_src && h_dst < header_lower + 255) {
-            *h_dst++ = tolower((unsigned char)*h_src++);
+/* Append n paths at the tail. Returns 0, or -1 if out of memory. */
+static int deque_push(clean_deque *d, char **paths, size_t n) {
+    pthread_mutex_lock(&d->lock);
+    if (d->tail + n > d->cap) {
+        size_t live = d->tail - d->head;
+        if (live + n > d->cap / 2) {
+            size_t cap = d->cap ? d->cap : POOL_BATCH * 4;
+            while (cap < (live + n) * 2) cap *= 2;
+            char **items = malloc(cap * sizeof(*items));
+            if (!items) {
+                pthread_mutex_unlock(&d->lock);
+                return -1;
+            }
+            if (live) memcpy(items, d->items + d->head, live * sizeof(*items));
+            free(d->items);
+            d->items = items;
+            d->cap = cap;
+        } else {
+            memmove(d->items, d->items + d->head, live * sizeof(*d->items));
         }
-        *h_dst = '\0';
+        d->head = 0;
+        d->tail = live;
+    }
+    memcpy(d->items + d->tail, paths, n * sizeof(*paths));
+    d->tail += n;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
 
-        if (fnmatch(pattern_lower, header_lower, 0) == 0) {
-            return 1;
+static char *deque_pop(clean_deque *d) {
+    char *path = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) path = d->items[--d->tail];
+    pthread_mutex_unlock(&d->lock);
+    return path;
+}
+
+/* Take up to half of victim's paths (at most max) from its head */
+static size_t deque_steal(clean_deque *victim, char **out, size_t max) {
+    size_t n;
+
+    pthread_mutex_lock(&victim->lock);
+    n = (victim->tail - victim->head + 1) / 2;
+    if (n > max) n = max;
+    if (n) {
+        memcpy(out, victim->items + victim->head, n * sizeof(*out));
+        victim->head += n;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return n;
+}
+
+/* Next path for worker w: its own deque first, then the others' */
+static char *pool_take(clean_worker *w) {
+    clean_pool *pool = w->pool;
+    char *stolen[POOL_STEAL_MAX];
+    char *path = deque_pop(&w->deque);
+
+    for (int i = 1; !path && i < pool->nworkers; i++) {
+        clean_worker *victim = &pool->workers[(w->index + i) % pool->nworkers];
+        size_t n = deque_steal(&victim->deque, stolen, POOL_STEAL_MAX);
+        if (n == 0) continue;
+        path = stolen[0];
+        /* Keep the rest; if that fails they are cleaned right here */
+        if (n > 1 && deque_push(&w->deque, stolen + 1, n - 1) == -1) {
+            atomic_fetch_sub(&pool->queued, n - 1);
+            for (size_t j = 1; j < n; j++) {
+                clean_file(&w->run, stolen[j]);
+                free(stolen[j]);
+            }
         }
-#endif
     }
+    if (path) atomic_fetch_sub(&pool->queued, 1);
+    return path;
+}
 
-    return 0;
+static void *pool_worker(void *arg) {
+    clean_worker *w = arg;
+    clean_pool *pool = w->pool;
+
+    for (;;) {
+        char *path = pool_take(w);
+        if (path) {
+            clean_file(&w->run, path);
+            free(path);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->done) {
+            pool->sleeping++;
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            pool->sleeping--;
+        }
+        int finished = atomic_load(&pool->queued) == 0 && pool->done;
+        pthread_mutex_unlock(&pool->lock);
+        if (finished) break;
+    }
+    return NULL;
 }
 
-/* Parse comma-separated header list from a string */
-static int parse_csv_headers(const char *csv_string, char ***headers) {
-    if (!csv_string || !*csv_string) {
-        *headers = NULL;
-        return 0;
+/* Hand the walker's current batch to the next worker */
+static void pool_flush_batch(clean_run *run, clean_pool *pool) {
+    clean_worker *w = &pool->workers[pool->next];
+    int n = pool->batch_len;
+
+    if (n == 0) return;
+    pool->batch_len = 0;
+    pool->next = (pool->next + 1) % pool->nworkers;
+
+    if (deque_push(&w->deque, pool->batch, n) == -1) {
+        /* Out of memory: clean them on the walker thread instead */
+        for (int i = 0; i < n; i++) {
+            clean_file(run, pool->batch[i]);
+            free(pool->batch[i]);
+        }
+        return;
     }
+    atomic_fetch_add(&pool->queued, n);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->sleeping) pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
 
-    /* Count headers (comma-separated) */
-    int count = 1;
-    const char *p = csv_string;
-    while (*p) {
-        if (*p == ',') count++;
-        p++;
+static void pool_submit(clean_run *run, const char *path) {
+    clean_pool *pool = run->pool;
+    char *copy = strdup(path);
+
+    if (!copy) {
+        clean_file(run, path);
+        return;
     }
+    pool->batch[pool->batch_len++] = copy;
+    if (pool->batch_len == POOL_BATCH) pool_flush_batch(run, pool);
+}
 
-    /* Allocate array */
-    *headers = malloc(count * sizeof(char *));
-    if (!*headers) return 0;
+/* Tell the workers no more paths are coming, join the first nstarted and
+ * release the pool; their error counts, statistics and journal entries
+ * are added to run */
+static void pool_stop(clean_pool *pool, clean_run *run, int nstarted) {
+    pthread_mutex_lock(&pool->lock);
+    pool->done = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
 
-    /* Parse headers */
-    char *env_copy = strdup(csv_string);
-    if (!env_copy) {
-        free(*headers);
-        return 0;
+    for (int i = 0; i < nstarted; i++) {
+        clean_worker *w = &pool->workers[i];
+        pthread_join(w->thread, NULL);
+        run->errors += w->run.errors;
+        if (run->stats) {
+            w->stats.bytes_out += w->run.out.written;
+            clean_stats_add(run->stats, &w->stats);
+        }
+        if (run->log) clean_journal_log_merge(run->log, &w->log);
+    }
+    for (int i = 0; i < pool->nworkers; i++) {
+        clean_worker *w = &pool->workers[i];
+        clean_stats_free(&w->stats);
+        clean_journal_log_free(&w->log);
+        mail_writer_free(&w->run.out);
+        free(w->deque.items);
+        pthread_mutex_destroy(&w->deque.lock);
     }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+}
+
+/* Start nworkers threads, each with its own copy of run. Returns 0, or -1
+ * with errno set if the threads could not be started. */
+static int pool_start(clean_pool *pool, clean_run *run, int nworkers) {
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = calloc(nworkers, sizeof(*pool->workers));
+    if (!pool->workers) return -1;
+    pool->nworkers = nworkers;
+    atomic_init(&pool->queued, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
 
-    int i = 0;
-    char *token = strtok(env_copy, ",");
-    while (token && i < count) {
-        /* Trim whitespace */
-        while (isspace((unsigned char)*token)) token++;
-        char *end = token + strlen(token) - 1;
-        while (end > token && isspace((unsigned char)*end)) *end-- = '\0';
+    /* Resolve the scanning kernel before any thread uses it */
+    mail_scan();
 
-        (*headers)[i++] = strdup(token);
-        token = strtok(NULL, ",");
+    for (int i = 0; i < nworkers; i++) {
+        clean_worker *w = &pool->workers[i];
+        w->run = *run;
+        w->run.errors = 0;
+        w->run.pool = NULL;
+        w->run.log = run->log ? &w->log : NULL;
+        mail_writer_init(&w->run.out, -1);
+        w->pool = pool;
+        w->index = i;
+        pthread_mutex_init(&w->deque.lock, NULL);
+    }
+    for (int i = 0; i < nworkers && run->stats; i++) {
+        clean_worker *w = &pool->workers[i];
+        if (clean_stats_init(&w->stats, run->stats->pattern_count) == -1) {
+            pool_stop(pool, run, 0);
+            errno = ENOMEM;
+            return -1;
+        }
+        w->run.stats = &w->stats;
+    }
+    for (int i = 0; i < nworkers; i++) {
+        int err = pthread_create(&pool->workers[i].thread, NULL, pool_worker, &pool->workers[i]);
+        if (err) {
+            /* Nothing is queued yet, so the running workers exit at once */
+            pool_stop(pool, run, i);
+            errno = err;
+            return -1;
+        }
     }
+    return 0;
+}
 
-    free(env_copy);
-    return i;
+/* Hand out what is left, then wait for the workers to finish */
+static void pool_finish(clean_pool *pool, clean_run *run) {
+    pool_flush_batch(run, pool);
+    pool_stop(pool, run, pool->nworkers);
 }
 
-/* Build the final removal list based on environment variables
- *
- * Processing order:
- *   1. MAILHEADERCLEAN (or built-in hardcoded list if not set) - establishes base
- *   2. MAILHEADERCLEAN_PRESERVE - removes headers from base (subtract)
- *   3. MAILHEADERCLEAN_EXTRA - adds headers to final list (add)
- *
- * Formula: (MAILHEADERCLEAN or built-in) - PRESERVE + EXTRA
- */
-static int build_removal_list(char ***removal_list) {
-    char **base_list = NULL;
-    int base_count = 0;
-    char **preserve_list = NULL;
-    int preserve_count = 0;
-    char **extra_list = NULL;
-    int extra_count = 0;
-    int i, j, k;
-    int found;
-
-    /* Step 1: Get base removal list (MAILHEADERCLEAN or hardcoded) */
-    char *env_mailheaderclean = getenv("MAILHEADERCLEAN");
-    if (env_mailheaderclean && *env_mailheaderclean) {
-        /* Use custom removal list from environment */
-        base_count = parse_csv_headers(env_mailheaderclean, &base_list);
+/* Clean a file now, or queue it for the workers with --jobs */
+static void clean_or_submit(clean_run *run, const char *path) {
+    if (run->pool) {
+        pool_submit(run, path);
     } else {
-        /* Use hardcoded list - count items first */
-        for (i = 0; HEADERS_TO_REMOVE[i] != NULL; i++) {
-            base_count++;
+        clean_file(run, path);
+    }
+}
+
+/* Clean a path: files directly, directories by walking regular files up to
+ * maxdepth levels below them (same as find DIR -maxdepth N -type f).
+ * Entries are read and sorted before any file is rewritten, so temp files
+ * created by in-place mode never show up in the listing. */
+static void clean_path(clean_run *run, const char *path, int depth) {
+    struct stat st;
+    struct dirent **entries;
+    int n, i;
+
+    if (depth == 0) {
+        /* Top-level arguments that cannot be stat'ed are reported when opened */
+        if (stat(path, &st) == -1) {
+            clean_or_submit(run, path);
+            return;
         }
-        /* Copy hardcoded list to dynamic array */
-        base_list = malloc(base_count * sizeof(char *));
-        if (!base_list) return 0;
-        for (i = 0; i < base_count; i++) {
-            base_list[i] = strdup(HEADERS_TO_REMOVE[i]);
+    } else if (lstat(path, &st) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+        run->errors++;
+        return;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        if (depth == 0 || S_ISREG(st.st_mode)) clean_or_submit(run, path);
+        return;
+    }
+
+    if (depth >= run->maxdepth) return;
+
+    n = scandir(path, &entries, NULL, alphasort);
+    if (n == -1) {
+        fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+        run->errors++;
+        return;
+    }
+
+    size_t path_len = strlen(path);
+    for (i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            size_t name_len = strlen(name);
+            char *child = malloc(path_len + name_len + 2);
+            if (child) {
+                memcpy(child, path, path_len);
+                child[path_len] = '/';
+                memcpy(child + path_len + 1, name, name_len + 1);
+                clean_path(run, child, depth + 1);
+                free(child);
+            }
         }
+        free(entries[i]);
     }
+    free(entries);
+}
 
-    /* Step 2: Parse preserve list and remove from base (MAILHEADERCLEAN_PRESERVE) */
-    char *env_preserve = getenv("MAILHEADERCLEAN_PRESERVE");
-    if (env_preserve && *env_preserve) {
-        preserve_count = parse_csv_headers(env_preserve, &preserve_list);
+/* Clean every path in a NUL-separated list on stdin (find -print0) */
+static void clean_stdin_list(clean_run *run) {
+    char *path = NULL;
+    size_t path_cap = 0;
+    ssize_t path_len;
 
-        /* Remove preserved headers from base list */
-        for (i = 0; i < preserve_count; i++) {
-            for (j = 0; j < base_count; j++) {
-                if (base_list[j] && strcasecmp_custom(preserve_list[i], base_list[j]) == 0) {
-                    free(base_list[j]);
-                    base_list[j] = NULL;  /* Mark as removed */
-                }
+    while ((path_len = getdelim(&path, &path_cap, '\0', stdin)) != -1) {
+        if (path_len > 0 && path[path_len - 1] == '\0') path_len--;
+        if (path_len == 0) continue;
+        clean_path(run, path, 0);
+    }
+    free(path);
+}
+
+/* Watch mode (--watch) -------------------------------------------------------
+ *
+ * Every new/ and cur/ directory found below the DIR arguments is watched
+ * with inotify for IN_MOVED_TO, the event a Maildir delivery produces when
+ * it renames a finished message out of tmp/, and for IN_CREATE, which is
+ * what a delivery that links tmp/X to new/X (Postfix local, qmail)
+ * produces. tmp/ itself is never watched or cleaned, and dot files (our own
+ * temp files) are ignored. A rename between two watched directories is a
+ * reader moving or flagging a message: each IN_MOVED_FROM records its
+ * cookie with the pending slot of its path, if it is waiting for the
+ * current batch. The matching IN_MOVED_TO then rewrites that slot to the
+ * new path, is skipped if the source was already cleaned (which also covers
+ * the rename of our own temp file), and is queued as an arrival if the
+ * source's batch ran while it was away. Arrivals are collected for up to
+ * WATCH_SETTLE_MS after the first one, or until WATCH_BATCH paths are
+ * pending, and then cleaned as one batch (by the --jobs workers, if any). A
+ * queue overflow rescans every watched directory. SIGINT or SIGTERM ends
+ * the loop after the current batch. */
+
+#define WATCH_SETTLE_MS 200     /* collect a burst for this long */
+#define WATCH_BATCH 4096        /* most paths pending before a batch is cleaned */
+#define WATCH_COOKIES 64        /* recent IN_MOVED_FROM cookies remembered */
+
+/* A recent IN_MOVED_FROM: the pending slot its path held in batch, or -1
+ * if the path was not pending (already cleaned) */
+typedef struct {
+    uint32_t cookie;            /* 0: free or consumed */
+    int slot;
+    uint64_t batch;
+} watch_cookie;
+
+typedef struct {
+    int fd;                     /* inotify instance */
+    char **dirs;                /* watched directory by watch descriptor */
+    int dirs_cap;
+    int count;                  /* directories watched */
+    watch_cookie cookies[WATCH_COOKIES];
+    int next_cookie;
+    char **pending;             /* paths waiting for the current batch */
+    size_t npending;
+    uint64_t batch;             /* batches cleaned so far */
+} clean_watch;
+
+static volatile sig_atomic_t watch_stop;
+
+static void watch_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+/* Watch dir. Returns 0, or -1 with errno set. */
+static int watch_add(clean_watch *w, const char *dir) {
+    int wd = inotify_add_watch(w->fd, dir, IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR);
+    if (wd == -1) return -1;
+    if (wd >= w->dirs_cap) {
+        int cap = w->dirs_cap ? w->dirs_cap : 64;
+        while (cap <= wd) cap *= 2;
+        char **dirs = realloc(w->dirs, cap * sizeof(*dirs));
+        if (!dirs) goto nomem;
+        memset(dirs + w->dirs_cap, 0, (cap - w->dirs_cap) * sizeof(*dirs));
+        w->dirs = dirs;
+        w->dirs_cap = cap;
+    }
+    /* The same directory named twice gets the same descriptor */
+    if (w->dirs[wd]) return 0;
+    w->dirs[wd] = strdup(dir);
+    if (!w->dirs[wd]) goto nomem;
+    w->count++;
+    return 0;
+
+nomem:
+    inotify_rm_watch(w->fd, wd);
+    errno = ENOMEM;
+    return -1;
+}
+
+/* Watch the new/ and cur/ directories at most maxdepth levels below path
+ * (path itself included). Errors are reported and counted. */
+static void watch_find(clean_run *run, clean_watch *w, const char *path, int depth) {
+    const char *base = strrchr(path, '/');
+    struct dirent **entries;
+    int n;
+
+    base = base ? base + 1 : path;
+    if (strcmp(base, "new") == 0 || strcmp(base, "cur") == 0) {
+        if (watch_add(w, path) == -1) {
+            fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+            run->errors++;
+        }
+        return;
+    }
+    if (depth >= run->maxdepth) return;
+
+    n = scandir(path, &entries, NULL, alphasort);
+    if (n == -1) {
+        if (depth == 0 || errno != ENOTDIR) {
+            fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+            run->errors++;
+        }
+        return;
+    }
+
+    size_t path_len = strlen(path);
+    for (int i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        /* Maildir++ folders are dot directories: skip only . and .. */
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0 &&
+            (entries[i]->d_type == DT_DIR || entries[i]->d_type == DT_UNKNOWN)) {
+            size_t name_len = strlen(name);
+            char *child = malloc(path_len + name_len + 2);
+            if (child) {
+                memcpy(child, path, path_len);
+                child[path_len] = '/';
+                memcpy(child + path_len + 1, name, name_len + 1);
+                watch_find(run, w, child, depth + 1);
+                free(child);
             }
         }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+/* Clean the pending paths as one batch */
+static void watch_flush(clean_run *run, clean_watch *w) {
+    for (size_t i = 0; i < w->npending; i++) {
+        clean_or_submit(run, w->pending[i]);
+        free(w->pending[i]);
+    }
+    w->npending = 0;
+    w->batch++;
+    if (run->pool) pool_flush_batch(run, run->pool);
+}
+
+/* Clean what is already in every watched directory */
+static void watch_rescan(clean_run *run, clean_watch *w) {
+    int maxdepth = run->maxdepth;
+
+    run->maxdepth = 1;
+    for (int wd = 0; wd < w->dirs_cap; wd++) {
+        if (w->dirs[wd]) clean_path(run, w->dirs[wd], 0);
+    }
+    run->maxdepth = maxdepth;
+    if (run->pool) pool_flush_batch(run, run->pool);
+}
+
+/* dir/name, or NULL if out of memory */
+static char *watch_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir), name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
 
-        /* Cleanup preserve list */
-        for (i = 0; i < preserve_count; i++) {
-            free(preserve_list[i]);
+    if (!path) return NULL;
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
+
+/* Handle one inotify event */
+static void watch_event(clean_run *run, clean_watch *w, const struct inotify_event *ev) {
+    watch_cookie *moved = NULL;
+    const char *dir;
+    char *path;
+
+    if (ev->mask & IN_Q_OVERFLOW) {
+        watch_flush(run, w);
+        watch_rescan(run, w);
+        return;
+    }
+    if (ev->wd < 0 || ev->wd >= w->dirs_cap || !w->dirs[ev->wd]) return;
+    dir = w->dirs[ev->wd];
+
+    if (ev->mask & IN_IGNORED) {
+        /* Directory removed or unmounted */
+        free(w->dirs[ev->wd]);
+        w->dirs[ev->wd] = NULL;
+        w->count--;
+        return;
+    }
+    if (ev->mask & IN_MOVED_FROM) {
+        watch_cookie *c = &w->cookies[w->next_cookie];
+        w->next_cookie = (w->next_cookie + 1) % WATCH_COOKIES;
+        c->cookie = ev->cookie;
+        c->slot = -1;
+        c->batch = w->batch;
+        if (ev->len == 0 || (ev->mask & IN_ISDIR) || !(path = watch_path(dir, ev->name))) return;
+        for (size_t i = 0; i < w->npending; i++) {
+            if (strcmp(w->pending[i], path) == 0) {
+                c->slot = (int)i;
+                break;
+            }
+        }
+        free(path);
+        return;
+    }
+    if (!(ev->mask & (IN_MOVED_TO | IN_CREATE)) || (ev->mask & IN_ISDIR) || ev->len == 0 || ev->name[0] == '.') return;
+    if ((ev->mask & IN_MOVED_TO) && ev->cookie != 0) {
+        for (int i = 0; i < WATCH_COOKIES; i++) {
+            if (w->cookies[i].cookie == ev->cookie) {
+                moved = &w->cookies[i];
+                moved->cookie = 0;
+                break;
+            }
         }
-        free(preserve_list);
+        /* Moved from a watched directory after it was cleaned */
+        if (moved && moved->slot == -1) return;
     }
 
-    /* Step 3: Parse extra list and add to base (MAILHEADERCLEAN_EXTRA) */
-    char *env_extra = getenv("MAILHEADERCLEAN_EXTRA");
-    if (env_extra && *env_extra) {
-        extra_count = parse_csv_headers(env_extra, &extra_list);
+    path = watch_path(dir, ev->name);
+    if (!path) return;
+    if (moved && moved->batch == w->batch) {
+        /* Moved while waiting for this batch: clean it where it is now */
+        free(w->pending[moved->slot]);
+        w->pending[moved->slot] = path;
+        return;
+    }
+    w->pending[w->npending++] = path;
+    if (w->npending == WATCH_BATCH) watch_flush(run, w);
+}
+
+static uint64_t watch_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* Watch the DIR arguments until SIGINT or SIGTERM, cleaning messages as
+ * they are delivered. Files already there are cleaned first. */
+static void watch_run(clean_run *run, char **dirs, int ndirs) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct sigaction sa = { .sa_handler = watch_signal };
+    clean_watch w = { 0 };
+    uint64_t deadline = 0;
+
+    w.fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    w.pending = malloc(WATCH_BATCH * sizeof(*w.pending));
+    if (w.fd == -1 || !w.pending) {
+        fprintf(stderr, "%s: --watch: %s\n", run->progname, strerror(w.fd == -1 ? errno : ENOMEM));
+        run->errors++;
+        goto out;
     }
 
-    /* Compact base list (remove NULLs) and prepare for extra additions */
-    int final_count = 0;
-    for (i = 0; i < base_count; i++) {
-        if (base_list[i]) final_count++;
+    /* Watch before the first pass, so nothing delivered meanwhile is lost */
+    for (int i = 0; i < ndirs; i++) watch_find(run, &w, dirs[i], 0);
+    if (w.count == 0) {
+        fprintf(stderr, "%s: --watch: no new/ or cur/ directory found\n", run->progname);
+        run->errors++;
+        goto out;
     }
-    final_count += extra_count;  /* Reserve space for extras */
 
-    *removal_list = malloc(final_count * sizeof(char *));
-    if (!*removal_list) {
-        /* Cleanup on error */
-        for (i = 0; i < base_count; i++) {
-            if (base_list[i]) free(base_list[i]);
+    /* No SA_RESTART: the signal interrupts poll() */
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    watch_rescan(run, &w);
+
+    while (!watch_stop && w.count > 0) {
+        struct pollfd pfd = { .fd = w.fd, .events = POLLIN };
+        int timeout = -1;
+        ssize_t len;
+
+        if (w.npending) {
+            uint64_t now = watch_now_ms();
+            timeout = now >= deadline ? 0 : (int)(deadline - now);
+        }
+        int r = poll(&pfd, 1, timeout);
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: --watch: %s\n", run->progname, strerror(errno));
+            run->errors++;
+            break;
+        }
+        if (r == 0) {
+            watch_flush(run, &w);
+            continue;
         }
-        free(base_list);
-        for (i = 0; i < extra_count; i++) {
-            free(extra_list[i]);
+
+        while ((len = read(w.fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + len; ) {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                if (w.npending == 0) deadline = watch_now_ms() + WATCH_SETTLE_MS;
+                watch_event(run, &w, ev);
+                p += sizeof(*ev) + ev->len;
+            }
+        }
+        if (len == -1 && errno != EAGAIN && errno != EINTR) {
+            fprintf(stderr, "%s: --watch: %s\n", run->progname, strerror(errno));
+            run->errors++;
+            break;
         }
-        free(extra_list);
+    }
+    watch_flush(run, &w);
+
+out:
+    for (int wd = 0; wd < w.dirs_cap; wd++) free(w.dirs[wd]);
+    free(w.dirs);
+    free(w.pending);
+    if (w.fd != -1) close(w.fd);
+}
+
+/* Server mode (--serve) ------------------------------------------------------
+ *
+ * The listening socket and every open connection sit in one epoll set that
+ * all server threads wait on. Connections are registered one-shot: the
+ * thread that gets a readable connection answers one request (the protocol
+ * is in mailheaderclean_serve.h) and re-arms it, so idle keep-alive
+ * connections hold no thread and a busy one cannot starve the others.
+ * Threads have their own writer, request buffer and statistics and share
+ * the compiled removal list. A response goes out in one writev(): the head
+ * and the filtered header block from the output buffer, the body straight
+ * from the request buffer. To fill in the length the header block must be
+ * complete before anything is sent, so the writer is held
+ * (MAIL_WRITER_HOLD) while filtering; a header block too large for the
+ * output buffer fails to flush with ENOBUFS and is filtered again into a
+ * memory file. SIGINT or SIGTERM wakes every thread through an eventfd;
+ * each finishes its current request and exits, and the socket file is
+ * removed. */
+
+#define SERVE_TIMEOUT_S 10      /* longest wait for the rest of a request */
+
+typedef struct {
+    clean_run run;              /* private copy: writer, stats */
+    clean_stats stats;          /* this thread's --stats counters */
+    int epoll_fd;
+    int listen_fd;              /* non-blocking */
+    int stop_fd;                /* eventfd, readable once stopping */
+    char *req;                  /* request buffer */
+    size_t req_cap;
+    pthread_t thread;
+} clean_server;
+
+/* Answer a failed request with status and no body */
+static void serve_status(clean_server *s, int conn, int status) {
+    unsigned char head[CLEAN_SERVE_RESPONSE_HEAD];
+
+    clean_serve_put32(head, (uint32_t)status);
+    clean_serve_put32(head + 4, 0);
+    mail_writer_redirect(&s->run.out, conn);
+    mail_write_copy(&s->run.out, (const char *)head, sizeof(head));
+    mail_writer_flush(&s->run.out);
+}
+
+/* The cleaned header block of in did not fit the output buffer: filter it
+ * again (uncounted) into a memory file, whose size gives the length, and
+ * send it from there. Returns 0, or -1 with errno set; *sent is set once
+ * anything may have been written to conn, after which a status frame
+ * would be taken for part of the response. */
+static int serve_large(clean_server *s, int conn, const mail_input *in, const char *body,
+                       size_t body_len, int *sent) {
+    mail_writer *out = &s->run.out;
+    unsigned char head[CLEAN_SERVE_RESPONSE_HEAD];
+    unsigned long long head_len;
+    off_t off = 0;
+    int mfd, r = -1;
+
+    mfd = memfd_create("mailheaderclean", MFD_CLOEXEC);
+    if (mfd == -1) return -1;
+    mail_writer_redirect(out, mfd);
+    out->written = 0;
+    filter_header_block(&s->run.matcher, in, out, NULL);
+    if (mail_writer_flush(out) == -1) goto done;
+    head_len = out->written;
+    if (head_len + body_len > UINT32_MAX) {
+        errno = EFBIG;
+        goto done;
+    }
+
+    clean_serve_put32(head, 0);
+    clean_serve_put32(head + 4, (uint32_t)(head_len + body_len));
+    mail_writer_redirect(out, conn);
+    mail_write_copy(out, (const char *)head, sizeof(head));
+    *sent = 1;
+    if (mail_writer_flush(out) == -1) goto done;
+    while ((unsigned long long)off < head_len) {
+        ssize_t n = sendfile(conn, mfd, &off, head_len - off);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == 0) errno = EIO;   /* the memory file ended early */
+        if (n <= 0) goto done;
+    }
+    mail_write_range(out, body, body_len);
+    r = mail_writer_flush(out);
+    if (r == 0 && s->run.stats) s->run.stats->bytes_out += head_len + body_len;
+
+done:
+    {
+        int saved = errno;
+        mail_writer_redirect(out, MAIL_WRITER_HOLD);
+        close(mfd);
+        errno = saved;
+    }
+    return r;
+}
+
+/* Clean the len-byte message in s->req and send the response on conn.
+ * Returns 0, or -1 if the connection has to be closed. */
+static int serve_message(clean_server *s, int conn, size_t len, uint64_t *since) {
+    clean_run *run = &s->run;
+    mail_writer *out = &run->out;
+    mail_input in = { .data = s->req, .len = len };
+    const char *body;
+    size_t body_len, head_len = 0;
+
+    mail_writer_redirect(out, MAIL_WRITER_HOLD);
+    out->written = 0;
+    mail_write_copy(out, "\0\0\0\0\0\0\0\0", CLEAN_SERVE_RESPONSE_HEAD);
+    body = filter_header_block(&run->matcher, &in, out, run->stats);
+    body_len = in.data + in.len - body;
+    clean_stats_time(run->stats, CLEAN_PHASE_CLASSIFY, since);
+
+    if (out->error == ENOBUFS) {
+        /* The block did not fit the output buffer */
+        int sent = 0;
+        if (serve_large(s, conn, &in, body, body_len, &sent) == -1) {
+            if (!sent) serve_status(s, conn, errno);
+            return -1;
+        }
+        clean_stats_time(run->stats, CLEAN_PHASE_WRITE, since);
         return 0;
     }
+    if (out->error) {
+        serve_status(s, conn, out->error);
+        return -1;
+    }
+    for (int i = 0; i < out->iovcnt; i++) head_len += out->iov[i].iov_len;
+    clean_serve_put32((unsigned char *)out->buf, 0);
+    clean_serve_put32((unsigned char *)out->buf + 4,
+                      (uint32_t)(head_len - CLEAN_SERVE_RESPONSE_HEAD + body_len));
+
+    out->fd = conn;
+    mail_write_range(out, body, body_len);
+    if (mail_writer_flush(out) == -1) return -1;
+    if (run->stats) run->stats->bytes_out += out->written - CLEAN_SERVE_RESPONSE_HEAD;
+    clean_stats_time(run->stats, CLEAN_PHASE_WRITE, since);
+    return 0;
+}
 
-    /* Copy non-NULL entries from base */
-    k = 0;
-    for (i = 0; i < base_count; i++) {
-        if (base_list[i]) {
-            (*removal_list)[k++] = base_list[i];
+/* Answer the request waiting on conn. Returns 0, or -1 if the connection
+ * is closed or has to be. */
+static int serve_request(clean_server *s, int conn) {
+    unsigned char head[CLEAN_SERVE_REQUEST_HEAD];
+    uint32_t len;
+    uint64_t t = 0;
+
+    clean_stats_start(s->run.stats, &t);
+    if (clean_serve_read(conn, head, sizeof(head)) != 1) return -1;
+    len = clean_serve_get32(head);
+    if (len > CLEAN_SERVE_MAX) {
+        serve_status(s, conn, EFBIG);
+        return -1;
+    }
+    if (len > s->req_cap) {
+        char *req = realloc(s->req, len);
+        if (!req) {
+            serve_status(s, conn, ENOMEM);
+            return -1;
         }
+        s->req = req;
+        s->req_cap = len;
     }
-    free(base_list);  /* Free the old array, but not the strings (they're copied to removal_list) */
+    if (len > 0 && clean_serve_read(conn, s->req, len) != 1) return -1;
+    clean_stats_time(s->run.stats, CLEAN_PHASE_READ, &t);
+    return serve_message(s, conn, len, &t);
+}
 
-    /* Add extra headers if not already in list */
-    for (i = 0; i < extra_count; i++) {
-        found = 0;
-        for (j = 0; j < k; j++) {
-            if (strcasecmp_custom(extra_list[i], (*removal_list)[j]) == 0) {
-                found = 1;
-                break;
-            }
+/* Take every pending connection and add it to the epoll set */
+static void serve_accept(clean_server *s) {
+    struct timeval timeout = { .tv_sec = SERVE_TIMEOUT_S };
+
+    for (;;) {
+        int conn = accept4(s->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1) {
+            /* Out of descriptors or memory: back off instead of spinning */
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) usleep(10000);
+            return;
         }
-        if (!found) {
-            (*removal_list)[k++] = extra_list[i];
-        } else {
-            free(extra_list[i]);  /* Already in list, don't need duplicate */
+        /* A client that stops mid-request cannot hold a thread forever */
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.fd = conn };
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, conn, &ev) == -1) close(conn);
+    }
+}
+
+static void *serve_worker(void *arg) {
+    clean_server *s = arg;
+    struct epoll_event ev;
+
+    for (;;) {
+        int n = epoll_wait(s->epoll_fd, &ev, 1, -1);
+        if (n == -1 && errno != EINTR) break;
+        if (n != 1) continue;
+
+        if (ev.data.fd == s->stop_fd) break;
+        if (ev.data.fd == s->listen_fd) {
+            serve_accept(s);
+            continue;
+        }
+
+        int conn = ev.data.fd;
+        if ((ev.events & (EPOLLHUP | EPOLLERR)) && !(ev.events & EPOLLIN)) {
+            close(conn);
+            continue;
+        }
+        if (serve_request(s, conn) == -1) {
+            close(conn);
+            continue;
+        }
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, conn, &ev) == -1) close(conn);
+    }
+    return NULL;
+}
+
+/* Listen on a Unix socket at path. A stale socket file (nothing accepts
+ * on it) is replaced; a live one or any other file is an error. Returns
+ * the socket, or -1 with errno set. */
+static int serve_listen(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            errno = EEXIST;
+            return -1;
+        }
+        fd = clean_serve_connect(path);
+        if (fd != -1) {
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
         }
+        unlink(path);
     }
-    free(extra_list);  /* Free the array */
 
-    return k;  /* Return actual count */
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/* Serve on path with nthreads threads until SIGINT or SIGTERM. Thread
+ * errors and statistics are added to run. */
+static void serve_run(clean_run *run, const char *path, int nthreads) {
+    clean_server *servers = NULL;
+    struct epoll_event ev = { .events = EPOLLIN };
+    sigset_t sigs, old;
+    int listen_fd, epoll_fd = -1, stop_fd = -1, started = 0, sig;
+
+    listen_fd = serve_listen(path);
+    if (listen_fd == -1) {
+        fprintf(stderr, "%s: %s: %s\n", run->progname, path, strerror(errno));
+        run->errors++;
+        return;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    servers = calloc(nthreads, sizeof(*servers));
+    ev.data.fd = listen_fd;
+    if (epoll_fd == -1 || stop_fd == -1 || !servers ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        fprintf(stderr, "%s: --serve: %s\n", run->progname, strerror(servers ? errno : ENOMEM));
+        run->errors++;
+        goto out;
+    }
+
+    /* Threads inherit the mask; only sigwait() below takes the signals. A
+     * client that goes away makes writev() fail with EPIPE instead. */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old);
+    signal(SIGPIPE, SIG_IGN);
+    mail_scan();
+
+    for (; started < nthreads; started++) {
+        clean_server *s = &servers[started];
+        s->run = *run;
+        s->run.errors = 0;
+        s->run.stats = NULL;
+        mail_writer_init(&s->run.out, MAIL_WRITER_HOLD);
+        if (run->stats) {
+            if (clean_stats_init(&s->stats, run->stats->pattern_count) == -1) break;
+            s->run.stats = &s->stats;
+        }
+        s->epoll_fd = epoll_fd;
+        s->listen_fd = listen_fd;
+        s->stop_fd = stop_fd;
+        if (pthread_create(&s->thread, NULL, serve_worker, s) != 0) {
+            clean_stats_free(&s->stats);
+            break;
+        }
+    }
+    if (started == 0) {
+        fprintf(stderr, "%s: --serve: cannot start threads\n", run->progname);
+        run->errors++;
+    } else {
+        sigwait(&sigs, &sig);
+    }
+
+    /* Level-triggered and never read: wakes every thread, now and later */
+    uint64_t one = 1;
+    ev.data.fd = stop_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev);
+    if (write(stop_fd, &one, sizeof(one)) == -1) {
+        /* cannot fail on a fresh eventfd */
+    }
+
+    for (int i = 0; i < started; i++) {
+        clean_server *s = &servers[i];
+        pthread_join(s->thread, NULL);
+        run->errors += s->run.errors;
+        if (run->stats) clean_stats_add(run->stats, &s->stats);
+        clean_stats_free(&s->stats);
+        mail_writer_free(&s->run.out);
+        free(s->req);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+out:
+    free(servers);
+    if (stop_fd != -1) close(stop_fd);
+    if (epoll_fd != -1) close(epoll_fd);
+    close(listen_fd);
+    unlink(path);
+}
+
+/* --stats report on stderr: "name<TAB>value" totals, then one
+ * "pattern<TAB>PATTERN<TAB>hits<TAB>bytes" line per removal-list entry */
+static void print_stats(const clean_stats *stats, char **removal_list) {
+    static const char *const phase_names[CLEAN_PHASES] = { "read_us", "classify_us", "write_us" };
+
+    fprintf(stderr, "messages\t%llu\n", stats->messages);
+    fprintf(stderr, "bytes_in\t%llu\n", stats->bytes_in);
+    fprintf(stderr, "bytes_out\t%llu\n", stats->bytes_out);
+    fprintf(stderr, "headers_kept\t%llu\n", stats->headers_kept);
+    fprintf(stderr, "headers_removed\t%llu\n", stats->headers_removed);
+    fprintf(stderr, "continuations_dropped\t%llu\n", stats->continuations_dropped);
+    fprintf(stderr, "unchanged\t%llu\n", stats->unchanged);
+    fprintf(stderr, "journal_skipped\t%llu\n", stats->journal_skipped);
+    fprintf(stderr, "received_removed\t%llu\n", stats->received.hits);
+    fprintf(stderr, "received_removed_bytes\t%llu\n", stats->received.bytes);
+    for (int i = 0; i < CLEAN_PHASES; i++) {
+        fprintf(stderr, "%s\t%llu\n", phase_names[i], (unsigned long long)(stats->ns[i] / 1000));
+    }
+    for (int i = 0; i < stats->pattern_count; i++) {
+        fprintf(stderr, "pattern\t%s\t%llu\t%llu\n", removal_list[i],
+                stats->patterns[i].hits, stats->patterns[i].bytes);
+    }
 }
 
 static void usage(const char *progname) {
-    printf("Usage: %s [-l] FILE\n", progname);
-    printf("Filter non-essential email headers from FILE\n");
+    printf("Usage: %s [-l] [-i] [-0] [-s] [-m N] [-j N] [-J FILE] FILE|DIR [FILE|DIR ...]\n", progname);
+    printf("       %s [-s] --mbox [MBOX ...]\n", progname);
+    printf("       %s [-s] [-m N] [-j N] [-J FILE] --watch DIR [DIR ...]\n", progname);
+    printf("       %s [-s] [-j N] --serve SOCKET\n", progname);
+    printf("Filter non-essential email headers from each FILE\n");
     printf("\nOptions:\n");
-    printf("  -l    List currently active header removal list and exit\n");
+    printf("  -l, --list        List currently active header removal list and exit\n");
+    printf("  -i, --in-place    Rewrite files in place (timestamps and mode preserved)\n");
+    printf("  -0, --null        Also read NUL-separated paths from stdin (find -print0)\n");
+    printf("  -m, --maxdepth N  Max depth to traverse below a DIR (default: 1)\n");
+    printf("  -j, --jobs N      Clean in place with N worker threads (0: one per CPU)\n");
+    printf("  -J, --journal FILE\n");
+    printf("                    With -i, skip files recorded in FILE as clean and not\n");
+    printf("                    changed since, and record the files cleaned now\n");
+    printf("  -M, --mbox        Stream each MBOX (stdin if none or -) to stdout\n");
+    printf("  -w, --watch       Clean in place the messages delivered to the new/ and\n");
+    printf("                    cur/ directories below each DIR as they arrive, until\n");
+    printf("                    SIGINT or SIGTERM\n");
+    printf("  -L, --serve SOCKET\n");
+    printf("                    Clean messages sent to the Unix socket SOCKET (see\n");
+    printf("                    mailheaderclean-client) with N threads (default: one\n");
+    printf("                    per CPU), until SIGINT or SIGTERM\n");
+    printf("  -s, --stats       Report counts, bytes per removal pattern and time per\n");
+    printf("                    phase for the whole run on stderr\n");
+    printf("  -h, --help        Show this help message\n");
+    printf("\nWithout -i, cleaned messages are written to stdout in argument order.\n");
+    printf("With -i, messages with nothing to clean are left untouched.\n");
     printf("\nEnvironment variables:\n");
     printf("  MAILHEADERCLEAN          Replace built-in removal list\n");
     printf("  MAILHEADERCLEAN_PRESERVE Exclude headers from removal\n");
@@ -273,117 +1389,233 @@ static void usage(const char *progname) {
     printf("  X-MS-*      Match any header starting with X-MS-\n");
 }
 
-int main(int argc, const char* argv[]) {
-    FILE *file;
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len;
-    int in_headers = 1;
-    int keep_current_header = 1;
-    int first_received_seen = 0;
+int main(int argc, char *argv[]) {
     char **removal_list = NULL;
     int removal_count = 0;
+    int list_only = 0, read_stdin = 0, jobs = 1, jobs_set = 0, want_stats = 0;
+    const char *journal_path = NULL, *serve_path = NULL;
+    int opt, i;
+    clean_run run = { .progname = argv[0], .maxdepth = 1 };
+    clean_stats stats;
+    clean_journal journal;
+    clean_journal_log log = { 0 };
+    uint64_t t = 0;
 
-    if (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
-        usage(argv[0]);
-        return 0;
-    }
+    static const struct option long_options[] = {
+        { "list",     no_argument,       NULL, 'l' },
+        { "in-place", no_argument,       NULL, 'i' },
+        { "null",     no_argument,       NULL, '0' },
+        { "maxdepth", required_argument, NULL, 'm' },
+        { "jobs",     required_argument, NULL, 'j' },
+        { "mbox",     no_argument,       NULL, 'M' },
+        { "stats",    no_argument,       NULL, 's' },
+        { "journal",  required_argument, NULL, 'J' },
+        { "watch",    no_argument,       NULL, 'w' },
+        { "serve",    required_argument, NULL, 'L' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
 
-    /* Handle -l option (list removal headers) */
-    if (argc == 2 && strcmp(argv[1], "-l") == 0) {
-        removal_count = build_removal_list(&removal_list);
-        for (int i = 0; i < removal_count; i++) {
-            printf("%s\n", removal_list[i]);
-        }
-        /* Cleanup */
-        if (removal_list) {
-            for (int i = 0; i < removal_count; i++) {
-                free(removal_list[i]);
+    while ((opt = getopt_long(argc, argv, "li0m:j:MsJ:wL:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            list_only = 1;
+            break;
+        case 'i':
+            run.in_place = 1;
+            break;
+        case '0':
+            read_stdin = 1;
+            break;
+        case 'M':
+            run.mbox = 1;
+            break;
+        case 's':
+            want_stats = 1;
+            break;
+        case 'J':
+            journal_path = optarg;
+            break;
+        case 'w':
+            run.watch = 1;
+            break;
+        case 'L':
+            serve_path = optarg;
+            break;
+        case 'm': {
+            char *end;
+            long depth = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || depth < 0 || depth > 4096) {
+                fprintf(stderr, "%s: invalid maxdepth '%s'\n", argv[0], optarg);
+                return 2;
             }
-            free(removal_list);
+            run.maxdepth = (int)depth;
+            break;
+        }
+        case 'j': {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n < 0 || n > 1024) {
+                fprintf(stderr, "%s: invalid jobs '%s'\n", argv[0], optarg);
+                return 2;
+            }
+            if (n == 0) {
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+                if (n < 1) n = 1;
+                if (n > 1024) n = 1024;
+            }
+            jobs = (int)n;
+            jobs_set = 1;
+            break;
+        }
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            return 2;
         }
-        return 0;
     }
 
-    if (argc != 2) {
+    if (run.mbox && (run.in_place || read_stdin || jobs > 1)) {
+        fprintf(stderr, "%s: --mbox cannot be combined with -i, -0 or -j\n", argv[0]);
+        return 2;
+    }
+
+    /* A server takes its messages from the socket only */
+    if (serve_path) {
+        if (run.in_place || run.mbox || read_stdin || run.watch || journal_path || optind < argc) {
+            fprintf(stderr, "%s: --serve takes no FILE and cannot be combined with -i, -M, -0, -w or -J\n",
+                    argv[0]);
+            return 2;
+        }
+        if (!jobs_set) {
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+            jobs = n < 1 ? 1 : n > 1024 ? 1024 : (int)n;
+        }
+    }
+
+    /* Watching cleans in place; the DIR arguments are watched, not walked */
+    if (run.watch) {
+        if (run.mbox || read_stdin) {
+            fprintf(stderr, "%s: --watch cannot be combined with -M or -0\n", argv[0]);
+            return 2;
+        }
+        run.in_place = 1;
+    }
+
+    if (!list_only && optind == argc && !read_stdin && !run.mbox && !serve_path) {
         fprintf(stderr, "%s: no args\n", argv[0]);
         return 2;
     }
 
-    file = fopen(argv[1], "r");
-    if (!file) {
-        fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], argv[1]);
-        return 1;
+    if (journal_path && !run.in_place && !list_only) {
+        fprintf(stderr, "%s: --journal requires --in-place\n", argv[0]);
+        return 2;
+    }
+
+    /* Workers rewrite files independently; stdout output must stay in order */
+    if (jobs > 1 && !run.in_place && !list_only && !serve_path) {
+        fprintf(stderr, "%s: --jobs requires --in-place\n", argv[0]);
+        return 2;
     }
 
-    /* Build removal list from environment variables */
+    /* Build removal list from environment variables (once per run) */
     removal_count = build_removal_list(&removal_list);
 
-    while ((line_len = getline(&line, &line_cap, file)) != -1) {
-        if (in_headers) {
-            /* Check for end of headers */
-            if (is_blank_line(line)) {
-                in_headers = 0;
-                printf("%s", line);  /* Output blank line separator */
-                continue;
-            }
+    mail_writer_init(&run.out, STDOUT_FILENO);
 
-            /* Check for continuation line */
-            if (is_continuation_line(line)) {
-                if (keep_current_header) {
-                    process_line(line);
-                    printf("%s", line);
-                }
-                continue;
+    /* Handle -l option (list removal headers) */
+    if (list_only) {
+        for (i = 0; i < removal_count; i++) {
+            mail_write_line(&run.out, removal_list[i]);
+        }
+    } else {
+        clean_pool pool;
+
+        header_matcher_compile(&run.matcher, removal_list, removal_count);
+
+        if (want_stats) {
+            if (clean_stats_init(&stats, removal_count) == 0) {
+                run.stats = &stats;
+            } else {
+                fprintf(stderr, "%s: --stats: %s\n", argv[0], strerror(ENOMEM));
             }
+        }
 
-            /* Extract header name */
-            char header_name[256] = {0};
-            const char *colon = strchr(line, ':');
-            if (colon && (colon - line) < 255) {
-                strncpy(header_name, line, colon - line);
-                header_name[colon - line] = '\0';
-
-                /* Special case: Received header - keep only first */
-                if (strcasecmp_custom(header_name, "Received") == 0) {
-                    if (!first_received_seen) {
-                        first_received_seen = 1;
-                        keep_current_header = 1;
-                        process_line(line);
-                        printf("%s", line);
-                    } else {
-                        keep_current_header = 0;
-                    }
-                    continue;
-                }
+        /* A journal that cannot be read is not used, nor replaced */
+        if (journal_path) {
+            if (clean_journal_open(&journal, journal_path, clean_journal_hash(removal_list, removal_count)) == 0) {
+                run.journal = &journal;
+                run.log = &log;
+            } else {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], journal_path, strerror(errno));
+                run.errors++;
+            }
+        }
 
-                /* Check if this header should be removed */
-                if (should_remove_header(header_name, removal_list, removal_count)) {
-                    keep_current_header = 0;
-                } else {
-                    keep_current_header = 1;
-                    process_line(line);
-                    printf("%s", line);
-                }
+        if (jobs > 1 && !serve_path) {
+            if (pool_start(&pool, &run, jobs) == 0) {
+                run.pool = &pool;
             } else {
-                /* Not a valid header line, output as-is */
-                process_line(line);
-                printf("%s", line);
+                fprintf(stderr, "%s: cannot start workers: %s\n", argv[0], strerror(errno));
             }
+        }
+
+        if (serve_path) {
+            serve_run(&run, serve_path, jobs);
+        } else if (run.mbox) {
+            /* Each argument is one mbox stream; no arguments means stdin */
+            for (i = optind; i < argc; i++) {
+                clean_mbox(&run, argv[i]);
+            }
+            if (optind == argc) clean_mbox(&run, "-");
+        } else if (run.watch) {
+            watch_run(&run, argv + optind, argc - optind);
         } else {
-            /* In body section - output everything unchanged */
-            printf("%s", line);
+            for (i = optind; i < argc; i++) {
+                clean_path(&run, argv[i], 0);
+            }
+        }
+        if (read_stdin) {
+            clean_stdin_list(&run);
         }
+
+        if (run.pool) {
+            pool_finish(&pool, &run);
+            run.pool = NULL;
+        }
+        if (run.journal) {
+            if (clean_journal_save(&journal, &log, journal_path) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], journal_path, strerror(errno));
+                run.errors++;
+            }
+            clean_journal_log_free(&log);
+            clean_journal_close(&journal);
+        }
+        header_matcher_free(&run.matcher);
     }
 
+    clean_stats_start(run.stats, &t);
+    if (mail_writer_flush(&run.out) == -1) {
+        fprintf(stderr, "%s: write error: %s\n", argv[0], strerror(errno));
+        run.errors++;
+    }
+    if (run.stats) {
+        clean_stats_time(run.stats, CLEAN_PHASE_WRITE, &t);
+        stats.bytes_out += run.out.written;
+        print_stats(&stats, removal_list);
+        clean_stats_free(&stats);
+    }
+    mail_writer_free(&run.out);
+
     /* Cleanup */
     if (removal_list) {
-        for (int i = 0; i < removal_count; i++) {
+        for (i = 0; i < removal_count; i++) {
             free(removal_list[i]);
         }
         free(removal_list);
     }
-    free(line);
-    fclose(file);
-    return 0;
+
+    if (fflush(stdout) == EOF) return 1;
+    return run.errors ? 1 : 0;
 }
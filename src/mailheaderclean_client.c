@@ -0,0 +1,123 @@
+/*
+mailheaderclean-client - clean messages through a mailheaderclean --serve
+Thin client for MTA/MDA hooks: sends each message over the server's Unix
+socket and writes the cleaned message to stdout, so no removal list is
+built and no filter process is started per message.
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+
+/* Include the --serve wire protocol and zero-copy input */
+#include "mailheaderclean_serve.h"
+#include "mail_io.h"
+
+#define CLIENT_DEFAULT_SOCKET "/run/mailheaderclean.sock"
+#define EX_TEMPFAIL 75          /* sysexits.h: try again later */
+
+/* Write all n bytes at p to stdout. Returns 0, or -1 with errno set. */
+static int write_all(const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(STDOUT_FILENO, p, n);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void usage(const char *progname) {
+    printf("Usage: %s [-p] [-S SOCKET] [FILE ...]\n", progname);
+    printf("Clean each FILE (stdin if none, or for -) with a running\n");
+    printf("mailheaderclean --serve and write the result to stdout\n");
+    printf("\nOptions:\n");
+    printf("  -S, --socket SOCKET  Server socket (default: $MAILHEADERCLEAN_SOCKET,\n");
+    printf("                       or %s)\n", CLIENT_DEFAULT_SOCKET);
+    printf("  -p, --passthrough    If the server cannot clean a message, write it\n");
+    printf("                       unchanged instead of failing\n");
+    printf("  -h, --help           Show this help message\n");
+    printf("\nExit status: 0 on success, 1 if a FILE cannot be read, 2 on usage\n");
+    printf("errors, 75 (EX_TEMPFAIL) if the server cannot be reached or fails.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = getenv("MAILHEADERCLEAN_SOCKET");
+    int passthrough = 0, fd = -1, status = 0, opt;
+    char *out = NULL;
+    size_t out_len = 0, out_cap = 0;
+
+    static const struct option long_options[] = {
+        { "socket",      required_argument, NULL, 'S' },
+        { "passthrough", no_argument,       NULL, 'p' },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "S:ph", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'S':
+            socket_path = optarg;
+            break;
+        case 'p':
+            passthrough = 1;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            return 2;
+        }
+    }
+    if (!socket_path || !*socket_path) socket_path = CLIENT_DEFAULT_SOCKET;
+
+    for (int i = optind; i < argc || i == optind; i++) {
+        const char *path = i < argc ? argv[i] : "-";
+        mail_input in;
+        int r;
+
+        r = strcmp(path, "-") == 0 ? mail_input_fd(&in, STDIN_FILENO) : mail_input_open(&in, path);
+        if (r == -1) {
+            fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], path);
+            if (!status) status = 1;
+            continue;
+        }
+
+        /* One connection for all FILEs; reconnect after a failed request */
+        if (fd == -1) fd = clean_serve_connect(socket_path);
+        if (fd == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], socket_path, strerror(errno));
+            r = -1;
+        } else if (clean_serve_request(fd, in.data, in.len, &out, &out_len, &out_cap) == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+            close(fd);
+            fd = -1;
+            r = -1;
+        }
+
+        if (r == 0) {
+            r = write_all(out, out_len);
+        } else if (passthrough) {
+            r = write_all(in.data, in.len);
+        } else {
+            status = EX_TEMPFAIL;
+            r = 0;
+        }
+        mail_input_close(&in);
+        if (r == -1) {
+            fprintf(stderr, "%s: write error: %s\n", argv[0], strerror(errno));
+            status = 1;
+            break;
+        }
+    }
+
+    if (fd != -1) close(fd);
+    free(out);
+    return status;
+}
@@ -0,0 +1,356 @@
+/*
+mailheaderclean_filter.h - Removal list and header block filter
+
+Builds the removal list from the built-in headers and the MAILHEADERCLEAN,
+MAILHEADERCLEAN_PRESERVE and MAILHEADERCLEAN_EXTRA environment variables,
+and filters one message's header block against its compiled matcher,
+from a mapped file or streamed through mail_mbox.h.
+
+Shared by the standalone binary, the bash loadable builtin and
+mail-tools --coproc.
+*/
+
+#ifndef MAILHEADERCLEAN_FILTER_H
+#define MAILHEADERCLEAN_FILTER_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <strings.h>
+
+#include "mailheaderclean_headers.h"
+#include "mailheaderclean_matcher.h"
+#include "mailheaderclean_stats.h"
+#include "mail_io.h"
+#include "mail_mbox.h"
+
+/* Run by stream_messages() before each line; the bash builtin defines it
+ * as QUIT so that a long mbox can be interrupted */
+#ifndef FILTER_STREAM_CHECK
+#define FILTER_STREAM_CHECK() do { } while (0)
+#endif
+
+/* Case-insensitive string comparison */
+static inline int strcasecmp_custom(const char *s1, const char *s2) {
+    while (*s1 && *s2) {
+        int c1 = tolower((unsigned char)*s1);
+        int c2 = tolower((unsigned char)*s2);
+        if (c1 != c2) return c1 - c2;
+        s1++;
+        s2++;
+    }
+    return tolower((unsigned char)*s1) - tolower((unsigned char)*s2);
+}
+
+/* Parse comma-separated header list from a string */
+static inline int parse_csv_headers(const char *csv_string, char ***headers) {
+    if (!csv_string || !*csv_string) {
+        *headers = NULL;
+        return 0;
+    }
+
+    /* Count headers (comma-separated) */
+    int count = 1;
+    const char *p = csv_string;
+    while (*p) {
+        if (*p == ',') count++;
+        p++;
+    }
+
+    /* Allocate array */
+    *headers = malloc(count * sizeof(char *));
+    if (!*headers) return 0;
+
+    /* Parse headers */
+    char *env_copy = strdup(csv_string);
+    if (!env_copy) {
+        free(*headers);
+        return 0;
+    }
+
+    int i = 0;
+    char *token = strtok(env_copy, ",");
+    while (token && i < count) {
+        /* Trim whitespace */
+        while (isspace((unsigned char)*token)) token++;
+        char *end = token + strlen(token) - 1;
+        while (end > token && isspace((unsigned char)*end)) *end-- = '\0';
+
+        (*headers)[i++] = strdup(token);
+        token = strtok(NULL, ",");
+    }
+
+    free(env_copy);
+    return i;
+}
+
+/* Build the final removal list based on environment variables
+ *
+ * Processing order:
+ *   1. MAILHEADERCLEAN (or built-in hardcoded list if not set) - establishes base
+ *   2. MAILHEADERCLEAN_PRESERVE - removes headers from base (subtract)
+ *   3. MAILHEADERCLEAN_EXTRA - adds headers to final list (add)
+ *
+ * Formula: (MAILHEADERCLEAN or built-in) - PRESERVE + EXTRA
+ */
+static inline int build_removal_list(char ***removal_list) {
+    char **base_list = NULL;
+    int base_count = 0;
+    char **preserve_list = NULL;
+    int preserve_count = 0;
+    char **extra_list = NULL;
+    int extra_count = 0;
+    int i, j, k;
+    int found;
+
+    /* Step 1: Get base removal list (MAILHEADERCLEAN or hardcoded) */
+    char *env_mailheaderclean = getenv("MAILHEADERCLEAN");
+    if (env_mailheaderclean && *env_mailheaderclean) {
+        /* Use custom removal list from environment */
+        base_count = parse_csv_headers(env_mailheaderclean, &base_list);
+    } else {
+        /* Use hardcoded list - count items first */
+        for (i = 0; HEADERS_TO_REMOVE[i] != NULL; i++) {
+            base_count++;
+        }
+        /* Copy hardcoded list to dynamic array */
+        base_list = malloc(base_count * sizeof(char *));
+        if (!base_list) return 0;
+        for (i = 0; i < base_count; i++) {
+            base_list[i] = strdup(HEADERS_TO_REMOVE[i]);
+        }
+    }
+
+    /* Step 2: Parse preserve list and remove from base (MAILHEADERCLEAN_PRESERVE) */
+    char *env_preserve = getenv("MAILHEADERCLEAN_PRESERVE");
+    if (env_preserve && *env_preserve) {
+        preserve_count = parse_csv_headers(env_preserve, &preserve_list);
+
+        /* Remove preserved headers from base list */
+        for (i = 0; i < preserve_count; i++) {
+            for (j = 0; j < base_count; j++) {
+                if (base_list[j] && strcasecmp_custom(preserve_list[i], base_list[j]) == 0) {
+                    free(base_list[j]);
+                    base_list[j] = NULL;  /* Mark as removed */
+                }
+            }
+        }
+
+        /* Cleanup preserve list */
+        for (i = 0; i < preserve_count; i++) {
+            free(preserve_list[i]);
+        }
+        free(preserve_list);
+    }
+
+    /* Step 3: Parse extra list and add to base (MAILHEADERCLEAN_EXTRA) */
+    char *env_extra = getenv("MAILHEADERCLEAN_EXTRA");
+    if (env_extra && *env_extra) {
+        extra_count = parse_csv_headers(env_extra, &extra_list);
+    }
+
+    /* Compact base list (remove NULLs) and prepare for extra additions */
+    int final_count = 0;
+    for (i = 0; i < base_count; i++) {
+        if (base_list[i]) final_count++;
+    }
+    final_count += extra_count;  /* Reserve space for extras */
+
+    *removal_list = malloc(final_count * sizeof(char *));
+    if (!*removal_list) {
+        /* Cleanup on error */
+        for (i = 0; i < base_count; i++) {
+            if (base_list[i]) free(base_list[i]);
+        }
+        free(base_list);
+        for (i = 0; i < extra_count; i++) {
+            free(extra_list[i]);
+        }
+        free(extra_list);
+        return 0;
+    }
+
+    /* Copy non-NULL entries from base */
+    k = 0;
+    for (i = 0; i < base_count; i++) {
+        if (base_list[i]) {
+            (*removal_list)[k++] = base_list[i];
+        }
+    }
+    free(base_list);  /* Free the old array, but not the strings (they're copied to removal_list) */
+
+    /* Add extra headers if not already in list */
+    for (i = 0; i < extra_count; i++) {
+        found = 0;
+        for (j = 0; j < k; j++) {
+            if (strcasecmp_custom(extra_list[i], (*removal_list)[j]) == 0) {
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            (*removal_list)[k++] = extra_list[i];
+        } else {
+            free(extra_list[i]);  /* Already in list, don't need duplicate */
+        }
+    }
+    free(extra_list);  /* Free the array */
+
+    return k;  /* Return actual count */
+}
+
+/* Filter the header block of one message. Kept header lines are written
+ * with CRs removed and tabs folded (copied only when they contain either).
+ * Every field is counted in stats, unless NULL. Returns the start of the
+ * blank separator line, or the end of the input if there is none. */
+static inline const char *filter_header_block(const header_matcher *matcher, const mail_input *in,
+                                              mail_writer *out, clean_stats *stats) {
+    const char *p = in->data;
+    const char *end = in->data + in->len;
+    int keep_current_header = 1;
+    int first_received_seen = 0;
+
+    if (stats) clean_stats_message(stats, in->len);
+    while (p < end) {
+        const char *eol = mail_line_end(p, end);
+
+        /* Check for end of headers */
+        if (mail_line_is_blank(p, eol)) {
+            return p;
+        }
+
+        /* Check for continuation line */
+        if (mail_line_is_continuation(p, eol)) {
+            if (keep_current_header) {
+                mail_write_folded(out, p, eol - p);
+            }
+            if (stats) clean_stats_continuation(stats, eol - p);
+            p = eol;
+            continue;
+        }
+
+        /* Extract header name */
+        const char *colon = memchr(p, ':', eol - p);
+        size_t name_len = colon ? (size_t)(colon - p) : 0;
+        if (colon) {
+            /* Special case: Received header - keep only first */
+            if (name_len == 8 && strncasecmp(p, "Received", 8) == 0) {
+                if (!first_received_seen) {
+                    first_received_seen = 1;
+                    keep_current_header = 1;
+                    mail_write_folded(out, p, eol - p);
+                } else {
+                    keep_current_header = 0;
+                }
+                if (stats) {
+                    clean_stats_field(stats, keep_current_header ? CLEAN_STATS_KEPT : CLEAN_STATS_RECEIVED,
+                                      eol - p);
+                }
+                p = eol;
+                continue;
+            }
+
+            /* Check if this header should be removed */
+            int pattern = header_matcher_match(matcher, p, name_len);
+            if (pattern != -1) {
+                keep_current_header = 0;
+            } else {
+                keep_current_header = 1;
+                mail_write_folded(out, p, eol - p);
+            }
+            if (stats) clean_stats_field(stats, pattern == -1 ? CLEAN_STATS_KEPT : pattern, eol - p);
+        } else {
+            /* Not a valid header line, output as-is */
+            mail_write_folded(out, p, eol - p);
+        }
+        p = eol;
+    }
+    return end;
+}
+
+/* Filter one message: the header block, then the blank separator line and
+ * the body unchanged, straight from the input */
+static inline void filter_message(const header_matcher *matcher, const mail_input *in, mail_writer *out,
+                                  clean_stats *stats) {
+    const char *rest = filter_header_block(matcher, in, out, stats);
+
+    mail_write_range(out, rest, in->data + in->len - rest);
+}
+
+/* Streaming version of filter_message() for mbox files, stdin and files
+ * too large to map: From_ lines, separators and bodies pass through
+ * unchanged, headers are filtered per message. FILTER_STREAM_CHECK() runs
+ * once per line. Returns 0, or -1 on a read error. */
+static inline int stream_messages(const header_matcher *matcher, mail_mbox *mb, mail_writer *out,
+                                  clean_stats *stats) {
+    mail_mbox_chunk c;
+    int keep_current_header = 1;
+    int keep_current_line = 1;      /* later pieces of an overlong line */
+    int first_received_seen = 0;
+    uint64_t t = 0;
+    int r;
+
+    /* With stats, each turn charges the previous line to classify, the
+     * flush to write and the refill to read */
+    clean_stats_start(stats, &t);
+    while (clean_stats_time(stats, CLEAN_PHASE_CLASSIFY, &t), mail_writer_detach(out),
+           clean_stats_time(stats, CLEAN_PHASE_WRITE, &t), (r = mail_mbox_next(mb, &c)) > 0) {
+        clean_stats_time(stats, CLEAN_PHASE_READ, &t);
+        FILTER_STREAM_CHECK();
+        if (c.new_message) {
+            keep_current_header = 1;
+            keep_current_line = 1;
+            first_received_seen = 0;
+            if (stats) clean_stats_message(stats, 0);
+        }
+        if (stats) stats->bytes_in += c.len;
+        if (c.part != MBOX_HEADER) {
+            mail_write_range(out, c.p, c.len);
+            continue;
+        }
+
+        /* Continuation lines, and later pieces of an overlong line */
+        if (!c.line_start || mail_line_is_continuation(c.p, c.p + c.len)) {
+            if (c.line_start) keep_current_line = keep_current_header;
+            if (keep_current_line) {
+                mail_write_folded(out, c.p, c.len);
+            }
+            if (stats) {
+                if (c.line_start) {
+                    clean_stats_continuation(stats, c.len);
+                } else {
+                    clean_stats_bytes(stats, c.len);
+                }
+            }
+            continue;
+        }
+
+        const char *colon = memchr(c.p, ':', c.len);
+        size_t name_len = colon ? (size_t)(colon - c.p) : 0;
+        if (colon) {
+            int pattern = CLEAN_STATS_KEPT;
+            if (name_len == 8 && strncasecmp(c.p, "Received", 8) == 0) {
+                keep_current_header = !first_received_seen;
+                first_received_seen = 1;
+                if (!keep_current_header) pattern = CLEAN_STATS_RECEIVED;
+            } else {
+                pattern = header_matcher_match(matcher, c.p, name_len);
+                keep_current_header = pattern == -1;
+                if (keep_current_header) pattern = CLEAN_STATS_KEPT;
+            }
+            keep_current_line = keep_current_header;
+            if (keep_current_header) {
+                mail_write_folded(out, c.p, c.len);
+            }
+            if (stats) clean_stats_field(stats, pattern, c.len);
+        } else {
+            /* Not a valid header line, output as-is; it does not end the
+             * field before it, whose continuation lines follow its fate */
+            keep_current_line = 1;
+            mail_write_folded(out, c.p, c.len);
+        }
+    }
+    return r;
+}
+
+#endif /* MAILHEADERCLEAN_FILTER_H */
@@ -0,0 +1,305 @@
+/*
+mailheaderclean_journal.h - Processed-state journal for mailheaderclean --journal
+
+A journal file remembers the messages that are known to be clean: every
+file mailheaderclean --in-place rewrote or found already clean, keyed by
+device and inode and stamped with its size and mtime. On the next run a
+file whose stat() still matches its entry is skipped without being
+opened, so a nightly run over a large maildir costs one stat() per old
+message and real work only for new mail. Cleaning preserves the mtime
+but gives the file a new inode and size, so the entry recorded is the
+one of the rewritten file.
+
+The journal is tied to the removal list it was written with: a hash of
+the list is stored in the head, and a journal written with another list
+(different MAILHEADERCLEAN, _PRESERVE or _EXTRA) is ignored and replaced.
+Entries of deleted files stay until their inode is reused; deleting the
+journal is always safe and only costs one full run.
+
+Layout (native byte order):
+
+  clean_journal_head
+  entries           count * clean_journal_entry, sorted by (dev, ino)
+
+The old journal is mapped read-only and shared by all --jobs workers;
+each worker collects its new entries in its own clean_journal_log. At
+the end of the run they are merged with the old entries (new ones win)
+and written to a temporary file that is renamed over the journal.
+*/
+
+#ifndef MAILHEADERCLEAN_JOURNAL_H
+#define MAILHEADERCLEAN_JOURNAL_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CLEAN_JOURNAL_MAGIC "MHCJNL\0\1"
+
+typedef struct {
+    char magic[8];
+    uint64_t list_hash;     /* clean_journal_hash() of the removal list */
+    uint64_t count;
+} clean_journal_head;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} clean_journal_entry;
+
+typedef struct {
+    const clean_journal_entry *entries;     /* old entries, sorted */
+    size_t count;
+    void *map;
+    size_t map_len;
+    uint64_t list_hash;
+} clean_journal;
+
+/* Entries recorded during the run, unsorted */
+typedef struct {
+    clean_journal_entry *items;
+    size_t count, cap;
+    int error;              /* sticky ENOMEM */
+} clean_journal_log;
+
+/* FNV-1a over the lower-cased patterns, in order */
+static inline uint64_t clean_journal_hash(char **removal_list, int removal_count) {
+    uint64_t h = 14695981039346656037ULL;
+
+    for (int i = 0; i < removal_count; i++) {
+        for (const char *p = removal_list[i]; ; p++) {
+            h ^= (unsigned char)tolower((unsigned char)*p);
+            h *= 1099511628211ULL;
+            if (*p == '\0') break;
+        }
+    }
+    return h;
+}
+
+/* Map the journal at path. A missing, damaged or foreign-list journal
+ * loads as empty. Returns 0, or -1 with errno set if path exists but
+ * cannot be read. */
+static inline int clean_journal_open(clean_journal *j, const char *path, uint64_t list_hash) {
+    const clean_journal_head *h;
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(j, 0, sizeof(*j));
+    j->list_hash = list_hash;
+    fd = open(path, O_RDONLY);
+    if (fd == -1) return errno == ENOENT ? 0 : -1;
+    if (fstat(fd, &st) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(*h)) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    h = map;
+    if (memcmp(h->magic, CLEAN_JOURNAL_MAGIC, 8) != 0 || h->list_hash != list_hash ||
+        h->count != ((size_t)st.st_size - sizeof(*h)) / sizeof(clean_journal_entry) ||
+        ((size_t)st.st_size - sizeof(*h)) % sizeof(clean_journal_entry) != 0) {
+        munmap(map, (size_t)st.st_size);
+        return 0;
+    }
+    j->map = map;
+    j->map_len = (size_t)st.st_size;
+    j->entries = (const clean_journal_entry *)(h + 1);
+    j->count = (size_t)h->count;
+    return 0;
+}
+
+static inline void clean_journal_close(clean_journal *j) {
+    if (j->map) munmap(j->map, j->map_len);
+    memset(j, 0, sizeof(*j));
+}
+
+static inline int clean_journal_cmp(const clean_journal_entry *a, const clean_journal_entry *b) {
+    if (a->dev != b->dev) return a->dev < b->dev ? -1 : 1;
+    if (a->ino != b->ino) return a->ino < b->ino ? -1 : 1;
+    return 0;
+}
+
+static inline int clean_journal_qsort_cmp(const void *a, const void *b) {
+    return clean_journal_cmp(a, b);
+}
+
+static inline void clean_journal_key(clean_journal_entry *e, const struct stat *st) {
+    e->dev = (uint64_t)st->st_dev;
+    e->ino = (uint64_t)st->st_ino;
+    e->size = (uint64_t)st->st_size;
+    e->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    e->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+}
+
+/* The file described by st was clean when last seen and is unchanged */
+static inline int clean_journal_current(const clean_journal *j, const struct stat *st) {
+    clean_journal_entry key;
+    size_t lo = 0, hi = j->count;
+
+    clean_journal_key(&key, st);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const clean_journal_entry *e = &j->entries[mid];
+        int c = clean_journal_cmp(e, &key);
+        if (c == 0) {
+            return e->size == key.size && e->mtime_sec == key.mtime_sec && e->mtime_nsec == key.mtime_nsec;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+/* Record the file described by st as clean */
+static inline void clean_journal_add(clean_journal_log *log, const struct stat *st) {
+    if (log->count == log->cap) {
+        size_t cap = log->cap ? log->cap * 2 : 256;
+        clean_journal_entry *n = realloc(log->items, cap * sizeof(*n));
+        if (!n) {
+            log->error = ENOMEM;
+            return;
+        }
+        log->items = n;
+        log->cap = cap;
+    }
+    clean_journal_key(&log->items[log->count++], st);
+}
+
+/* Move src's entries to the end of dst */
+static inline void clean_journal_log_merge(clean_journal_log *dst, clean_journal_log *src) {
+    if (src->error) dst->error = src->error;
+    for (size_t i = 0; i < src->count && !dst->error; i++) {
+        if (dst->count == dst->cap) {
+            size_t cap = dst->cap ? dst->cap * 2 : 256;
+            while (cap < dst->count + src->count - i) cap *= 2;
+            clean_journal_entry *n = realloc(dst->items, cap * sizeof(*n));
+            if (!n) {
+                dst->error = ENOMEM;
+                break;
+            }
+            dst->items = n;
+            dst->cap = cap;
+        }
+        dst->items[dst->count++] = src->items[i];
+    }
+    free(src->items);
+    memset(src, 0, sizeof(*src));
+}
+
+static inline void clean_journal_log_free(clean_journal_log *log) {
+    free(log->items);
+    memset(log, 0, sizeof(*log));
+}
+
+/* write() all of n bytes. Returns 0, or -1 with errno set. */
+static inline int clean_journal_write(int fd, const void *p, size_t n) {
+    const char *c = p;
+
+    while (n > 0) {
+        ssize_t w = write(fd, c, n);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        c += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Merge the old entries with log (sorted here; an entry from log replaces
+ * the old one for the same inode) and write the journal to a temporary file
+ * next to path, then rename it over path. Nothing is written when log is
+ * empty. Returns 0, or -1 with errno set. */
+static inline int clean_journal_save(const clean_journal *j, clean_journal_log *log, const char *path) {
+    clean_journal_head head;
+    clean_journal_entry *merged;
+    size_t n = 0, a = 0, b = 0, path_len = strlen(path);
+    char *tmp;
+    int fd, saved;
+
+    if (log->error) {
+        errno = log->error;
+        return -1;
+    }
+    if (log->count == 0) return 0;
+
+    qsort(log->items, log->count, sizeof(*log->items), clean_journal_qsort_cmp);
+    merged = malloc((j->count + log->count) * sizeof(*merged));
+    tmp = malloc(path_len + sizeof(".XXXXXX"));
+    if (!merged || !tmp) {
+        free(merged);
+        free(tmp);
+        errno = ENOMEM;
+        return -1;
+    }
+    while (a < j->count || b < log->count) {
+        const clean_journal_entry *e;
+        if (b == log->count || (a < j->count && clean_journal_cmp(&j->entries[a], &log->items[b]) < 0)) {
+            e = &j->entries[a++];
+        } else {
+            /* Drop an old entry for the same inode */
+            if (a < j->count && clean_journal_cmp(&j->entries[a], &log->items[b]) == 0) a++;
+            e = &log->items[b++];
+        }
+        /* A file named twice in one run is logged twice */
+        if (n > 0 && clean_journal_cmp(&merged[n - 1], e) == 0) {
+            merged[n - 1] = *e;
+        } else {
+            merged[n++] = *e;
+        }
+    }
+
+    memcpy(head.magic, CLEAN_JOURNAL_MAGIC, 8);
+    head.list_hash = j->list_hash;
+    head.count = n;
+
+    memcpy(tmp, path, path_len);
+    memcpy(tmp + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+    fd = mkstemp(tmp);
+    if (fd == -1) goto fail;
+    fchmod(fd, 0644);
+    if (clean_journal_write(fd, &head, sizeof(head)) == -1 ||
+        clean_journal_write(fd, merged, n * sizeof(*merged)) == -1) goto fail;
+    if (close(fd) == -1) {
+        fd = -1;
+        goto fail;
+    }
+    fd = -1;
+    if (rename(tmp, path) == -1) goto fail;
+    free(merged);
+    free(tmp);
+    return 0;
+
+fail:
+    saved = errno;
+    if (fd != -1) close(fd);
+    unlink(tmp);
+    free(merged);
+    free(tmp);
+    errno = saved;
+    return -1;
+}
+
+#endif /* MAILHEADERCLEAN_JOURNAL_H */
@@ -26,7 +26,7 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
-#include <fnmatch.h>
+#include <fcntl.h>
 
 #include "builtins.h"
 #include "shell.h"
@@ -35,349 +35,258 @@
 extern char **make_builtin_argv();
 extern void builtin_usage();
 extern void builtin_error();
+extern void sh_invalidid();
+
+/* Include the shared removal list and message filter, compiled matcher,
+ * run statistics, zero-copy I/O and the mbox splitter. The streaming
+ * filter checks for signals on every line. */
+#define FILTER_STREAM_CHECK() QUIT
+#include "mailheaderclean_filter.h"
+#include "mailheaderclean_matcher.h"
+#include "mailheaderclean_stats.h"
+#include "mail_io.h"
+#include "mail_mbox.h"
+
+/* Process-lifetime cache of the compiled removal list.
+ *
+ * Building the list (getenv, CSV parsing, strdup, dedup) and compiling the
+ * matcher used to happen on every call and dominated per-call cost for small
+ * messages in long-running bash loops. The cache is keyed on the values of
+ * the environment variables the list is derived from and is rebuilt only
+ * when one of them changes. */
+static const char *REMOVAL_CACHE_KEYS[] = {
+    "MAILHEADERCLEAN",
+    "MAILHEADERCLEAN_PRESERVE",
+    "MAILHEADERCLEAN_EXTRA",
+    "MAILHEADERCLEAN_MATCHER",
+};
+#define REMOVAL_CACHE_NKEYS (sizeof(REMOVAL_CACHE_KEYS) / sizeof(REMOVAL_CACHE_KEYS[0]))
 
-/* Include shared header removal list */
-#include "mailheaderclean_headers.h"
+static struct {
+    int valid;
+    char *values[REMOVAL_CACHE_NKEYS];  /* NULL = variable unset */
+    char **removal_list;
+    int removal_count;
+    header_matcher matcher;
+} removal_cache;
 
-/* Helper function: process a line (remove \r, convert \t to space) */
-static void process_line(char *line) {
-    char *src = line, *dst = line;
+static void removal_cache_free(void) {
+    size_t i;
 
-    while (*src) {
-        if (*src == '\r') {
-            src++;
-            continue;
-        }
-        if (*src == '\t') {
-            *dst++ = ' ';
-            src++;
-            continue;
-        }
-        *dst++ = *src++;
+    if (removal_cache.valid) {
+        header_matcher_free(&removal_cache.matcher);
     }
-    *dst = '\0';
-}
-
-/* Helper function: check if a line is blank */
-static int is_blank_line(const char *line) {
-    while (*line) {
-        if (*line == '\n') return 1;
-        if (!isspace((unsigned char)*line)) return 0;
-        line++;
+    if (removal_cache.removal_list) {
+        for (int j = 0; j < removal_cache.removal_count; j++) {
+            free(removal_cache.removal_list[j]);
+        }
+        free(removal_cache.removal_list);
     }
-    return 1;
-}
-
-/* Helper function: check if a line is a continuation line */
-static int is_continuation_line(const char *line) {
-    return (line[0] == ' ' || line[0] == '\t');
-}
-
-/* Case-insensitive string comparison */
-static int strcasecmp_custom(const char *s1, const char *s2) {
-    while (*s1 && *s2) {
-        int c1 = tolower((unsigned char)*s1);
-        int c2 = tolower((unsigned char)*s2);
-        if (c1 != c2) return c1 - c2;
-        s1++;
-        s2++;
+    for (i = 0; i < REMOVAL_CACHE_NKEYS; i++) {
+        free(removal_cache.values[i]);
     }
-    return tolower((unsigned char)*s1) - tolower((unsigned char)*s2);
+    memset(&removal_cache, 0, sizeof(removal_cache));
 }
 
-/* Check if header should be removed
- * Supports wildcard patterns using shell glob syntax:
- *   X-*         matches any header starting with X-
- *   *-Status    matches any header ending with -Status
- *   X-MS-*      matches any header starting with X-MS-
- *   X-*-Status  matches X- followed by anything, ending in -Status
- */
-static int should_remove_header(const char *header, char **removal_list, int removal_count) {
-    int i;
-
-    /* Check removal list with wildcard support */
-    for (i = 0; i < removal_count; i++) {
-        /* Use fnmatch for glob pattern matching (case-insensitive) */
-#ifdef FNM_CASEFOLD
-        /* GNU extension for case-insensitive matching */
-        if (fnmatch(removal_list[i], header, FNM_CASEFOLD) == 0) {
-            return 1;
-        }
-#else
-        /* Fallback: convert both to lowercase for comparison */
-        char pattern_lower[256], header_lower[256];
-        const char *p_src = removal_list[i];
-        const char *h_src = header;
-        char *p_dst = pattern_lower;
-        char *h_dst = header_lower;
-
-        while (*p_src && p_dst < pattern_lower + 255) {
-            *p_dst++ = tolower((unsigned char)*p_src++);
-        }
-        *p_dst = '\0';
-
-        while (*h_src && h_dst < header_lower + 255) {
-            *h_dst++ = tolower((unsigned char)*h_src++);
+/* Return the cached removal list, rebuilding it if the environment changed */
+static header_matcher *get_removal_matcher(void) {
+    const char *current[REMOVAL_CACHE_NKEYS];
+    int changed = !removal_cache.valid;
+    size_t i;
+
+    for (i = 0; i < REMOVAL_CACHE_NKEYS; i++) {
+        current[i] = getenv(REMOVAL_CACHE_KEYS[i]);
+        if (!changed) {
+            const char *cached = removal_cache.values[i];
+            if ((current[i] == NULL) != (cached == NULL) ||
+                (current[i] && strcmp(current[i], cached) != 0)) {
+                changed = 1;
+            }
         }
-        *h_dst = '\0';
+    }
 
-        if (fnmatch(pattern_lower, header_lower, 0) == 0) {
-            return 1;
+    if (changed) {
+        removal_cache_free();
+        for (i = 0; i < REMOVAL_CACHE_NKEYS; i++) {
+            removal_cache.values[i] = current[i] ? strdup(current[i]) : NULL;
         }
-#endif
+        removal_cache.removal_count = build_removal_list(&removal_cache.removal_list);
+        header_matcher_compile(&removal_cache.matcher,
+                               removal_cache.removal_list, removal_cache.removal_count);
+        removal_cache.valid = 1;
     }
 
-    return 0;
+    return &removal_cache.matcher;
 }
 
-/* Parse comma-separated header list from a string */
-static int parse_csv_headers(const char *csv_string, char ***headers) {
-    if (!csv_string || !*csv_string) {
-        *headers = NULL;
-        return 0;
-    }
-
-    /* Count headers (comma-separated) */
-    int count = 1;
-    const char *p = csv_string;
-    while (*p) {
-        if (*p == ',') count++;
-        p++;
+/* Filter every message read from fd, as an mbox or as a single message,
+ * with bounded memory. From_ lines, separators and bodies pass through
+ * unchanged. */
+static int filter_stream(int fd, const char *filename, int single, FILE *output, clean_stats *stats) {
+    mail_mbox mb;
+    mail_writer out;
+    uint64_t t = 0;
+    int r, w;
+
+    if ((single ? mail_mbox_init_message(&mb, fd) : mail_mbox_init(&mb, fd)) == -1) {
+        builtin_error("%s", strerror(errno));
+        return EXECUTION_FAILURE;
     }
 
-    /* Allocate array */
-    *headers = malloc(count * sizeof(char *));
-    if (!*headers) return 0;
+    /* Output goes straight to the descriptor behind the stream */
+    fflush(output);
+    mail_writer_init(&out, fileno(output));
 
-    /* Parse headers */
-    char *env_copy = strdup(csv_string);
-    if (!env_copy) {
-        free(*headers);
-        return 0;
-    }
+    /* Removal list from environment variables (cached across calls) */
+    r = stream_messages(get_removal_matcher(), &mb, &out, stats);
 
-    int i = 0;
-    char *token = strtok(env_copy, ",");
-    while (token && i < count) {
-        /* Trim whitespace */
-        while (isspace((unsigned char)*token)) token++;
-        char *end = token + strlen(token) - 1;
-        while (end > token && isspace((unsigned char)*end)) *end-- = '\0';
+    clean_stats_start(stats, &t);
+    w = mail_writer_flush(&out);
+    if (stats) stats->bytes_out += out.written;
+    clean_stats_time(stats, CLEAN_PHASE_WRITE, &t);
+    mail_writer_free(&out);
+    mail_mbox_free(&mb);
 
-        (*headers)[i++] = strdup(token);
-        token = strtok(NULL, ",");
+    if (r == -1) {
+        builtin_error("%s: read error: %s", filename, strerror(mb.error));
+        return EXECUTION_FAILURE;
     }
-
-    free(env_copy);
-    return i;
-}
-
-/* Build the final removal list based on environment variables
- *
- * Processing order:
- *   1. MAILHEADERCLEAN (or built-in hardcoded list if not set) - establishes base
- *   2. MAILHEADERCLEAN_PRESERVE - removes headers from base (subtract)
- *   3. MAILHEADERCLEAN_EXTRA - adds headers to final list (add)
- *
- * Formula: (MAILHEADERCLEAN or built-in) - PRESERVE + EXTRA
- */
-static int build_removal_list(char ***removal_list) {
-    char **base_list = NULL;
-    int base_count = 0;
-    char **preserve_list = NULL;
-    int preserve_count = 0;
-    char **extra_list = NULL;
-    int extra_count = 0;
-    int i, j, k;
-    int found;
-
-    /* Step 1: Get base removal list (MAILHEADERCLEAN or hardcoded) */
-    char *env_mailheaderclean = getenv("MAILHEADERCLEAN");
-    if (env_mailheaderclean && *env_mailheaderclean) {
-        /* Use custom removal list from environment */
-        base_count = parse_csv_headers(env_mailheaderclean, &base_list);
-    } else {
-        /* Use hardcoded list - count items first */
-        for (i = 0; HEADERS_TO_REMOVE[i] != NULL; i++) {
-            base_count++;
-        }
-        /* Copy hardcoded list to dynamic array */
-        base_list = malloc(base_count * sizeof(char *));
-        if (!base_list) return 0;
-        for (i = 0; i < base_count; i++) {
-            base_list[i] = strdup(HEADERS_TO_REMOVE[i]);
-        }
+    if (w == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
     }
+    return EXECUTION_SUCCESS;
+}
 
-    /* Step 2: Parse preserve list and remove from base (MAILHEADERCLEAN_PRESERVE) */
-    char *env_preserve = getenv("MAILHEADERCLEAN_PRESERVE");
-    if (env_preserve && *env_preserve) {
-        preserve_count = parse_csv_headers(env_preserve, &preserve_list);
-
-        /* Remove preserved headers from base list */
-        for (i = 0; i < preserve_count; i++) {
-            for (j = 0; j < base_count; j++) {
-                if (base_list[j] && strcasecmp_custom(preserve_list[i], base_list[j]) == 0) {
-                    free(base_list[j]);
-                    base_list[j] = NULL;  /* Mark as removed */
-                }
-            }
-        }
-
-        /* Cleanup preserve list */
-        for (i = 0; i < preserve_count; i++) {
-            free(preserve_list[i]);
-        }
-        free(preserve_list);
+/* Core filtering function. Kept header lines are written with CRs removed
+ * and tabs folded; the blank separator line and the body are written
+ * unchanged, straight from the input. Counted in stats unless NULL.
+ * Files over the memory ceiling are streamed instead. */
+static int filter_headers(const char *filename, FILE *output, clean_stats *stats) {
+    mail_input in;
+    mail_writer out;
+    uint64_t t = 0;
+    int fd, r;
+
+    fd = open(filename, O_RDONLY);
+    if (fd != -1 && mail_input_streamed(fd)) {
+        /* Larger than the memory ceiling, or not a regular file */
+        r = filter_stream(fd, filename, 1, output, stats);
+        close(fd);
+        return r;
     }
-
-    /* Step 3: Parse extra list and add to base (MAILHEADERCLEAN_EXTRA) */
-    char *env_extra = getenv("MAILHEADERCLEAN_EXTRA");
-    if (env_extra && *env_extra) {
-        extra_count = parse_csv_headers(env_extra, &extra_list);
+    clean_stats_start(stats, &t);
+    if (fd == -1 || mail_input_fd(&in, fd) == -1) {
+        builtin_error("%s: cannot open: %s", filename, strerror(errno));
+        if (fd != -1) close(fd);
+        return EXECUTION_FAILURE;
     }
-
-    /* Compact base list (remove NULLs) and prepare for extra additions */
-    int final_count = 0;
-    for (i = 0; i < base_count; i++) {
-        if (base_list[i]) final_count++;
+    close(fd);
+    clean_stats_time(stats, CLEAN_PHASE_READ, &t);
+
+    /* Output goes straight to the descriptor behind the stream */
+    fflush(output);
+    mail_writer_init(&out, fileno(output));
+
+    /* Removal list from environment variables (cached across calls) */
+    filter_message(get_removal_matcher(), &in, &out, stats);
+    clean_stats_time(stats, CLEAN_PHASE_CLASSIFY, &t);
+
+    r = mail_writer_flush(&out);
+    if (stats) stats->bytes_out += out.written;
+    clean_stats_time(stats, CLEAN_PHASE_WRITE, &t);
+    mail_writer_free(&out);
+    mail_input_close(&in);
+    clean_stats_time(stats, CLEAN_PHASE_READ, &t);
+
+    if (r == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
     }
-    final_count += extra_count;  /* Reserve space for extras */
+    return EXECUTION_SUCCESS;
+}
 
-    *removal_list = malloc(final_count * sizeof(char *));
-    if (!*removal_list) {
-        /* Cleanup on error */
-        for (i = 0; i < base_count; i++) {
-            if (base_list[i]) free(base_list[i]);
+/* --mbox: filter every message of an mbox file (or stdin for NULL or
+ * "-") */
+static int filter_mbox(const char *filename, FILE *output, clean_stats *stats) {
+    int fd = STDIN_FILENO;
+    int r;
+
+    if (filename && strcmp(filename, "-") != 0) {
+        fd = open(filename, O_RDONLY);
+        if (fd == -1) {
+            builtin_error("%s: cannot open: %s", filename, strerror(errno));
+            return EXECUTION_FAILURE;
         }
-        free(base_list);
-        for (i = 0; i < extra_count; i++) {
-            free(extra_list[i]);
-        }
-        free(extra_list);
-        return 0;
+    } else {
+        filename = "stdin";
     }
+    r = filter_stream(fd, filename, 0, output, stats);
+    if (fd != STDIN_FILENO) close(fd);
+    return r;
+}
 
-    /* Copy non-NULL entries from base */
-    k = 0;
-    for (i = 0; i < base_count; i++) {
-        if (base_list[i]) {
-            (*removal_list)[k++] = base_list[i];
-        }
-    }
-    free(base_list);  /* Free the old array, but not the strings (they're copied to removal_list) */
-
-    /* Add extra headers if not already in list */
-    for (i = 0; i < extra_count; i++) {
-        found = 0;
-        for (j = 0; j < k; j++) {
-            if (strcasecmp_custom(extra_list[i], (*removal_list)[j]) == 0) {
-                found = 1;
-                break;
-            }
-        }
-        if (!found) {
-            (*removal_list)[k++] = extra_list[i];
-        } else {
-            free(extra_list[i]);  /* Already in list, don't need duplicate */
-        }
-    }
-    free(extra_list);  /* Free the array */
+/* Add value to the number stored under key in the associative array var */
+static int stats_bind(SHELL_VAR *var, char *name, const char *key, unsigned long long value) {
+    char num[32];
+    char *old = assoc_reference(assoc_cell(var), (char *)key);
 
-    return k;  /* Return actual count */
+    if (old) value += strtoull(old, NULL, 10);
+    snprintf(num, sizeof(num), "%llu", value);
+    return bind_assoc_variable(var, name, savestring(key), num, 0) ? 0 : -1;
 }
 
-/* Core filtering function */
-static int filter_headers(const char *filename, FILE *output) {
-    FILE *file;
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len;
-    int in_headers = 1;
-    int keep_current_header = 1;
-    int first_received_seen = 0;
-    char **removal_list = NULL;
-    int removal_count = 0;
-
-    file = fopen(filename, "r");
-    if (!file) {
-        builtin_error("%s: cannot open: %s", filename, strerror(errno));
+/* -S ARRAY: add this call's counters to those already in the associative
+ * array called name, so a loop over many messages keeps running totals.
+ * Patterns get "hits:PATTERN" and "bytes:PATTERN" keys once they match. */
+static int bind_stats(char *name, const clean_stats *stats, char **patterns) {
+    static const char *const phase_names[CLEAN_PHASES] = { "read_us", "classify_us", "write_us" };
+    const struct {
+        const char *key;
+        unsigned long long value;
+    } totals[] = {
+        { "messages", stats->messages },
+        { "bytes_in", stats->bytes_in },
+        { "bytes_out", stats->bytes_out },
+        { "headers_kept", stats->headers_kept },
+        { "headers_removed", stats->headers_removed },
+        { "continuations_dropped", stats->continuations_dropped },
+        { "received_removed", stats->received.hits },
+        { "received_removed_bytes", stats->received.bytes },
+    };
+    SHELL_VAR *var;
+    char *key;
+    size_t i;
+    int r = 0;
+
+    /* 1: fail on readonly, 2: associative (reports its own errors) */
+    var = find_or_make_array_variable(name, 1 | 2);
+    if (var == 0) {
         return EXECUTION_FAILURE;
     }
 
-    /* Build removal list from environment variables */
-    removal_count = build_removal_list(&removal_list);
-
-    while ((line_len = getline(&line, &line_cap, file)) != -1) {
-        QUIT;  /* Check for signals */
-
-        if (in_headers) {
-            /* Check for end of headers */
-            if (is_blank_line(line)) {
-                in_headers = 0;
-                fprintf(output, "%s", line);  /* Output blank line separator */
-                continue;
-            }
-
-            /* Check for continuation line */
-            if (is_continuation_line(line)) {
-                if (keep_current_header) {
-                    process_line(line);
-                    fprintf(output, "%s", line);
-                }
-                continue;
-            }
-
-            /* Extract header name */
-            char header_name[256] = {0};
-            const char *colon = strchr(line, ':');
-            if (colon && (colon - line) < 255) {
-                strncpy(header_name, line, colon - line);
-                header_name[colon - line] = '\0';
-
-                /* Special case: Received header - keep only first */
-                if (strcasecmp_custom(header_name, "Received") == 0) {
-                    if (!first_received_seen) {
-                        first_received_seen = 1;
-                        keep_current_header = 1;
-                        process_line(line);
-                        fprintf(output, "%s", line);
-                    } else {
-                        keep_current_header = 0;
-                    }
-                    continue;
-                }
-
-                /* Check if this header should be removed */
-                if (should_remove_header(header_name, removal_list, removal_count)) {
-                    keep_current_header = 0;
-                } else {
-                    keep_current_header = 1;
-                    process_line(line);
-                    fprintf(output, "%s", line);
-                }
-            } else {
-                /* Not a valid header line, output as-is */
-                process_line(line);
-                fprintf(output, "%s", line);
-            }
-        } else {
-            /* In body section - output everything unchanged */
-            fprintf(output, "%s", line);
-        }
+    for (i = 0; i < sizeof(totals) / sizeof(totals[0]) && r == 0; i++) {
+        r = stats_bind(var, name, totals[i].key, totals[i].value);
     }
-
-    /* Cleanup */
-    if (removal_list) {
-        for (int i = 0; i < removal_count; i++) {
-            free(removal_list[i]);
+    for (i = 0; i < CLEAN_PHASES && r == 0; i++) {
+        r = stats_bind(var, name, phase_names[i], stats->ns[i] / 1000);
+    }
+    for (int j = 0; j < stats->pattern_count && r == 0; j++) {
+        if (stats->patterns[j].hits == 0) continue;
+        key = malloc(strlen(patterns[j]) + 7);
+        if (!key) {
+            builtin_error("%s", strerror(ENOMEM));
+            return EXECUTION_FAILURE;
         }
-        free(removal_list);
+        sprintf(key, "hits:%s", patterns[j]);
+        r = stats_bind(var, name, key, stats->patterns[j].hits);
+        if (r == 0) {
+            sprintf(key, "bytes:%s", patterns[j]);
+            r = stats_bind(var, name, key, stats->patterns[j].bytes);
+        }
+        free(key);
     }
-    free(line);
-    fclose(file);
-
-    return EXECUTION_SUCCESS;
+    return r == 0 ? EXECUTION_SUCCESS : EXECUTION_FAILURE;
 }
 
 /* Bash builtin entry point */
@@ -385,50 +294,100 @@ int
 mailheaderclean_builtin(WORD_LIST *list)
 {
     char **v;
-    int c, r;
-    char **removal_list = NULL;
-    int removal_count = 0;
+    int c, i, r;
+    int list_only = 0, mbox = 0;
+    char *stats_array = NULL;
+    const header_matcher *matcher;
+    clean_stats stats;
 
     /* Convert WORD_LIST to argc/argv */
     v = make_builtin_argv(list, &c);
 
-    if (c < 2) {
+    /* Options: -l, -M/--mbox, -S/--stats ARRAY */
+    for (i = 1; i < c && v[i][0] == '-' && v[i][1] != '\0'; i++) {
+        if (strcmp(v[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(v[i], "-l") == 0) {
+            list_only = 1;
+        } else if (strcmp(v[i], "-M") == 0 || strcmp(v[i], "--mbox") == 0) {
+            mbox = 1;
+        } else if ((strcmp(v[i], "-S") == 0 || strcmp(v[i], "--stats") == 0) && i + 1 < c) {
+            stats_array = v[++i];
+        } else {
+            builtin_usage();
+            free(v);
+            return EX_USAGE;
+        }
+    }
+
+    /* -l takes nothing else; --mbox reads stdin without FILE */
+    if (list_only ? (mbox || stats_array || i != c) : (c - i != 1 && !(mbox && i == c))) {
         builtin_usage();
         free(v);
         return EX_USAGE;
     }
+    if (stats_array && legal_identifier(stats_array) == 0) {
+        sh_invalidid(stats_array);
+        free(v);
+        return EX_USAGE;
+    }
 
     QUIT;  /* Check for signals */
 
     /* Handle -l option (list removal headers) */
-    if (c == 2 && strcmp(v[1], "-l") == 0) {
-        removal_count = build_removal_list(&removal_list);
-        for (int i = 0; i < removal_count; i++) {
-            printf("%s\n", removal_list[i]);
-        }
-        /* Cleanup */
-        if (removal_list) {
-            for (int i = 0; i < removal_count; i++) {
-                free(removal_list[i]);
-            }
-            free(removal_list);
+    if (list_only) {
+        mail_writer out;
+
+        matcher = get_removal_matcher();
+        fflush(stdout);
+        mail_writer_init(&out, fileno(stdout));
+        for (int j = 0; j < matcher->pattern_count; j++) {
+            mail_write_line(&out, matcher->patterns[j]);
         }
+        r = mail_writer_flush(&out);
+        mail_writer_free(&out);
         free(v);
+        if (r == -1) {
+            builtin_error("write error: %s", strerror(errno));
+            return EXECUTION_FAILURE;
+        }
         return EXECUTION_SUCCESS;
     }
 
-    if (c != 2) {
-        builtin_usage();
-        free(v);
-        return EX_USAGE;
+    if (stats_array) {
+        matcher = get_removal_matcher();
+        if (clean_stats_init(&stats, matcher->pattern_count) == -1) {
+            builtin_error("%s", strerror(ENOMEM));
+            free(v);
+            return EXECUTION_FAILURE;
+        }
     }
 
-    r = filter_headers(v[1], stdout);
+    /* -M/--mbox: FILE optional, stdin by default */
+    if (mbox) {
+        r = filter_mbox(i < c ? v[i] : NULL, stdout, stats_array ? &stats : NULL);
+    } else {
+        r = filter_headers(v[i], stdout, stats_array ? &stats : NULL);
+    }
+
+    if (stats_array) {
+        if (bind_stats(stats_array, &stats, matcher->patterns) != EXECUTION_SUCCESS) r = EXECUTION_FAILURE;
+        clean_stats_free(&stats);
+    }
 
     free(v);
     return r;
 }
 
+/* Called by bash on enable -d: release the cached removal list */
+void
+mailheaderclean_builtin_unload(char *name)
+{
+    removal_cache_free();
+}
+
 /* Documentation strings */
 char *mailheaderclean_doc[] = {
     "Filter non-essential email headers from a file.",
@@ -441,7 +400,17 @@ char *mailheaderclean_doc[] = {
     "Received header.",
     " ",
     "Options:",
-    "  -l    List currently active header removal list and exit",
+    "  -l          List currently active header removal list and exit",
+    "  -M, --mbox  Read FILE as an mbox (stdin if FILE is - or omitted) and",
+    "              filter every message, with bounded memory",
+    "  -S, --stats ARRAY",
+    "              Add this call's counters to the associative array ARRAY:",
+    "              messages, bytes_in, bytes_out, headers_kept,",
+    "              headers_removed, continuations_dropped, received_removed,",
+    "              received_removed_bytes, read_us, classify_us, write_us,",
+    "              and hits:PATTERN and bytes:PATTERN for each pattern that",
+    "              removed a header. Calls in a loop keep running totals;",
+    "              unset ARRAY to start again.",
     " ",
     "Environment Variables:",
     "  MAILHEADERCLEAN        Comma-separated list to replace built-in removal list",
@@ -450,6 +419,9 @@ char *mailheaderclean_doc[] = {
     " ",
     "Precedence: MAILHEADERCLEAN (or built-in) - PRESERVE + EXTRA",
     " ",
+    "The compiled removal list is kept between calls and rebuilt only when",
+    "one of these (exported) variables changes.",
+    " ",
     "Wildcard patterns supported (shell glob syntax):",
     "  X-*         Match any header starting with X-",
     "  *-Status    Match any header ending with -Status",
@@ -466,6 +438,6 @@ struct builtin mailheaderclean_struct = {
     mailheaderclean_builtin,     /* function implementing builtin */
     BUILTIN_ENABLED,             /* initial flags for builtin */
     mailheaderclean_doc,         /* array of long documentation strings */
-    "mailheaderclean [-l] FILE", /* usage synopsis */
+    "mailheaderclean [-l] [--mbox] [-S ARRAY] FILE", /* usage synopsis */
     0                            /* reserved for internal use */
 };
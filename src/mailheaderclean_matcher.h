@@ -0,0 +1,317 @@
+/*
+mailheaderclean_matcher.h - Compiled header-name matcher
+
+The removal list is compiled once into a case-folded trie so that each
+header name is classified in a single pass over its bytes, instead of
+running fnmatch() against every pattern for every header line. It is
+shared between the standalone binary (mailheaderclean.c) and the bash
+loadable builtin (mailheaderclean_loadable.c).
+
+Pattern forms handled by the trie:
+  Name          exact name                (forward trie, exact mark)
+  Prefix-*      leading literal           (forward trie, prefix mark)
+  *-Suffix      trailing literal          (reverse trie)
+  X-*-Status    prefix and suffix literal (forward trie, infix list)
+
+Anything else (?, [...], backslash escapes, several *) is kept on a
+small fallback list that is still checked with fnmatch().
+
+The original fnmatch() loop is kept as header_matcher_reference(). Set
+MAILHEADERCLEAN_MATCHER=fnmatch to route every lookup through it; the
+differential tests compare both paths over the test corpus.
+*/
+
+#ifndef MAILHEADERCLEAN_MATCHER_H
+#define MAILHEADERCLEAN_MATCHER_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <strings.h>
+#include <fnmatch.h>
+
+/* Trie node. Children of a node are kept in a singly linked sibling list;
+ * the removal list is small, so this stays compact and cache friendly. */
+typedef struct {
+    unsigned char ch;   /* lower-cased edge label */
+    int child;          /* first child, -1 if none */
+    int sibling;        /* next sibling, -1 if none */
+    int exact;          /* lowest pattern index ending here, -1 if none */
+    int prefix;         /* lowest "Prefix*" pattern index ending here, -1 if none */
+    int infix;          /* first "Prefix*Suffix" entry at this node, -1 if none */
+} hm_node;
+
+/* "Prefix*Suffix" pattern hanging off the node for its prefix */
+typedef struct {
+    const char *suffix;
+    size_t suffix_len;
+    int pattern;
+    int next;
+} hm_infix;
+
+typedef struct {
+    char **patterns;        /* removal list (not owned) */
+    int pattern_count;
+    int use_reference;      /* MAILHEADERCLEAN_MATCHER=fnmatch */
+
+    hm_node *nodes;         /* node 0: forward root, node 1: reverse root */
+    int node_count, node_cap;
+    hm_infix *infixes;
+    int infix_count, infix_cap;
+    int *fallback;          /* pattern indices needing fnmatch() */
+    int fallback_count;
+} header_matcher;
+
+#define HM_FORWARD_ROOT 0
+#define HM_REVERSE_ROOT 1
+
+/* Reference implementation: the fnmatch() loop over the removal list.
+ * Returns the index of the first matching pattern, or -1.
+ * Supports wildcard patterns using shell glob syntax:
+ *   X-*         matches any header starting with X-
+ *   *-Status    matches any header ending with -Status
+ *   X-MS-*      matches any header starting with X-MS-
+ *   X-*-Status  matches X- followed by anything, ending in -Status
+ */
+static int header_matcher_reference(char **removal_list, int removal_count, const char *header) {
+    int i;
+
+    for (i = 0; i < removal_count; i++) {
+#ifdef FNM_CASEFOLD
+        /* GNU extension for case-insensitive matching */
+        if (fnmatch(removal_list[i], header, FNM_CASEFOLD) == 0) {
+            return i;
+        }
+#else
+        /* Fallback: convert both to lowercase for comparison */
+        char *pattern_lower = strdup(removal_list[i]);
+        char *header_lower = strdup(header);
+        int hit = 0;
+
+        if (pattern_lower && header_lower) {
+            char *c;
+            for (c = pattern_lower; *c; c++) *c = tolower((unsigned char)*c);
+            for (c = header_lower; *c; c++) *c = tolower((unsigned char)*c);
+            hit = fnmatch(pattern_lower, header_lower, 0) == 0;
+        }
+        free(pattern_lower);
+        free(header_lower);
+        if (hit) {
+            return i;
+        }
+#endif
+    }
+
+    return -1;
+}
+
+static int hm_new_node(header_matcher *m, unsigned char ch) {
+    if (m->node_count == m->node_cap) {
+        int cap = m->node_cap ? m->node_cap * 2 : 256;
+        hm_node *n = realloc(m->nodes, cap * sizeof(hm_node));
+        if (!n) return -1;
+        m->nodes = n;
+        m->node_cap = cap;
+    }
+    hm_node *node = &m->nodes[m->node_count];
+    node->ch = ch;
+    node->child = node->sibling = -1;
+    node->exact = node->prefix = node->infix = -1;
+    return m->node_count++;
+}
+
+static int hm_find_child(const header_matcher *m, int node, unsigned char ch) {
+    int c;
+    for (c = m->nodes[node].child; c != -1; c = m->nodes[c].sibling) {
+        if (m->nodes[c].ch == ch) return c;
+    }
+    return -1;
+}
+
+/* Walk (and extend) the trie along len bytes of s; reverse walks backwards */
+static int hm_insert_path(header_matcher *m, int root, const char *s, size_t len, int reverse) {
+    int node = root;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        unsigned char ch = tolower((unsigned char)s[reverse ? len - 1 - i : i]);
+        int next = hm_find_child(m, node, ch);
+        if (next == -1) {
+            next = hm_new_node(m, ch);
+            if (next == -1) return -1;
+            m->nodes[next].sibling = m->nodes[node].child;
+            m->nodes[node].child = next;
+        }
+        node = next;
+    }
+    return node;
+}
+
+static void hm_mark(int *slot, int pattern) {
+    if (*slot == -1 || pattern < *slot) *slot = pattern;
+}
+
+/* Compile the removal list. The pattern strings must outlive the matcher.
+ * Returns 0 on success, -1 on allocation failure (the matcher then falls
+ * back to the reference implementation). */
+static int header_matcher_compile(header_matcher *m, char **removal_list, int removal_count) {
+    int i;
+
+    memset(m, 0, sizeof(*m));
+    m->patterns = removal_list;
+    m->pattern_count = removal_count;
+
+    const char *env_matcher = getenv("MAILHEADERCLEAN_MATCHER");
+    if (env_matcher && strcmp(env_matcher, "fnmatch") == 0) {
+        m->use_reference = 1;
+        return 0;
+    }
+
+    if (hm_new_node(m, 0) == -1 || hm_new_node(m, 0) == -1) goto fail;
+    if (removal_count > 0) {
+        m->fallback = malloc(removal_count * sizeof(int));
+        if (!m->fallback) goto fail;
+    }
+
+    for (i = 0; i < removal_count; i++) {
+        const char *p = removal_list[i];
+        size_t len = strlen(p);
+        const char *star = NULL;
+        int stars = 0, special = 0;
+        size_t j;
+        int node;
+
+        for (j = 0; j < len; j++) {
+            if (p[j] == '*') {
+                if (!star) star = p + j;
+                stars++;
+            } else if (p[j] == '?' || p[j] == '[' || p[j] == '\\') {
+                special = 1;
+            }
+        }
+
+        if (special || stars > 1) {
+            m->fallback[m->fallback_count++] = i;
+            continue;
+        }
+
+        if (stars == 0) {
+            node = hm_insert_path(m, HM_FORWARD_ROOT, p, len, 0);
+            if (node == -1) goto fail;
+            hm_mark(&m->nodes[node].exact, i);
+        } else if (star == p + len - 1) {
+            node = hm_insert_path(m, HM_FORWARD_ROOT, p, len - 1, 0);
+            if (node == -1) goto fail;
+            hm_mark(&m->nodes[node].prefix, i);
+        } else if (star == p) {
+            node = hm_insert_path(m, HM_REVERSE_ROOT, p + 1, len - 1, 1);
+            if (node == -1) goto fail;
+            hm_mark(&m->nodes[node].exact, i);
+        } else {
+            node = hm_insert_path(m, HM_FORWARD_ROOT, p, star - p, 0);
+            if (node == -1) goto fail;
+            if (m->infix_count == m->infix_cap) {
+                int cap = m->infix_cap ? m->infix_cap * 2 : 16;
+                hm_infix *n = realloc(m->infixes, cap * sizeof(hm_infix));
+                if (!n) goto fail;
+                m->infixes = n;
+                m->infix_cap = cap;
+            }
+            hm_infix *inf = &m->infixes[m->infix_count];
+            inf->suffix = star + 1;
+            inf->suffix_len = len - (star - p) - 1;
+            inf->pattern = i;
+            inf->next = m->nodes[node].infix;
+            m->nodes[node].infix = m->infix_count++;
+        }
+    }
+    return 0;
+
+fail:
+    free(m->nodes);
+    free(m->infixes);
+    free(m->fallback);
+    memset(m, 0, sizeof(*m));
+    m->patterns = removal_list;
+    m->pattern_count = removal_count;
+    m->use_reference = 1;
+    return -1;
+}
+
+static void header_matcher_free(header_matcher *m) {
+    free(m->nodes);
+    free(m->infixes);
+    free(m->fallback);
+    memset(m, 0, sizeof(*m));
+}
+
+/* Classify a header name of len bytes (need not be NUL-terminated).
+ * Returns the index of the first pattern in removal-list order that
+ * matches, or -1 if the header should be kept. */
+static int header_matcher_match(const header_matcher *m, const char *name, size_t len) {
+    int best = -1;
+    int node, i, e;
+    size_t pos;
+
+    if (m->use_reference || m->fallback_count) {
+        char stack_buf[256];
+        char *buf = len < sizeof(stack_buf) ? stack_buf : malloc(len + 1);
+        if (!buf) return -1;
+        memcpy(buf, name, len);
+        buf[len] = '\0';
+
+        if (m->use_reference) {
+            best = header_matcher_reference(m->patterns, m->pattern_count, buf);
+        } else {
+            for (i = 0; i < m->fallback_count; i++) {
+                int idx = m->fallback[i];
+#ifdef FNM_CASEFOLD
+                int hit = fnmatch(m->patterns[idx], buf, FNM_CASEFOLD) == 0;
+#else
+                int hit = header_matcher_reference(&m->patterns[idx], 1, buf) == 0;
+#endif
+                if (hit) {
+                    best = idx;
+                    break;  /* fallback[] is in ascending pattern order */
+                }
+            }
+        }
+        if (buf != stack_buf) free(buf);
+        if (m->use_reference) return best;
+    }
+
+    /* Forward pass: prefixes and infixes along the way, exact at the end */
+    node = HM_FORWARD_ROOT;
+    for (pos = 0; ; pos++) {
+        const hm_node *n = &m->nodes[node];
+        if (n->prefix != -1) hm_mark(&best, n->prefix);
+        for (e = n->infix; e != -1; e = m->infixes[e].next) {
+            const hm_infix *inf = &m->infixes[e];
+            if ((best == -1 || inf->pattern < best) &&
+                len - pos >= inf->suffix_len &&
+                strncasecmp(name + len - inf->suffix_len, inf->suffix, inf->suffix_len) == 0) {
+                best = inf->pattern;
+            }
+        }
+        if (pos == len) {
+            if (n->exact != -1) hm_mark(&best, n->exact);
+            break;
+        }
+        node = hm_find_child(m, node, tolower((unsigned char)name[pos]));
+        if (node == -1) break;
+    }
+
+    /* Reverse pass: "*Suffix" patterns */
+    node = HM_REVERSE_ROOT;
+    for (pos = len; ; pos--) {
+        const hm_node *n = &m->nodes[node];
+        if (n->exact != -1) hm_mark(&best, n->exact);
+        if (pos == 0) break;
+        node = hm_find_child(m, node, tolower((unsigned char)name[pos - 1]));
+        if (node == -1) break;
+    }
+
+    return best;
+}
+
+#endif /* MAILHEADERCLEAN_MATCHER_H */
@@ -0,0 +1,153 @@
+/*
+mailheaderclean_serve.h - Wire protocol of mailheaderclean --serve
+
+A long-lived mailheaderclean --serve listens on a Unix domain socket, so
+an MTA or MDA hook cleans a message with one connect and one round trip
+instead of an exec, dynamic linking and a fresh removal list per message.
+A connection carries any number of requests, answered in order:
+
+  request   u32 length, then length bytes: the raw message
+  response  u32 status, u32 length, then length bytes: the cleaned message
+
+Integers are big-endian. Status 0 is success; anything else is an errno
+value (EFBIG: the message is larger than CLEAN_SERVE_MAX; ENOMEM) and
+comes with an empty body. The server closes the connection after a non-zero
+status, or when a request is cut short. A failure after part of a response
+has been sent closes the connection with no status, so a client sees a
+short response rather than a frame in the middle of one.
+
+Shared by the server in mailheaderclean.c, the mailheaderclean-client
+binary and the latency benchmark in tools/mail_bench.c.
+*/
+
+#ifndef MAILHEADERCLEAN_SERVE_H
+#define MAILHEADERCLEAN_SERVE_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define CLEAN_SERVE_MAX (64u * 1024 * 1024)    /* largest message accepted */
+#define CLEAN_SERVE_REQUEST_HEAD 4
+#define CLEAN_SERVE_RESPONSE_HEAD 8
+
+static inline void clean_serve_put32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static inline uint32_t clean_serve_get32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* Read exactly n bytes. Returns 1, 0 on end of file before the first
+ * byte, or -1 with errno set (ECONNRESET if the peer stopped mid-way). */
+static inline int clean_serve_read(int fd, void *p, size_t n) {
+    char *c = p;
+    size_t got = 0;
+
+    while (got < n) {
+        ssize_t r = read(fd, c + got, n - got);
+        if (r == 0) {
+            if (got == 0) return 0;
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        got += (size_t)r;
+    }
+    return 1;
+}
+
+/* Connect to the server at path. Returns the socket, or -1 with errno set. */
+static inline int clean_serve_connect(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/* One round trip: send the len bytes at msg, receive the cleaned message
+ * into *out (grown as needed, capacity *cap) and its length into *out_len.
+ * Returns 0, or -1 with errno set: the server's status, or the I/O error. */
+static inline int clean_serve_request(int fd, const char *msg, size_t len,
+                                      char **out, size_t *out_len, size_t *cap) {
+    unsigned char head[CLEAN_SERVE_RESPONSE_HEAD];
+    struct iovec iov[2];
+    uint32_t status, n;
+    int r;
+
+    if (len > CLEAN_SERVE_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+    clean_serve_put32(head, (uint32_t)len);
+    iov[0].iov_base = head;
+    iov[0].iov_len = CLEAN_SERVE_REQUEST_HEAD;
+    iov[1].iov_base = (void *)msg;
+    iov[1].iov_len = len;
+    for (int i = 0; i < 2; ) {
+        ssize_t w = writev(fd, iov + i, 2 - i);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (i < 2 && (size_t)w >= iov[i].iov_len) w -= iov[i++].iov_len;
+        if (i < 2) {
+            iov[i].iov_base = (char *)iov[i].iov_base + w;
+            iov[i].iov_len -= (size_t)w;
+        }
+    }
+
+    r = clean_serve_read(fd, head, CLEAN_SERVE_RESPONSE_HEAD);
+    if (r != 1) {
+        if (r == 0) errno = ECONNRESET;
+        return -1;
+    }
+    status = clean_serve_get32(head);
+    n = clean_serve_get32(head + 4);
+    if (status != 0) {
+        errno = (int)status;
+        return -1;
+    }
+    if (n > *cap) {
+        char *b = realloc(*out, n);
+        if (!b) {
+            errno = ENOMEM;
+            return -1;
+        }
+        *out = b;
+        *cap = n;
+    }
+    if (n > 0 && (r = clean_serve_read(fd, *out, n)) != 1) {
+        if (r == 0) errno = ECONNRESET;
+        return -1;
+    }
+    *out_len = n;
+    return 0;
+}
+
+#endif /* MAILHEADERCLEAN_SERVE_H */
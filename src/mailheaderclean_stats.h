@@ -0,0 +1,169 @@
+/*
+mailheaderclean_stats.h - Run statistics for mailheaderclean --stats
+
+Counts what the filter does: messages and bytes in, bytes out, header
+fields kept and removed, continuation lines dropped with removed fields,
+and for every removal-list pattern the fields it removed and their size
+in input bytes (header line plus continuation lines). A removed field is
+charged to the first pattern in list order that matches it, the same one
+the matcher reports. Received fields after the first are counted apart,
+since they are removed by a fixed rule rather than by the list.
+
+Wall-clock time is split into three phases: read (open, map or fill the
+stream buffer, unmap), classify (the header scan, including copying kept
+lines into the output buffer) and write (writev, and for in-place
+rewrites the temp file, attributes and rename). Mapped input is faulted
+in lazily, so page-in time of large mapped messages shows up as classify.
+
+A NULL stats pointer disables counting; the hot loops only test it once
+per header line. Shared by the standalone binary, where each --jobs
+worker counts on its own and the totals are added up at the end, and the
+bash loadable builtin.
+*/
+
+#ifndef MAILHEADERCLEAN_STATS_H
+#define MAILHEADERCLEAN_STATS_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+enum {
+    CLEAN_PHASE_READ,
+    CLEAN_PHASE_CLASSIFY,
+    CLEAN_PHASE_WRITE,
+    CLEAN_PHASES
+};
+
+/* Where the current field's continuation lines go */
+#define CLEAN_STATS_KEPT     (-1)
+#define CLEAN_STATS_RECEIVED (-2)
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long bytes;
+} clean_stats_pattern;
+
+typedef struct {
+    unsigned long long messages;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long headers_kept;
+    unsigned long long headers_removed;
+    unsigned long long continuations_dropped;
+    unsigned long long unchanged;       /* in place: already clean, not rewritten */
+    unsigned long long journal_skipped; /* in place: unchanged since the journal entry */
+    clean_stats_pattern received;       /* Received fields after the first */
+    uint64_t ns[CLEAN_PHASES];
+    clean_stats_pattern *patterns;      /* one per removal-list entry */
+    int pattern_count;
+    int current;        /* pattern of the current field, or CLEAN_STATS_* */
+} clean_stats;
+
+/* Returns 0, or -1 if the per-pattern counters cannot be allocated */
+static inline int clean_stats_init(clean_stats *s, int pattern_count) {
+    memset(s, 0, sizeof(*s));
+    s->current = CLEAN_STATS_KEPT;
+    if (pattern_count > 0) {
+        s->patterns = calloc(pattern_count, sizeof(*s->patterns));
+        if (!s->patterns) return -1;
+    }
+    s->pattern_count = pattern_count;
+    return 0;
+}
+
+static inline void clean_stats_free(clean_stats *s) {
+    free(s->patterns);
+    s->patterns = NULL;
+    s->pattern_count = 0;
+}
+
+/* Add src to dst; both must count the same removal list */
+static inline void clean_stats_add(clean_stats *dst, const clean_stats *src) {
+    dst->messages += src->messages;
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    dst->headers_kept += src->headers_kept;
+    dst->headers_removed += src->headers_removed;
+    dst->continuations_dropped += src->continuations_dropped;
+    dst->unchanged += src->unchanged;
+    dst->journal_skipped += src->journal_skipped;
+    dst->received.hits += src->received.hits;
+    dst->received.bytes += src->received.bytes;
+    for (int i = 0; i < CLEAN_PHASES; i++) dst->ns[i] += src->ns[i];
+    for (int i = 0; i < dst->pattern_count && i < src->pattern_count; i++) {
+        dst->patterns[i].hits += src->patterns[i].hits;
+        dst->patterns[i].bytes += src->patterns[i].bytes;
+    }
+}
+
+static inline uint64_t clean_stats_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Start timing at *since (no-op without stats) */
+static inline void clean_stats_start(clean_stats *s, uint64_t *since) {
+    if (s) *since = clean_stats_clock();
+}
+
+/* Charge the time from *since to phase and restart the clock */
+static inline void clean_stats_time(clean_stats *s, int phase, uint64_t *since) {
+    uint64_t now;
+
+    if (!s) return;
+    now = clean_stats_clock();
+    s->ns[phase] += now - *since;
+    *since = now;
+}
+
+/* A message of len input bytes starts */
+static inline void clean_stats_message(clean_stats *s, size_t len) {
+    s->messages++;
+    s->bytes_in += len;
+    s->current = CLEAN_STATS_KEPT;
+}
+
+/* A message of len bytes with fields header fields, all kept, that was
+ * found clean and left as it is */
+static inline void clean_stats_unchanged(clean_stats *s, size_t len, int fields) {
+    clean_stats_message(s, len);
+    s->headers_kept += (unsigned long long)fields;
+    s->bytes_out += len;
+    s->unchanged++;
+}
+
+/* A header field of len bytes (first line only): kept with
+ * CLEAN_STATS_KEPT, otherwise removed by pattern or CLEAN_STATS_RECEIVED */
+static inline void clean_stats_field(clean_stats *s, int pattern, size_t len) {
+    s->current = pattern;
+    if (pattern == CLEAN_STATS_KEPT) {
+        s->headers_kept++;
+        return;
+    }
+    s->headers_removed++;
+    clean_stats_pattern *p = pattern == CLEAN_STATS_RECEIVED ? &s->received : &s->patterns[pattern];
+    p->hits++;
+    p->bytes += len;
+}
+
+/* len more bytes of the current field (a piece of an overlong line) */
+static inline void clean_stats_bytes(clean_stats *s, size_t len) {
+    if (s->current == CLEAN_STATS_KEPT) return;
+    if (s->current == CLEAN_STATS_RECEIVED) {
+        s->received.bytes += len;
+    } else {
+        s->patterns[s->current].bytes += len;
+    }
+}
+
+/* A continuation line of len bytes belonging to the current field */
+static inline void clean_stats_continuation(clean_stats *s, size_t len) {
+    if (s->current != CLEAN_STATS_KEPT) s->continuations_dropped++;
+    clean_stats_bytes(s, len);
+}
+
+#endif /* MAILHEADERCLEAN_STATS_H */
@@ -7,80 +7,403 @@ Extracts email message body (everything after the first blank line)
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 
-static void process_line(char *line) {
-    char *src = line, *dst = line;
+/* Include shared zero-copy input and range output, the mbox splitter, the
+ * directory index, body extraction, the MIME part walker and the RFC 2047
+ * decoder for attachment names */
+#include "mail_io.h"
+#include "mail_mbox.h"
+#include "mail_index.h"
+#include "mail_extract.h"
+#include "mail_mime.h"
+#include "mail_addr.h"
 
-    while (*src) {
-        if (*src == '\r') {
-            src++;
-            continue;
-        }
-        if (*src == '\t') {
-            *dst++ = ' ';
-            src++;
-            continue;
-        }
-        *dst++ = *src++;
-    }
-    *dst = '\0';
-}
+/* Streaming version for mbox files, stdin and files too large to map:
+ * the body of every message, CRs removed and tabs folded. Returns 0, or
+ * -1 on a read error. */
+static int stream_bodies(mail_mbox *mb, mail_writer *out) {
+    mail_mbox_chunk c;
+    int r;
 
-static int is_blank_line(const char *line) {
-    while (*line) {
-        if (*line == '\n') return 1;
-        if (!isspace((unsigned char)*line)) return 0;
-        line++;
+    while (mail_writer_detach(out), (r = mail_mbox_next(mb, &c)) > 0) {
+        if (c.part == MBOX_BODY) mail_write_folded(out, c.p, c.len);
     }
-    return 1;
+    return r;
 }
 
 static void usage(const char *progname) {
-    printf("Usage: %s FILE\n", progname);
+    printf("Usage: %s [--mbox|--index] FILE\n", progname);
+    printf("       %s --text|--list-parts|--part N FILE\n", progname);
+    printf("       %s --extract-attachments DIR [-j N] FILE...\n", progname);
     printf("Extract email message body from FILE (after first blank line)\n");
+    printf("\nOptions:\n");
+    printf("  -M, --mbox  Stream FILE as an mbox (or stdin if FILE is - or absent):\n");
+    printf("              body of every message, one after another\n");
+    printf("  --index     Start at the body offset recorded for FILE in the header\n");
+    printf("              index of its directory (see mailheader --index) when the\n");
+    printf("              entry is current; otherwise scan the headers as usual\n");
+    printf("  --text      Decoded text parts of a MIME message only, attachments and\n");
+    printf("              other non-text parts skipped; the first text branch of a\n");
+    printf("              multipart/alternative\n");
+    printf("  --part N    Decoded body of MIME leaf part N (from 1, see --list-parts)\n");
+    printf("  --list-parts  One line per MIME leaf part: number, type, transfer\n");
+    printf("              encoding, encoded size and file name, tab-separated\n");
+    printf("  --extract-attachments DIR  Decode every attachment of each FILE into\n");
+    printf("              DIR/NAME.N.FILENAME (NAME: FILE's base name, N: its part\n");
+    printf("              number) and print the paths written; existing files\n");
+    printf("              are not overwritten\n");
+    printf("  -j, --jobs N  With --extract-attachments, read the FILEs with N worker\n");
+    printf("              threads (0: one per CPU; default 1)\n");
+    printf("  -h, --help  Show this help message\n");
+}
+
+/* --index: body from the offset in the directory index, if it is current */
+static int run_index(const char *progname, const char *path, mail_writer *out) {
+    mail_input in;
+    long long off;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || mail_input_fd(&in, fd) == -1) {
+        fprintf(stderr, "\n%s: %s could not be opened!\n", progname, path);
+        if (fd != -1) close(fd);
+        return 1;
+    }
+    off = mail_index_body_offset(path, fd);
+    close(fd);
+
+    if (off >= 0 && (size_t)off <= in.len) {
+        mail_write_folded(out, in.data + off, in.len - off);
+    } else {
+        mail_extract_body(&in, out);
+    }
+    int r = mail_writer_flush(out);
+    mail_input_close(&in);
+    return r == -1 ? 1 : 0;
+}
+
+/* --text, --part N, --list-parts: walk the MIME parts of path (or stdin) */
+static int run_mime(const char *progname, const char *path, mail_mime_mode mode, unsigned part,
+                    mail_writer *out) {
+    mail_mime m;
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    int r = 0;
+
+    if (fd == -1) {
+        fprintf(stderr, "\n%s: %s could not be opened!\n", progname, path);
+        return 1;
+    }
+    mail_mime_init(&m, mode, part, out);
+    if (mail_mime_run(&m, fd) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path, strerror(errno));
+        r = 1;
+    } else if (mode == MIME_PART && !m.found) {
+        fprintf(stderr, "%s: %s: no part %u (%u parts)\n", progname, path, part, m.parts);
+        r = 1;
+    }
+    if (mail_writer_flush(out) == -1) r = 1;
+    if (fd != STDIN_FILENO) close(fd);
+    return r;
+}
+
+/* --extract-attachments ---------------------------------------------------
+ *
+ * Each worker takes the next FILE from a shared index and walks it once;
+ * every attachment is decoded as it is read, straight into its own file,
+ * so nothing is held beyond the walker's input chunk and output buffer. */
+
+typedef struct {
+    const char *progname;
+    const char *dir;
+    const char *const *paths;
+    int count;
+    atomic_int next;            /* next path to take */
+    atomic_int failed;
+} extract_pool;
+
+/* One worker's state for the message being read */
+typedef struct {
+    const extract_pool *pool;
+    const char *base;           /* base name of the message file */
+    mail_addr_buf name, raw;    /* decoded attachment name, scratch */
+    char file[PATH_MAX];        /* output path of the current part */
+    int failed;
+} extract_ctx;
+
+/* Attachment name as UTF-8 (RFC 2231 charset, or RFC 2047 words) with
+ * '/' and control characters replaced, cut to room bytes at a character
+ * boundary */
+static size_t extract_name(extract_ctx *x, const mail_mime *m, size_t room) {
+    size_t n = strlen(m->filename), i;
+
+    x->name.len = 0;
+    if (!m->filename_charset[0]
+        || mail_addr_to_utf8(&x->name, m->filename_charset, strlen(m->filename_charset), m->filename, n) == -1) {
+        x->name.len = 0;
+        mail_addr_decode(&x->name, &x->raw, m->filename, n);
+    }
+    if (x->name.error) return 0;
+
+    for (i = 0; i < x->name.len; i++) {
+        unsigned char c = (unsigned char)x->name.p[i];
+        if (c == '/' || c < 0x20 || c == 0x7f) x->name.p[i] = '_';
+    }
+    n = x->name.len;
+    if (n > room) {
+        n = room;
+        while (n > 0 && ((unsigned char)x->name.p[n] & 0xc0) == 0x80) n--;
+    }
+    return n;
+}
+
+/* mail_mime open_part(): create DIR/NAME.N[.FILENAME], which must not exist */
+static int extract_open(void *arg, const mail_mime *m) {
+    extract_ctx *x = arg;
+    char num[16];
+    int nlen = snprintf(num, sizeof(num), ".%u", m->parts);
+    size_t used = strlen(x->base) + (size_t)nlen + 1;
+    size_t n = extract_name(x, m, used < NAME_MAX ? NAME_MAX - used : 0);
+    int len, fd;
+
+    len = snprintf(x->file, sizeof(x->file), "%s/%s%s%s%.*s", x->pool->dir, x->base, num,
+                   n ? "." : "", (int)n, x->name.p ? x->name.p : "");
+    if (len < 0 || (size_t)len >= sizeof(x->file)) {
+        fprintf(stderr, "%s: %s/%s%s: %s\n", x->pool->progname, x->pool->dir, x->base, num,
+                strerror(ENAMETOOLONG));
+        x->failed = 1;
+        return -1;
+    }
+    /* Never overwrite: FILEs with the same base name (cur/x and new/x, or
+     * one FILE given twice) would otherwise replace each other's parts */
+    fd = open(x->file, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "%s: %s: %s\n", x->pool->progname, x->file,
+                errno == EEXIST ? "already exists, part skipped" : strerror(errno));
+        x->failed = 1;
+    }
+    return fd;
+}
+
+/* mail_mime close_part(): report the file written, or its error */
+static void extract_close(void *arg, const mail_mime *m, int fd, int error) {
+    extract_ctx *x = arg;
+
+    (void)m;
+    if (close(fd) == -1 && !error) error = errno;
+    if (error) {
+        fprintf(stderr, "%s: %s: %s\n", x->pool->progname, x->file, strerror(error));
+        x->failed = 1;
+    } else {
+        printf("%s\n", x->file);
+    }
+}
+
+/* Extract the attachments of path (or stdin). Returns 0, or 1 on any error. */
+static int extract_message(extract_ctx *x, const char *path, mail_writer *out) {
+    const char *progname = x->pool->progname;
+    mail_mime m;
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    const char *slash = strrchr(path, '/');
+
+    if (fd == -1) {
+        fprintf(stderr, "\n%s: %s could not be opened!\n", progname, path);
+        return 1;
+    }
+    x->base = fd == STDIN_FILENO ? "stdin" : slash ? slash + 1 : path;
+    x->failed = 0;
+
+    mail_mime_init(&m, MIME_EXTRACT, 0, out);
+    m.open_part = extract_open;
+    m.close_part = extract_close;
+    m.ctx = x;
+    if (mail_mime_run(&m, fd) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", progname, path, strerror(errno));
+        x->failed = 1;
+    }
+    if (fd != STDIN_FILENO) close(fd);
+    return x->failed;
+}
+
+static void *extract_worker(void *arg) {
+    extract_pool *pool = arg;
+    extract_ctx x;
+    mail_writer out;
+    int i;
+
+    memset(&x, 0, sizeof(x));
+    x.pool = pool;
+    mail_writer_init(&out, -1);
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->count) {
+        if (extract_message(&x, pool->paths[i], &out)) atomic_store(&pool->failed, 1);
+    }
+    mail_writer_free(&out);
+    mail_addr_buf_free(&x.name);
+    mail_addr_buf_free(&x.raw);
+    return NULL;
+}
+
+/* --extract-attachments DIR: run jobs workers (this thread being one of
+ * them) over paths */
+static int run_extract(const char *progname, const char *dir, int jobs, const char *const *paths, int count) {
+    extract_pool pool = { .progname = progname, .dir = dir, .paths = paths, .count = count };
+    pthread_t threads[1024];
+    struct stat st;
+    int started = 0;
+
+    if (stat(dir, &st) == -1 || (!S_ISDIR(st.st_mode) && (errno = ENOTDIR))) {
+        fprintf(stderr, "%s: %s: %s\n", progname, dir, strerror(errno));
+        return 1;
+    }
+    atomic_init(&pool.next, 0);
+    atomic_init(&pool.failed, 0);
+
+    /* Resolve the scan kernel before the workers share it */
+    mail_scan();
+    if (jobs > count) jobs = count;
+    for (; started < jobs - 1; started++) {
+        if (pthread_create(&threads[started], NULL, extract_worker, &pool) != 0) break;
+    }
+    extract_worker(&pool);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    if (fflush(stdout) == EOF) return 1;
+    return atomic_load(&pool.failed) ? 1 : 0;
+}
+
+/* Stream fd with bounded memory, as an mbox or as a single message */
+static int run_stream(const char *progname, const char *path, int fd, int single, mail_writer *out) {
+    mail_mbox mb;
+    int r;
+
+    if ((single ? mail_mbox_init_message(&mb, fd) : mail_mbox_init(&mb, fd)) == -1) {
+        fprintf(stderr, "%s: %s\n", progname, strerror(errno));
+        return 1;
+    }
+    r = stream_bodies(&mb, out);
+    if (r == -1) fprintf(stderr, "%s: %s: %s\n", progname, path ? path : "stdin", strerror(errno));
+    mail_mbox_free(&mb);
+    return r == -1 ? 1 : 0;
+}
+
+/* --mbox: stream path (or stdin) with bounded memory */
+static int run_mbox(const char *progname, const char *path, mail_writer *out) {
+    int fd = STDIN_FILENO;
+    int r;
+
+    if (path && strcmp(path, "-") != 0) {
+        fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "\n%s: %s could not be opened!\n", progname, path);
+            return 1;
+        }
+    }
+    r = run_stream(progname, path, fd, 0, out);
+    if (fd != STDIN_FILENO) close(fd);
+    return r;
 }
 
 int main(int argc, const char* argv[]) {
-    FILE *file;
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len;
-    int found_blank = 0;
+    mail_input in;
+    mail_writer out;
+    int fd, r;
 
     if (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
         usage(argv[0]);
         return 0;
     }
 
+    if (argc >= 2 && argc <= 3 && (strcmp(argv[1], "-M") == 0 || strcmp(argv[1], "--mbox") == 0)) {
+        mail_writer_init(&out, STDOUT_FILENO);
+        r = run_mbox(argv[0], argc == 3 ? argv[2] : NULL, &out);
+        if (mail_writer_flush(&out) == -1) r = 1;
+        mail_writer_free(&out);
+        return r;
+    }
+
+    if ((argc == 3 && (strcmp(argv[1], "--text") == 0 || strcmp(argv[1], "--list-parts") == 0))
+        || (argc == 4 && strcmp(argv[1], "--part") == 0)) {
+        unsigned long part = 0;
+        char *end;
+
+        if (argc == 4) {
+            errno = 0;
+            part = strtoul(argv[2], &end, 10);
+            if (*argv[2] < '0' || *argv[2] > '9' || *end || errno || part == 0 || part > UINT_MAX) {
+                fprintf(stderr, "%s: invalid part number: %s\n", argv[0], argv[2]);
+                return 2;
+            }
+        }
+        mail_writer_init(&out, STDOUT_FILENO);
+        r = run_mime(argv[0], argv[argc - 1],
+                     argc == 4 ? MIME_PART : argv[1][2] == 't' ? MIME_TEXT : MIME_LIST,
+                     (unsigned)part, &out);
+        mail_writer_free(&out);
+        return r;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "--extract-attachments") == 0) {
+        int first = 3, jobs = 1;
+
+        if (argc > 4 && (strcmp(argv[3], "-j") == 0 || strcmp(argv[3], "--jobs") == 0)) {
+            char *end;
+            long n = strtol(argv[4], &end, 10);
+            if (*argv[4] == '\0' || *end != '\0' || n < 0 || n > 1024) {
+                fprintf(stderr, "%s: invalid jobs '%s'\n", argv[0], argv[4]);
+                return 2;
+            }
+            if (n == 0) {
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+                if (n < 1) n = 1;
+                if (n > 1024) n = 1024;
+            }
+            jobs = (int)n;
+            first = 5;
+        }
+        if (first >= argc) {
+            fprintf(stderr, "%s: --extract-attachments needs DIR and FILE...\n", argv[0]);
+            return 2;
+        }
+        return run_extract(argv[0], argv[2], jobs, argv + first, argc - first);
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--index") == 0) {
+        mail_writer_init(&out, STDOUT_FILENO);
+        r = run_index(argv[0], argv[2], &out);
+        mail_writer_free(&out);
+        return r;
+    }
+
     if (argc != 2) {
         fprintf(stderr, "%s: no args\n", argv[0]);
         return 2;
     }
 
-    file = fopen(argv[1], "r");
-    if (!file) {
+    fd = strcmp(argv[1], "-") == 0 ? STDIN_FILENO : open(argv[1], O_RDONLY);
+    if (fd == -1) {
         fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], argv[1]);
         return 1;
     }
 
-    /* Skip header section - read until blank line */
-    while ((line_len = getline(&line, &line_cap, file)) != -1) {
-        if (is_blank_line(line)) {
-            found_blank = 1;
-            break;
-        }
-    }
-
-    /* Output everything after the blank line (the message body) */
-    if (found_blank) {
-        while ((line_len = getline(&line, &line_cap, file)) != -1) {
-            process_line(line);
-            printf("%s", line);
-        }
+    mail_writer_init(&out, STDOUT_FILENO);
+    if (mail_input_streamed(fd)) {
+        /* Pipes and files over the memory ceiling */
+        r = run_stream(argv[0], argv[1], fd, 1, &out);
+        if (mail_writer_flush(&out) == -1) r = 1;
+    } else if (mail_input_fd(&in, fd) == -1) {
+        fprintf(stderr, "\n%s: %s could not be opened!\n", argv[0], argv[1]);
+        r = 1;
+    } else {
+        mail_extract_body(&in, &out);
+        r = mail_writer_flush(&out) == -1 ? 1 : 0;
+        mail_input_close(&in);
     }
 
-    free(line);
-    fclose(file);
-    return 0;
+    mail_writer_free(&out);
+    if (fd != STDIN_FILENO) close(fd);
+    return r;
 }
@@ -20,12 +20,15 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE     /* memmem() in mail_mime.h */
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
 
 #include "builtins.h"
 #include "shell.h"
@@ -34,73 +37,105 @@
 extern char **make_builtin_argv();
 extern void builtin_usage();
 extern void builtin_error();
+extern void sh_invalidid();
 
-/* Helper function: process a line (remove \r, convert \t to space) */
-static void process_line(char *line) {
-    char *src = line, *dst = line;
+/* Include shared zero-copy input and range output, the mbox splitter, the
+ * directory index, body extraction, the MIME part walker and -v/-a
+ * capture */
+#include "mail_io.h"
+#include "mail_mbox.h"
+#include "mail_index.h"
+#include "mail_extract.h"
+#include "mail_mime.h"
+#include "mail_capture.h"
 
-    while (*src) {
-        if (*src == '\r') {
-            src++;
-            continue;
-        }
-        if (*src == '\t') {
-            *dst++ = ' ';
-            src++;
-            continue;
-        }
-        *dst++ = *src++;
+/* Body of every message read from fd, as an mbox or as a single message,
+ * CRs removed and tabs folded, bounded memory */
+static int stream_message(int fd, const char *filename, int single, mail_writer *out) {
+    mail_mbox mb;
+    mail_mbox_chunk c;
+    int r, w;
+
+    if ((single ? mail_mbox_init_message(&mb, fd) : mail_mbox_init(&mb, fd)) == -1) {
+        builtin_error("%s", strerror(errno));
+        return EXECUTION_FAILURE;
     }
-    *dst = '\0';
-}
 
-/* Helper function: check if a line is blank */
-static int is_blank_line(const char *line) {
-    while (*line) {
-        if (*line == '\n') return 1;
-        if (!isspace((unsigned char)*line)) return 0;
-        line++;
+    while (mail_writer_detach(out), (r = mail_mbox_next(&mb, &c)) > 0) {
+        QUIT;  /* Check for signals */
+        if (c.part == MBOX_BODY) mail_write_folded(out, c.p, c.len);
+    }
+
+    w = mail_writer_flush(out);
+    mail_mbox_free(&mb);
+
+    if (r == -1) {
+        builtin_error("%s: read error: %s", filename, strerror(mb.error));
+        return EXECUTION_FAILURE;
     }
-    return 1;
+    if (w == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
+    }
+    return EXECUTION_SUCCESS;
 }
 
-/* Core extraction function */
-static int extract_message(const char *filename, FILE *output) {
-    FILE *file;
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len;
-    int found_blank = 0;
+/* Core extraction function: emit everything in fd after the first blank
+ * line, CRs removed and tabs folded. With use_index, start at the body
+ * offset from the directory index when its entry for the file is current.
+ * Files over the memory ceiling are streamed instead. */
+static int extract_message(int fd, const char *filename, mail_writer *out, int use_index) {
+    mail_input in;
+    long long off = -1;
+    int r;
 
-    file = fopen(filename, "r");
-    if (!file) {
+    if (mail_input_streamed(fd)) {
+        /* Larger than the memory ceiling, or not a regular file: the
+         * headers are scanned, the index is not used */
+        return stream_message(fd, filename, 1, out);
+    }
+    if (mail_input_fd(&in, fd) == -1) {
         builtin_error("%s: cannot open: %s", filename, strerror(errno));
         return EXECUTION_FAILURE;
     }
+    if (use_index) off = mail_index_body_offset(filename, fd);
 
-    /* Skip header section - read until blank line */
-    while ((line_len = getline(&line, &line_cap, file)) != -1) {
-        QUIT;  /* Check for signals */
-
-        if (is_blank_line(line)) {
-            found_blank = 1;
-            break;
-        }
+    if (off >= 0 && (size_t)off <= in.len) {
+        mail_write_folded(out, in.data + off, in.len - off);
+    } else {
+        mail_extract_body(&in, out);
     }
 
-    /* Output everything after the blank line (the message body) */
-    if (found_blank) {
-        while ((line_len = getline(&line, &line_cap, file)) != -1) {
-            QUIT;  /* Check for signals */
+    /* Output points into the input; write it out before closing */
+    r = mail_writer_flush(out);
+    mail_input_close(&in);
 
-            process_line(line);
-            fprintf(output, "%s", line);
-        }
+    if (r == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
     }
+    return EXECUTION_SUCCESS;
+}
 
-    free(line);
-    fclose(file);
+/* --text, --part N, --list-parts: walk the MIME parts of fd */
+static int mime_message(int fd, const char *filename, mail_mime_mode mode, unsigned part, mail_writer *out) {
+    mail_mime m;
+    int r;
 
+    mail_mime_init(&m, mode, part, out);
+    if (mail_mime_run(&m, fd) == -1) {
+        builtin_error("%s: read error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
+    }
+    if (mode == MIME_PART && !m.found) {
+        builtin_error("%s: no part %u (%u parts)", filename, part, m.parts);
+        return EXECUTION_FAILURE;
+    }
+    r = mail_writer_flush(out);
+    if (r == -1) {
+        builtin_error("%s: write error: %s", filename, strerror(errno));
+        return EXECUTION_FAILURE;
+    }
     return EXECUTION_SUCCESS;
 }
 
@@ -109,12 +144,59 @@ int
 mailmessage_builtin(WORD_LIST *list)
 {
     char **v;
-    int c, r;
+    int c, i, r;
+    int mbox = 0, use_index = 0, mime = 0;
+    mail_mime_mode mode = MIME_TEXT;
+    unsigned long part = 0;
+    char *files[] = { "-", NULL }, **f;
+    mail_capture cap = { NULL, 0 };
+    mail_writer out;
 
     /* Convert WORD_LIST to argc/argv */
     v = make_builtin_argv(list, &c);
 
-    if (c != 2) {
+    /* Options: -M/--mbox, --index, --text, --part N, --list-parts, -v VAR,
+     * -a ARRAY */
+    for (i = 1; i < c && v[i][0] == '-' && v[i][1] != '\0'; i++) {
+        const char *a = v[i];
+
+        if (strcmp(a, "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(a, "-M") == 0 || strcmp(a, "--mbox") == 0) {
+            mbox = 1;
+        } else if (strcmp(a, "--index") == 0) {
+            use_index = 1;
+        } else if (strcmp(a, "--text") == 0 || strcmp(a, "--list-parts") == 0) {
+            mime++;
+            mode = a[2] == 't' ? MIME_TEXT : MIME_LIST;
+        } else if (strcmp(a, "--part") == 0 && i + 1 < c) {
+            char *end;
+            const char *n = v[++i];
+
+            errno = 0;
+            part = strtoul(n, &end, 10);
+            if (*n < '0' || *n > '9' || *end || errno || part == 0 || part > UINT_MAX) {
+                builtin_error("%s: invalid part number", n);
+                free(v);
+                return EX_USAGE;
+            }
+            mime++;
+            mode = MIME_PART;
+        } else if ((strcmp(a, "-v") == 0 || strcmp(a, "-a") == 0) && i + 1 < c) {
+            if (mail_capture_option(&cap, a[1] == 'a', v[++i]) == -1) {
+                free(v);
+                return EX_USAGE;
+            }
+        } else {
+            builtin_usage();
+            free(v);
+            return EX_USAGE;
+        }
+    }
+
+    if ((mbox && use_index) || mime > 1 || (mime && (mbox || use_index)) || (i == c && !mbox)) {
         builtin_usage();
         free(v);
         return EX_USAGE;
@@ -122,7 +204,35 @@ mailmessage_builtin(WORD_LIST *list)
 
     QUIT;  /* Check for signals */
 
-    r = extract_message(v[1], stdout);
+    mail_capture_start(&cap, &out);
+
+    /* Every FILE even after a failure, --mbox without one reads stdin;
+     * bodies concatenated */
+    for (f = i < c ? v + i : files, r = EXECUTION_SUCCESS; *f; f++) {
+        const char *name = *f;
+        int fd = STDIN_FILENO;
+
+        QUIT;  /* Check for signals */
+        if (mbox && strcmp(name, "-") == 0) {
+            name = "stdin";
+        } else if ((fd = open(name, O_RDONLY)) == -1) {
+            builtin_error("%s: cannot open: %s", name, strerror(errno));
+            r = EXECUTION_FAILURE;
+            continue;
+        }
+        if ((mime ? mime_message(fd, name, mode, (unsigned)part, &out)
+             : mbox ? stream_message(fd, name, 0, &out)
+                    : extract_message(fd, name, &out, use_index)) != EXECUTION_SUCCESS) {
+            r = EXECUTION_FAILURE;
+        }
+        if (fd != STDIN_FILENO) close(fd);
+    }
+
+    /* What was read is assigned even if a FILE failed */
+    if (cap.name && mail_capture_bind(&cap, &out) != EXECUTION_SUCCESS) {
+        r = EXECUTION_FAILURE;
+    }
+    mail_writer_free(&out);
 
     free(v);
     return r;
@@ -130,13 +240,36 @@ mailmessage_builtin(WORD_LIST *list)
 
 /* Documentation strings */
 char *mailmessage_doc[] = {
-    "Extract email message body from a file.",
+    "Extract email message bodies from files.",
+    " ",
+    "Read each FILE and display its email message body (everything after",
+    "the first blank line), one after the other. The headers section is",
+    "skipped.",
+    " ",
+    "With --mbox (-M), read each FILE as an mbox, or stdin if FILE is - or",
+    "omitted, and display the body of every message. Memory use stays",
+    "bounded however large the input is.",
+    " ",
+    "With --index, start at the body offset recorded for FILE in the",
+    "header index of its directory (see mailheader --index) if the entry",
+    "is current, instead of scanning the headers.",
+    " ",
+    "With --text, display only the text of each FILE as a MIME message:",
+    "its text parts that are not attachments, decoded from base64 or",
+    "quoted-printable, and of a multipart/alternative only the first",
+    "branch with text. Attachments are skipped without being decoded.",
+    "With --part N, display the decoded body of leaf part N (numbered from",
+    "1 in message order). With --list-parts, display one line per leaf",
+    "part: number, type, transfer encoding, encoded size and file name,",
+    "separated by tabs.",
     " ",
-    "Read the specified FILE and display the email message body (everything",
-    "after the first blank line). The headers section is skipped.",
+    "With -v VAR, assign the output to the shell variable VAR instead of",
+    "displaying it. With -a ARRAY, assign each line of it to an element of",
+    "the indexed array ARRAY, starting at index 0; ARRAY is emptied first.",
     " ",
     "Exit Status:",
-    "Returns success unless the file cannot be opened or read.",
+    "Returns success unless a FILE cannot be opened or read, has no part N,",
+    "or VAR or ARRAY cannot be assigned. The remaining FILEs are still read.",
     (char *)NULL
 };
 
@@ -146,6 +279,6 @@ struct builtin mailmessage_struct = {
     mailmessage_builtin,     /* function implementing builtin */
     BUILTIN_ENABLED,         /* initial flags for builtin */
     mailmessage_doc,         /* array of long documentation strings */
-    "mailmessage FILE",      /* usage synopsis */
+    "mailmessage [-v VAR | -a ARRAY] [--mbox|--index|--text|--list-parts|--part N] FILE...", /* usage synopsis */
     0                        /* reserved for internal use */
 };
@@ -0,0 +1,397 @@
+/*
+mailthread - build and query a conversation thread index
+Reads Message-ID, In-Reply-To, References, Date and Subject from every
+message under the given directories with optional worker threads, links
+them into threads and keeps the result in a mappable index file that
+later runs update incrementally (mail_thread.h)
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+
+/* Include shared line helpers, the field selection, the thread index and
+ * the parallel directory walk */
+#include "mail_io.h"
+#include "mail_select.h"
+#include "mail_thread.h"
+#include "mail_walk.h"
+
+/* Run-wide: the old index to reuse entries from, and the new one being
+ * collected under lock */
+typedef struct {
+    const mail_thread *old;
+    const uint32_t *by_ino;     /* old messages by inode */
+    pthread_mutex_t lock;
+    mail_thread_build build;
+    size_t read, renamed;       /* files parsed, entries found by inode */
+} thread_run;
+
+/* Per-worker reader state */
+typedef struct {
+    thread_run *run;
+    mail_select sel;
+    char *head;
+    size_t head_cap;
+    mail_thread_fields fields;
+} thread_worker;
+
+/* Old entry of the file with inode ino, or NULL */
+static const mail_thread_msg *find_ino(const thread_run *run, uint64_t ino) {
+    size_t lo = 0, hi = run->by_ino ? mail_thread_count(run->old) : 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const mail_thread_msg *m = &run->old->msgs[run->by_ino[mid]];
+        if (m->ino == ino) return m;
+        if (m->ino < ino) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static int ino_cmp(const void *a, const void *b, void *ix) {
+    uint64_t x = ((const mail_thread *)ix)->msgs[*(const uint32_t *)a].ino;
+    uint64_t y = ((const mail_thread *)ix)->msgs[*(const uint32_t *)b].ino;
+    return (x > y) - (x < y);
+}
+
+/* Index one message: reuse its old entry if the file has not changed,
+ * otherwise read its header block */
+static void thread_file(mail_walk *walk, void *arg, const mail_walk_item *item) {
+    thread_worker *w = arg;
+    thread_run *run = w->run;
+    const char *base = strrchr(item->path, '/');
+    const mail_thread_msg *o;
+    struct stat st;
+    ssize_t len;
+    int fd;
+
+    /* Dot files are index files and the like, never messages */
+    base = base ? base + 1 : item->path;
+    if (base[0] == '.' && !item->is_arg) return;
+
+    if (stat(item->path, &st) == -1) {
+        if (item->is_arg) mail_walk_warn(walk, "File not readable, skipping: %s", item->path);
+        mail_walk_error(walk);
+        return;
+    }
+    o = run->old ? mail_thread_find_path(run->old, item->path) : NULL;
+    if (!o || !mail_thread_current(o, &st)) {
+        o = find_ino(run, (uint64_t)st.st_ino);
+        if (o && !mail_thread_current(o, &st)) o = NULL;
+        if (o) {
+            pthread_mutex_lock(&run->lock);
+            run->renamed++;
+            pthread_mutex_unlock(&run->lock);
+        }
+    }
+    if (o) {
+        mail_walk_counted(walk);
+        pthread_mutex_lock(&run->lock);
+        mail_thread_reuse(&run->build, item->path, &st, run->old, o);
+        pthread_mutex_unlock(&run->lock);
+        return;
+    }
+
+    fd = open(item->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        mail_walk_warn(walk, "File not readable, skipping: %s", item->path);
+        mail_walk_error(walk);
+        return;
+    }
+    len = mail_read_header(fd, &w->head, &w->head_cap);
+    close(fd);
+    if (len == -1 || mail_thread_parse(&w->fields, &w->sel, w->head, (size_t)len) == -1) {
+        int saved = len == -1 ? errno : ENOMEM;
+        pthread_mutex_lock(&walk->out_lock);
+        if (!walk->quiet) fprintf(stderr, "%s: %s: %s\n", walk->progname, item->path, strerror(saved));
+        pthread_mutex_unlock(&walk->out_lock);
+        mail_walk_error(walk);
+        return;
+    }
+    mail_walk_counted(walk);
+    pthread_mutex_lock(&run->lock);
+    mail_thread_add(&run->build, item->path, &st, &w->fields);
+    run->read++;
+    pthread_mutex_unlock(&run->lock);
+}
+
+/* Print a string of the index, "-" if it is empty or out of range */
+static void print_str(const mail_thread *ix, uint64_t off, uint32_t len) {
+    const char *s = len ? mail_thread_str(ix, off, len) : NULL;
+
+    if (s) {
+        fwrite(s, 1, len, stdout);
+    } else {
+        putchar('-');
+    }
+}
+
+/* One line per message of the thread rooted at root, depth first:
+ * DEPTH, DATE, MESSAGE-ID, PATH and SUBJECT, tab-separated, "-" where
+ * there is none (a missing message has only its ID) */
+static void print_thread(const mail_thread *ix, uint32_t root) {
+    int depth = 0;
+
+    for (uint32_t n = root, steps = 0; n != MAIL_THREAD_NONE && steps < ix->head->nodes;
+         n = mail_thread_next(ix, n, &depth), steps++) {
+        const mail_thread_node *node = &ix->nodes[n];
+        printf("%d\t", depth);
+        if (node->msg != MAIL_THREAD_NONE && ix->msgs[node->msg].date != 0) {
+            printf("%lld", (long long)ix->msgs[node->msg].date);
+        } else {
+            putchar('-');
+        }
+        putchar('\t');
+        print_str(ix, node->id_off, node->id_len);
+        putchar('\t');
+        if (node->msg != MAIL_THREAD_NONE) {
+            const mail_thread_msg *m = &ix->msgs[node->msg];
+            print_str(ix, m->path_off, m->path_len);
+            putchar('\t');
+            print_str(ix, m->subject_off, m->subject_len);
+        } else {
+            fputs("-\t-", stdout);
+        }
+        putchar('\n');
+    }
+}
+
+static void usage(const char *progname) {
+    printf("Usage: %s [OPTIONS] DIR|FILE [DIR|FILE ...]\n", progname);
+    printf("       %s -n [-f INDEX] [-t | -m MESSAGE-ID]\n", progname);
+    printf("Link the messages under DIR into conversation threads by Message-ID,\n");
+    printf("In-Reply-To and References and keep them in a thread index; unchanged\n");
+    printf("messages are not read again when the index is updated\n");
+    printf("\nOptions:\n");
+    printf("  -f, --index FILE     Index file (default: DIR/%s, first DIR)\n", MAIL_THREAD_NAME);
+    printf("  -n, --no-update      Query the index as it is, without reading messages\n");
+    printf("  -t, --threads        Print every thread\n");
+    printf("  -m, --message ID     Print the thread of the message with this Message-ID\n");
+    printf("  -x, --exclude L      Comma-separated directory names to skip\n");
+    printf("                       (default: tmp, maildir deliveries in progress; '' for none)\n");
+    printf("  -j, --jobs N         Read messages with N worker threads (0: one per CPU)\n");
+    printf("  -q, --quiet          Do not report skipped files\n");
+    printf("      --stats          Report message, thread and index counts on stderr\n");
+    printf("  -h, --help           Show this help message\n");
+    printf("\nOutput (-t, -m): one line per message, threads depth first, replies by date:\n");
+    printf("  DEPTH<TAB>DATE<TAB>MESSAGE-ID<TAB>PATH<TAB>SUBJECT\n");
+    printf("DATE is in seconds since the epoch; - marks a missing value, and a message\n");
+    printf("that is referenced but not indexed has only its MESSAGE-ID.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *index_path = NULL, *exclude = "tmp", *message = NULL;
+    int jobs = 1, opt, no_update = 0, print_all = 0, stats = 0, r = 0;
+    char *default_index = NULL;
+    thread_worker *workers = NULL;
+    thread_run run;
+    mail_thread old, ix;
+    mail_walk walk;
+
+    static const struct option long_options[] = {
+        { "index",     required_argument, NULL, 'f' },
+        { "no-update", no_argument,       NULL, 'n' },
+        { "threads",   no_argument,       NULL, 't' },
+        { "message",   required_argument, NULL, 'm' },
+        { "exclude",   required_argument, NULL, 'x' },
+        { "jobs",      required_argument, NULL, 'j' },
+        { "quiet",     no_argument,       NULL, 'q' },
+        { "stats",     no_argument,       NULL, 'S' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    mail_walk_init(&walk, argv[0]);
+    memset(&run, 0, sizeof(run));
+    memset(&old, 0, sizeof(old));
+    memset(&ix, 0, sizeof(ix));
+    while ((opt = getopt_long(argc, argv, "f:ntm:x:j:qh", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            index_path = optarg;
+            break;
+        case 'n':
+            no_update = 1;
+            break;
+        case 't':
+            print_all = 1;
+            break;
+        case 'm':
+            message = optarg;
+            break;
+        case 'x':
+            exclude = optarg;
+            break;
+        case 'j': {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n < 0 || n > 1024) {
+                fprintf(stderr, "%s: invalid jobs '%s'\n", argv[0], optarg);
+                return 2;
+            }
+            if (n == 0) {
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+                if (n < 1) n = 1;
+                if (n > 1024) n = 1024;
+            }
+            jobs = (int)n;
+            break;
+        }
+        case 'q':
+            walk.quiet = 1;
+            break;
+        case 'S':
+            stats = 1;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            return 2;
+        }
+    }
+
+    if (print_all && message) {
+        fprintf(stderr, "%s: -t and -m are exclusive\n", argv[0]);
+        return 2;
+    }
+    if (no_update ? optind != argc : optind == argc) {
+        fprintf(stderr, "%s: %s\n", argv[0], no_update ? "-n takes no DIR" : "no args");
+        return 2;
+    }
+    if (!index_path) {
+        struct stat st;
+        const char *dir = optind < argc ? argv[optind] : ".";
+        if (optind < argc && (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode))) {
+            fprintf(stderr, "%s: %s is not a directory: give the index with -f\n", argv[0], dir);
+            return 2;
+        }
+        if (asprintf(&default_index, "%s/%s", dir, MAIL_THREAD_NAME) == -1) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(ENOMEM));
+            return 2;
+        }
+        index_path = default_index;
+    }
+
+    if (mail_thread_open(&old, index_path) == -1) {
+        if (no_update || errno != ENOENT) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], index_path, strerror(errno));
+            if (no_update) {
+                free(default_index);
+                return 1;
+            }
+        }
+        memset(&old, 0, sizeof(old));
+    }
+
+    if (no_update) {
+        ix = old;
+        memset(&old, 0, sizeof(old));
+    } else {
+        mail_thread_tree tree;
+
+        /* Old entries by inode, for messages renamed since */
+        run.old = old.head ? &old : NULL;
+        if (run.old && mail_thread_count(&old) > 0) {
+            uint32_t *by_ino = malloc(mail_thread_count(&old) * sizeof(*by_ino));
+            if (by_ino) {
+                for (size_t i = 0; i < mail_thread_count(&old); i++) by_ino[i] = (uint32_t)i;
+                qsort_r(by_ino, mail_thread_count(&old), sizeof(*by_ino), ino_cmp, &old);
+                run.by_ino = by_ino;
+            }
+        }
+        pthread_mutex_init(&run.lock, NULL);
+        workers = calloc((size_t)jobs, sizeof(thread_worker));
+        if (!workers || mail_walk_exclude(&walk, exclude) == -1) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(ENOMEM));
+            return 2;
+        }
+        for (int i = 0; i < jobs; i++) {
+            workers[i].run = &run;
+            if (mail_select_compile(&workers[i].sel, MAIL_THREAD_FIELDS) == -1) {
+                fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+                return 2;
+            }
+        }
+        walk.file = thread_file;
+
+        /* Resolve the scan kernel before the workers share it */
+        mail_scan();
+
+        walk.errors += mail_walk_args(&walk, argv + optind, argc - optind);
+        mail_walk_run(&walk, jobs, workers, sizeof(thread_worker));
+        for (int i = 0; i < jobs; i++) {
+            mail_select_free(&workers[i].sel);
+            free(workers[i].head);
+            free(workers[i].fields.scratch);
+        }
+        free(workers);
+        free((void *)run.by_ino);
+        pthread_mutex_destroy(&run.lock);
+
+        if (run.build.error) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(run.build.error));
+            r = 1;
+        } else {
+            mail_thread_sort(&run.build);
+            if (mail_thread_link(&tree, &run.build) == -1) {
+                fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+                r = 1;
+            } else {
+                /* Rewrite the index only when a message was read, renamed,
+                 * added or removed */
+                int changed = run.read || run.renamed || !old.head || run.build.count != mail_thread_count(&old);
+                if (changed && mail_thread_save(&run.build, &tree, index_path) == -1) {
+                    fprintf(stderr, "%s: %s: %s\n", argv[0], index_path, strerror(errno));
+                    r = 1;
+                }
+                if (stats) {
+                    fprintf(stderr, "%s: %zu messages (%zu read, %zu renamed), %u threads, %u missing parents\n",
+                            argv[0], run.build.count, run.read, run.renamed, tree.nroots,
+                            tree.count - (uint32_t)run.build.count);
+                }
+                mail_thread_tree_free(&tree);
+            }
+        }
+        free(run.build.msgs);
+        free(run.build.pool);
+        mail_thread_close(&old);
+        if (walk.errors) r = 1;
+
+        if (r == 0 && (print_all || message) && mail_thread_open(&ix, index_path) == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], index_path, strerror(errno));
+            r = 1;
+        }
+    }
+
+    if (ix.head && print_all) {
+        for (uint32_t i = 0; i < ix.head->roots; i++) print_thread(&ix, ix.roots[i]);
+    } else if (ix.head && message) {
+        uint32_t n = mail_thread_find(&ix, message, strlen(message));
+        if (n == MAIL_THREAD_NONE) {
+            fprintf(stderr, "%s: %s: not in the index\n", argv[0], message);
+            r = 1;
+        } else {
+            print_thread(&ix, mail_thread_root(&ix, n));
+        }
+    }
+    if (ix.head && stats && no_update) {
+        fprintf(stderr, "%s: %u messages, %u threads, %u missing parents\n",
+                argv[0], ix.head->count, ix.head->roots, ix.head->nodes - ix.head->count);
+    }
+    if (fflush(stdout) == EOF) r = 1;
+    mail_thread_close(&ix);
+    mail_walk_free(&walk);
+    free(default_index);
+    return r;
+}
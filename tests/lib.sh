@@ -0,0 +1,71 @@
+# lib.sh - Helpers shared by the test scripts
+#
+# Sourced by a test script after it sets SCRIPT_DIR:
+#
+#   SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+#   source "${SCRIPT_DIR}/lib.sh"
+#
+# Sets the build and test data paths, the output colours and the test
+# counters, and defines check, require_bin, start_tests and summary.
+
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+BUILD_LIB="${SCRIPT_DIR}/../build/lib"
+TEST_DATA="${SCRIPT_DIR}/test-data"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+TEST_RULE=''
+
+# check NAME COMMAND... - pass if COMMAND succeeds
+check() {
+    local name="$1"
+    shift
+    ((TOTAL_TESTS++)) || true
+    if "$@"; then
+        ((PASSED_TESTS++)) || true
+        echo -e "${GREEN}✓${NC} $name"
+    else
+        ((FAILED_TESTS++)) || true
+        echo -e "${RED}✗${NC} $name"
+    fi
+}
+
+# require_bin TOOL... - exit unless every TOOL is built in BUILD_BIN
+require_bin() {
+    local tool
+    for tool in "$@"; do
+        if [[ ! -x "${BUILD_BIN}/$tool" ]]; then
+            echo -e "${RED}Error: ${BUILD_BIN}/$tool not found. Run 'make' first.${NC}"
+            exit 1
+        fi
+    done
+}
+
+# start_tests TITLE - print TITLE underlined; summary repeats the rule
+start_tests() {
+    TEST_RULE="${1//?/=}"
+    echo "$1"
+    echo "$TEST_RULE"
+    echo
+}
+
+# summary - print the totals and exit, with 1 if any test failed
+summary() {
+    echo
+    echo "$TEST_RULE"
+    echo "Total tests: $TOTAL_TESTS"
+    echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+    if ((FAILED_TESTS > 0)); then
+        echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+        exit 1
+    fi
+    echo "Failed: 0"
+    exit 0
+}
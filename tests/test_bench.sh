@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+#
+# test_bench.sh - Benchmark corpus generator and driver (make bench)
+#
+# Checks that mail_corpus is deterministic and honours its options, that
+# its mbox holds the same messages as its directory, and that mail_bench
+# runs every tool over a small corpus without a failed run.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+ROOT_DIR="${SCRIPT_DIR}/.."
+TOOLS_BIN="${ROOT_DIR}/build/tools"
+
+require_bin mailheader
+if ! make -C "$ROOT_DIR" -s build/tools/mail_corpus build/tools/mail_bench > /dev/null; then
+    echo -e "${RED}Error: cannot build the benchmark tools${NC}"
+    exit 1
+fi
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+start_tests "Testing the benchmark tools"
+
+# Same options and seed, same bytes; another seed, other bytes
+"${TOOLS_BIN}/mail_corpus" -n 50 -m "$T/a.mbox" "$T/a" > /dev/null
+"${TOOLS_BIN}/mail_corpus" -n 50 "$T/b" > /dev/null
+"${TOOLS_BIN}/mail_corpus" -n 50 -s 2 "$T/c" > /dev/null
+check "same seed gives the same corpus" diff -r "$T/a" "$T/b"
+check "another seed gives another corpus" bash -c "! diff -rq '$T/a' '$T/c' > /dev/null"
+check "COUNT messages written" test "$(ls "$T/a" | wc -l)" = 50
+
+# The mbox holds the same messages
+check "mbox headers match the message files" cmp -s \
+    <("${BUILD_BIN}/mailheader" --mbox "$T/a.mbox") \
+    <(for f in "$T"/a/*; do "${BUILD_BIN}/mailheader" "$f"; echo; done | sed '$d')
+
+# Options
+"${TOOLS_BIN}/mail_corpus" -n 20 -c 0 "$T/lf" > /dev/null
+"${TOOLS_BIN}/mail_corpus" -n 20 -c 100 "$T/crlf" > /dev/null
+check "-c 0 writes no CR" bash -c "! grep -lq \$'\\r' '$T'/lf/*"
+check "-c 100 ends every line with CRLF" bash -c "! grep -lqv \$'\\r\$' '$T'/crlf/*"
+
+"${TOOLS_BIN}/mail_corpus" -n 1 -H 10 -x 0 -d 0 -b 0 "$T/plain" > /dev/null
+check "-H 10 -x 0 -d 0 writes 10 unfolded fields" \
+    test "$("${BUILD_BIN}/mailheader" "$T/plain/msg-000000" | wc -l)" = 10
+
+"${TOOLS_BIN}/mail_corpus" -n 1 -H 8 -x 6 -d 2 "$T/bloat" > /dev/null
+"${BUILD_BIN}/mailheaderclean" "$T/bloat/msg-000000" | "${BUILD_BIN}/mailheader" - > "$T/cleaned"
+check "-x fields are removed by mailheaderclean" \
+    bash -c "grep -q '^Subject:' '$T/cleaned' && ! grep -Eq '^(ARC-|DKIM-|Authentication-|X-MS-)' '$T/cleaned'"
+
+"${TOOLS_BIN}/mail_corpus" -n 1 -b 64k "$T/body" > /dev/null
+size=$("${BUILD_BIN}/mailmessage" "$T/body/msg-000000" | wc -c)
+check "-b 64k writes a body of about 64 KB" test "$size" -ge 65536 -a "$size" -lt 66560
+
+# The driver runs every tool and strategy it can
+"${TOOLS_BIN}/mail_bench" -b "$BUILD_BIN" -l "${ROOT_DIR}/build/lib" -m "$T/a.mbox" -r 1 "$T/a" > "$T/report"
+check "mail_bench runs every standalone tool and strategy" \
+    test "$(grep -c ' standalone ' "$T/report")" = 12
+check "mail_bench has no failed run" bash -c "! grep -q failed '$T/report'"
+
+rc=0
+"${TOOLS_BIN}/mail_bench" "$T/missing" > /dev/null 2>&1 || rc=$?
+check "missing corpus fails" test "$rc" = 1
+
+# Summary
+summary
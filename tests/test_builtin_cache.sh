@@ -0,0 +1,96 @@
+#!/usr/bin/env bash
+#
+# test_builtin_cache.sh - Removal list cache in the mailheaderclean builtin
+#
+# The builtin keeps its compiled removal list for the life of the shell and
+# rebuilds it only when MAILHEADERCLEAN, MAILHEADERCLEAN_PRESERVE or
+# MAILHEADERCLEAN_EXTRA change. Load the builtin once, change the variables
+# between calls without reloading, and require the standalone output each time.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+BUILD_LIB="${SCRIPT_DIR}/../build/lib"
+TEST_FILE="${SCRIPT_DIR}/test-data/1749819569.M335292P205326V0000000000000811I000000000AE40A83_10.okusi0,S=5408:2,S"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+if [[ ! -f "${BUILD_LIB}/mailheaderclean.so" ]]; then
+    echo -e "${YELLOW}Skipped: ${BUILD_LIB}/mailheaderclean.so not found${NC}"
+    exit 0
+fi
+
+enable -f "${BUILD_LIB}/mailheaderclean.so" mailheaderclean
+
+# compare NAME [VAR=VALUE ...] - export the assignments, run both versions
+compare() {
+    local name="$1" assign
+    shift
+    unset MAILHEADERCLEAN MAILHEADERCLEAN_PRESERVE MAILHEADERCLEAN_EXTRA
+    for assign in "$@"; do
+        export "${assign?}"
+    done
+    ((TOTAL_TESTS++)) || true
+    if cmp -s <(builtin mailheaderclean "$TEST_FILE") <("${BUILD_BIN}/mailheaderclean" "$TEST_FILE"); then
+        ((PASSED_TESTS++)) || true
+        echo -e "${GREEN}✓${NC} $name"
+    else
+        ((FAILED_TESTS++)) || true
+        echo -e "${RED}✗${NC} $name"
+    fi
+}
+
+echo "Testing removal list cache in the mailheaderclean builtin"
+echo "========================================================="
+echo
+
+compare "default list"
+compare "default list again (cached)"
+compare "MAILHEADERCLEAN set" "MAILHEADERCLEAN=From,Subject"
+compare "MAILHEADERCLEAN changed" "MAILHEADERCLEAN=Date"
+compare "MAILHEADERCLEAN unset again"
+compare "PRESERVE set" "MAILHEADERCLEAN_PRESERVE=X-Spam-Status"
+compare "PRESERVE changed" "MAILHEADERCLEAN_PRESERVE=X-Spam-*,List-*"
+compare "EXTRA set" "MAILHEADERCLEAN_EXTRA=Reply-To"
+compare "EXTRA set to empty" "MAILHEADERCLEAN_EXTRA="
+compare "all three" "MAILHEADERCLEAN=From,X-Spam-Status" \
+    "MAILHEADERCLEAN_PRESERVE=X-Spam-Status" "MAILHEADERCLEAN_EXTRA=Reply-To"
+compare "back to default"
+
+# -l reflects the current environment, not the first build
+((TOTAL_TESTS++)) || true
+export MAILHEADERCLEAN="Alpha,Beta"
+first=$(builtin mailheaderclean -l | tr '\n' ,)
+export MAILHEADERCLEAN="Gamma"
+second=$(builtin mailheaderclean -l | tr '\n' ,)
+unset MAILHEADERCLEAN
+if [[ "$first" == "Alpha,Beta," && "$second" == "Gamma," ]]; then
+    ((PASSED_TESTS++)) || true
+    echo -e "${GREEN}✓${NC} -l follows environment changes"
+else
+    ((FAILED_TESTS++)) || true
+    echo -e "${RED}✗${NC} -l follows environment changes ($first / $second)"
+fi
+
+enable -d mailheaderclean
+
+# Summary
+echo
+echo "========================================================="
+echo "Total tests: $TOTAL_TESTS"
+echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+if ((FAILED_TESTS > 0)); then
+    echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+    exit 1
+fi
+echo "Failed: 0"
+exit 0
@@ -0,0 +1,108 @@
+#!/usr/bin/env bash
+#
+# test_coproc.sh - mail-tools --coproc
+#
+# Drives mail-tools as a bash coproc: streams the header, body, clean and
+# fields commands for the whole corpus from a background job while reading
+# the answers, and checks every answer byte for byte against the standalone
+# binaries. Then checks error answers, a last command without its newline,
+# and that the removal list comes from the environment.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mail-tools mailheader mailmessage mailheaderclean
+MT="${BUILD_BIN}/mail-tools"
+
+# Answer lengths are bytes: read -N must count bytes, not characters
+export LC_ALL=C
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+# mt_read FD VAR - read one answer from FD into VAR, its status into STATUS
+mt_read() {
+    local -n _answer=$2
+    local len
+    read -r STATUS len <&"$1" || return 1
+    _answer=''
+    ((len == 0)) || IFS= read -r -d '' -N "$len" _answer <&"$1"
+}
+
+start_tests "Testing mail-tools --coproc"
+
+FILES=("$TEST_DATA"/*)
+FIELDS='From,To,Subject,Date'
+
+coproc MAILTOOLS { "$MT" --coproc; }
+MT_PID=$MAILTOOLS_PID
+# Commands are written by a background job while the answers are read, so
+# neither side waits for the other (coproc fds are not inherited: dup it)
+exec {to_mt}>&"${MAILTOOLS[1]}"
+for f in "${FILES[@]}"; do
+    printf 'header %s\nbody %s\nclean %s\nfields %s %s\n' "$f" "$f" "$f" "$f" "$FIELDS"
+done >&"$to_mt" &
+WRITER=$!
+exec {to_mt}>&-
+
+status_ok=1
+for f in "${FILES[@]}"; do
+    for cmd in header body clean fields; do
+        mt_read "${MAILTOOLS[0]}" answer || { status_ok=0; break 2; }
+        [[ $STATUS == 0 ]] || status_ok=0
+        printf '%s' "$answer" >> "$T/coproc.$cmd"
+    done
+done
+wait "$WRITER"
+for f in "${FILES[@]}"; do
+    "$BUILD_BIN/mailheader" "$f" >> "$T/expect.header"
+    "$BUILD_BIN/mailmessage" "$f" >> "$T/expect.body"
+    "$BUILD_BIN/mailheaderclean" "$f" >> "$T/expect.clean"
+    "$BUILD_BIN/mailheader" -H "$FIELDS" "$f" >> "$T/expect.fields"
+done
+
+check "${#FILES[@]} pipelined messages, all status 0" test "$status_ok" = 1
+check "header matches mailheader" cmp -s "$T/coproc.header" "$T/expect.header"
+check "body matches mailmessage" cmp -s "$T/coproc.body" "$T/expect.body"
+check "clean matches mailheaderclean" cmp -s "$T/coproc.clean" "$T/expect.clean"
+check "fields matches mailheader -H" cmp -s "$T/coproc.fields" "$T/expect.fields"
+
+# Errors are answered and the loop goes on
+F="${FILES[0]}"
+printf 'bogus %s\nheader %s\nfields %s\nheader\nheader %s\n' "$F" "$T/none" "$F" "$F" >&"${MAILTOOLS[1]}"
+mt_read "${MAILTOOLS[0]}" answer
+check "unknown command: status 22" test "$STATUS" = 22
+mt_read "${MAILTOOLS[0]}" answer
+check "unreadable FILE: status 1 and a message" test "$STATUS:${answer#*: }" = "1:No such file or directory"
+mt_read "${MAILTOOLS[0]}" answer
+check "fields without LIST: status 22" test "$STATUS" = 22
+mt_read "${MAILTOOLS[0]}" answer
+check "header without FILE: status 22" test "$STATUS" = 22
+mt_read "${MAILTOOLS[0]}" answer
+check "next command answered normally" cmp -s <(printf '%s' "$answer") <("$BUILD_BIN/mailheader" "$F")
+
+# A command line too long is refused once, the rest of it skipped
+{ printf 'header '; head -c 70000 /dev/zero | tr '\0' x; printf '\nbody %s\n' "$F"; } >&"${MAILTOOLS[1]}"
+mt_read "${MAILTOOLS[0]}" answer
+check "overlong command: status 22" test "$STATUS" = 22
+mt_read "${MAILTOOLS[0]}" answer
+check "command after it answered" cmp -s <(printf '%s' "$answer") <("$BUILD_BIN/mailmessage" "$F")
+
+exec {MAILTOOLS[1]}>&-
+rc=0
+wait "$MT_PID" || rc=$?
+check "end of input: exit 0" test "$rc" = 0
+
+# Last command without a newline; removal list from the environment
+printf 'From: a@example.com\nX-Custom: 1\nSubject: s\n\nbody\n' > "$T/custom.eml"
+printf 'clean %s' "$T/custom.eml" | MAILHEADERCLEAN_EXTRA='X-Custom' "$MT" --coproc > "$T/env.out"
+check "unterminated command answered, EXTRA honoured" cmp -s "$T/env.out" \
+    <(printf '0 37\nFrom: a@example.com\nSubject: s\n\nbody\n')
+
+check "without --coproc: exit 2" bash -c '"$1" 2> /dev/null; test $? -eq 2' _ "$MT"
+
+# Summary
+summary
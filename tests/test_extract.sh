@@ -0,0 +1,137 @@
+#!/usr/bin/env bash
+#
+# test_extract.sh - mailmessage --extract-attachments DIR [-j N] FILE...
+#
+# Builds messages with base64, quoted-printable and unencoded attachments
+# and RFC 2231 and RFC 2047 file names, and checks that every attachment is
+# written to DIR as the original bytes under the expected name, that names
+# cannot leave DIR, that a pipe and a 4K memory ceiling write the same
+# files, that every scan kernel decodes base64 alike, and that -j 4 writes
+# the same files as -j 1 over the crafted messages and the corpus. Files
+# that exist, from another FILE with the same base name or not, are kept.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailmessage
+MM="${BUILD_BIN}/mailmessage"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+start_tests "Testing attachment extraction"
+
+# A text body, then attachments: base64 binary, QP text with an RFC 2231
+# name in two pieces, an unencoded one with an RFC 2047 name, an inline
+# image with only a Content-Type name, and one whose name tries to climb
+# out of DIR. The newline in front of a delimiter belongs to it, so the
+# text files end without one.
+head -c 500000 /dev/urandom > "$T/data.bin"
+printf 'r\303\251sum\303\251 = 1\ttab\nline two' > "$T/notes.txt"
+printf 'plain attachment' > "$T/plain.txt"
+head -c 3000 /dev/urandom > "$T/logo.png"
+{
+    printf 'From: a@example.com\nSubject: files\nMIME-Version: 1.0\n'
+    printf 'Content-Type: multipart/mixed; boundary="b1"\n\n'
+    printf -- '--b1\nContent-Type: text/plain\n\nsee attached\n'
+    printf -- '--b1\nContent-Type: application/octet-stream\n'
+    printf 'Content-Disposition: attachment; filename="data.bin"\n'
+    printf 'Content-Transfer-Encoding: base64\n\n'
+    base64 -w 76 "$T/data.bin"
+    printf -- '--b1\nContent-Type: text/plain; charset=utf-8\n'
+    printf "Content-Disposition: attachment;\n filename*0*=utf-8''r%%C3%%A9sum;\n filename*1=\"\303\251.txt\"\n"
+    printf 'Content-Transfer-Encoding: quoted-printable\n\n'
+    printf 'r=C3=A9sum=C3=A9 =3D 1\ttab\nline =\ntwo\n'
+    printf -- '--b1\nContent-Type: text/plain\n'
+    printf 'Content-Disposition: attachment; filename="=?iso-8859-1?Q?na=EFve?= plain.txt"\n\n'
+    cat "$T/plain.txt"
+    printf '\n'
+    printf -- '--b1\nContent-Type: image/png; name=logo.png\nContent-Transfer-Encoding: base64\n\n'
+    base64 "$T/logo.png"
+    printf -- '--b1\nContent-Type: text/plain\n'
+    printf 'Content-Disposition: attachment; filename="../../etc/evil\001name"\n\n'
+    printf 'contained\n'
+    printf -- '--b1--\n'
+} > "$T/files.eml"
+sed 's/$/\r/' "$T/files.eml" > "$T/files-crlf.eml"
+
+# List the files of a directory, with their checksums
+listing() {
+    (cd "$1" && find . -type f -print0 | LC_ALL=C sort -z | xargs -0r sha256sum)
+}
+
+mkdir "$T/out"
+"$MM" --extract-attachments "$T/out" "$T/files.eml" > "$T/printed"
+check "attachments are written under their decoded names" \
+    cmp -s <(printf '%s\n' "files.eml.2.data.bin" "files.eml.3.résumé.txt" "files.eml.4.naïve plain.txt" \
+                 "files.eml.5.logo.png" "files.eml.6..._.._etc_evil_name" | LC_ALL=C sort) \
+           <(cd "$T/out" && ls | LC_ALL=C sort)
+check "the paths written are printed" \
+    cmp -s <(sed 's|.*/||' "$T/printed" | LC_ALL=C sort) <(cd "$T/out" && ls | LC_ALL=C sort)
+check "base64 attachment is the original file" cmp -s "$T/data.bin" "$T/out/files.eml.2.data.bin"
+check "quoted-printable attachment is decoded" cmp -s "$T/notes.txt" "$T/out/files.eml.3.résumé.txt"
+check "unencoded attachment byte for byte" cmp -s "$T/plain.txt" "$T/out/files.eml.4.naïve plain.txt"
+check "inline part with a name is extracted" cmp -s "$T/logo.png" "$T/out/files.eml.5.logo.png"
+check "a name cannot leave DIR" test -f "$T/out/files.eml.6..._.._etc_evil_name"
+check "the text body is not extracted" bash -c '! ls "$1" | grep -q "\.1"' _ "$T/out"
+
+mkdir "$T/crlf"
+"$MM" --extract-attachments "$T/crlf" "$T/files-crlf.eml" > /dev/null
+check "CRLF: base64 attachment is the original file" cmp -s "$T/data.bin" "$T/crlf/files-crlf.eml.2.data.bin"
+check "CRLF: QP text keeps its CRLFs" \
+    cmp -s <(printf 'r\303\251sum\303\251 = 1\ttab\r\nline two') "$T/crlf/files-crlf.eml.3.résumé.txt"
+
+# Pipes, a 4K ceiling and every scan kernel write the same files
+mkdir "$T/pipe" "$T/small"
+cat "$T/files.eml" | "$MM" --extract-attachments "$T/pipe" - > /dev/null
+check "from a pipe: named after stdin" cmp -s "$T/data.bin" "$T/pipe/stdin.2.data.bin"
+MAIL_TOOLS_MEMORY=4K "$MM" --extract-attachments "$T/small" "$T/files.eml" > /dev/null
+check "4K ceiling writes the same files" cmp -s <(listing "$T/out") <(listing "$T/small")
+for kernel in avx2 sse2 swar scalar; do
+    rm -rf "$T/k" && mkdir "$T/k"
+    MAIL_TOOLS_SCAN=$kernel "$MM" --extract-attachments "$T/k" "$T/files.eml" "$T/files-crlf.eml" > /dev/null
+    check "MAIL_TOOLS_SCAN=$kernel decodes the same files" \
+        cmp -s <(listing "$T/k") <(cd "$T" && { listing out; listing crlf; } | LC_ALL=C sort -k2)
+done
+
+# Workers: the same files whatever the number of threads
+mkdir "$T/j1" "$T/j4"
+FILES=("$TEST_DATA"/* "$T/files.eml" "$T/files-crlf.eml")
+"$MM" --extract-attachments "$T/j1" -j 1 "${FILES[@]}" > "$T/j1.printed"
+"$MM" --extract-attachments "$T/j4" --jobs 4 "${FILES[@]}" > "$T/j4.printed"
+check "-j 4 writes the same files as -j 1" cmp -s <(listing "$T/j1") <(listing "$T/j4")
+check "-j 4 prints every path once" \
+    cmp -s <(sed 's|.*/||' "$T/j1.printed" | LC_ALL=C sort) <(sed 's|.*/||' "$T/j4.printed" | LC_ALL=C sort)
+check "corpus: each file equals --part N" bash -c '
+    for f in "$1"/*; do
+        name=${f##*/}; msg=${name%%.[0-9]*}; rest=${name#"$msg".}; n=${rest%%.*}
+        [[ -f "$2/$msg" ]] || continue
+        cmp -s "$f" <("$3" --part "$n" "$2/$msg") || exit 1
+    done' _ "$T/j1" "$TEST_DATA" "$MM"
+
+# Errors
+check "missing DIR fails" bash -c '! "$1" --extract-attachments "$2/none" "$3" 2>/dev/null' _ "$MM" "$T" "$T/files.eml"
+check "DIR that is a file fails" bash -c '! "$1" --extract-attachments "$2" "$2" 2>/dev/null' _ "$MM" "$T/files.eml"
+check "no FILE is a usage error" bash -c '"$1" --extract-attachments "$2" 2>/dev/null; (($? == 2))' _ "$MM" "$T/out"
+check "invalid -j is a usage error" \
+    bash -c '"$1" --extract-attachments "$2" -j x "$3" 2>/dev/null; (($? == 2))' _ "$MM" "$T/out" "$T/files.eml"
+check "a missing FILE fails, the others are still extracted" bash -c '
+    mkdir "$2/miss"
+    ! "$1" --extract-attachments "$2/miss" /nonexistent "$3" > /dev/null 2>&1 &&
+    cmp -s "$2/data.bin" "$2/miss/files.eml.2.data.bin"' _ "$MM" "$T" "$T/files.eml"
+check "two FILEs with one base name: the second is refused" bash -c '
+    mkdir "$2/same" "$2/same/a" "$2/same/b" "$2/same/out"
+    cp "$3" "$2/same/a/m" && cp "$3" "$2/same/b/m"
+    ! "$1" --extract-attachments "$2/same/out" "$2/same/a/m" "$2/same/b/m" > "$2/same/printed" 2>/dev/null &&
+    [[ $(sort "$2/same/printed" | uniq -d) == "" ]] &&
+    cmp -s "$2/data.bin" "$2/same/out/m.2.data.bin"' _ "$MM" "$T" "$T/files.eml"
+check "an existing file is not overwritten" bash -c '
+    mkdir "$2/keep" && printf "mine" > "$2/keep/files.eml.2.data.bin"
+    ! "$1" --extract-attachments "$2/keep" "$3" > /dev/null 2>&1 &&
+    [[ $(cat "$2/keep/files.eml.2.data.bin") == mine ]]' _ "$MM" "$T" "$T/files.eml"
+
+# Summary
+summary
@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+#
+# test_fields.sh - Selective field extraction (mailheader -H FIELDS)
+#
+# Checks -H output against the full mailheader output filtered with grep
+# over the test corpus, the early stop on single-instance fields, the
+# mbox and stdin inputs, and that the builtin matches the binary.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheader
+MH="${BUILD_BIN}/mailheader"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+start_tests "Testing mailheader -H"
+
+# corpus_matches FIELDS REGEX - -H FIELDS equals the full output filtered by REGEX
+corpus_matches() {
+    local f
+    for f in "$TEST_DATA"/*; do
+        cmp -s <("$MH" -H "$1" "$f") <("$MH" "$f" | grep -aiE "$2" || true) || return 1
+    done
+}
+
+check "From,To,Subject,Date over the corpus" corpus_matches 'From,To,Subject,Date' '^(from|to|subject|date):'
+check "names match in any case" corpus_matches 'SUBJECT,message-id' '^(subject|message-id):'
+check "X-* and Received (patterns, repeated fields)" corpus_matches 'X-*,Received' '^(x-[^:]*|received):'
+
+# Early stop: single-instance fields end the scan once all are seen
+printf 'From: a\r\nSubject: s\r\n\tmore\r\nFrom: b\r\nX-Late: 1\r\n\r\nbody\r\n' > "$T/dup.eml"
+check "stops after From and Subject, continuation kept" \
+    cmp -s <(printf 'From: a\nSubject: s more\n') <("$MH" -H from,subject "$T/dup.eml")
+check "repeatable field keeps scanning to the end" \
+    cmp -s <(printf 'From: a\nFrom: b\nX-Late: 1\n') <("$MH" -H from,x-late "$T/dup.eml")
+check "field without a match prints nothing" test -z "$("$MH" -H X-None "$T/dup.eml")"
+check "blanks around names are ignored" \
+    cmp -s <("$MH" -H from,subject "$T/dup.eml") <("$MH" -H ' from , Subject ' "$T/dup.eml")
+
+# Inputs
+check "stdin (-)" cmp -s <("$MH" -H subject "$T/dup.eml") <("$MH" -H subject - < "$T/dup.eml")
+mapfile -t files < <(ls "$TEST_DATA" | head -20)
+for f in "${files[@]}"; do
+    printf 'From test@example.com Mon Jan  1 00:00:00 2024\n'
+    cat "$TEST_DATA/$f"
+    printf '\n'
+done > "$T/all.mbox"
+check "--mbox: one block per message" cmp -s \
+    <("$MH" --mbox -H Subject,From "$T/all.mbox") \
+    <(for f in "${files[@]}"; do "$MH" -H Subject,From "$TEST_DATA/$f"; echo; done | sed '$d')
+
+# Errors
+rc=0; "$MH" -H , "$T/dup.eml" > /dev/null 2>&1 || rc=$?
+check "empty field list fails" test "$rc" = 2
+rc=0; "$MH" -H ' , ' "$T/dup.eml" > /dev/null 2>&1 || rc=$?
+check "blank field list fails" test "$rc" = 2
+rc=0; "$MH" -H > /dev/null 2>&1 || rc=$?
+check "-H without FIELDS fails" test "$rc" = 2
+
+# Builtin
+if [[ -f "${BUILD_LIB}/mailheader.so" ]]; then
+    check "builtin matches the binary over the corpus" bash -c '
+        enable -f "$1" mailheader || exit 1
+        for f in "$2"/*; do
+            cmp -s <(mailheader -H from,to,subject "$f") <("$3" -H from,to,subject "$f") || exit 1
+            cmp -s <(mailheader -H "x-*" "$f") <("$3" -H "x-*" "$f") || exit 1
+        done' _ "${BUILD_LIB}/mailheader.so" "$TEST_DATA" "$MH"
+    check "builtin --mbox -H matches the binary" bash -c '
+        enable -f "$1" mailheader || exit 1
+        cmp -s <(mailheader --mbox -H subject "$2") <("$3" --mbox -H subject "$2")' \
+        _ "${BUILD_LIB}/mailheader.so" "$T/all.mbox" "$MH"
+else
+    echo -e "${YELLOW}⊘${NC} builtin checks skipped (build/lib/mailheader.so not built)"
+fi
+
+# Summary
+summary
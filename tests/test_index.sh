@@ -0,0 +1,118 @@
+#!/usr/bin/env bash
+#
+# test_index.sh - Sidecar header index (mailheader --index, mailmessage --index)
+#
+# Indexes a copy of the test corpus and checks field queries against the
+# values mailheader prints, then changes, renames and removes messages and
+# checks that the next query sees the changes. mailmessage --index must
+# print the same body as mailmessage, with a current index and a stale one.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheader mailmessage
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+D="$TEMP_DIR/cur"
+mkdir "$D"
+cp "$TEST_DATA"/* "$D"/
+
+start_tests "Testing the header index"
+
+# expected_fields FIELD... - name and first value of each field, from mailheader
+expected_fields() {
+    local f field value line
+    for f in "$D"/*; do
+        line="${f##*/}"
+        for field in "$@"; do
+            value=$("${BUILD_BIN}/mailheader" "$f" | grep -i -m1 "^$field:" | sed 's/^[^:]*:[ ]*//; s/[[:space:]]*$//' || true)
+            line+=$'\t'"$value"
+        done
+        printf '%s\n' "$line"
+    done
+}
+
+# Fresh index answers like mailheader
+"${BUILD_BIN}/mailheader" --index "$D"
+check "index file created" test -f "$D/.mailheader.idx"
+expected_fields Subject From > "$TEMP_DIR/expected"
+check "Subject,From from a fresh index" \
+    cmp -s "$TEMP_DIR/expected" <("${BUILD_BIN}/mailheader" --index "$D" -H Subject,From)
+check "field names match in any case" \
+    cmp -s "$TEMP_DIR/expected" <("${BUILD_BIN}/mailheader" --index "$D" -H SUBJECT,from)
+
+# No changes: the index file is not rewritten
+inode=$(stat -c %i "$D/.mailheader.idx")
+"${BUILD_BIN}/mailheader" --index "$D" -H Date > /dev/null
+check "unchanged directory leaves the index alone" test "$(stat -c %i "$D/.mailheader.idx")" = "$inode"
+
+# Current index: mailmessage --index starts at the recorded body offset
+bad=0
+for f in "$D"/*; do
+    cmp -s <("${BUILD_BIN}/mailmessage" "$f") <("${BUILD_BIN}/mailmessage" --index "$f") || bad=1
+done
+check "mailmessage --index body matches mailmessage" test "$bad" = 0
+
+# Change, rename (maildir flag change) and remove messages
+mapfile -t names < <(ls "$D")
+mv "$D/${names[0]}" "$D/${names[0]}T"
+printf 'Subject: rewritten\r\nFrom: a@example.com\r\n\r\nnew body\r\n' > "$D/${names[1]}"
+rm -f "$D/${names[2]}"
+printf 'From: b@example.com\nSubject: new\n message\n\nbody\n' > "$D/zz-new"
+expected_fields Subject From > "$TEMP_DIR/expected"
+check "queries see changed, renamed, removed and new messages" \
+    cmp -s "$TEMP_DIR/expected" <("${BUILD_BIN}/mailheader" --index "$D" -H Subject,From)
+check "mailmessage --index with a stale entry" \
+    cmp -s <(printf 'new body\n') <("${BUILD_BIN}/mailmessage" --index "$D/${names[1]}")
+
+# A field that is not indexed yet is added
+expected_fields X-Mailer Subject > "$TEMP_DIR/expected"
+check "new field added to the index" \
+    cmp -s "$TEMP_DIR/expected" <("${BUILD_BIN}/mailheader" --index "$D" -H X-Mailer,Subject)
+
+# Names are trimmed; patterns cannot be indexed
+inode=$(stat -c %i "$D/.mailheader.idx")
+check "blanks around names are ignored" \
+    cmp -s "$TEMP_DIR/expected" <("${BUILD_BIN}/mailheader" --index "$D" -H ' X-Mailer , Subject')
+check "and add no field to the index" test "$(stat -c %i "$D/.mailheader.idx")" = "$inode"
+rc=0
+"${BUILD_BIN}/mailheader" --index "$D" -H 'X-*' > /dev/null 2>&1 || rc=$?
+check "a field pattern is refused" test "$rc" = 2
+check "and not added to the index" bash -c '! grep -qa "x-\*" "$1"' _ "$D/.mailheader.idx"
+
+# -n answers from the index as it is, without seeing new messages
+"${BUILD_BIN}/mailheader" --index "$D" -H X-Mailer,Subject > "$TEMP_DIR/before"
+printf 'Subject: unseen\n\nbody\n' > "$D/zz-unseen"
+inode=$(stat -c %i "$D/.mailheader.idx")
+check "-n answers from the index alone" \
+    cmp -s "$TEMP_DIR/before" <("${BUILD_BIN}/mailheader" --index "$D" -n -H X-Mailer,Subject)
+check "and leaves it alone" test "$(stat -c %i "$D/.mailheader.idx")" = "$inode"
+rc=0
+"${BUILD_BIN}/mailheader" --index "$D" -n -H Reply-To > /dev/null 2>&1 || rc=$?
+check "-n with a field not indexed fails" test "$rc" = 1
+check "an update then sees the new message" \
+    bash -c '"$1" --index "$2" -H Subject | grep -q "^zz-unseen	unseen\$"' _ "${BUILD_BIN}/mailheader" "$D"
+rm "$D/zz-unseen"
+"${BUILD_BIN}/mailheader" --index "$D"
+
+# A damaged index is rebuilt
+head -c 100 /dev/urandom > "$D/.mailheader.idx"
+check "damaged index is rebuilt" \
+    cmp -s "$TEMP_DIR/expected" <("${BUILD_BIN}/mailheader" --index "$D" -H X-Mailer,Subject)
+
+# Errors
+rc=0
+"${BUILD_BIN}/mailheader" --index "$TEMP_DIR/missing" > /dev/null 2>&1 || rc=$?
+check "missing directory fails" test "$rc" = 1
+rc=0
+"${BUILD_BIN}/mailheader" --index "$TEMP_DIR" -n -H Subject > /dev/null 2>&1 || rc=$?
+check "-n without an index fails" test "$rc" = 1
+rc=0
+"${BUILD_BIN}/mailheader" -n "$D/zz-new" > /dev/null 2>&1 || rc=$?
+check "-n without --index fails" test "$rc" = 2
+
+# Summary
+summary
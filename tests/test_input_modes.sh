@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+#
+# test_input_modes.sh - mmap and read() input paths of the three utilities
+#
+# Regular files are mapped with mmap(); pipes and other non-regular inputs
+# are streamed (mail_mbox.h). Both must give the same bytes, and the
+# CR stripping / tab folding / continuation joining rules must hold at
+# buffer and line edges (empty file, no final newline, CRLF, no blank line).
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+TEST_DATA="${SCRIPT_DIR}/test-data"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+# expect NAME EXPECTED_FILE COMMAND...
+expect() {
+    local name="$1" expected="$2"
+    shift 2
+    ((TOTAL_TESTS++)) || true
+    if cmp -s "$expected" <("$@"); then
+        ((PASSED_TESTS++)) || true
+        echo -e "${GREEN}✓${NC} $name"
+    else
+        ((FAILED_TESTS++)) || true
+        echo -e "${RED}✗${NC} $name"
+        diff <(od -c "$expected") <("$@" | od -c) | head -10 || true
+    fi
+}
+
+for tool in mailheader mailmessage mailheaderclean; do
+    if [[ ! -x "${BUILD_BIN}/$tool" ]]; then
+        echo -e "${RED}Error: ${BUILD_BIN}/$tool not found. Run 'make' first.${NC}"
+        exit 1
+    fi
+done
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+echo "Testing mmap and read() input paths"
+echo "==================================="
+echo
+
+# CRLF message with tabs in headers, continuation lines and body
+printf 'Subject: one\r\n\ttwo\r\n three\r\nX-Spam-Flag: YES\r\n\tcont\r\nTo:\ta@b\r\n\r\nBody\tline\r\nend\r\n' > "$T/crlf.eml"
+printf 'Subject: one two three\nX-Spam-Flag: YES cont\nTo: a@b\n' > "$T/crlf.header"
+printf 'Body line\nend\n' > "$T/crlf.body"
+printf 'Subject: one\n two\n three\nTo: a@b\n\r\nBody\tline\r\nend\r\n' > "$T/crlf.clean"
+
+expect "mailheader: CRLF, tabs, continuation joining" "$T/crlf.header" "${BUILD_BIN}/mailheader" "$T/crlf.eml"
+expect "mailmessage: CRLF and tabs folded in body" "$T/crlf.body" "${BUILD_BIN}/mailmessage" "$T/crlf.eml"
+expect "mailheaderclean: separator and body unchanged" "$T/crlf.clean" "${BUILD_BIN}/mailheaderclean" "$T/crlf.eml"
+
+# Edge cases: empty file, no final newline, no blank line, blank first line
+: > "$T/empty.eml"
+printf 'Subject: x' > "$T/nonl.eml"
+printf 'Subject: x\nFrom: y\n' > "$T/noblank.eml"
+printf '\nonly body\n' > "$T/nohead.eml"
+: > "$T/nothing"
+
+expect "empty file: no headers" "$T/nothing" "${BUILD_BIN}/mailheader" "$T/empty.eml"
+expect "empty file: no body" "$T/nothing" "${BUILD_BIN}/mailmessage" "$T/empty.eml"
+expect "no final newline: header kept as-is" "$T/nonl.eml" "${BUILD_BIN}/mailheader" "$T/nonl.eml"
+expect "no blank line: no body" "$T/nothing" "${BUILD_BIN}/mailmessage" "$T/noblank.eml"
+expect "no blank line: headers only" "$T/noblank.eml" "${BUILD_BIN}/mailheaderclean" "$T/noblank.eml"
+expect "blank first line: no headers" "$T/nothing" "${BUILD_BIN}/mailheader" "$T/nohead.eml"
+printf 'only body\n' > "$T/nohead.body"
+expect "blank first line: whole rest is body" "$T/nohead.body" "${BUILD_BIN}/mailmessage" "$T/nohead.eml"
+
+# Streamed input: a pipe must give the same output as the mapped file
+sample=$(find "$TEST_DATA" -maxdepth 1 -type f -size +8k | sort | sed -n 1p)
+for tool in mailheader mailmessage mailheaderclean; do
+    "${BUILD_BIN}/$tool" "$sample" > "$T/$tool.mapped"
+    expect "$tool: pipe input matches mapped file" "$T/$tool.mapped" \
+        bash -c '"$1" /dev/stdin < <(cat "$2")' _ "${BUILD_BIN}/$tool" "$sample"
+done
+
+# A large body passes through intact
+{ printf 'Subject: big\n\n'; head -c 3000000 /dev/zero | tr '\0' 'x' | fold -w 76; } > "$T/big.eml"
+tail -n +3 "$T/big.eml" > "$T/big.body"
+expect "mailmessage: 3 MB body" "$T/big.body" "${BUILD_BIN}/mailmessage" "$T/big.eml"
+expect "mailheaderclean: 3 MB message" "$T/big.eml" "${BUILD_BIN}/mailheaderclean" "$T/big.eml"
+
+# Summary
+echo
+echo "==================================="
+echo "Total tests: $TOTAL_TESTS"
+echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+if ((FAILED_TESTS > 0)); then
+    echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+    exit 1
+fi
+echo "Failed: 0"
+exit 0
@@ -87,7 +87,7 @@ echo
 echo "TEST 4: Verify files installed to correct locations"
 echo "-------------------------------------------"
 # Check binaries
-for bin in mailheader mailmessage mailheaderclean; do
+for bin in mailheader mailmessage mailheaderclean mailgetaddresses; do
     if [[ -f "$TEST_PREFIX/bin/$bin" ]]; then
         echo "  ✓ $TEST_PREFIX/bin/$bin installed"
         ((PASS++)) || true
@@ -98,7 +98,7 @@ for bin in mailheader mailmessage mailheaderclean; do
 done
 
 # Check scripts
-for script in mailgetaddresses mailgetheaders; do
+for script in mailgetheaders; do
     if [[ -f "$TEST_PREFIX/bin/$script" ]]; then
         echo "  ✓ $TEST_PREFIX/bin/$script installed"
         ((PASS++)) || true
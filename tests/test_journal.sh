@@ -0,0 +1,107 @@
+#!/usr/bin/env bash
+#
+# test_journal.sh - Already-clean fast path and mailheaderclean --journal
+#
+# Checks that -i leaves clean messages untouched (same inode), that a second
+# run with --journal skips every recorded file, that touched, edited or
+# replaced files are cleaned again, and that a journal written with another
+# removal list, or a damaged one, is ignored.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheaderclean
+MHC="${BUILD_BIN}/mailheaderclean"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+# stat_value FILE KEY - value of a "KEY<TAB>value" line
+stat_value() {
+    awk -F'\t' -v k="$2" '$1 == k { print $2 }' "$1"
+}
+
+# run_stats NAME ARGS... - clean with --stats into $T/NAME.stats
+run_stats() {
+    local name="$1"
+    shift
+    "$MHC" --stats "$@" 2> "$T/$name.stats"
+}
+
+start_tests "Testing mailheaderclean -i fast path and --journal"
+
+mkdir "$T/dir"
+printf 'From: a@example.com\nSubject: clean\n\nbody\n' > "$T/dir/clean.eml"
+printf 'From: a@example.com\nX-Spam-Score: 5\nSubject: dirty\n\nbody\n' > "$T/dir/dirty.eml"
+printf 'From: a@example.com\r\nSubject: crlf\r\n\r\nbody\r\n' > "$T/dir/crlf.eml"
+touch -d '2020-01-01 00:00:00' "$T/dir"/*.eml
+ino_before=$(stat -c %i "$T/dir/clean.eml")
+crlf_before=$(stat -c %i "$T/dir/crlf.eml")
+
+# Fast path without a journal
+run_stats plain -i "$T/dir/clean.eml"
+check "clean file keeps its inode" test "$(stat -c %i "$T/dir/clean.eml")" = "$ino_before"
+check "clean file counted as unchanged" test "$(stat_value "$T/plain.stats" unchanged)" = 1
+
+# First journal run: dirty and CRLF files rewritten, all three recorded
+run_stats first -i -J "$T/journal" "$T/dir"
+check "dirty file cleaned" bash -c '! grep -q "^X-Spam" "$1"' _ "$T/dir/dirty.eml"
+check "CRLF file rewritten" test "$(stat -c %i "$T/dir/crlf.eml")" != "$crlf_before"
+check "first run: 1 unchanged, 0 skipped" test \
+    "$(stat_value "$T/first.stats" unchanged) $(stat_value "$T/first.stats" journal_skipped)" = "1 0"
+check "journal written" test -s "$T/journal"
+
+# Second run: nothing opened
+run_stats second -i -J "$T/journal" "$T/dir"
+check "second run skips all 3 files" test \
+    "$(stat_value "$T/second.stats" journal_skipped) $(stat_value "$T/second.stats" messages)" = "3 0"
+
+# Changed files are looked at again
+touch "$T/dir/clean.eml"
+printf 'X-Spam-Flag: YES\n' | cat - "$T/dir/dirty.eml" > "$T/dirty.new"
+cp "$T/dirty.new" "$T/dir/dirty.eml"
+touch -d '2020-01-01 00:00:00' "$T/dir/dirty.eml"
+run_stats third -i -J "$T/journal" "$T/dir"
+check "touched and edited files processed, other skipped" test \
+    "$(stat_value "$T/third.stats" messages) $(stat_value "$T/third.stats" journal_skipped)" = "2 1"
+check "edited file cleaned again" bash -c '! grep -q "^X-Spam" "$1"' _ "$T/dir/dirty.eml"
+
+# Replaced file (new inode, same size and mtime) is not trusted
+cp -p "$T/dir/clean.eml" "$T/clean.copy"
+mv "$T/clean.copy" "$T/dir/clean.eml"
+run_stats replaced -i -J "$T/journal" "$T/dir"
+check "replaced file processed" test "$(stat_value "$T/replaced.stats" messages)" = 1
+
+# Another removal list invalidates the journal
+MAILHEADERCLEAN_EXTRA='X-Other' run_stats other -i -J "$T/journal" "$T/dir"
+check "changed removal list: full run" test \
+    "$(stat_value "$T/other.stats" messages) $(stat_value "$T/other.stats" journal_skipped)" = "3 0"
+
+# A damaged journal is a full run, and is replaced
+printf 'garbage' > "$T/journal"
+run_stats damaged -i -J "$T/journal" "$T/dir"
+check "damaged journal: full run" test "$(stat_value "$T/damaged.stats" messages)" = 3
+run_stats again -i -J "$T/journal" "$T/dir"
+check "damaged journal replaced" test "$(stat_value "$T/again.stats" journal_skipped)" = 3
+
+# --jobs workers record the same files as one process
+mkdir "$T/corpus"
+cp -p "$TEST_DATA"/* "$T/corpus/"
+run_stats jobs1 -i -j 4 -J "$T/corpus.journal" "$T/corpus"
+run_stats jobs2 -i -j 4 -J "$T/corpus.journal" "$T/corpus"
+check "--jobs: second run skips the whole corpus" test \
+    "$(stat_value "$T/jobs2.stats" journal_skipped)" = "$(ls "$TEST_DATA" | wc -l)"
+run_stats jobs3 -i -J "$T/corpus.journal" "$T/corpus"
+check "--jobs journal read by a single process" test \
+    "$(stat_value "$T/jobs3.stats" messages)" = 0
+
+# Errors
+check "--journal without -i is refused" bash -c \
+    '"$1" -J "$2/j" "$2/dir/clean.eml" > /dev/null 2>&1; test $? -eq 2' _ "$MHC" "$T"
+check "help lists --journal" bash -c '"$1" --help | grep -q -- --journal' _ "$MHC"
+
+# Summary
+summary
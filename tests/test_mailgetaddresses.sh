@@ -9,7 +9,7 @@ GREEN='\033[0;32m'
 BLUE='\033[0;34m'
 NC='\033[0m' # No Color
 
-echo -e "${BLUE}Testing mailgetaddresses script${NC}"
+echo -e "${BLUE}Testing mailgetaddresses${NC}"
 echo "=================================="
 echo
 
@@ -17,7 +17,7 @@ echo
 TEST_FILE=""
 TEST_DIR=""
 if [[ -d test-data ]]; then
-  TEST_FILE=$(find test-data -type f -not -path '*/.*' | head -1)
+  TEST_FILE=$(find test-data -type f -not -path '*/.*' -print -quit)
   TEST_DIR="test-data"
 elif [[ -f ../examples/test.eml ]]; then
   TEST_FILE="../examples/test.eml"
@@ -36,31 +36,69 @@ echo
 # Test 1: Basic extraction
 echo -e "${BLUE}Test 1: Extract email addresses only${NC}"
 echo "Command: mailgetaddresses \"$TEST_FILE\""
-../scripts/mailgetaddresses "$TEST_FILE"
+../build/bin/mailgetaddresses "$TEST_FILE"
 echo
 
 # Test 2: Extract with names
 echo -e "${BLUE}Test 2: Extract with names (-n option)${NC}"
 echo "Command: mailgetaddresses -n \"$TEST_FILE\""
-../scripts/mailgetaddresses -n "$TEST_FILE"
+../build/bin/mailgetaddresses -n "$TEST_FILE"
 echo
 
 # Test 3: Separated by header type
 echo -e "${BLUE}Test 3: Separated by header type (-s option)${NC}"
 echo "Command: mailgetaddresses -s \"$TEST_FILE\""
-../scripts/mailgetaddresses -s "$TEST_FILE"
+../build/bin/mailgetaddresses -s "$TEST_FILE"
 echo
 
 # Test 4: Extract only specific headers
-echo -e "${BLUE}Test 4: Extract only From header (-h from)${NC}"
-echo "Command: mailgetaddresses -h from \"$TEST_FILE\""
-../scripts/mailgetaddresses -h from "$TEST_FILE"
+echo -e "${BLUE}Test 4: Extract only From header (-H from)${NC}"
+echo "Command: mailgetaddresses -H from \"$TEST_FILE\""
+../build/bin/mailgetaddresses -H from "$TEST_FILE"
 echo
 
 # Test 5: Combine options
 echo -e "${BLUE}Test 5: Combine -n and -s options${NC}"
-echo "Command: mailgetaddresses -n -s -h from,to \"$TEST_FILE\""
-../scripts/mailgetaddresses -n -s -h from,to "$TEST_FILE"
+echo "Command: mailgetaddresses -n -s -H from,to \"$TEST_FILE\""
+../build/bin/mailgetaddresses -n -s -H from,to "$TEST_FILE"
+echo
+
+# Test 6: Address list syntax
+echo -e "${BLUE}Test 6: Quoted commas, groups, comments and encoded names${NC}"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cat > "$tmp/list.eml" <<'EOM'
+From: "Smith, John" <john@example.com>
+To: undisclosed: anne@example.org, (Bob) bob@example.net;,
+ =?UTF-8?Q?Ren=C3=A9e?= <renee@example.com>
+Cc:<noreply@example.com>
+Subject: list
+
+body
+EOM
+expected='FROM: Smith, John <john@example.com>
+TO: anne@example.org
+TO: Bob <bob@example.net>
+TO: Renée <renee@example.com>
+CC: noreply@example.com'
+actual=$(../build/bin/mailgetaddresses -ns "$tmp/list.eml")
+if [[ "$actual" == "$expected" ]]; then
+  echo "✓ Address list parsed"
+else
+  echo "✗ Address list parsed incorrectly:"
+  echo "$actual"
+  exit 1
+fi
+echo
+
+# Test 7: Parallel walk finds the same addresses
+echo -e "${BLUE}Test 7: --jobs gives the same addresses as a single worker${NC}"
+if [[ "$(../build/bin/mailgetaddresses -j 4 "$TEST_DIR" | sort)" == "$(../build/bin/mailgetaddresses -j 1 "$TEST_DIR" | sort)" ]]; then
+  echo "✓ -j 4 matches -j 1"
+else
+  echo "✗ -j 4 output differs from -j 1"
+  exit 1
+fi
 echo
 
 # Show original headers for comparison
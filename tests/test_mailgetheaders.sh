@@ -110,7 +110,7 @@ TEST_COUNT=0
 for email in tests/test-data/*; do
     [[ ! -f "$email" ]] && continue
 
-    ((TEST_COUNT++))
+    ((TEST_COUNT++)) || true
     if ((TEST_COUNT > 10)); then
         break  # Only test first 10 files
     fi
@@ -128,6 +128,51 @@ if ((TEST_COUNT > 0)); then
 fi
 echo
 
+echo "TEST 5: mailgetheaders builtin (-A)"
+echo "-------------------------------------------"
+if [[ -f build/lib/mailgetheaders.so ]]; then
+    DUP_FILE=$(mktemp)
+    printf 'Received: one\nReceived: two\n\tcont\nSubject: x\n\nReceived: body\n' > "$DUP_FILE"
+
+    # The builtin's printed declaration must load the same array as the script
+    if [[ "$(bash -c 'enable -f build/lib/mailgetheaders.so mailgetheaders
+                      declare -A Headers; eval "$(mailgetheaders "$1")"
+                      for k in "${!Headers[@]}"; do printf "%s=%s\n" "$k" "${Headers[$k]}"; done | sort' _ examples/test.eml)" \
+          == "$(bash -c 'declare -A Headers; eval "$(scripts/mailgetheaders "$1")"
+                      for k in "${!Headers[@]}"; do printf "%s=%s\n" "$k" "${Headers[$k]}"; done | sort' _ examples/test.eml)" ]]; then
+        echo "  ✓ Printed declaration matches the script"
+        ((PASS++)) || true
+    else
+        echo "  ✗ FAIL: Printed declaration differs from the script"
+        ((FAIL++)) || true
+    fi
+
+    for policy in first:one last:"two cont" concat:$'one\ntwo cont'; do
+        if [[ "$(bash -c 'enable -f build/lib/mailgetheaders.so mailgetheaders
+                          f() { local -A H; mailgetheaders -A H -d "$1" "$2" && printf "%s" "${H[Received]}"; }
+                          f "$1" "$2"' _ "${policy%%:*}" "$DUP_FILE")" == "${policy#*:}" ]]; then
+            echo "  ✓ -d ${policy%%:*} keeps the expected Received value"
+            ((PASS++)) || true
+        else
+            echo "  ✗ FAIL: -d ${policy%%:*} gave the wrong Received value"
+            ((FAIL++)) || true
+        fi
+    done
+
+    if bash -c 'enable -f build/lib/mailgetheaders.so mailgetheaders
+                declare -rA H=(); mailgetheaders -A H "$1"' _ "$DUP_FILE" 2>/dev/null; then
+        echo "  ✗ FAIL: Readonly array was assigned"
+        ((FAIL++)) || true
+    else
+        echo "  ✓ Readonly array is refused"
+        ((PASS++)) || true
+    fi
+    rm -f "$DUP_FILE"
+else
+    echo "  - Skipped: build/lib/mailgetheaders.so not found"
+fi
+echo
+
 echo "=== Summary ==="
 echo "Passed: $PASS"
 echo "Failed: $FAIL"
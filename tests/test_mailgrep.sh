@@ -0,0 +1,92 @@
+#!/usr/bin/env bash
+#
+# test_mailgrep.sh - mailgrep PATTERN FILE|DIR...
+#
+# Checks mailgrep against mailheader piped to grep -E over the corpus, with
+# and without the literal prefilter (a pattern in a group has no required
+# literal), one worker against four, -H field values, -F, -i, -l and -q,
+# that folded lines are matched unfolded, that a body is never searched,
+# and the exit status.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailgrep mailheader
+MG="${BUILD_BIN}/mailgrep"
+MH="${BUILD_BIN}/mailheader"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+start_tests "Testing mailgrep"
+
+FILES=("$TEST_DATA"/*)
+
+# reference [GREP_OPTIONS...] PATTERN - what mailheader | grep -E prints
+reference() {
+    local f
+    for f in "${FILES[@]}"; do
+        "$MH" "$f" | LC_ALL=C grep -E "$@" | sed "s|^|$f:|" || true
+    done
+}
+
+for pattern in 'Received: from' '^Subject: .*[Rr]e' 'spam' '@[a-z]+\.com>'; do
+    reference "$pattern" > "$T/ref"
+    check "corpus '$pattern': mailheader | grep -E" cmp -s "$T/ref" <("$MG" "$pattern" "${FILES[@]}")
+    check "corpus '$pattern': no prefilter, same lines" cmp -s "$T/ref" <("$MG" "($pattern)" "${FILES[@]}")
+    check "corpus '$pattern': -j 4 over the directory, same lines" \
+        cmp -s <(sort "$T/ref") <("$MG" -j 4 "$pattern" "$TEST_DATA" | sort)
+done
+check "corpus -i: mailheader | grep -Ei" \
+    cmp -s <(reference -i 'subject: .*invoice') <("$MG" -i 'subject: .*invoice' "${FILES[@]}")
+check "corpus -F: mailheader | grep -F" \
+    cmp -s <(for f in "${FILES[@]}"; do "$MH" "$f" | grep -F 'a.m' | sed "s|^|$f:|" || true; done) \
+           <("$MG" -F 'a.m' "${FILES[@]}")
+check "corpus -l: the files -q finds a match in" \
+    cmp -s <(for f in "${FILES[@]}"; do "$MG" -q spam "$f" && echo "$f"; done || true) <("$MG" -l spam "${FILES[@]}")
+
+# A folded field, a body that repeats the header words, CRLF
+{
+    printf 'From: Alice <alice@example.com>\nTo: bob@example.org,\n\tcarol@example.net\n'
+    printf 'Subject: quarterly\n report\nX-Note: Subject: decoy\n\n'
+    printf 'Subject: in the body\nbob@example.org\n'
+} > "$T/folded.eml"
+sed 's/$/\r/' "$T/folded.eml" > "$T/crlf.eml"
+
+check "a folded field is matched unfolded" \
+    cmp -s <(printf '%s:To: bob@example.org, carol@example.net\n' "$T/folded.eml") \
+           <("$MG" 'org, carol' "$T/folded.eml")
+check "CRLF: the same line without CRs" \
+    cmp -s <(printf '%s:Subject: quarterly report\n' "$T/crlf.eml") <("$MG" 'quarterly report' "$T/crlf.eml")
+check "the body is not searched" bash -c '! "$1" "in the body" "$2"' _ "$MG" "$T/folded.eml"
+check "-H matches field values only" \
+    cmp -s <(printf '%s:Subject: quarterly report\n' "$T/folded.eml") <("$MG" -H subject '^quarterly' "$T/folded.eml")
+check "-H skips other fields" bash -c '! "$1" -H subject decoy "$2"' _ "$MG" "$T/folded.eml"
+check "-H with a glob" \
+    cmp -s <(printf '%s:X-Note: Subject: decoy\n' "$T/folded.eml") <("$MG" -H 'x-*' -F decoy "$T/folded.eml")
+check "-i -F ignores case" bash -c '"$1" -q -i -F ALICE@EXAMPLE "$2"' _ "$MG" "$T/folded.eml"
+check "several -e: any of them" \
+    bash -c '(($("$1" -e ^From: -e ^Subject: "$2" | wc -l) == 2))' _ "$MG" "$T/folded.eml"
+check "- reads stdin" \
+    cmp -s <(printf '(standard input):From: Alice <alice@example.com>\n') <("$MG" ^From - < "$T/folded.eml")
+check "arguments are searched in order" \
+    cmp -s <(printf '%s\n' "$T/folded.eml" "$T/crlf.eml") <("$MG" -l ^From "$T/folded.eml" "$T/crlf.eml")
+printf 'Subject: no body\n' > "$T/nobody.eml"
+check "a message without a blank line" bash -c '"$1" -q "no body" "$2"' _ "$MG" "$T/nobody.eml"
+
+# Exit status
+check "no match exits 1" bash -c '"$1" zzzz-none "$2"; (($? == 1))' _ "$MG" "$T/folded.eml"
+check "-q prints nothing and exits 0" bash -c '[[ -z $("$1" -q -j 4 Received "$2") ]]' _ "$MG" "$TEST_DATA"
+check "a missing FILE exits 2" bash -c '"$1" From /nonexistent "$2" >/dev/null 2>&1; (($? == 2))' _ "$MG" "$T/folded.eml"
+check "-s silences it" bash -c '[[ -z $("$1" -s From /nonexistent 2>&1 >/dev/null) ]]' _ "$MG"
+check "an invalid pattern exits 2" bash -c '"$1" "a(" "$2" 2>/dev/null; (($? == 2))' _ "$MG" "$T/folded.eml"
+check "invalid -j exits 2" bash -c '"$1" -j x From "$2" 2>/dev/null; (($? == 2))' _ "$MG" "$T/folded.eml"
+check "-x prunes a directory" bash -c '
+    mkdir -p "$2/tree/skip" && cp "$3" "$2/tree/skip/" &&
+    "$1" -q From "$2/tree" && ! "$1" -q -x skip From "$2/tree"' _ "$MG" "$T" "$T/folded.eml"
+
+# Summary
+summary
@@ -0,0 +1,192 @@
+#!/usr/bin/env bash
+#
+# test_mailheaderclean_multi.sh - Multi-file, directory and in-place modes
+#
+# Verifies that one mailheaderclean process can clean many files, walk
+# directories, read a NUL-separated list from stdin, and rewrite files in
+# place with timestamps and permissions preserved, also with worker threads
+# and with long bodies attached by copy_file_range().
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+TEST_DATA="${SCRIPT_DIR}/test-data"
+CLEAN="${BUILD_BIN}/mailheaderclean"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+test_pass() {
+    ((TOTAL_TESTS++)) || true
+    ((PASSED_TESTS++)) || true
+    echo -e "${GREEN}✓${NC} $1"
+}
+
+test_fail() {
+    ((TOTAL_TESTS++)) || true
+    ((FAILED_TESTS++)) || true
+    echo -e "${RED}✗${NC} $1"
+}
+
+if [[ ! -f "$CLEAN" ]]; then
+    echo -e "${RED}Error: $CLEAN not found. Run 'make' first.${NC}"
+    exit 1
+fi
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+# A small maildir with a handful of messages in cur/ and new/
+MAILDIR="${TEMP_DIR}/Maildir"
+mkdir -p "$MAILDIR"/{cur,new,tmp} "${TEMP_DIR}/expected"
+declare -a SAMPLE=()
+readarray -t SAMPLE < <(find "$TEST_DATA" -maxdepth 1 -type f | sort | head -20)
+i=0
+for f in "${SAMPLE[@]}"; do
+    if ((i++ % 2)); then dest="$MAILDIR/cur"; else dest="$MAILDIR/new"; fi
+    cp "$f" "$dest/"
+    "$CLEAN" "$f" > "${TEMP_DIR}/expected/${f##*/}"
+done
+
+check_cleaned() {
+    local dir="$1" f bad=0
+    for f in "$dir"/cur/* "$dir"/new/*; do
+        cmp -s "$f" "${TEMP_DIR}/expected/${f##*/}" || bad=1
+    done
+    return "$bad"
+}
+
+echo "Testing mailheaderclean multi-file and in-place modes"
+echo "====================================================="
+echo
+
+# Test 1: several files on stdout equal the concatenation of single runs
+if cmp -s <("$CLEAN" "${SAMPLE[@]:0:5}") <(for f in "${SAMPLE[@]:0:5}"; do cat "${TEMP_DIR}/expected/${f##*/}"; done); then
+    test_pass "Multiple FILE arguments are cleaned in order to stdout"
+else
+    test_fail "Multiple FILE arguments"
+fi
+
+# Test 2: in-place over a directory tree, timestamps and mode preserved
+cp -r "$MAILDIR" "${TEMP_DIR}/md1"
+touch -d '2020-01-02 03:04:05' "${TEMP_DIR}"/md1/cur/* "${TEMP_DIR}"/md1/new/*
+chmod 600 "${TEMP_DIR}"/md1/cur/*
+first_cur=$(find "${TEMP_DIR}/md1/cur" -type f | head -1)
+before=$(stat -c '%a %Y' "$first_cur")
+if "$CLEAN" --in-place --maxdepth 2 "${TEMP_DIR}/md1" && check_cleaned "${TEMP_DIR}/md1"; then
+    test_pass "In-place directory walk cleans every message"
+else
+    test_fail "In-place directory walk"
+fi
+if [[ "$(stat -c '%a %Y' "$first_cur")" == "$before" ]]; then
+    test_pass "Mode and mtime preserved ($before)"
+else
+    test_fail "Mode and mtime preserved"
+fi
+if [[ -z "$(find "${TEMP_DIR}/md1" -name '*.??????' -newer "$first_cur")" ]] && \
+   (($(find "${TEMP_DIR}/md1" -type f | wc -l) == ${#SAMPLE[@]})); then
+    test_pass "No temp files left behind"
+else
+    test_fail "Temp files left behind"
+fi
+
+# Test 3: maxdepth 1 on the maildir root finds no messages
+cp -r "$MAILDIR" "${TEMP_DIR}/md2"
+"$CLEAN" -i "${TEMP_DIR}/md2"
+if cmp -s "${TEMP_DIR}/md2/cur/${SAMPLE[1]##*/}" "${SAMPLE[1]}"; then
+    test_pass "Default maxdepth 1 does not descend into cur/ and new/"
+else
+    test_fail "Default maxdepth 1"
+fi
+
+# Test 4: NUL-separated list on stdin (find -print0)
+cp -r "$MAILDIR" "${TEMP_DIR}/md3"
+if find "${TEMP_DIR}/md3" -type f -print0 | "$CLEAN" -i -0 && check_cleaned "${TEMP_DIR}/md3"; then
+    test_pass "NUL-separated list from find -print0"
+else
+    test_fail "NUL-separated list from stdin"
+fi
+
+# Test 5: cleaning is idempotent in place
+if "$CLEAN" -i -m 2 "${TEMP_DIR}/md3" && check_cleaned "${TEMP_DIR}/md3"; then
+    test_pass "Second in-place run leaves cleaned files unchanged"
+else
+    test_fail "Idempotent in-place run"
+fi
+
+# Test 6: a missing file is reported, the rest are still processed
+cp -r "$MAILDIR" "${TEMP_DIR}/md4"
+set +e
+"$CLEAN" -i "${TEMP_DIR}/md4/missing" "${TEMP_DIR}"/md4/cur/* 2>/dev/null
+rc=$?
+set -e
+if ((rc == 1)) && cmp -s "${TEMP_DIR}/md4/cur/${SAMPLE[1]##*/}" "${TEMP_DIR}/expected/${SAMPLE[1]##*/}"; then
+    test_pass "Errors are reported (exit 1) without stopping the run"
+else
+    test_fail "Error handling (exit $rc)"
+fi
+
+# Test 7: worker threads clean the same files, attributes preserved
+cp -r "$MAILDIR" "${TEMP_DIR}/md5"
+for i in 1 2 3 4 5; do
+    for f in "${TEMP_DIR}"/md5/cur/*[^0-9]; do cp -p "$f" "$f.$i"; done
+done
+cp -r "${TEMP_DIR}/md5" "${TEMP_DIR}/md6"
+touch -d '2021-05-06 07:08:09' "${TEMP_DIR}"/md[56]/{cur,new}/*
+"$CLEAN" -i -m 2 "${TEMP_DIR}/md5"
+if "$CLEAN" -i -m 2 --jobs 4 "${TEMP_DIR}/md6" && diff -r "${TEMP_DIR}/md5" "${TEMP_DIR}/md6" >/dev/null && \
+   [[ "$(cd "${TEMP_DIR}/md5" && find . -type f -printf '%p %T@ %m\n' | sort)" == \
+      "$(cd "${TEMP_DIR}/md6" && find . -type f -printf '%p %T@ %m\n' | sort)" ]]; then
+    test_pass "--jobs 4 gives the same files, mtimes and modes as one thread"
+else
+    test_fail "--jobs 4 differs from a single-threaded run"
+fi
+
+# Test 8: long bodies are attached in the kernel, not rewritten; the
+# result must still match the stdout output byte for byte
+mkdir -p "${TEMP_DIR}/big"
+{ cat "${SAMPLE[0]}"; for i in $(seq 20000); do printf 'line %d of a long attachment body\r\n' "$i"; done; } \
+    > "${TEMP_DIR}/big/long.eml"
+printf 'From: a\nX-MS-Has-Attach: yes\n' > "${TEMP_DIR}/big/nobody.eml"
+touch -d '2022-03-04 05:06:07' "${TEMP_DIR}"/big/*
+for f in "${TEMP_DIR}"/big/*; do "$CLEAN" "$f" > "$f.expected"; done
+before=$(stat -c '%Y' "${TEMP_DIR}/big/long.eml")
+if "$CLEAN" -i "${TEMP_DIR}/big/long.eml" "${TEMP_DIR}/big/nobody.eml" && \
+   cmp -s "${TEMP_DIR}/big/long.eml" "${TEMP_DIR}/big/long.eml.expected" && \
+   cmp -s "${TEMP_DIR}/big/nobody.eml" "${TEMP_DIR}/big/nobody.eml.expected" && \
+   [[ "$(stat -c '%Y' "${TEMP_DIR}/big/long.eml")" == "$before" ]]; then
+    test_pass "Long body attached unchanged in place, mtime preserved"
+else
+    test_fail "Long body in place"
+fi
+
+# Test 9: usage errors
+set +e
+"$CLEAN" >/dev/null 2>&1; rc_none=$?
+"$CLEAN" --maxdepth x "$MAILDIR" >/dev/null 2>&1; rc_bad=$?
+"$CLEAN" --jobs 2 "$MAILDIR" >/dev/null 2>&1; rc_jobs=$?
+set -e
+if ((rc_none == 2 && rc_bad == 2 && rc_jobs == 2)); then
+    test_pass "Usage errors exit with status 2 (--jobs without --in-place)"
+else
+    test_fail "Usage errors (got $rc_none, $rc_bad, $rc_jobs)"
+fi
+
+# Summary
+echo
+echo "====================================================="
+echo "Total tests: $TOTAL_TESTS"
+echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+if ((FAILED_TESTS > 0)); then
+    echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+    exit 1
+fi
+echo "Failed: 0"
+exit 0
@@ -0,0 +1,124 @@
+#!/usr/bin/env bash
+#
+# test_mailthread.sh - mailthread DIR...
+#
+# Checks the threads built from a crafted Maildir (replies, References
+# order, missing parents, duplicate IDs, loops, date order), that an update
+# reads only new and changed messages and follows renames, that four
+# workers build the same threads as one, -m, -n, and the exit status.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailthread
+MT="${BUILD_BIN}/mailthread"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+start_tests "Testing mailthread"
+
+# msg NAME FIELD... - a message in $T/md/cur with these header lines
+msg() {
+    local name="$1"
+    shift
+    printf '%s\n' "$@" "" "body" > "$T/md/cur/$name"
+}
+
+# threads - DEPTH, MESSAGE-ID and file name of each line of -t
+threads() {
+    "$MT" -t "$@" | awk -F'\t' '{ n = split($4, p, "/"); print $1, $3, p[n] }'
+}
+
+mkdir -p "$T/md/cur" "$T/md/tmp"
+msg a 'Message-ID: <a@x>' 'Date: Mon, 1 Jan 2024 10:00:00 +0000' 'Subject: root'
+msg b 'Message-ID: <b@x>' 'In-Reply-To: <a@x>' 'Date: Mon, 1 Jan 2024 11:00:00 +0000'
+msg c 'Message-ID: <c@x>' 'References: <a@x>' '  <b@x>' 'In-Reply-To: <b@x>' 'Date: Mon, 1 Jan 2024 12:00:00 +0000'
+msg d 'Message-ID: <d@x>' 'References: <a@x>' 'Date: Mon, 01 Jan 2024 05:30:00 -0500'
+msg e 'Message-ID: <e@x>' 'In-Reply-To: <gone@x>' 'Date: Wed, 3 Jan 2024 10:00:00 +0000'
+msg f 'Message-ID: <f@x>' 'In-Reply-To: <lost@x>' 'Date: Tue, 2 Jan 2024 10:00:00 +0000'
+msg g 'Message-ID: <g@x>' 'References: <lost@x>' 'Date: Tue, 2 Jan 2024 09:00:00 +0000'
+msg h 'Message-ID: <h@x>' 'References: <i@x>' 'Date: Thu, 4 Jan 2024 10:00:00 +0000'
+msg i 'Message-ID: <i@x>' 'References: <h@x>' 'Date: Thu, 4 Jan 2024 11:00:00 +0000'
+msg j 'Message-ID: <a@x>' 'Date: Fri, 5 Jan 2024 10:00:00 +0000'
+msg k 'Subject: no id' 'Date: Sat, 6 Jan 2024 10:00:00 +0000'
+msg l 'message-id:' ' <l@x>' 'Subject: =?UTF-8?Q?caf=C3=A9?=' 'Date: 6 Jan 2024 12:00 GMT'
+printf 'not a message\n' > "$T/md/tmp/partial"
+
+cat > "$T/expected" <<'EOF'
+0 <a@x> a
+1 <d@x> d
+1 <b@x> b
+2 <c@x> c
+0 <lost@x> -
+1 <g@x> g
+1 <f@x> f
+0 <e@x> e
+0 <i@x> i
+1 <h@x> h
+0 <a@x> j
+0 - k
+0 <l@x> l
+EOF
+check "threads of the crafted Maildir" cmp -s "$T/expected" <(threads "$T/md")
+check "the index is written in the directory" test -s "$T/md/.mailthread.idx"
+check "dates are in seconds since the epoch, zones applied" \
+    bash -c '[[ $("$1" -t "$2" | awk -F"\t" "\$3 == \"<d@x>\" { print \$2 }") == 1704105000 ]]' _ "$MT" "$T/md"
+check "a missing parent has only its ID" \
+    bash -c '"$1" -t "$2" | grep -q "^0	-	<lost@x>	-	-\$"' _ "$MT" "$T/md"
+check "the subject is printed unfolded as written" \
+    bash -c '"$1" -t "$2" | grep -q "	=?UTF-8?Q?caf=C3=A9?=\$"' _ "$MT" "$T/md"
+check "-m prints the whole thread" \
+    cmp -s <(sed -n 1,4p "$T/expected") \
+           <("$MT" -n -f "$T/md/.mailthread.idx" -m '<c@x>' | awk -F'\t' '{ n = split($4, p, "/"); print $1, $3, p[n] }')
+check "-m an unknown ID exits 1" \
+    bash -c '"$1" -n -f "$2" -m "<none@x>" 2>/dev/null; (($? == 1))' _ "$MT" "$T/md/.mailthread.idx"
+
+# Updates: only new and changed files are read, renames are followed
+stats() {
+    "$MT" --stats "$T/md" 2>&1 >/dev/null
+}
+check "an unchanged Maildir reads nothing" bash -c '[[ $1 == *"12 messages (0 read, 0 renamed)"* ]]' _ "$(stats)"
+msg m 'Message-ID: <m@x>' 'In-Reply-To: <e@x>' 'Date: Wed, 3 Jan 2024 12:00:00 +0000'
+check "a new message is the only one read" bash -c '[[ $1 == *"13 messages (1 read, 0 renamed)"* ]]' _ "$(stats)"
+check "and joins its thread" bash -c '"$1" -n -f "$2" -m "<e@x>" | grep -q "^1	.*	<m@x>	"' _ "$MT" "$T/md/.mailthread.idx"
+mv "$T/md/cur/b" "$T/md/cur/b:2,S"
+check "a maildir flag change reads nothing" bash -c '[[ $1 == *"13 messages (0 read, 1 renamed)"* ]]' _ "$(stats)"
+check "and keeps the message in place" \
+    bash -c '"$1" -n -f "$2" -m "<a@x>" | grep -q "^1	.*	<b@x>	.*/b:2,S	"' _ "$MT" "$T/md/.mailthread.idx"
+rm "$T/md/cur/g"
+check "a deleted message leaves the index" bash -c '[[ $1 == *"12 messages (0 read, 0 renamed)"* ]]' _ "$(stats)"
+check "and its lone sibling starts the thread" \
+    bash -c '[[ $("$1" -n -f "$2" -m "<f@x>" | cut -f1,3) == "0	<f@x>" ]]' _ "$MT" "$T/md/.mailthread.idx"
+msg h 'Message-ID: <h@x>' 'In-Reply-To: <d@x>' 'Date: Thu, 4 Jan 2024 10:00:00 +0000' 'Subject: moved'
+touch -d '2024-01-04 10:00' "$T/md/cur/h"
+check "a changed message is read again" bash -c '[[ $1 == *"(1 read, 0 renamed)"* ]]' _ "$(stats)"
+check "and moves to its new thread" \
+    bash -c '"$1" -n -f "$2" -m "<a@x>" | grep -q "^2	.*	<h@x>	"' _ "$MT" "$T/md/.mailthread.idx"
+
+# The corpus: one line per file, the same threads with four workers
+"$MT" -f "$T/corpus.idx" -t "$TEST_DATA" > "$T/one"
+check "corpus: every file once" \
+    cmp -s <(find "$TEST_DATA" -type f ! -name '.*' | sort) <(cut -f4 "$T/one" | grep -v '^-$' | sort)
+check "corpus: -j 4 builds the same threads" \
+    cmp -s "$T/one" <("$MT" -j 4 -f "$T/corpus4.idx" -t "$TEST_DATA")
+check "corpus: the index answers -n the same" cmp -s "$T/one" <("$MT" -n -f "$T/corpus4.idx" -t)
+
+# Exit status
+check "-n without an index exits 1" bash -c '"$1" -n -f "$2/none.idx" -t 2>/dev/null; (($? == 1))' _ "$MT" "$T"
+head -c 100 "$T/corpus.idx" > "$T/short.idx"
+check "a truncated index is refused" bash -c '"$1" -n -f "$2/short.idx" -t 2>/dev/null; (($? == 1))' _ "$MT" "$T"
+check "a truncated index is rebuilt by an update" \
+    bash -c '"$1" -f "$2/short.idx" "$3" 2>/dev/null && "$1" -n -f "$2/short.idx" -m "<a@x>" >/dev/null' _ "$MT" "$T" "$T/md"
+check "a FILE argument needs -f" bash -c '"$1" "$2/md/cur/a" 2>/dev/null; (($? == 2))' _ "$MT" "$T"
+check "a missing DIR exits 1" bash -c '"$1" -q -f "$2/x.idx" /nonexistent; (($? == 1))' _ "$MT" "$T"
+check "-t with -m exits 2" bash -c '"$1" -t -m "<a@x>" "$2" 2>/dev/null; (($? == 2))' _ "$MT" "$T/md"
+check "invalid -j exits 2" bash -c '"$1" -j x "$2" 2>/dev/null; (($? == 2))' _ "$MT" "$T/md"
+check "-x '' indexes tmp too" \
+    bash -c '"$1" -x "" -f "$2/all.idx" --stats "$2/md" 2>&1 | grep -q "^.*: 13 messages"' _ "$MT" "$T"
+
+# Summary
+summary
@@ -58,6 +58,26 @@ echo "════════════════════════
 run_test "test_simple.sh"
 run_test "test_builtin_vs_standalone.sh"
 run_test "test_env_vars.sh"
+run_test "test_matcher.sh"
+run_test "test_mailheaderclean_multi.sh"
+run_test "test_builtin_cache.sh"
+run_test "test_input_modes.sh"
+run_test "test_scan_kernels.sh"
+run_test "test_mbox.sh"
+run_test "test_streaming.sh"
+run_test "test_index.sh"
+run_test "test_fields.sh"
+run_test "test_capture.sh"
+run_test "test_mime.sh"
+run_test "test_extract.sh"
+run_test "test_stats.sh"
+run_test "test_journal.sh"
+run_test "test_watch.sh"
+run_test "test_serve.sh"
+run_test "test_coproc.sh"
+run_test "test_mailgrep.sh"
+run_test "test_mailthread.sh"
+run_test "test_bench.sh"
 
 # Phase 3: Comprehensive Tests (slow but thorough)
 echo
@@ -0,0 +1,124 @@
+#!/usr/bin/env bash
+#
+# test_matcher.sh - Differential test of the compiled header-name matcher
+#
+# Runs mailheaderclean with the compiled trie matcher and with the fnmatch()
+# reference implementation (MAILHEADERCLEAN_MATCHER=fnmatch) and requires
+# byte-identical output for every test email and pattern set.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+TEST_DATA="${SCRIPT_DIR}/test-data"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+test_pass() {
+    ((PASSED_TESTS++)) || true
+    echo -e "${GREEN}✓${NC} $1"
+}
+
+test_fail() {
+    ((FAILED_TESTS++)) || true
+    echo -e "${RED}✗${NC} $1"
+}
+
+if [[ ! -f "${BUILD_BIN}/mailheaderclean" ]]; then
+    echo -e "${RED}Error: ${BUILD_BIN}/mailheaderclean not found. Run 'make' first.${NC}"
+    exit 1
+fi
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+# Synthetic email exercising every pattern form and edge case
+cat > "${TEMP_DIR}/edge.eml" <<'EOF'
+From: sender@example.com
+To: recipient@example.com
+Subject: Matcher edge cases
+x-ms-exchange-lowercase: value
+X-MS-: empty tail
+X-Custom-Status: active
+X--Status: shortest infix
+X-Status: too short for X-*-Status
+Status: exact
+STATUS-Status: both
+List-: prefix only
+Authentication-Results-Original: prefix without dash
+Received-SPF: pass
+X-Spam: no dash
+X-Spam-Flag: YES
+Reply-To: reply@example.com
+Thread-Index-Extra: not exact
+A: single
+: empty name
+X-Google-DKIM-Signature: v=1
+Content-Type: text/plain
+
+Body line.
+EOF
+
+# Pattern sets: default list, each pattern form, fallbacks and PRESERVE/EXTRA
+declare -a CASES=(
+    "default||"
+    "prefix|MAILHEADERCLEAN=X-*,List-*|"
+    "suffix|MAILHEADERCLEAN=*-Status,*ID|"
+    "infix|MAILHEADERCLEAN=X-*-Status,A*A,Received*SPF|"
+    "exact|MAILHEADERCLEAN=Status,A,Reply-To,Subject|"
+    "fallback|MAILHEADERCLEAN=X-?S-*,[Rr]eply-To,*-*-*,\\Status,X-Sp[a-z]m*|"
+    "everything|MAILHEADERCLEAN=*|"
+    "extra|MAILHEADERCLEAN_EXTRA=X-*-Status,*-Id,Subj?ct,[Rr]eply-To|"
+    "preserve|MAILHEADERCLEAN_PRESERVE=X-Spam-*,List-*,Received-SPF|"
+)
+
+echo "Differential test: compiled matcher vs fnmatch reference"
+echo "========================================================"
+echo
+
+declare -a FILES=("${TEMP_DIR}/edge.eml" "${TEST_DATA}"/*)
+
+for entry in "${CASES[@]}"; do
+    IFS='|' read -r name assign _ <<<"$entry"
+    ((TOTAL_TESTS++)) || true
+    mismatches=0
+    declare -a env_args=()
+    [[ -n "$assign" ]] && env_args=("$assign")
+
+    for file in "${FILES[@]}"; do
+        env "${env_args[@]}" "${BUILD_BIN}/mailheaderclean" "$file" > "${TEMP_DIR}/trie.out"
+        env "${env_args[@]}" MAILHEADERCLEAN_MATCHER=fnmatch "${BUILD_BIN}/mailheaderclean" "$file" > "${TEMP_DIR}/ref.out"
+        if ! cmp -s "${TEMP_DIR}/trie.out" "${TEMP_DIR}/ref.out"; then
+            ((mismatches++)) || true
+            if ((mismatches == 1)); then
+                echo "  First mismatch: $file"
+                diff "${TEMP_DIR}/ref.out" "${TEMP_DIR}/trie.out" | head -10 || true
+            fi
+        fi
+    done
+
+    if ((mismatches == 0)); then
+        test_pass "$name: ${#FILES[@]} files identical"
+    else
+        test_fail "$name: $mismatches/${#FILES[@]} files differ"
+    fi
+done
+
+# Summary
+echo
+echo "========================================================"
+echo "Total tests: $TOTAL_TESTS"
+echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+if ((FAILED_TESTS > 0)); then
+    echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+    exit 1
+fi
+echo "Failed: 0"
+exit 0
@@ -0,0 +1,144 @@
+#!/usr/bin/env bash
+#
+# test_mbox.sh - --mbox and stdin streaming in the three utilities
+#
+# Builds an mbox from the test corpus and checks that each tool's --mbox
+# output equals its per-file output joined the way --mbox documents it,
+# read from a file and from a pipe. Also covers From_ splitting rules,
+# lines longer than the stream buffer and "-" as stdin in file mode.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+TEST_DATA="${SCRIPT_DIR}/test-data"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+# expect NAME EXPECTED_FILE COMMAND...
+expect() {
+    local name="$1" expected="$2"
+    shift 2
+    ((TOTAL_TESTS++)) || true
+    if cmp -s "$expected" <("$@"); then
+        ((PASSED_TESTS++)) || true
+        echo -e "${GREEN}✓${NC} $name"
+    else
+        ((FAILED_TESTS++)) || true
+        echo -e "${RED}✗${NC} $name"
+        diff <(od -c "$expected") <("$@" | od -c) | head -10 || true
+    fi
+}
+
+for tool in mailheader mailmessage mailheaderclean; do
+    if [[ ! -x "${BUILD_BIN}/$tool" ]]; then
+        echo -e "${RED}Error: ${BUILD_BIN}/$tool not found. Run 'make' first.${NC}"
+        exit 1
+    fi
+done
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+echo "Testing --mbox and stdin streaming"
+echo "=================================="
+echo
+
+# Corpus messages that survive an mbox round trip unchanged: a header/body
+# separator, a final newline and no body line starting with "From "
+FROM_LINE='From sender@example.com Mon Jan  1 00:00:00 2024'
+: > "$T/all.mbox"
+: > "$T/all.header"
+: > "$T/all.body"
+: > "$T/all.clean"
+count=0
+for f in "$TEST_DATA"/*; do
+    [[ -f "$f" && -s "$f" ]] || continue
+    [[ $(tail -c 1 "$f" | od -An -c | tr -d ' ') == '\n' ]] || continue
+    grep -q '^From ' "$f" && continue
+    grep -qE $'^\r?$' "$f" || continue
+
+    { echo "$FROM_LINE"; cat "$f"; echo; } >> "$T/all.mbox"
+    ((count > 0)) && echo >> "$T/all.header"
+    "${BUILD_BIN}/mailheader" "$f" >> "$T/all.header"
+    { "${BUILD_BIN}/mailmessage" "$f"; echo; } >> "$T/all.body"
+    { echo "$FROM_LINE"; "${BUILD_BIN}/mailheaderclean" "$f"; echo; } >> "$T/all.clean"
+    ((count++)) || true
+done
+echo "Corpus mbox: $count messages"
+echo
+
+expect "mailheader --mbox FILE" "$T/all.header" "${BUILD_BIN}/mailheader" --mbox "$T/all.mbox"
+expect "mailmessage --mbox FILE" "$T/all.body" "${BUILD_BIN}/mailmessage" --mbox "$T/all.mbox"
+expect "mailheaderclean --mbox FILE" "$T/all.clean" "${BUILD_BIN}/mailheaderclean" --mbox "$T/all.mbox"
+expect "mailheader -M (stdin)" "$T/all.header" \
+    bash -c '"$1" -M < <(cat "$2")' _ "${BUILD_BIN}/mailheader" "$T/all.mbox"
+expect "mailmessage -M - (stdin)" "$T/all.body" \
+    bash -c 'cat "$2" | "$1" -M -' _ "${BUILD_BIN}/mailmessage" "$T/all.mbox"
+expect "mailheaderclean -M (stdin)" "$T/all.clean" \
+    bash -c 'cat "$2" | "$1" -M' _ "${BUILD_BIN}/mailheaderclean" "$T/all.mbox"
+
+# "From " only starts a message after a blank line
+printf 'From a\nSubject: one\n\nbody\nFrom here on\n\nFrom b\nSubject: two\n\nsecond\n' > "$T/split.mbox"
+printf 'Subject: one\n\nSubject: two\n' > "$T/split.header"
+printf 'body\nFrom here on\n\nsecond\n' > "$T/split.body"
+expect "From_ inside a paragraph stays in the body (headers)" "$T/split.header" "${BUILD_BIN}/mailheader" --mbox "$T/split.mbox"
+expect "From_ inside a paragraph stays in the body (bodies)" "$T/split.body" "${BUILD_BIN}/mailmessage" --mbox "$T/split.mbox"
+
+# A single message without a From_ line is one message (MDA pipe)
+printf 'Subject: x\r\nX-Spam-Flag: YES\r\n\r\nbody\r\n' > "$T/one.eml"
+for tool in mailheader mailmessage mailheaderclean; do
+    "${BUILD_BIN}/$tool" "$T/one.eml" > "$T/one.$tool"
+    expect "$tool: piped message without From_ matches file mode" "$T/one.$tool" \
+        bash -c 'cat "$2" | "$1" --mbox' _ "${BUILD_BIN}/$tool" "$T/one.eml"
+    expect "$tool: - reads stdin" "$T/one.$tool" \
+        bash -c '"$1" - < "$2"' _ "${BUILD_BIN}/$tool" "$T/one.eml"
+done
+
+# Lines longer than the 256 KB stream buffer, in headers and body
+{
+    printf 'From x\nSubject: '; head -c 700000 /dev/zero | tr '\0' 's'; printf '\r\n'
+    printf '\tcont\r\nX-Spam-Flag: '; head -c 600000 /dev/zero | tr '\0' 'x'; printf '\n'
+    printf 'To: a@b\n\n'; head -c 900000 /dev/zero | tr '\0' 'b'; printf '\tend\r\n'
+} > "$T/long.mbox"
+tail -n +2 "$T/long.mbox" > "$T/long.eml"
+for tool in mailheader mailmessage; do
+    "${BUILD_BIN}/$tool" "$T/long.eml" > "$T/long.$tool"
+    expect "$tool: lines longer than the stream buffer" "$T/long.$tool" \
+        "${BUILD_BIN}/$tool" --mbox "$T/long.mbox"
+done
+{ echo "From x"; "${BUILD_BIN}/mailheaderclean" "$T/long.eml"; } > "$T/long.mailheaderclean"
+expect "mailheaderclean: lines longer than the stream buffer" "$T/long.mailheaderclean" \
+    "${BUILD_BIN}/mailheaderclean" --mbox "$T/long.mbox"
+
+# Usage errors
+((TOTAL_TESTS++)) || true
+rc=0
+"${BUILD_BIN}/mailheaderclean" --mbox -i "$T/all.mbox" > /dev/null 2>&1 || rc=$?
+if ((rc == 2)); then
+    ((PASSED_TESTS++)) || true
+    echo -e "${GREEN}✓${NC} mailheaderclean: --mbox with -i is a usage error"
+else
+    ((FAILED_TESTS++)) || true
+    echo -e "${RED}✗${NC} mailheaderclean: --mbox with -i is a usage error (rc=$rc)"
+fi
+
+# Summary
+echo
+echo "=================================="
+echo "Total tests: $TOTAL_TESTS"
+echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+if ((FAILED_TESTS > 0)); then
+    echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+    exit 1
+fi
+echo "Failed: 0"
+exit 0
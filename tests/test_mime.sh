@@ -0,0 +1,143 @@
+#!/usr/bin/env bash
+#
+# test_mime.sh - mailmessage --text, --part N and --list-parts
+#
+# Builds MIME messages with nested multiparts, quoted-printable and base64
+# text, a binary attachment and CRLF line endings, and checks the listed
+# parts, the extracted text and that a decoded attachment is the original
+# file. Then checks that a pipe and a 4K memory ceiling (chunked reads) give
+# the same bytes as a mapped file, over the crafted messages and the corpus,
+# and the builtin against the binary.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailmessage
+MM="${BUILD_BIN}/mailmessage"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+start_tests "Testing MIME part extraction"
+
+# multipart/mixed: an alternative (QP text, HTML), a base64 binary
+# attachment, a base64 text part, a text attachment
+head -c 300000 /dev/urandom > "$T/report.pdf"
+{
+    printf 'From: a@example.com\nSubject: report\nMIME-Version: 1.0\n'
+    printf 'Content-Type: multipart/mixed;\n boundary="=_outer"\n\n'
+    printf 'This is a multi-part message in MIME format.\n'
+    printf -- '--=_outer\nContent-Type: multipart/alternative; boundary=inner\n\n'
+    printf -- '--inner\nContent-Type: text/plain; charset="utf-8"\n'
+    printf 'Content-Transfer-Encoding: quoted-printable\n\n'
+    printf 'Caf=C3=A9 soft=\nbreak\ttab, x=3D1, bad=ZZ\n--innerX is no delimiter\n'
+    printf -- '--inner\nContent-Type: text/html\n\n<p>Caf&eacute;</p>\n'
+    printf -- '--inner--\n\n'
+    printf -- '--=_outer\nContent-Type: application/pdf; name="ignored.pdf"\n'
+    printf 'Content-Disposition: attachment;\n\tfilename="report.pdf"\n'
+    printf 'Content-Transfer-Encoding: BASE64\n\n'
+    base64 -w 76 "$T/report.pdf"
+    printf -- '--=_outer\nContent-Type: text/plain\nContent-Transfer-Encoding: base64\n\n'
+    printf 'second\r\ntext\r\n' | base64
+    printf -- '--=_outer\nContent-Type: text/plain\nContent-Disposition: attachment; filename=notes.txt\n\n'
+    printf 'not in --text\n'
+    printf -- '--=_outer--\nepilogue\n'
+} > "$T/mixed.eml"
+PDF_SIZE=$(( $(base64 -w 76 "$T/report.pdf" | wc -c) - 1 ))
+
+printf '1\ttext/plain\tquoted-printable\t65\t\n2\ttext/html\t7bit\t18\t\n3\tapplication/pdf\tbase64\t%s\treport.pdf\n4\ttext/plain\tbase64\t20\t\n5\ttext/plain\t7bit\t13\tnotes.txt\n' \
+    "$PDF_SIZE" > "$T/mixed.parts"
+printf 'Caf\303\251 softbreak tab, x=1, bad=ZZ\n--innerX is no delimiter\nsecond\ntext\n' > "$T/mixed.text"
+
+check "--list-parts: number, type, encoding, size, file name" \
+    cmp -s "$T/mixed.parts" <("$MM" --list-parts "$T/mixed.eml")
+check "--text: decoded text parts, first alternative, no attachments" \
+    cmp -s "$T/mixed.text" <("$MM" --text "$T/mixed.eml")
+check "--part 3: the attachment decodes to the original file" \
+    cmp -s "$T/report.pdf" <("$MM" --part 3 "$T/mixed.eml")
+check "--part 2: an unencoded part byte for byte" \
+    cmp -s <(printf '<p>Caf&eacute;</p>') <("$MM" --part 2 "$T/mixed.eml")
+check "--part 4: base64 text keeps its CRs" \
+    cmp -s <(printf 'second\r\ntext\r\n') <("$MM" --part 4 "$T/mixed.eml")
+
+# The same message with CRLF line endings
+sed 's/$/\r/' "$T/mixed.eml" > "$T/crlf.eml"
+check "CRLF: same text" cmp -s "$T/mixed.text" <("$MM" --text "$T/crlf.eml")
+check "CRLF: same attachment" cmp -s "$T/report.pdf" <("$MM" --part 3 "$T/crlf.eml")
+check "CRLF: QP soft line break across CRLF" bash -c '"$1" --part 1 "$2" | grep -q "softbreak"' _ "$MM" "$T/crlf.eml"
+
+# Not multipart: the body is part 1
+printf 'Subject: plain\nContent-Transfer-Encoding: quoted-printable\n\nH=C3=A9\tllo=\n!\n' > "$T/single.eml"
+check "single part: listed as part 1" \
+    cmp -s <(printf '1\ttext/plain\tquoted-printable\t15\t\n') <("$MM" --list-parts "$T/single.eml")
+check "single part: decoded and folded" \
+    cmp -s <(printf 'H\303\251 llo!\n') <("$MM" --text "$T/single.eml")
+printf 'Subject: none\n\nplain body\n' > "$T/none.eml"
+check "no Content-Type: text/plain, body as mailmessage prints it" \
+    cmp -s <("$MM" "$T/none.eml") <("$MM" --text "$T/none.eml")
+
+# A delimiter right after the part headers, an empty part, no closing one
+printf 'Content-Type: multipart/mixed; boundary=b\n\n--b\n\n--b\nContent-Type: text/plain\n\nlast\n' > "$T/open.eml"
+check "empty part and missing close delimiter" \
+    cmp -s <(printf '1\ttext/plain\t7bit\t0\t\n2\ttext/plain\t7bit\t5\t\n') <("$MM" --list-parts "$T/open.eml")
+
+# Pipes and a 4K ceiling read in chunks; the output must not change
+for f in mixed crlf single open; do
+    for mode in --text --list-parts "--part 1"; do
+        # shellcheck disable=SC2086
+        "$MM" $mode "$T/$f.eml" > "$T/$f.mapped" 2>/dev/null || true
+        # shellcheck disable=SC2086
+        check "$f $mode: pipe equals file" \
+            cmp -s "$T/$f.mapped" <(cat "$T/$f.eml" | "$MM" $mode - 2>/dev/null)
+        # shellcheck disable=SC2086
+        check "$f $mode: 4K ceiling equals mapped" \
+            cmp -s "$T/$f.mapped" <(MAIL_TOOLS_MEMORY=4K "$MM" $mode "$T/$f.eml" 2>/dev/null)
+    done
+done
+check "attachment from a pipe under a 4K ceiling" \
+    cmp -s "$T/report.pdf" <(cat "$T/crlf.eml" | MAIL_TOOLS_MEMORY=4K "$MM" --part 3 -)
+
+FILES=("$TEST_DATA"/*)
+for mode in --text --list-parts; do
+    for f in "${FILES[@]}"; do "$MM" "$mode" "$f"; done > "$T/corpus.mapped"
+    for f in "${FILES[@]}"; do MAIL_TOOLS_MEMORY=4K "$MM" "$mode" "$f"; done > "$T/corpus.streamed"
+    check "corpus $mode: 4K ceiling equals mapped" cmp -s "$T/corpus.mapped" "$T/corpus.streamed"
+done
+
+# Errors
+check "--part past the last part fails" bash -c '! "$1" --part 6 "$2" 2>/dev/null' _ "$MM" "$T/mixed.eml"
+check "--part 0 is a usage error" bash -c '"$1" --part 0 "$2" 2>/dev/null; (($? == 2))' _ "$MM" "$T/mixed.eml"
+check "missing FILE fails" bash -c '! "$1" --text /nonexistent 2>/dev/null' _ "$MM"
+
+# The builtin
+if [[ -f "${BUILD_LIB}/mailmessage.so" ]]; then
+    # with_builtin SCRIPT ARGS... - run SCRIPT with the builtin enabled; $1
+    # is the binary, ARGS follow from $2
+    with_builtin() {
+        local script="$1"
+        shift
+        bash -c 'enable -f "$0/mailmessage.so" mailmessage || exit 1
+                 '"$script" "$BUILD_LIB" "$MM" "$@"
+    }
+
+    check "builtin --list-parts equals the binary" with_builtin '
+        mailmessage --list-parts "$2" | cmp -s - <("$1" --list-parts "$2")' "$T/mixed.eml"
+    check "builtin --text -v equals the binary over the corpus" with_builtin '
+        for f in "${@:2}"; do
+            mailmessage -v t --text "$f" || exit 1
+            cmp -s <(printf %s "$t") <("$1" --text "$f" | tr -d "\0") || exit 1
+        done' "${FILES[@]}"
+    check "builtin --part over several FILEs" with_builtin '
+        mailmessage --part 1 "$2" "$3" | cmp -s - <("$1" --part 1 "$2"; "$1" --part 1 "$3")' \
+        "$T/mixed.eml" "$T/single.eml"
+    check "builtin --text with --mbox is a usage error" with_builtin '
+        mailmessage --text --mbox "$2" 2>/dev/null; (($? == 2))' "$T/mixed.eml"
+else
+    echo -e "${YELLOW}⊘${NC} builtin checks skipped (build/lib/mailmessage.so not built)"
+fi
+
+# Summary
+summary
@@ -0,0 +1,117 @@
+#!/usr/bin/env bash
+#
+# test_scan_kernels.sh - Differential test of the CR/TAB scanning kernels
+#
+# Runs mailheader, mailmessage and mailheaderclean with every scanning
+# kernel forced through MAIL_TOOLS_SCAN (avx2, sse2, swar) and requires
+# output byte-identical to the scalar reference, over the test corpus and
+# a synthetic message with CR and TAB at every offset of a 64-byte block.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BUILD_BIN="${SCRIPT_DIR}/../build/bin"
+TEST_DATA="${SCRIPT_DIR}/test-data"
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+test_pass() {
+    ((PASSED_TESTS++)) || true
+    echo -e "${GREEN}✓${NC} $1"
+}
+
+test_fail() {
+    ((FAILED_TESTS++)) || true
+    echo -e "${RED}✗${NC} $1"
+}
+
+for tool in mailheader mailmessage mailheaderclean; do
+    if [[ ! -x "${BUILD_BIN}/$tool" ]]; then
+        echo -e "${RED}Error: ${BUILD_BIN}/$tool not found. Run 'make' first.${NC}"
+        exit 1
+    fi
+done
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+# Lines of every length from 0 to 130, each with a TAB and/or CR moved
+# through all positions, in both header and body, plus runs of CRs
+awk 'BEGIN {
+    hdr = "X-Test"
+    for (len = 0; len <= 130; len++) {
+        line = ""
+        for (i = 0; i < len; i++) line = line sprintf("%c", 97 + i % 26)
+        pos = len % 67
+        printf "%s-%d: %s\t%s\r\n", hdr, len, substr(line, 1, pos), substr(line, pos + 1)
+        printf "\t%s\r\r\n", line
+    }
+    printf "\r\n"
+    for (len = 0; len <= 130; len++) {
+        line = ""
+        for (i = 0; i < len; i++) line = line sprintf("%c", 65 + i % 26)
+        pos = (len * 7) % (len + 1)
+        printf "%s\t%s\r\n", substr(line, 1, pos), substr(line, pos + 1)
+        if (len % 5 == 0) printf "\r\r\r\t\t\t%s\r\n", line
+        if (len % 3 == 0) printf "%s\n", line
+    }
+}' > "${TEMP_DIR}/offsets.eml"
+
+echo "Differential test: scanning kernels vs scalar reference"
+echo "======================================================="
+echo
+
+declare -a FILES=("${TEMP_DIR}/offsets.eml" "${TEST_DATA}"/*)
+
+for tool in mailheader mailmessage mailheaderclean; do
+    for file in "${FILES[@]}"; do
+        MAIL_TOOLS_SCAN=scalar "${BUILD_BIN}/$tool" "$file" > "${TEMP_DIR}/${file##*/}.$tool" || true
+    done
+done
+
+for kernel in avx2 sse2 swar; do
+    for tool in mailheader mailmessage mailheaderclean; do
+        ((TOTAL_TESTS++)) || true
+        mismatches=0
+        for file in "${FILES[@]}"; do
+            if ! cmp -s "${TEMP_DIR}/${file##*/}.$tool" \
+                 <(MAIL_TOOLS_SCAN=$kernel "${BUILD_BIN}/$tool" "$file" || true); then
+                ((mismatches++)) || true
+                ((mismatches == 1)) && echo "  First mismatch: $file"
+            fi
+        done
+        if ((mismatches == 0)); then
+            test_pass "$kernel: $tool, ${#FILES[@]} files identical"
+        else
+            test_fail "$kernel: $tool, $mismatches/${#FILES[@]} files differ"
+        fi
+    done
+done
+
+# The synthetic message really does exercise folding
+((TOTAL_TESTS++)) || true
+if ! grep -q $'[\r\t]' <("${BUILD_BIN}/mailmessage" "${TEMP_DIR}/offsets.eml") && \
+   [[ $("${BUILD_BIN}/mailmessage" "${TEMP_DIR}/offsets.eml" | wc -l) -gt 200 ]]; then
+    test_pass "CR removed and TAB folded in the synthetic body"
+else
+    test_fail "CR removed and TAB folded in the synthetic body"
+fi
+
+# Summary
+echo
+echo "======================================================="
+echo "Total tests: $TOTAL_TESTS"
+echo -e "Passed: ${GREEN}$PASSED_TESTS${NC}"
+if ((FAILED_TESTS > 0)); then
+    echo -e "Failed: ${RED}$FAILED_TESTS${NC}"
+    exit 1
+fi
+echo "Failed: 0"
+exit 0
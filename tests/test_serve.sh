@@ -0,0 +1,122 @@
+#!/usr/bin/env bash
+#
+# test_serve.sh - mailheaderclean --serve and mailheaderclean-client
+#
+# Starts a server on a scratch socket and checks that the client's output
+# matches the standalone filter (one file, the corpus over one connection,
+# stdin), that an idle connection does not hold up others, that a header
+# block larger than the output buffer is still answered, that the client
+# fails with 75 or passes through when no server is running, and that
+# SIGTERM ends the server and removes its socket.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheaderclean mailheaderclean-client
+MHC="${BUILD_BIN}/mailheaderclean"
+CLIENT="${BUILD_BIN}/mailheaderclean-client"
+
+TEMP_DIR=$(mktemp -d)
+SERVER=''
+IDLE=''
+trap '[[ -n $IDLE ]] && kill "$IDLE" 2>/dev/null
+      [[ -n $SERVER ]] && kill "$SERVER" 2>/dev/null
+      rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+S="$T/clean.sock"
+
+# stat_value FILE KEY - value of a "KEY<TAB>value" line
+stat_value() {
+    awk -F'\t' -v k="$2" '$1 == k { print $2 }' "$1"
+}
+
+# wait_socket PATH - wait up to 5s for a socket to appear
+wait_socket() {
+    local -i i
+    for ((i = 0; i < 50; i++)); do
+        [[ -S $1 ]] && return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+start_tests "Testing mailheaderclean --serve"
+
+"$MHC" --serve "$S" --stats -j 1 2> "$T/serve.stats" &
+SERVER=$!
+check "server creates its socket" wait_socket "$S"
+
+FILES=("$TEST_DATA"/*)
+FIRST=${FILES[0]##*/}
+check "one file matches the standalone filter" cmp -s \
+    <("$CLIENT" -S "$S" "$TEST_DATA/$FIRST") <("$MHC" "$TEST_DATA/$FIRST")
+check "whole corpus over one connection" cmp -s \
+    <("$CLIENT" -S "$S" "$TEST_DATA"/*) <("$MHC" "$TEST_DATA"/*)
+check "stdin and \$MAILHEADERCLEAN_SOCKET" cmp -s \
+    <(MAILHEADERCLEAN_SOCKET="$S" "$CLIENT" < "$TEST_DATA/$FIRST") <("$MHC" "$TEST_DATA/$FIRST")
+
+# An open connection that sends nothing must not block other clients,
+# even with a single thread: this client keeps its connection after the
+# first FILE and then blocks opening a FIFO nobody writes to
+mkfifo "$T/fifo"
+"$CLIENT" -S "$S" "$TEST_DATA/$FIRST" "$T/fifo" > /dev/null 2>&1 &
+IDLE=$!
+sleep 0.2
+check "idle connection does not block -j 1" bash -c \
+    'timeout 5 "$1" -S "$2" "$3" > /dev/null' _ "$CLIENT" "$S" "$TEST_DATA/$FIRST"
+kill "$IDLE" 2>/dev/null || true
+IDLE=''
+
+# A cleaned header block larger than the output buffer
+{
+    printf 'From: a@example.com\nX-Spam-Score: 5\n'
+    for ((i = 0; i < 5000; i++)); do
+        printf 'X-Long-%d: %0100d\n' "$i" 0
+    done
+    printf 'Subject: big\n\nbody\n'
+} > "$T/big.eml"
+check "oversized header block answered" cmp -s \
+    <("$CLIENT" -S "$S" "$T/big.eml") <("$MHC" "$T/big.eml")
+# More kept long lines than the writer has iovecs, in a small buffer
+{
+    printf 'From: a@example.com\n'
+    for ((i = 0; i < 1100; i++)); do
+        printf 'X-Spam-Score: %d\nX-Keep-%d: %05000d\n' "$i" "$i" 0
+    done
+    printf 'Subject: many\n\nbody\n'
+} > "$T/many.eml"
+check "header block with more ranges than iovecs answered" cmp -s \
+    <("$CLIENT" -S "$S" "$T/many.eml") <("$MHC" "$T/many.eml")
+check "server still answers afterwards" cmp -s \
+    <("$CLIENT" -S "$S" "$TEST_DATA/$FIRST") <("$MHC" "$TEST_DATA/$FIRST")
+
+check "a second server on a live socket fails" bash -c \
+    '"$1" --serve "$2" 2> /dev/null; test $? -eq 1' _ "$MHC" "$S"
+
+kill -TERM "$SERVER"
+rc=0
+wait "$SERVER" || rc=$?
+SERVER=''
+check "SIGTERM ends the server with status 0" test "$rc" = 0
+check "socket removed on exit" test ! -e "$S"
+check "--stats counts the messages served" test \
+    "$(stat_value "$T/serve.stats" messages)" -ge "$(($(ls "$TEST_DATA" | wc -l) + 4))"
+
+# No server
+check "no server: exit 75" bash -c \
+    '"$1" -S "$2" "$3" > /dev/null 2>&1; test $? -eq 75' _ "$CLIENT" "$S" "$T/big.eml"
+check "no server, -p: message passed through" cmp -s \
+    <("$CLIENT" -p -S "$S" "$T/big.eml" 2> /dev/null) "$T/big.eml"
+
+# Errors
+check "--serve with a FILE is refused" bash -c \
+    '"$1" --serve "$2" "$3" 2> /dev/null; test $? -eq 2' _ "$MHC" "$S" "$T/big.eml"
+check "--serve with -i is refused" bash -c \
+    '"$1" -i --serve "$2" 2> /dev/null; test $? -eq 2' _ "$MHC" "$S"
+check "client: unreadable FILE gives 1" bash -c \
+    '"$1" -p -S "$2" "$2.none" 2> /dev/null; test $? -eq 1' _ "$CLIENT" "$S"
+
+# Summary
+summary
@@ -0,0 +1,91 @@
+#!/usr/bin/env bash
+#
+# test_stats.sh - Run statistics (mailheaderclean --stats, builtin -S ARRAY)
+#
+# Checks that the counters add up (kept + removed fields, pattern hits and
+# bytes against the bytes actually removed), that output is unchanged by
+# --stats, and that totals agree between one run, --jobs workers, --mbox
+# and a loop of builtin calls.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheaderclean
+MHC="${BUILD_BIN}/mailheaderclean"
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+# stat_value FILE KEY - value of a "KEY<TAB>value" line
+stat_value() {
+    awk -F'\t' -v k="$2" '$1 == k { print $2 }' "$1"
+}
+
+# Counters and per-pattern rows without the timings
+counters() {
+    grep -v '_us	' "$1"
+}
+
+start_tests "Testing mailheaderclean --stats"
+
+# A small LF-only message: removed bytes are exactly bytes_in - bytes_out
+printf 'Received: one\nReceived: two\n\tcontinued\nFrom: a\nX-Spam-Score: 1\n more\n more\nSubject: s\nX-MS-Has-Attach: yes\n\nbody\n' > "$T/one.eml"
+"$MHC" --stats "$T/one.eml" > "$T/one.out" 2> "$T/one.stats"
+check "output unchanged by --stats" cmp -s "$T/one.out" <("$MHC" "$T/one.eml")
+check "messages, kept and removed fields" test \
+    "$(stat_value "$T/one.stats" messages) $(stat_value "$T/one.stats" headers_kept) $(stat_value "$T/one.stats" headers_removed)" = "1 3 3"
+check "continuations dropped" test "$(stat_value "$T/one.stats" continuations_dropped)" = 3
+check "second Received counted apart" test \
+    "$(stat_value "$T/one.stats" received_removed) $(stat_value "$T/one.stats" received_removed_bytes)" = "1 25"
+check "pattern hits and bytes" grep -qxF $'pattern\tX-Spam-*\t1\t28' "$T/one.stats"
+check "removed bytes add up to bytes_in - bytes_out" test \
+    "$(awk -F'\t' '$1 == "pattern" { n += $4 } $1 == "received_removed_bytes" { n += $2 } END { print n }' "$T/one.stats")" \
+    = $(( $(wc -c < "$T/one.eml") - $(wc -c < "$T/one.out") ))
+check "bytes_in and bytes_out" test \
+    "$(stat_value "$T/one.stats" bytes_in) $(stat_value "$T/one.stats" bytes_out)" = "$(wc -c < "$T/one.eml") $(wc -c < "$T/one.out")"
+check "every removal pattern reported" test \
+    "$(grep -c '^pattern	' "$T/one.stats")" = "$("$MHC" -l | wc -l)"
+
+# Whole corpus: the counters must add up
+"$MHC" --stats "$TEST_DATA" > "$T/all.out" 2> "$T/all.stats"
+check "corpus: message count" test "$(stat_value "$T/all.stats" messages)" = "$(ls "$TEST_DATA" | wc -l)"
+check "corpus: hits add up to removed fields" test \
+    "$(awk -F'\t' '$1 == "pattern" { n += $3 } $1 == "received_removed" { n += $2 } END { print n }' "$T/all.stats")" \
+    = "$(stat_value "$T/all.stats" headers_removed)"
+check "corpus: bytes_out is the output size" test "$(stat_value "$T/all.stats" bytes_out)" = "$(wc -c < "$T/all.out")"
+
+# Totals are the same however the batch is run
+cp -r "$TEST_DATA" "$T/jobs"
+"$MHC" --stats -i -j 4 "$T/jobs" 2> "$T/jobs.stats"
+check "--jobs 4 totals match one process" cmp -s <(counters "$T/all.stats") <(counters "$T/jobs.stats")
+for f in "$TEST_DATA"/*; do
+    printf 'From test@example.com Mon Jan  1 00:00:00 2024\n'
+    cat "$f"
+    printf '\n'
+done > "$T/all.mbox"
+"$MHC" --stats --mbox "$T/all.mbox" > /dev/null 2> "$T/mbox.stats"
+check "--mbox field counts match per-file run" cmp -s \
+    <(counters "$T/all.stats" | grep -vE '^(bytes_in|bytes_out)	') \
+    <(counters "$T/mbox.stats" | grep -vE '^(bytes_in|bytes_out)	')
+
+# Builtin: -S ARRAY accumulates across calls
+if [[ -f "${BUILD_LIB}/mailheaderclean.so" ]]; then
+    check "builtin -S totals over a loop match --stats" bash -c '
+        enable -f "$1" mailheaderclean || exit 1
+        declare -A S=()
+        for f in "$2"/*; do mailheaderclean -S S "$f" > /dev/null || exit 1; done
+        for k in messages bytes_in bytes_out headers_kept headers_removed continuations_dropped \
+                 received_removed received_removed_bytes; do
+            [[ ${S[$k]} == "$(awk -F"\t" -v k=$k "\$1 == k { print \$2 }" "$3")" ]] || exit 1
+        done
+        [[ ${S[hits:X-MS-*]} == "$(awk -F"\t" "\$2 == \"X-MS-*\" { print \$3 }" "$3")" ]]' \
+        _ "${BUILD_LIB}/mailheaderclean.so" "$TEST_DATA" "$T/all.stats"
+else
+    echo -e "${YELLOW}⊘${NC} builtin checks skipped (build/lib/mailheaderclean.so not built)"
+fi
+
+# Summary
+summary
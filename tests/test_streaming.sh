@@ -0,0 +1,118 @@
+#!/usr/bin/env bash
+#
+# test_streaming.sh - bounded memory for huge lines and messages
+#
+# Runs the three utilities over 1 GB single-line messages (a header line
+# and a body line, from a sparse file and from a pipe) under an address
+# space limit far below the input size, so mapping or buffering the whole
+# input fails. Then checks field names longer than 255 bytes and than the
+# stream buffer, names longer than MAIL_TOOLS_MEMORY, and that a small
+# ceiling streams the corpus to the same bytes as the mapped path.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheader mailmessage mailheaderclean
+
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+
+GB=$((1024 * 1024 * 1024))
+LIMIT_KB=200000     # address space for one run, about a fifth of the input
+
+# limited BYTES COMMAND... - run COMMAND with a 16M ceiling under the address
+# space limit; pass if it succeeds and writes exactly BYTES bytes
+limited() {
+    local bytes="$1" out
+    shift
+    out=$( (ulimit -v "$LIMIT_KB"; MAIL_TOOLS_MEMORY=16M "$@" | wc -c) ) || return 1
+    [[ $out == "$bytes" ]]
+}
+
+# big_body - a message whose body is one 1 GB line, on stdout
+big_body() {
+    printf 'Subject: s\n\n'
+    head -c "$GB" /dev/zero
+    printf '\n'
+}
+
+start_tests "Testing bounded-memory streaming"
+
+# "Subject: " and 1 GB of NULs as one header line, then a short body.
+# Sparse: no disk space is used.
+printf 'Subject: ' > "$T/header.eml"
+truncate -s "$GB" "$T/header.eml"
+printf '\n\nbody\n' >> "$T/header.eml"
+SIZE=$((GB + 7))
+
+check "mailheader: 1 GB header line" limited $((GB + 1)) "$BUILD_BIN/mailheader" "$T/header.eml"
+check "mailmessage: body after a 1 GB header line" limited 5 "$BUILD_BIN/mailmessage" "$T/header.eml"
+check "mailheaderclean: 1 GB header line kept" limited "$SIZE" "$BUILD_BIN/mailheaderclean" "$T/header.eml"
+check "mailheaderclean: 1 GB header line removed" limited 6 \
+    env MAILHEADERCLEAN_EXTRA=Subject "$BUILD_BIN/mailheaderclean" "$T/header.eml"
+check "mailheader -H: 1 GB header line from a pipe" \
+    limited $((GB + 1)) bash -c 'cat "$1" | "$2" -H Subject -' _ "$T/header.eml" "$BUILD_BIN/mailheader"
+export GB
+export -f big_body
+check "mailmessage: 1 GB body line from a pipe" \
+    limited $((GB + 1)) bash -c 'big_body | "$1" -' _ "$BUILD_BIN/mailmessage"
+check "mailheaderclean: 1 GB body line from a pipe" \
+    limited $((GB + 13)) bash -c 'big_body | "$1" -' _ "$BUILD_BIN/mailheaderclean"
+
+# Field names of 300 bytes (longer than the old 255-byte limit) and of
+# 300 KB (longer than the 256 KB stream buffer), from a file and a pipe
+for n in 300 307200; do
+    name="X-Long-$(head -c "$n" /dev/zero | tr '\0' a)"
+    printf 'From: a@example.com\n%s: v\n continued\nSubject: s\n\nbody\n' "$name" > "$T/name$n.eml"
+    printf 'From: a@example.com\nSubject: s\n\nbody\n' > "$T/name$n.clean"
+    printf '%s: v continued\n' "$name" > "$T/name$n.field"
+    for input in file pipe; do
+        if [[ $input == file ]]; then
+            run() { "$@" "$T/name$n.eml"; }
+        else
+            run() { "$@" - < <(cat "$T/name$n.eml"); }
+        fi
+        check "$n-byte name removed ($input)" \
+            cmp -s "$T/name$n.clean" <(MAILHEADERCLEAN_EXTRA='X-Long-*' run "$BUILD_BIN/mailheaderclean")
+        check "$n-byte name selected ($input)" \
+            cmp -s "$T/name$n.field" <(run "$BUILD_BIN/mailheader" -H 'X-Long-*')
+    done
+done
+
+# A name longer than the ceiling cannot be classified: the line is kept
+# as it is, like any other line without a field name
+name="X-Long-$(head -c 102400 /dev/zero | tr '\0' a)"
+printf 'From: a@example.com\n%s: v\n\nbody\n' "$name" > "$T/huge-name.eml"
+check "name over the ceiling kept unchanged" cmp -s "$T/huge-name.eml" \
+    <(MAIL_TOOLS_MEMORY=64K MAILHEADERCLEAN_EXTRA='X-Long-*' "$BUILD_BIN/mailheaderclean" "$T/huge-name.eml")
+
+# A long line without a colon after a removed field is kept whole, and the
+# field after it starts its own line
+{
+    printf 'X-Mailer: foo\n'
+    head -c 10000 /dev/zero | tr '\0' a
+    printf '\nSubject: s\n\nbody\n'
+} > "$T/colonless.eml"
+check "long colonless line after a removed field" cmp -s \
+    <("$BUILD_BIN/mailheaderclean" "$T/colonless.eml") \
+    <(MAIL_TOOLS_MEMORY=4K "$BUILD_BIN/mailheaderclean" - < "$T/colonless.eml")
+check "and its lines are intact" bash -c \
+    '[[ $(MAIL_TOOLS_MEMORY=4K "$1" - < "$2" | head -2 | wc -L) == 10000 && \
+       $(MAIL_TOOLS_MEMORY=4K "$1" - < "$2" | sed -n 2p) == "Subject: s" ]]' _ "$BUILD_BIN/mailheaderclean" "$T/colonless.eml"
+
+# A 4K ceiling streams nearly every corpus file; the bytes must not change
+FILES=("$TEST_DATA"/*)
+for tool in mailheader mailmessage mailheaderclean; do
+    for f in "${FILES[@]}"; do "$BUILD_BIN/$tool" "$f"; done > "$T/mapped.$tool"
+    for f in "${FILES[@]}"; do MAIL_TOOLS_MEMORY=4K "$BUILD_BIN/$tool" "$f"; done > "$T/streamed.$tool"
+    check "$tool: corpus streamed with a 4K ceiling" cmp -s "$T/mapped.$tool" "$T/streamed.$tool"
+done
+
+check "invalid MAIL_TOOLS_MEMORY falls back to the default" cmp -s "$T/mapped.mailheaderclean" \
+    <(for f in "${FILES[@]}"; do MAIL_TOOLS_MEMORY=lots "$BUILD_BIN/mailheaderclean" "$f"; done)
+
+# Summary
+summary
@@ -61,11 +61,31 @@ test_exists "src/mailmessage_loadable.c" "file"
 test_exists "src/mailheaderclean.c" "file"
 test_exists "src/mailheaderclean_loadable.c" "file"
 test_exists "src/mailheaderclean_headers.h" "file"
+test_exists "src/mailheaderclean_matcher.h" "file"
+test_exists "src/mailheaderclean_stats.h" "file"
+test_exists "src/mailheaderclean_journal.h" "file"
+test_exists "src/mailheaderclean_serve.h" "file"
+test_exists "src/mailheaderclean_client.c" "file"
+test_exists "src/mailheaderclean_filter.h" "file"
+test_exists "src/mail_tools.c" "file"
+test_exists "src/mail_io.h" "file"
+test_exists "src/mail_scan.h" "file"
+test_exists "src/mail_mbox.h" "file"
+test_exists "src/mail_index.h" "file"
+test_exists "src/mail_select.h" "file"
+test_exists "src/mail_extract.h" "file"
+test_exists "src/mailgetaddresses.c" "file"
+test_exists "src/mailgetaddresses_loadable.c" "file"
+test_exists "src/mailgetheaders_loadable.c" "file"
+test_exists "src/mail_addr.h" "file"
+test_exists "src/mail_walk.h" "file"
+test_exists "src/mailgrep.c" "file"
+test_exists "src/mail_thread.h" "file"
+test_exists "src/mailthread.c" "file"
 echo
 
 echo "TEST 3: Check scripts in scripts/"
 echo "-------------------------------------------"
-test_exists "scripts/mailgetaddresses" "file"
 test_exists "scripts/mailgetheaders" "file"
 test_exists "scripts/mail-tools.sh" "file"
 echo
@@ -76,6 +96,9 @@ test_exists "man/mailheader.1" "file"
 test_exists "man/mailmessage.1" "file"
 test_exists "man/mailheaderclean.1" "file"
 test_exists "man/mailgetaddresses.1" "file"
+test_exists "man/mail-tools.1" "file"
+test_exists "man/mailgrep.1" "file"
+test_exists "man/mailthread.1" "file"
 echo
 
 echo "TEST 5: Check examples in examples/"
@@ -86,8 +109,8 @@ echo
 
 echo "TEST 6: Check tools in tools/"
 echo "-------------------------------------------"
-test_exists "tools/benchmark.sh" "file"
-test_exists "tools/benchmark_detailed.sh" "file"
+test_exists "tools/mail_bench.c" "file"
+test_exists "tools/mail_corpus.c" "file"
 echo
 
 echo "TEST 7: Check root-level files"
@@ -0,0 +1,103 @@
+#!/usr/bin/env bash
+#
+# test_watch.sh - mailheaderclean --watch (inotify Maildir daemon)
+#
+# Starts the watcher on a scratch Maildir, delivers messages the Maildir
+# way (write to tmp/, rename into new/) and checks that they are cleaned on
+# arrival, that tmp/ is left alone, that a reader moving a message to cur/
+# does not make it clean the message again, that a link() delivery and a
+# message moved to cur/ before its batch ran are cleaned, and that SIGTERM
+# ends it.
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${SCRIPT_DIR}/lib.sh"
+
+require_bin mailheaderclean
+MHC="${BUILD_BIN}/mailheaderclean"
+
+TEMP_DIR=$(mktemp -d)
+WATCHER=''
+trap '[[ -n $WATCHER ]] && kill "$WATCHER" 2>/dev/null; rm -rf "$TEMP_DIR"' EXIT
+T="$TEMP_DIR"
+M="$T/Maildir"
+
+# stat_value FILE KEY - value of a "KEY<TAB>value" line
+stat_value() {
+    awk -F'\t' -v k="$2" '$1 == k { print $2 }' "$1"
+}
+
+# message SUBJECT - a message with one header on the default removal list
+message() {
+    printf 'From: a@example.com\nX-MS-Has-Attach: yes\nSubject: %s\n\nbody\n' "$1"
+}
+
+# deliver DIR NAME - Maildir delivery: write to tmp/, rename into new/
+deliver() {
+    message "$2" > "$1/tmp/$2"
+    mv "$1/tmp/$2" "$1/new/$2"
+}
+
+# wait_clean FILE... - wait up to 5s until no FILE has the removable header
+wait_clean() {
+    local -i i
+    for ((i = 0; i < 50; i++)); do
+        grep -q '^X-MS-Has-Attach' "$@" 2>/dev/null || return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+start_tests "Testing mailheaderclean --watch"
+
+mkdir -p "$M"/{new,cur,tmp} "$M/.Sent"/{new,cur,tmp}
+message old > "$M/cur/old"
+message pending > "$M/tmp/pending"
+
+"$MHC" --watch --stats -m 2 "$M" 2> "$T/watch.stats" &
+WATCHER=$!
+
+check "messages already there are cleaned first" wait_clean "$M/cur/old"
+
+for i in 1 2 3 4 5; do deliver "$M" "m$i"; done
+deliver "$M/.Sent" sent
+check "delivered messages are cleaned on arrival" \
+    wait_clean "$M"/new/m{1,2,3,4,5} "$M/.Sent/new/sent"
+check "tmp/ is not touched" grep -q '^X-MS-Has-Attach' "$M/tmp/pending"
+check "body and kept fields unchanged" cmp -s "$M/new/m1" \
+    <(printf 'From: a@example.com\nSubject: m1\n\nbody\n')
+check "no temp files left behind" test "$(ls -A "$M/new" | wc -l)" = 5
+
+# A reader moves and flags a message: not new mail
+mv "$M/new/m1" "$M/cur/m1:2,S"
+sleep 0.5
+
+# Postfix local and qmail deliver by link(): tmp/X to new/X, then unlink
+message linked > "$M/tmp/linked"
+ln "$M/tmp/linked" "$M/new/linked"
+rm "$M/tmp/linked"
+check "a link() delivery is cleaned" wait_clean "$M/new/linked"
+
+# A reader flags a message before its batch is cleaned
+deliver "$M" early
+mv "$M/new/early" "$M/cur/early:2,S"
+check "a message moved to cur/ before its batch is cleaned there" wait_clean "$M/cur/early:2,S"
+sleep 0.5
+
+kill -TERM "$WATCHER"
+rc=0
+wait "$WATCHER" || rc=$?
+WATCHER=''
+check "SIGTERM ends the watcher with status 0" test "$rc" = 0
+check "each message cleaned once (old, m1-m5, sent, linked, early)" \
+    test "$(stat_value "$T/watch.stats" messages)" = 9
+
+# Errors
+check "--watch with no new/ or cur/ fails" bash -c \
+    '"$1" --watch "$2/tmp" 2> /dev/null; test $? -eq 1' _ "$MHC" "$M"
+check "--watch with --mbox is refused" bash -c \
+    '"$1" --watch --mbox "$2" 2> /dev/null; test $? -eq 2' _ "$MHC" "$M"
+
+# Summary
+summary
@@ -0,0 +1,90 @@
+#!/bin/bash
+# Body-heavy benchmark: output throughput of the standalone binaries on
+# messages with a short header and a large body (archive re-cleaning)
+
+set -euo pipefail
+
+BIN_DIR="${1:-$(dirname "$0")/../build/bin}"
+declare -i COUNT=${COUNT:-200}        # messages in the corpus
+declare -i BODY_KB=${BODY_KB:-256}    # body size per message
+declare -i ROUNDS=${ROUNDS:-3}        # best of N
+
+for tool in mailheader mailmessage mailheaderclean; do
+  if [[ ! -x "$BIN_DIR/$tool" ]]; then
+    echo "Error: $BIN_DIR/$tool not found"
+    echo "Usage: $0 [BIN_DIR]"
+    echo ""
+    echo "Build with 'make' first, or point BIN_DIR at installed binaries"
+    exit 1
+  fi
+done
+
+declare tmpdir
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT
+
+# Deterministic corpus: 76-column body lines, some CRLF messages, and a
+# header with a few removable and folded fields
+declare -i i
+declare line body
+line=$(printf '%075d' 0 | tr 0 a)
+body=$(for ((i = 0; i < BODY_KB * 1024 / 76; i++)); do echo "$line"; done)
+mkdir -p "$tmpdir/corpus"
+for ((i = 0; i < COUNT; i++)); do
+  {
+    printf 'Return-Path: <sender%d@example.com>\n' "$i"
+    printf 'Received: from mx%d.example.com by mail.example.com\n\tfor <user@example.com>; Mon, 1 Jan 2024 00:00:00 +0000\n' "$i"
+    printf 'X-Spam-Status: No, score=-1.0\nDKIM-Signature: v=1; a=rsa-sha256;\n\tb=abcdefghijklmnop\n'
+    printf 'From: sender%d@example.com\nTo: user@example.com\nSubject: Message %d\n\n' "$i" "$i"
+    if ((i % 4 == 0)); then
+      printf '%s\n' "$body" | sed 's/$/\r/'
+    else
+      printf '%s\n' "$body"
+    fi
+  } > "$tmpdir/corpus/msg$i"
+done
+mapfile -t FILES < <(find "$tmpdir/corpus" -type f | sort)
+
+declare -i total_bytes
+total_bytes=$(cat "${FILES[@]}" | wc -c)
+
+echo "Body-heavy Output Benchmark"
+echo "==========================="
+echo "Binaries: $BIN_DIR"
+echo "Corpus:   $COUNT messages, ${BODY_KB} KB body each, $((total_bytes / 1048576)) MB total"
+echo ""
+
+# best_ms CMD... - best wall time of ROUNDS runs, output to a file
+best_ms() {
+  local -i r start end ms best=0
+  for ((r = 0; r < ROUNDS; r++)); do
+    start=$(date +%s%N)
+    "$@" > "$tmpdir/out"
+    end=$(date +%s%N)
+    ((ms = (end - start) / 1000000))
+    ((best == 0 || ms < best)) && best=$ms
+  done
+  echo "$best"
+}
+
+per_file() {
+  local tool="$1" file
+  for file in "${FILES[@]}"; do
+    "$BIN_DIR/$tool" "$file"
+  done
+}
+
+report() {
+  local name="$1" ms="$2"
+  local -i rate=0
+  ((ms > 0)) && ((rate = total_bytes / 1024 * 1000 / 1024 / ms))
+  printf "%-34s %8s ms %8s MB/s\n" "$name" "$ms" "$rate"
+}
+
+report "mailheader (per file)" "$(best_ms per_file mailheader)"
+report "mailmessage (per file)" "$(best_ms per_file mailmessage)"
+report "mailheaderclean (per file)" "$(best_ms per_file mailheaderclean)"
+report "mailheaderclean (one process)" "$(best_ms "$BIN_DIR/mailheaderclean" "${FILES[@]}")"
+report "cat (one process, reference)" "$(best_ms cat "${FILES[@]}")"
+
+#fin
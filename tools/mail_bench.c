@@ -0,0 +1,488 @@
+/*
+mail_bench.c - Benchmark driver for the mail tools
+
+Runs each tool over a corpus directory (see mail_corpus.c, or any maildir
+folder such as tests/test-data) and prints, for every implementation and
+input strategy, the best wall time of ROUNDS runs as input MB/s,
+messages/s and ns per header field, and the peak RSS of the processes
+doing the work:
+
+  file    one call per message with the path as argument (mmap input)
+  stdin   one call per message reading "-" from a redirect (read() input;
+          binaries only, the builtins read stdin only as an mbox)
+  dir     one call for the whole directory
+  mbox    one call streaming the corpus as an mbox (--mbox, needs -m)
+
+The standalone binaries are run with fork/exec, one process per call.
+The builtins are loaded into a single bash with enable -f, which loops
+over the messages; the bash startup is included in their time. Builtins
+that are not built are skipped, as are strategies a tool does not offer.
+All output goes to /dev/null; a run that fails is reported, not timed.
+
+With -L, mailheaderclean is also timed per message, as an MDA hook sees
+it, and the 50th and 99th percentile and worst latency are printed for:
+
+  exec     mailheaderclean FILE, one process per message
+  client   mailheaderclean-client FILE against a mailheaderclean --serve
+           started for the run, one client process per message
+  socket   one request per message over a connection kept open (the
+           server's own cost, without any process start)
+
+Build and run:  make bench
+Usage:          build/tools/mail_bench [-b BIN_DIR] [-l LIB_DIR] [-m MBOX]
+                                       [-t TOOLS] [-r ROUNDS] [-B BASH] [-L] DIR
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "mail_io.h"
+#include "mailheaderclean_serve.h"
+
+typedef enum {
+    MODE_FILE,
+    MODE_STDIN,
+    MODE_DIR,
+    MODE_MBOX,
+    MODE_COUNT
+} bench_mode;
+
+static const char *mode_names[MODE_COUNT] = {"file", "stdin", "dir", "mbox"};
+
+#define M(mode) (1u << (mode))
+
+typedef struct {
+    const char *name;
+    unsigned standalone;    /* strategies of the binary */
+    unsigned builtin;       /* strategies of the loadable builtin */
+} bench_tool;
+
+static const bench_tool tools[] = {
+    {"mailheader", M(MODE_FILE) | M(MODE_STDIN) | M(MODE_MBOX),
+                   M(MODE_FILE) | M(MODE_MBOX)},
+    {"mailmessage", M(MODE_FILE) | M(MODE_STDIN) | M(MODE_MBOX),
+                    M(MODE_FILE) | M(MODE_MBOX)},
+    {"mailheaderclean", M(MODE_FILE) | M(MODE_STDIN) | M(MODE_DIR) | M(MODE_MBOX),
+                        M(MODE_FILE) | M(MODE_MBOX)},
+    {"mailgetaddresses", M(MODE_FILE) | M(MODE_DIR),
+                         M(MODE_FILE) | M(MODE_DIR)},
+};
+
+#define TOOL_COUNT ((int)(sizeof(tools) / sizeof(tools[0])))
+
+/* The builtin side: one bash, one loop. $1 .so, $2 builtin, then either
+ * "file" with the message paths on stdin, or the arguments of one call. */
+static const char bash_loop[] =
+    "enable -f \"$1\" \"$2\" || exit 125\n"
+    "t=$2 rc=0\n"
+    "shift 2\n"
+    "if [[ $1 == file ]]; then\n"
+    "    while IFS= read -r f; do \"$t\" \"$f\" || rc=1; done\n"
+    "else\n"
+    "    \"$t\" \"$@\" || rc=1\n"
+    "fi\n"
+    "exit $rc\n";
+
+typedef struct {
+    const char *dir;
+    char **paths;           /* message files, sorted */
+    size_t count;
+    size_t bytes;
+    size_t fields;          /* header fields, continuation lines not counted */
+    char list[64];          /* file holding the paths, one per line */
+} corpus;
+
+typedef struct {
+    double seconds;
+    long max_rss_kb;
+    int failed;
+} run_result;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Header fields of one message, as the tools see them */
+static size_t count_fields(const char *p, const char *end) {
+    size_t n = 0;
+
+    while (p < end && !mail_line_is_blank(p, end)) {
+        if (!mail_line_is_continuation(p, end)) n++;
+        p = mail_line_end(p, end);
+    }
+    return n;
+}
+
+/* Regular files of dir (dotfiles skipped), sizes and header fields */
+static int corpus_load(corpus *c, const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    size_t cap = 0;
+    FILE *list;
+    int fd;
+
+    memset(c, 0, sizeof(*c));
+    c->dir = dir;
+    if (!d) return -1;
+    while ((e = readdir(d)) != NULL) {
+        char path[4096];
+        struct stat st;
+
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) continue;
+        if (c->count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            c->paths = realloc(c->paths, cap * sizeof(char *));
+            if (!c->paths) {
+                closedir(d);
+                return -1;
+            }
+        }
+        if ((c->paths[c->count] = strdup(path)) == NULL) {
+            closedir(d);
+            return -1;
+        }
+        c->count++;
+    }
+    closedir(d);
+    if (c->count == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    qsort(c->paths, c->count, sizeof(char *), by_name);
+
+    for (size_t i = 0; i < c->count; i++) {
+        mail_input in;
+        if (mail_input_open(&in, c->paths[i]) == -1) return -1;
+        c->bytes += in.len;
+        c->fields += count_fields(in.data, in.data + in.len);
+        mail_input_close(&in);
+    }
+
+    strcpy(c->list, "/tmp/mail_bench.XXXXXX");
+    if ((fd = mkstemp(c->list)) == -1 || (list = fdopen(fd, "w")) == NULL) return -1;
+    for (size_t i = 0; i < c->count; i++) fprintf(list, "%s\n", c->paths[i]);
+    return fclose(list);
+}
+
+/* Start argv with stdin from in_path (or /dev/null) and output discarded */
+static pid_t spawn(char *const argv[], const char *in_path) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        int in = open(in_path ? in_path : "/dev/null", O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if (in == -1 || out == -1) _exit(127);
+        dup2(in, 0);
+        dup2(out, 1);
+        dup2(out, 2);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+/* Wait for pid; keep the largest peak RSS. Returns the exit status, or -1. */
+static int reap(pid_t pid, long *max_rss_kb) {
+    struct rusage ru;
+    int status;
+
+    if (pid == -1 || wait4(pid, &status, 0, &ru) == -1) return -1;
+    if (ru.ru_maxrss > *max_rss_kb) *max_rss_kb = ru.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static run_result run_standalone(const char *bin, bench_mode mode, const corpus *c,
+                                 const char *mbox) {
+    run_result r = {0, 0, 0};
+    char *argv[4] = {(char *)bin, NULL, NULL, NULL};
+    double t0 = now();
+
+    if (mode == MODE_FILE || mode == MODE_STDIN) {
+        for (size_t i = 0; i < c->count && !r.failed; i++) {
+            argv[1] = mode == MODE_FILE ? c->paths[i] : "-";
+            r.failed = reap(spawn(argv, mode == MODE_STDIN ? c->paths[i] : NULL), &r.max_rss_kb) != 0;
+        }
+    } else {
+        if (mode == MODE_MBOX) {
+            argv[1] = "--mbox";
+            argv[2] = (char *)mbox;
+        } else {
+            argv[1] = (char *)c->dir;
+        }
+        r.failed = reap(spawn(argv, NULL), &r.max_rss_kb) != 0;
+    }
+    r.seconds = now() - t0;
+    return r;
+}
+
+static run_result run_builtin(const char *bash, const char *so, const char *name,
+                              bench_mode mode, const corpus *c, const char *mbox) {
+    run_result r = {0, 0, 0};
+    char *argv[10];
+    int n = 0;
+    double t0;
+
+    argv[n++] = (char *)bash;
+    argv[n++] = "--norc";
+    argv[n++] = "-c";
+    argv[n++] = (char *)bash_loop;
+    argv[n++] = "mail_bench";
+    argv[n++] = (char *)so;
+    argv[n++] = (char *)name;
+    if (mode == MODE_MBOX) {
+        argv[n++] = "--mbox";
+        argv[n++] = (char *)mbox;
+    } else if (mode == MODE_DIR) {
+        argv[n++] = (char *)c->dir;
+    } else {
+        argv[n++] = "file";
+    }
+    argv[n] = NULL;
+
+    t0 = now();
+    r.failed = reap(spawn(argv, c->list), &r.max_rss_kb) != 0;
+    r.seconds = now() - t0;
+    return r;
+}
+
+static void report(const char *tool, const char *impl, bench_mode mode, const corpus *c,
+                   const run_result *r) {
+    printf("%-17s %-10s %-6s ", tool, impl, mode_names[mode]);
+    if (r->failed) {
+        printf("%9s\n", "failed");
+        return;
+    }
+    printf("%9.3f %9.1f %10.0f %10.0f %9ld\n", r->seconds, c->bytes / 1048576.0 / r->seconds,
+           c->count / r->seconds, r->seconds * 1e9 / (c->fields ? c->fields : 1), r->max_rss_kb);
+}
+
+/* Best time of rounds runs, largest RSS; stops at the first failure */
+static run_result best_of(int rounds, const char *bin, const char *so, const char *bash,
+                          const char *name, bench_mode mode, const corpus *c, const char *mbox) {
+    run_result best = {1e30, 0, 0};
+
+    for (int i = 0; i < rounds; i++) {
+        run_result r = so ? run_builtin(bash, so, name, mode, c, mbox)
+                          : run_standalone(bin, mode, c, mbox);
+        if (r.failed) return r;
+        if (r.seconds < best.seconds) best.seconds = r.seconds;
+        if (r.max_rss_kb > best.max_rss_kb) best.max_rss_kb = r.max_rss_kb;
+    }
+    return best;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Sort the per-message latencies (seconds) and print them in microseconds */
+static void report_latency(const char *path, double *lat, size_t n, int failed) {
+    printf("%-8s ", path);
+    if (failed) {
+        printf("%10s\n", "failed");
+        return;
+    }
+    qsort(lat, n, sizeof(*lat), by_value);
+    printf("%10.1f %10.1f %10.1f\n", lat[n / 2] * 1e6, lat[n - 1 - n / 100] * 1e6, lat[n - 1] * 1e6);
+}
+
+/* -L: mailheaderclean latency per message, exec per message against
+ * --serve. Returns 0, or 1 if a path failed. */
+static int run_latency(const char *bin_dir, const corpus *c) {
+    char bin[4096], client[4096], sock[64];
+    char *argv[5];
+    double *lat = malloc(c->count * sizeof(*lat));
+    pid_t server;
+    int fd = -1, failed = 0, f;
+    long rss = 0;
+
+    snprintf(bin, sizeof(bin), "%s/mailheaderclean", bin_dir);
+    snprintf(client, sizeof(client), "%s/mailheaderclean-client", bin_dir);
+    snprintf(sock, sizeof(sock), "/tmp/mail_bench.%d.sock", (int)getpid());
+    if (!lat || access(bin, X_OK) != 0 || access(client, X_OK) != 0) {
+        printf("latency: mailheaderclean or mailheaderclean-client not built\n");
+        free(lat);
+        return 1;
+    }
+
+    printf("\nLatency: mailheaderclean, %zu messages (microseconds)\n", c->count);
+    printf("%-8s %10s %10s %10s\n", "path", "p50", "p99", "max");
+
+    argv[0] = bin;
+    argv[2] = NULL;
+    f = 0;
+    for (size_t i = 0; i < c->count && !f; i++) {
+        double t0 = now();
+        argv[1] = c->paths[i];
+        f = reap(spawn(argv, NULL), &rss) != 0;
+        lat[i] = now() - t0;
+    }
+    report_latency("exec", lat, c->count, f);
+    failed |= f;
+
+    argv[1] = "--serve";
+    argv[2] = sock;
+    argv[3] = NULL;
+    server = spawn(argv, NULL);
+    for (int i = 0; i < 200 && fd == -1; i++) {
+        fd = clean_serve_connect(sock);
+        if (fd == -1) usleep(10000);
+    }
+    if (fd == -1) {
+        printf("%-8s %10s\n", "client", "failed");
+        printf("%-8s %10s\n", "socket", "failed");
+        failed = 1;
+    } else {
+        char *out = NULL;
+        size_t out_len, out_cap = 0;
+
+        argv[0] = client;
+        argv[1] = "-S";
+        argv[2] = sock;
+        argv[4] = NULL;
+        f = 0;
+        for (size_t i = 0; i < c->count && !f; i++) {
+            double t0 = now();
+            argv[3] = c->paths[i];
+            f = reap(spawn(argv, NULL), &rss) != 0;
+            lat[i] = now() - t0;
+        }
+        report_latency("client", lat, c->count, f);
+        failed |= f;
+
+        f = 0;
+        for (size_t i = 0; i < c->count && !f; i++) {
+            mail_input in;
+            if (mail_input_open(&in, c->paths[i]) == -1) {
+                f = 1;
+                break;
+            }
+            double t0 = now();
+            f = clean_serve_request(fd, in.data, in.len, &out, &out_len, &out_cap) == -1;
+            lat[i] = now() - t0;
+            mail_input_close(&in);
+        }
+        report_latency("socket", lat, c->count, f);
+        failed |= f;
+        free(out);
+        close(fd);
+    }
+    if (server != -1) {
+        kill(server, SIGTERM);
+        reap(server, &rss);
+    }
+    free(lat);
+    return failed;
+}
+
+static int selected(const char *list, const char *name) {
+    size_t n = strlen(name);
+
+    if (!list) return 1;
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += n) {
+        if ((p == list || p[-1] == ',') && (p[n] == ',' || p[n] == '\0')) return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-b BIN_DIR] [-l LIB_DIR] [-m MBOX] [-t TOOLS] [-r ROUNDS] [-B BASH] [-L] DIR\n", prog);
+    fprintf(stderr, "Benchmark the mail tools over the messages in DIR\n\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -b BIN_DIR  Standalone binaries (default: build/bin)\n");
+    fprintf(stderr, "  -l LIB_DIR  Loadable builtins (default: build/lib)\n");
+    fprintf(stderr, "  -m MBOX     The same messages as an mbox, for the mbox strategy\n");
+    fprintf(stderr, "  -t TOOLS    Comma-separated tools (default: all)\n");
+    fprintf(stderr, "  -r ROUNDS   Best of ROUNDS runs (default: 3)\n");
+    fprintf(stderr, "  -B BASH     Bash used to load the builtins (default: /bin/bash)\n");
+    fprintf(stderr, "  -L          Also time mailheaderclean per message: exec against --serve\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *bin_dir = "build/bin", *lib_dir = "build/lib", *mbox = NULL;
+    const char *only = NULL, *bash = "/bin/bash";
+    int rounds = 3, c, failed = 0, latency = 0;
+    corpus corp;
+
+    while ((c = getopt(argc, argv, "b:l:m:t:r:B:Lh")) != -1) {
+        switch (c) {
+            case 'b': bin_dir = optarg; break;
+            case 'l': lib_dir = optarg; break;
+            case 'm': mbox = optarg; break;
+            case 't': only = optarg; break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'B': bash = optarg; break;
+            case 'L': latency = 1; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 22;
+        }
+    }
+    if (optind != argc - 1 || rounds <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (corpus_load(&corp, argv[optind]) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
+        return 1;
+    }
+
+    printf("Corpus: %s: %zu messages, %.1f MB, %zu header fields (best of %d)\n",
+           corp.dir, corp.count, corp.bytes / 1048576.0, corp.fields, rounds);
+    printf("%-17s %-10s %-6s %9s %9s %10s %10s %9s\n", "tool", "impl", "input",
+           "seconds", "MB/s", "msgs/s", "ns/header", "RSS KB");
+
+    for (int t = 0; t < TOOL_COUNT; t++) {
+        char bin[4096], so[4096];
+        int have_bin, have_so;
+
+        if (!selected(only, tools[t].name)) continue;
+        snprintf(bin, sizeof(bin), "%s/%s", bin_dir, tools[t].name);
+        snprintf(so, sizeof(so), "%s/%s.so", lib_dir, tools[t].name);
+        have_bin = access(bin, X_OK) == 0;
+        have_so = access(so, R_OK) == 0;
+        if (!have_bin) printf("%-17s %-10s %s\n", tools[t].name, "standalone", "not built");
+        if (!have_so) printf("%-17s %-10s %s\n", tools[t].name, "builtin", "not built");
+
+        for (int m = 0; m < MODE_COUNT; m++) {
+            run_result r;
+
+            if (m == MODE_MBOX && !mbox) continue;
+            if (have_bin && (tools[t].standalone & M(m))) {
+                r = best_of(rounds, bin, NULL, bash, tools[t].name, m, &corp, mbox);
+                report(tools[t].name, "standalone", m, &corp, &r);
+                failed |= r.failed;
+            }
+            if (have_so && (tools[t].builtin & M(m))) {
+                r = best_of(rounds, NULL, so, bash, tools[t].name, m, &corp, mbox);
+                report(tools[t].name, "builtin", m, &corp, &r);
+                failed |= r.failed;
+            }
+        }
+    }
+
+    if (latency) failed |= run_latency(bin_dir, &corp);
+
+    unlink(corp.list);
+    for (size_t i = 0; i < corp.count; i++) free(corp.paths[i]);
+    free(corp.paths);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,306 @@
+/*
+mail_corpus.c - Deterministic synthetic mail corpus for the benchmarks
+
+Writes COUNT messages, one file each, into DIR, and optionally the same
+messages as one mbox file. The same options and seed always produce the
+same bytes, so results from different builds and machines compare.
+
+Each message has:
+
+  - the Exchange/ARC/antispam fields mailheaderclean removes, as prepended
+    by relaying MTAs (-x)
+  - ordinary fields: Return-Path, Received, Date, From, To, Cc, Subject,
+    Message-ID, MIME and list fields (-H); Received repeats past the table
+  - long fields (Received, signatures, antispam reports, To, References)
+    folded over DEPTH continuation lines, alternating TAB and space (-d)
+  - a 72-column text body of about BYTES bytes (-b, k/m suffix allowed)
+  - CRLF line endings in PCT percent of the messages (-c)
+
+Build:  make bench (or make build/tools/mail_corpus)
+Usage:  build/tools/mail_corpus [-n COUNT] [-H N] [-x N] [-d DEPTH] [-b BYTES]
+                                [-c PCT] [-s SEED] [-m MBOX] DIR
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct {
+    int count;              /* messages */
+    int headers;            /* ordinary header fields per message */
+    int bloat;              /* Exchange/ARC/antispam fields per message */
+    int depth;              /* continuation lines of a long field */
+    size_t body;            /* body bytes per message */
+    int crlf_pct;           /* messages with CRLF line endings, in percent */
+    unsigned long long seed;
+} corpus_opts;
+
+typedef struct {
+    const char *name;
+    int is_long;            /* folded over depth continuation lines */
+} field_def;
+
+/* Ordinary fields, in the order they appear */
+static const field_def ordinary[] = {
+    {"Return-Path", 0}, {"Received", 1}, {"Date", 0}, {"From", 0},
+    {"To", 1}, {"Cc", 0}, {"Subject", 0}, {"Message-ID", 0},
+    {"In-Reply-To", 0}, {"References", 1}, {"MIME-Version", 0},
+    {"Content-Type", 0}, {"Content-Transfer-Encoding", 0}, {"Reply-To", 0},
+    {"List-Id", 0}, {"List-Unsubscribe", 0},
+};
+
+/* Fields on mailheaderclean's built-in removal list */
+static const field_def bloat[] = {
+    {"ARC-Seal", 1}, {"ARC-Message-Signature", 1},
+    {"ARC-Authentication-Results", 1}, {"DKIM-Signature", 1},
+    {"Authentication-Results", 1}, {"X-MS-Exchange-Organization-SCL", 0},
+    {"X-MS-Exchange-Organization-AuthSource", 0},
+    {"X-MS-Exchange-CrossTenant-OriginalArrivalTime", 0},
+    {"X-MS-Exchange-CrossTenant-Id", 0}, {"X-MS-TrafficTypeDiagnostic", 0},
+    {"X-MS-Office365-Filtering-Correlation-Id", 0},
+    {"X-Microsoft-Antispam", 0}, {"X-Microsoft-Antispam-Message-Info", 1},
+    {"X-Forefront-Antispam-Report", 1}, {"X-Google-DKIM-Signature", 1},
+    {"X-Gm-Message-State", 1}, {"X-Received", 1}, {"X-Spam-Status", 0},
+};
+
+#define COUNT_OF(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+/* Body vocabulary; nothing capitalised, so no body line starts with "From " */
+static const char *words[] = {
+    "the", "message", "archive", "server", "header", "mail", "line", "value",
+    "report", "meeting", "review", "draft", "attached", "please", "thanks",
+    "schedule", "budget", "quarter", "project", "update", "question", "team",
+};
+
+/* Growable buffer holding one message */
+typedef struct {
+    char *p;
+    size_t len, cap;
+} buf;
+
+static void buf_reserve(buf *b, size_t n) {
+    if (b->len + n <= b->cap) return;
+    while (b->len + n > b->cap) b->cap = b->cap ? b->cap * 2 : 65536;
+    b->p = realloc(b->p, b->cap);
+    if (!b->p) {
+        perror("realloc");
+        exit(1);
+    }
+}
+
+static void buf_printf(buf *b, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    buf_reserve(b, 256);
+    va_start(ap, fmt);
+    n = vsnprintf(b->p + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    b->len += n < (int)(b->cap - b->len) ? (size_t)n : b->cap - b->len - 1;
+}
+
+/* xorshift64*: the corpus must not depend on the C library's rand() */
+static unsigned long long next_random(unsigned long long *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+/* n characters of base64-looking noise, like signatures and report blobs */
+static void add_noise(buf *b, unsigned long long *rng, int n) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    buf_reserve(b, n);
+    for (int i = 0; i < n; i++) b->p[b->len++] = alphabet[next_random(rng) % 64];
+}
+
+/* The first line of a field's value */
+static void add_value(buf *b, unsigned long long *rng, const char *name, int msg) {
+    int r = (int)(next_random(rng) % 1000);
+
+    if (strcmp(name, "Return-Path") == 0) {
+        buf_printf(b, "<sender%d@example%d.com>", msg, r % 50);
+    } else if (strcmp(name, "Received") == 0 || strcmp(name, "X-Received") == 0) {
+        buf_printf(b, "from mx%d.example.net (mx%d.example.net [192.0.2.%d])", r, r, r % 250);
+    } else if (strcmp(name, "Date") == 0) {
+        buf_printf(b, "Mon, %d Jan 2024 %02d:%02d:00 +0000", 1 + r % 28, r % 24, r % 60);
+    } else if (strcmp(name, "From") == 0) {
+        buf_printf(b, "\"Sender %d\" <sender%d@example.com>", msg, msg);
+    } else if (strcmp(name, "To") == 0) {
+        buf_printf(b, "Team %d <team%d@example.org>,", r % 10, r % 10);
+    } else if (strcmp(name, "Cc") == 0 || strcmp(name, "Reply-To") == 0) {
+        buf_printf(b, "cc%d@example.org, cc%d@example.net", r, r + 1);
+    } else if (strcmp(name, "Subject") == 0) {
+        buf_printf(b, "Re: %s %s %d", words[r % COUNT_OF(words)],
+                   words[(r / 7) % COUNT_OF(words)], msg);
+    } else if (strcmp(name, "Message-ID") == 0 || strcmp(name, "In-Reply-To") == 0 ||
+               strcmp(name, "References") == 0) {
+        buf_printf(b, "<%d.%d@mail.example.com>", msg, r);
+    } else if (strcmp(name, "MIME-Version") == 0) {
+        buf_printf(b, "1.0");
+    } else if (strcmp(name, "Content-Type") == 0) {
+        buf_printf(b, "text/plain; charset=utf-8");
+    } else if (strcmp(name, "Content-Transfer-Encoding") == 0) {
+        buf_printf(b, "8bit");
+    } else if (strncmp(name, "List-", 5) == 0) {
+        buf_printf(b, "<list%d.example.org>", r % 20);
+    } else if (strncmp(name, "X-MS-", 5) == 0 || strcmp(name, "X-Microsoft-Antispam") == 0 ||
+               strcmp(name, "X-Spam-Status") == 0) {
+        buf_printf(b, "BCL:0;ARA:%d;", r);
+        add_noise(b, rng, 24);
+    } else {
+        buf_printf(b, "i=%d; a=rsa-sha256; d=example.com; s=s%d;", 1 + r % 3, r);
+    }
+}
+
+static void add_field(buf *b, unsigned long long *rng, const corpus_opts *o,
+                      const field_def *f, int msg, const char *eol) {
+    buf_printf(b, "%s: ", f->name);
+    add_value(b, rng, f->name, msg);
+    buf_printf(b, "%s", eol);
+    if (!f->is_long) return;
+    for (int d = 0; d < o->depth; d++) {
+        buf_printf(b, "%s", (d & 1) ? "        " : "\t");
+        if (strcmp(f->name, "To") == 0) {
+            /* Keep the address list parseable for mailgetaddresses */
+            int r = (int)(next_random(rng) % 1000);
+            buf_printf(b, "\"Member %d\" <member%d@example.org>, member%d@example.net%s",
+                       r, r, r + 1, d + 1 < o->depth ? "," : "");
+        } else {
+            add_noise(b, rng, 56 + (int)(next_random(rng) % 16));
+        }
+        buf_printf(b, "%s", eol);
+    }
+}
+
+static void add_message(buf *b, unsigned long long *rng, const corpus_opts *o, int msg) {
+    const char *eol = (int)(next_random(rng) % 100) < o->crlf_pct ? "\r\n" : "\n";
+    size_t body_start;
+
+    /* Relays prepend their trace and filtering fields above the original */
+    for (int i = 0; i < o->bloat; i++) {
+        add_field(b, rng, o, &bloat[i % COUNT_OF(bloat)], msg, eol);
+    }
+    for (int i = 0; i < o->headers; i++) {
+        add_field(b, rng, o, i < COUNT_OF(ordinary) ? &ordinary[i] : &ordinary[1], msg, eol);
+    }
+    buf_printf(b, "%s", eol);
+
+    body_start = b->len;
+    while (b->len - body_start < o->body) {
+        size_t line = b->len;
+        while (b->len - line < 66) {
+            buf_printf(b, "%s ", words[next_random(rng) % COUNT_OF(words)]);
+        }
+        b->len--;       /* trailing space */
+        buf_printf(b, "%s", eol);
+    }
+}
+
+static int write_file(const char *path, const char *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+
+    if (!f) return -1;
+    if (fwrite(data, 1, len, f) != len) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
+
+static size_t parse_size(const char *s) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+
+    if (*end == 'k' || *end == 'K') n <<= 10;
+    if (*end == 'm' || *end == 'M') n <<= 20;
+    return (size_t)n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n COUNT] [-H N] [-x N] [-d DEPTH] [-b BYTES] [-c PCT] [-s SEED] [-m MBOX] DIR\n", prog);
+    fprintf(stderr, "Write a deterministic synthetic mail corpus to DIR\n\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n COUNT  Messages (default: 2000)\n");
+    fprintf(stderr, "  -H N      Ordinary header fields per message (default: 12)\n");
+    fprintf(stderr, "  -x N      Exchange/ARC/antispam fields per message (default: 16)\n");
+    fprintf(stderr, "  -d DEPTH  Continuation lines of each long field (default: 3)\n");
+    fprintf(stderr, "  -b BYTES  Body size per message, k/m suffix allowed (default: 4k)\n");
+    fprintf(stderr, "  -c PCT    Percentage of messages with CRLF line endings (default: 25)\n");
+    fprintf(stderr, "  -s SEED   Random seed (default: 1)\n");
+    fprintf(stderr, "  -m MBOX   Also write every message to the mbox file MBOX\n");
+}
+
+int main(int argc, char *argv[]) {
+    corpus_opts o = {2000, 12, 16, 3, 4096, 25, 1};
+    const char *mbox_path = NULL;
+    unsigned long long rng;
+    FILE *mbox = NULL;
+    buf b = {NULL, 0, 0};
+    size_t total = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:H:x:d:b:c:s:m:h")) != -1) {
+        switch (c) {
+            case 'n': o.count = atoi(optarg); break;
+            case 'H': o.headers = atoi(optarg); break;
+            case 'x': o.bloat = atoi(optarg); break;
+            case 'd': o.depth = atoi(optarg); break;
+            case 'b': o.body = parse_size(optarg); break;
+            case 'c': o.crlf_pct = atoi(optarg); break;
+            case 's': o.seed = strtoull(optarg, NULL, 10); break;
+            case 'm': mbox_path = optarg; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 22;
+        }
+    }
+    if (optind != argc - 1 || o.count <= 0 || o.headers < 0 || o.bloat < 0 ||
+        o.depth < 0 || o.crlf_pct < 0 || o.crlf_pct > 100) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (mkdir(argv[optind], 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
+        return 1;
+    }
+    if (mbox_path && (mbox = fopen(mbox_path, "wb")) == NULL) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], mbox_path, strerror(errno));
+        return 1;
+    }
+
+    /* xorshift must not start at zero */
+    rng = o.seed * 0x9E3779B97F4A7C15ULL + 1;
+    for (int i = 0; i < o.count; i++) {
+        char path[4096];
+
+        b.len = 0;
+        add_message(&b, &rng, &o, i);
+        snprintf(path, sizeof(path), "%s/msg-%06d", argv[optind], i);
+        if (write_file(path, b.p, b.len) == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+            return 1;
+        }
+        if (mbox) {
+            fprintf(mbox, "From sender%d@example.com Mon Jan  1 00:00:00 2024\n", i);
+            fwrite(b.p, 1, b.len, mbox);
+            fputc('\n', mbox);
+        }
+        total += b.len;
+    }
+    if (mbox && fclose(mbox) == EOF) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], mbox_path, strerror(errno));
+        return 1;
+    }
+
+    printf("%d messages, %.1f MB in %s%s%s\n", o.count, total / 1048576.0, argv[optind],
+           mbox ? " and " : "", mbox ? mbox_path : "");
+    free(b.p);
+    return 0;
+}